@@ -70,6 +70,9 @@
 /* Define to 1 if you have the <sys/int_types.h> header file. */
 #cmakedefine HAVE_SYS_INT_TYPES_H 1
 
+/* Define to 1 if you have the <sys/mman.h> header file. */
+#cmakedefine HAVE_SYS_MMAN_H 1
+
 /* Define to 1 if you have the <sys/socket.h> header file. */
 #cmakedefine HAVE_SYS_SOCKET_H 1
 
@@ -1520,12 +1520,13 @@ srtp_err_status_t srtp_aes_expand_decryption_key(
     srtp_aes_expanded_key_t *expanded_key)
 {
     srtp_err_status_t status;
-    size_t num_rounds = expanded_key->num_rounds;
+    size_t num_rounds;
 
     status = srtp_aes_expand_encryption_key(key, key_len, expanded_key);
     if (status) {
         return status;
     }
+    num_rounds = expanded_key->num_rounds;
 
     /* invert the order of the round keys */
     for (size_t i = 0; i < num_rounds / 2; i++) {
@@ -120,7 +120,8 @@ static srtp_err_status_t srtp_aes_icm_alloc(srtp_cipher_t **c,
         return srtp_err_status_alloc_fail;
     }
 
-    icm = (srtp_aes_icm_ctx_t *)srtp_crypto_alloc(sizeof(srtp_aes_icm_ctx_t));
+    icm = (srtp_aes_icm_ctx_t *)srtp_crypto_alloc_aligned(
+        sizeof(srtp_aes_icm_ctx_t), SRTP_CACHE_LINE_SIZE);
     if (icm == NULL) {
         srtp_crypto_free(*c);
         *c = NULL;
@@ -160,7 +161,7 @@ static srtp_err_status_t srtp_aes_icm_dealloc(srtp_cipher_t *c)
     if (ctx) {
         /* zeroize the key material */
         octet_string_set_to_zero(ctx, sizeof(srtp_aes_icm_ctx_t));
-        srtp_crypto_free(ctx);
+        srtp_crypto_free_aligned(ctx);
     }
 
     /* free the cipher context */
@@ -166,6 +166,44 @@ srtp_err_status_t srtp_auth_type_test(const srtp_auth_type_t *at,
             return srtp_err_status_algo_fail;
         }
 
+        /*
+         * if the auth function can save its state, check that finishing
+         * a tag from a saved state twice gives the same tag both times
+         */
+        if (srtp_auth_can_save(a)) {
+            size_t half = test_case->data_length_octets / 2;
+
+            status = srtp_auth_start(a);
+            if (!status) {
+                status = srtp_auth_update(a, test_case->data, half);
+            }
+            if (!status) {
+                status = srtp_auth_save(a);
+            }
+            for (int pass = 0; pass < 2 && !status; pass++) {
+                status = srtp_auth_restore(a);
+                if (status) {
+                    break;
+                }
+                octet_string_set_to_zero(tag, test_case->tag_length_octets);
+                status = srtp_auth_compute(
+                    a, test_case->data + half,
+                    test_case->data_length_octets - half, tag);
+                if (!status &&
+                    !srtp_octet_string_equal(tag, test_case->tag,
+                                             test_case->tag_length_octets)) {
+                    debug_print(srtp_mod_auth,
+                                "test case %zu failed from saved state",
+                                case_num);
+                    status = srtp_err_status_algo_fail;
+                }
+            }
+            if (status) {
+                srtp_auth_dealloc(a);
+                return status;
+            }
+        }
+
         /* deallocate the auth function */
         status = srtp_auth_dealloc(a);
         if (status) {
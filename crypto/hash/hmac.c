@@ -84,8 +84,8 @@ static srtp_err_status_t srtp_hmac_alloc(srtp_auth_t **a,
     }
 
     /* allocate memory for auth and srtp_hmac_ctx_t structures */
-    pointer = (uint8_t *)srtp_crypto_alloc(sizeof(srtp_hmac_ctx_t) +
-                                           sizeof(srtp_auth_t));
+    pointer = (uint8_t *)srtp_crypto_alloc_aligned(
+        sizeof(srtp_hmac_ctx_t) + sizeof(srtp_auth_t), SRTP_CACHE_LINE_SIZE);
     if (pointer == NULL) {
         return srtp_err_status_alloc_fail;
     }
@@ -107,7 +107,7 @@ static srtp_err_status_t srtp_hmac_dealloc(srtp_auth_t *a)
     octet_string_set_to_zero(a, sizeof(srtp_hmac_ctx_t) + sizeof(srtp_auth_t));
 
     /* free memory */
-    srtp_crypto_free(a);
+    srtp_crypto_free_aligned(a);
 
     return srtp_err_status_ok;
 }
@@ -118,6 +118,7 @@ static srtp_err_status_t srtp_hmac_init(void *statev,
 {
     srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
     uint8_t ipad[64];
+    uint8_t opad[64];
 
     /*
      * check key length - note that we don't support keys larger
@@ -133,12 +134,12 @@ static srtp_err_status_t srtp_hmac_init(void *statev,
      */
     for (size_t i = 0; i < key_len; i++) {
         ipad[i] = key[i] ^ 0x36;
-        state->opad[i] = key[i] ^ 0x5c;
+        opad[i] = key[i] ^ 0x5c;
     }
     /* set the rest of ipad, opad to constant values */
     for (size_t i = key_len; i < 64; i++) {
         ipad[i] = 0x36;
-        ((uint8_t *)state->opad)[i] = 0x5c;
+        opad[i] = 0x5c;
     }
 
     debug_print(srtp_mod_hmac, "ipad: %s",
@@ -151,6 +152,13 @@ static srtp_err_status_t srtp_hmac_init(void *statev,
     srtp_sha1_update(&state->init_ctx, ipad, 64);
     memcpy(&state->ctx, &state->init_ctx, sizeof(srtp_sha1_ctx_t));
 
+    /* hash opad ^ key once, compute() restarts from this midstate */
+    srtp_sha1_init(&state->outer_ctx);
+    srtp_sha1_update(&state->outer_ctx, opad, 64);
+
+    octet_string_set_to_zero(ipad, sizeof(ipad));
+    octet_string_set_to_zero(opad, sizeof(opad));
+
     return srtp_err_status_ok;
 }
 
@@ -163,6 +171,24 @@ static srtp_err_status_t srtp_hmac_start(void *statev)
     return srtp_err_status_ok;
 }
 
+static srtp_err_status_t srtp_hmac_save(void *statev)
+{
+    srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
+
+    memcpy(&state->saved_ctx, &state->ctx, sizeof(srtp_sha1_ctx_t));
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_restore(void *statev)
+{
+    srtp_hmac_ctx_t *state = (srtp_hmac_ctx_t *)statev;
+
+    memcpy(&state->ctx, &state->saved_ctx, sizeof(srtp_sha1_ctx_t));
+
+    return srtp_err_status_ok;
+}
+
 static srtp_err_status_t srtp_hmac_update(void *statev,
                                           const uint8_t *message,
                                           size_t msg_octets)
@@ -205,11 +231,8 @@ static srtp_err_status_t srtp_hmac_compute(void *statev,
     debug_print(srtp_mod_hmac, "intermediate state: %s",
                 srtp_octet_string_hex_string((uint8_t *)H, 20));
 
-    /* re-initialize hash context */
-    srtp_sha1_init(&state->ctx);
-
-    /* hash opad ^ key  */
-    srtp_sha1_update(&state->ctx, (uint8_t *)state->opad, 64);
+    /* restore the precomputed opad ^ key midstate */
+    memcpy(&state->ctx, &state->outer_ctx, sizeof(srtp_sha1_ctx_t));
 
     /* hash the result of the inner hash */
     srtp_sha1_update(&state->ctx, (uint8_t *)H, 20);
@@ -244,5 +267,7 @@ const srtp_auth_type_t srtp_hmac = {
     srtp_hmac_start,        /* */
     srtp_hmac_description,  /* */
     &srtp_hmac_test_case_0, /* */
-    SRTP_HMAC_SHA1          /* */
+    SRTP_HMAC_SHA1,         /* */
+    srtp_hmac_save,         /* */
+    srtp_hmac_restore       /* */
 };
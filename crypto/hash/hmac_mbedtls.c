@@ -49,9 +49,37 @@
 #include "alloc.h"
 #include "err.h" /* for srtp_debug */
 #include "auth_test_cases.h"
-#include <mbedtls/md.h>
+#include <mbedtls/sha1.h>
+#include <mbedtls/version.h>
 
 #define SHA1_DIGEST_SIZE 20
+#define SHA1_BLOCK_SIZE 64
+
+/*
+ * mbedtls 3.x dropped the _ret suffix from the sha1 functions that
+ * return an error code; map the names so both major versions build
+ */
+#if MBEDTLS_VERSION_NUMBER < 0x03000000
+#define srtp_mbedtls_sha1_starts mbedtls_sha1_starts_ret
+#define srtp_mbedtls_sha1_update mbedtls_sha1_update_ret
+#define srtp_mbedtls_sha1_finish mbedtls_sha1_finish_ret
+#else
+#define srtp_mbedtls_sha1_starts mbedtls_sha1_starts
+#define srtp_mbedtls_sha1_update mbedtls_sha1_update
+#define srtp_mbedtls_sha1_finish mbedtls_sha1_finish
+#endif
+
+/*
+ * the sha1 midstates after absorbing (key ^ ipad) and (key ^ opad) are
+ * computed once in init, so that start() and compute() only need to
+ * clone them instead of re-hashing a 64 byte pad block per packet
+ */
+typedef struct {
+    mbedtls_sha1_context ctx;
+    mbedtls_sha1_context inner_ctx;
+    mbedtls_sha1_context outer_ctx;
+    mbedtls_sha1_context saved_ctx; /* kept by srtp_hmac_mbedtls_save() */
+} srtp_hmac_mbedtls_ctx_t;
 
 /* the debug module for authentiation */
 
@@ -65,12 +93,18 @@ static srtp_err_status_t srtp_hmac_mbedtls_alloc(srtp_auth_t **a,
                                                  size_t out_len)
 {
     extern const srtp_auth_type_t srtp_hmac;
+    srtp_hmac_mbedtls_ctx_t *hmac;
 
     debug_print(srtp_mod_hmac, "allocating auth func with key length %zu",
                 key_len);
     debug_print(srtp_mod_hmac, "                          tag length %zu",
                 out_len);
 
+    /* check key length - keys longer than a block are not supported */
+    if (key_len > SHA1_BLOCK_SIZE) {
+        return srtp_err_status_bad_param;
+    }
+
     /* check output length - should be less than 20 bytes */
     if (out_len > SHA1_DIGEST_SIZE) {
         return srtp_err_status_bad_param;
@@ -81,15 +115,20 @@ static srtp_err_status_t srtp_hmac_mbedtls_alloc(srtp_auth_t **a,
         return srtp_err_status_alloc_fail;
     }
     // allocate the buffer of mbedtls context.
-    (*a)->state = srtp_crypto_alloc(sizeof(mbedtls_md_context_t));
-    if ((*a)->state == NULL) {
+    hmac = (srtp_hmac_mbedtls_ctx_t *)srtp_crypto_alloc(
+        sizeof(srtp_hmac_mbedtls_ctx_t));
+    if (hmac == NULL) {
         srtp_crypto_free(*a);
         *a = NULL;
         return srtp_err_status_alloc_fail;
     }
-    mbedtls_md_init((mbedtls_md_context_t *)(*a)->state);
+    mbedtls_sha1_init(&hmac->ctx);
+    mbedtls_sha1_init(&hmac->inner_ctx);
+    mbedtls_sha1_init(&hmac->outer_ctx);
+    mbedtls_sha1_init(&hmac->saved_ctx);
 
     /* set pointers */
+    (*a)->state = hmac;
     (*a)->type = &srtp_hmac;
     (*a)->out_len = out_len;
     (*a)->key_len = key_len;
@@ -100,10 +139,14 @@ static srtp_err_status_t srtp_hmac_mbedtls_alloc(srtp_auth_t **a,
 
 static srtp_err_status_t srtp_hmac_mbedtls_dealloc(srtp_auth_t *a)
 {
-    mbedtls_md_context_t *hmac_ctx;
-    hmac_ctx = (mbedtls_md_context_t *)a->state;
-    mbedtls_md_free(hmac_ctx);
-    srtp_crypto_free(hmac_ctx);
+    srtp_hmac_mbedtls_ctx_t *hmac;
+    hmac = (srtp_hmac_mbedtls_ctx_t *)a->state;
+    mbedtls_sha1_free(&hmac->ctx);
+    mbedtls_sha1_free(&hmac->inner_ctx);
+    mbedtls_sha1_free(&hmac->outer_ctx);
+    mbedtls_sha1_free(&hmac->saved_ctx);
+    octet_string_set_to_zero(hmac, sizeof(srtp_hmac_mbedtls_ctx_t));
+    srtp_crypto_free(hmac);
     /* zeroize entire state*/
     octet_string_set_to_zero(a, sizeof(srtp_auth_t));
 
@@ -115,10 +158,27 @@ static srtp_err_status_t srtp_hmac_mbedtls_dealloc(srtp_auth_t *a)
 
 static srtp_err_status_t srtp_hmac_mbedtls_start(void *statev)
 {
-    mbedtls_md_context_t *state = (mbedtls_md_context_t *)statev;
-    if (mbedtls_md_hmac_reset(state) != 0) {
-        return srtp_err_status_auth_fail;
-    }
+    srtp_hmac_mbedtls_ctx_t *state = (srtp_hmac_mbedtls_ctx_t *)statev;
+
+    mbedtls_sha1_clone(&state->ctx, &state->inner_ctx);
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_mbedtls_save(void *statev)
+{
+    srtp_hmac_mbedtls_ctx_t *state = (srtp_hmac_mbedtls_ctx_t *)statev;
+
+    mbedtls_sha1_clone(&state->saved_ctx, &state->ctx);
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_mbedtls_restore(void *statev)
+{
+    srtp_hmac_mbedtls_ctx_t *state = (srtp_hmac_mbedtls_ctx_t *)statev;
+
+    mbedtls_sha1_clone(&state->ctx, &state->saved_ctx);
 
     return srtp_err_status_ok;
 }
@@ -127,40 +187,52 @@ static srtp_err_status_t srtp_hmac_mbedtls_init(void *statev,
                                                 const uint8_t *key,
                                                 size_t key_len)
 {
-    mbedtls_md_context_t *state = (mbedtls_md_context_t *)statev;
-    const mbedtls_md_info_t *info = NULL;
+    srtp_hmac_mbedtls_ctx_t *state = (srtp_hmac_mbedtls_ctx_t *)statev;
+    uint8_t ipad[SHA1_BLOCK_SIZE];
+    uint8_t opad[SHA1_BLOCK_SIZE];
+    srtp_err_status_t status = srtp_err_status_ok;
+    size_t i;
 
-    info = mbedtls_md_info_from_type(MBEDTLS_MD_SHA1);
-    if (info == NULL) {
-        return srtp_err_status_auth_fail;
+    if (key_len > SHA1_BLOCK_SIZE) {
+        return srtp_err_status_bad_param;
     }
 
-    if (mbedtls_md_setup(state, info, 1) != 0) {
-        return srtp_err_status_auth_fail;
+    for (i = 0; i < key_len; i++) {
+        ipad[i] = key[i] ^ 0x36;
+        opad[i] = key[i] ^ 0x5c;
+    }
+    for (i = key_len; i < SHA1_BLOCK_SIZE; i++) {
+        ipad[i] = 0x36;
+        opad[i] = 0x5c;
     }
 
-    debug_print(srtp_mod_hmac, "mbedtls setup, name: %s",
-                mbedtls_md_get_name(info));
-    debug_print(srtp_mod_hmac, "mbedtls setup, size: %d",
-                mbedtls_md_get_size(info));
-
-    if (mbedtls_md_hmac_starts(state, key, key_len) != 0) {
-        return srtp_err_status_auth_fail;
+    if (srtp_mbedtls_sha1_starts(&state->inner_ctx) != 0 ||
+        srtp_mbedtls_sha1_update(&state->inner_ctx, ipad, SHA1_BLOCK_SIZE) !=
+            0 ||
+        srtp_mbedtls_sha1_starts(&state->outer_ctx) != 0 ||
+        srtp_mbedtls_sha1_update(&state->outer_ctx, opad, SHA1_BLOCK_SIZE) !=
+            0) {
+        status = srtp_err_status_auth_fail;
+    } else {
+        mbedtls_sha1_clone(&state->ctx, &state->inner_ctx);
     }
 
-    return srtp_err_status_ok;
+    octet_string_set_to_zero(ipad, sizeof(ipad));
+    octet_string_set_to_zero(opad, sizeof(opad));
+
+    return status;
 }
 
 static srtp_err_status_t srtp_hmac_mbedtls_update(void *statev,
                                                   const uint8_t *message,
                                                   size_t msg_octets)
 {
-    mbedtls_md_context_t *state = (mbedtls_md_context_t *)statev;
+    srtp_hmac_mbedtls_ctx_t *state = (srtp_hmac_mbedtls_ctx_t *)statev;
 
     debug_print(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
 
-    if (mbedtls_md_hmac_update(state, message, msg_octets) != 0) {
+    if (srtp_mbedtls_sha1_update(&state->ctx, message, msg_octets) != 0) {
         return srtp_err_status_auth_fail;
     }
 
@@ -173,7 +245,8 @@ static srtp_err_status_t srtp_hmac_mbedtls_compute(void *statev,
                                                    size_t tag_len,
                                                    uint8_t *result)
 {
-    mbedtls_md_context_t *state = (mbedtls_md_context_t *)statev;
+    srtp_hmac_mbedtls_ctx_t *state = (srtp_hmac_mbedtls_ctx_t *)statev;
+    uint8_t H[SHA1_DIGEST_SIZE];
     uint8_t hash_value[SHA1_DIGEST_SIZE];
     size_t i;
 
@@ -183,11 +256,22 @@ static srtp_err_status_t srtp_hmac_mbedtls_compute(void *statev,
     }
 
     /* hash message, copy output into H */
-    if (mbedtls_md_hmac_update(statev, message, msg_octets) != 0) {
+    if (srtp_mbedtls_sha1_update(&state->ctx, message, msg_octets) != 0) {
+        return srtp_err_status_auth_fail;
+    }
+
+    if (srtp_mbedtls_sha1_finish(&state->ctx, H) != 0) {
+        return srtp_err_status_auth_fail;
+    }
+
+    /* outer hash, starting from the cached (key ^ opad) midstate */
+    mbedtls_sha1_clone(&state->ctx, &state->outer_ctx);
+
+    if (srtp_mbedtls_sha1_update(&state->ctx, H, SHA1_DIGEST_SIZE) != 0) {
         return srtp_err_status_auth_fail;
     }
 
-    if (mbedtls_md_hmac_finish(state, hash_value) != 0) {
+    if (srtp_mbedtls_sha1_finish(&state->ctx, hash_value) != 0) {
         return srtp_err_status_auth_fail;
     }
 
@@ -220,5 +304,7 @@ const srtp_auth_type_t srtp_hmac = {
     srtp_hmac_mbedtls_start,       /* */
     srtp_hmac_mbedtls_description, /* */
     &srtp_hmac_test_case_0,        /* */
-    SRTP_HMAC_SHA1                 /* */
+    SRTP_HMAC_SHA1,                /* */
+    srtp_hmac_mbedtls_save,        /* */
+    srtp_hmac_mbedtls_restore      /* */
 };
@@ -49,6 +49,7 @@
 #include <pk11pub.h>
 
 #define SHA1_DIGEST_SIZE 20
+#define SHA1_BLOCK_SIZE 64
 
 /* the debug module for authentiation */
 
@@ -57,12 +58,43 @@ srtp_debug_module_t srtp_mod_hmac = {
     "hmac sha-1 nss" /* printable name for module   */
 };
 
+/*
+ * hmac is built from a plain sha1 digest context, the digest state after
+ * absorbing (key ^ ipad) and (key ^ opad) is saved once in init and then
+ * restored per packet, instead of re-hashing a 64 byte pad block each time
+ */
 typedef struct {
     NSSInitContext *nss;
-    PK11SymKey *key;
     PK11Context *ctx;
+    unsigned char *inner_state;
+    unsigned int inner_state_len;
+    unsigned char *outer_state;
+    unsigned int outer_state_len;
+    unsigned char *saved_state; /* kept by srtp_hmac_save() */
+    unsigned int saved_state_len;
 } srtp_hmac_nss_ctx_t;
 
+static void srtp_hmac_free_states(srtp_hmac_nss_ctx_t *hmac)
+{
+    if (hmac->inner_state) {
+        PORT_ZFree(hmac->inner_state, hmac->inner_state_len);
+        hmac->inner_state = NULL;
+        hmac->inner_state_len = 0;
+    }
+
+    if (hmac->outer_state) {
+        PORT_ZFree(hmac->outer_state, hmac->outer_state_len);
+        hmac->outer_state = NULL;
+        hmac->outer_state_len = 0;
+    }
+
+    if (hmac->saved_state) {
+        PORT_ZFree(hmac->saved_state, hmac->saved_state_len);
+        hmac->saved_state = NULL;
+        hmac->saved_state_len = 0;
+    }
+}
+
 static srtp_err_status_t srtp_hmac_alloc(srtp_auth_t **a,
                                          size_t key_len,
                                          size_t out_len)
@@ -76,6 +108,11 @@ static srtp_err_status_t srtp_hmac_alloc(srtp_auth_t **a,
     debug_print(srtp_mod_hmac, "                          tag length %zu",
                 out_len);
 
+    /* check key length - keys longer than a block are not supported */
+    if (key_len > SHA1_BLOCK_SIZE) {
+        return srtp_err_status_bad_param;
+    }
+
     /* check output length - should be less than 20 bytes */
     if (out_len > SHA1_DIGEST_SIZE) {
         return srtp_err_status_bad_param;
@@ -106,8 +143,13 @@ static srtp_err_status_t srtp_hmac_alloc(srtp_auth_t **a,
     }
 
     hmac->nss = nss;
-    hmac->key = NULL;
     hmac->ctx = NULL;
+    hmac->inner_state = NULL;
+    hmac->inner_state_len = 0;
+    hmac->outer_state = NULL;
+    hmac->outer_state_len = 0;
+    hmac->saved_state = NULL;
+    hmac->saved_state_len = 0;
 
     /* set pointers */
     (*a)->state = hmac;
@@ -126,10 +168,7 @@ static srtp_err_status_t srtp_hmac_dealloc(srtp_auth_t *a)
     hmac = (srtp_hmac_nss_ctx_t *)a->state;
     if (hmac) {
         /* free any PK11 values that have been created */
-        if (hmac->key) {
-            PK11_FreeSymKey(hmac->key);
-            hmac->key = NULL;
-        }
+        srtp_hmac_free_states(hmac);
 
         if (hmac->ctx) {
             PK11_DestroyContext(hmac->ctx, PR_TRUE);
@@ -157,58 +196,116 @@ static srtp_err_status_t srtp_hmac_start(void *statev)
     srtp_hmac_nss_ctx_t *hmac;
     hmac = (srtp_hmac_nss_ctx_t *)statev;
 
-    if (PK11_DigestBegin(hmac->ctx) != SECSuccess) {
+    if (PK11_RestoreContext(hmac->ctx, hmac->inner_state,
+                            (int)hmac->inner_state_len) != SECSuccess) {
+        return srtp_err_status_auth_fail;
+    }
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_save(void *statev)
+{
+    srtp_hmac_nss_ctx_t *hmac;
+    hmac = (srtp_hmac_nss_ctx_t *)statev;
+    unsigned char *state;
+    unsigned int len;
+
+    /* the state fits the buffer from init, so nothing is allocated here */
+    state = PK11_SaveContextAlloc(hmac->ctx, hmac->saved_state,
+                                  hmac->saved_state_len, &len);
+    if (state != hmac->saved_state) {
+        if (state) {
+            PORT_ZFree(state, len);
+        }
+        return srtp_err_status_auth_fail;
+    }
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_restore(void *statev)
+{
+    srtp_hmac_nss_ctx_t *hmac;
+    hmac = (srtp_hmac_nss_ctx_t *)statev;
+
+    if (PK11_RestoreContext(hmac->ctx, hmac->saved_state,
+                            (int)hmac->saved_state_len) != SECSuccess) {
         return srtp_err_status_auth_fail;
     }
     return srtp_err_status_ok;
 }
 
+/*
+ * hashes a pad block into a fresh digest context and returns the saved
+ * digest state, or NULL on failure
+ */
+static unsigned char *srtp_hmac_save_pad_state(PK11Context *ctx,
+                                               const uint8_t *pad,
+                                               unsigned int *state_len)
+{
+    if (PK11_DigestBegin(ctx) != SECSuccess) {
+        return NULL;
+    }
+
+    if (PK11_DigestOp(ctx, pad, SHA1_BLOCK_SIZE) != SECSuccess) {
+        return NULL;
+    }
+
+    return PK11_SaveContextAlloc(ctx, NULL, 0, state_len);
+}
+
 static srtp_err_status_t srtp_hmac_init(void *statev,
                                         const uint8_t *key,
                                         size_t key_len)
 {
     srtp_hmac_nss_ctx_t *hmac;
     hmac = (srtp_hmac_nss_ctx_t *)statev;
-    PK11SymKey *sym_key;
-    PK11Context *ctx;
+    uint8_t ipad[SHA1_BLOCK_SIZE];
+    uint8_t opad[SHA1_BLOCK_SIZE];
+    srtp_err_status_t status = srtp_err_status_ok;
 
-    if (hmac->ctx) {
-        PK11_DestroyContext(hmac->ctx, PR_TRUE);
-        hmac->ctx = NULL;
+    if (key_len > SHA1_BLOCK_SIZE) {
+        return srtp_err_status_bad_param;
     }
 
-    if (hmac->key) {
-        PK11_FreeSymKey(hmac->key);
-        hmac->key = NULL;
+    srtp_hmac_free_states(hmac);
+
+    if (hmac->ctx == NULL) {
+        hmac->ctx = PK11_CreateDigestContext(SEC_OID_SHA1);
+        if (!hmac->ctx) {
+            return srtp_err_status_auth_fail;
+        }
     }
 
-    PK11SlotInfo *slot = PK11_GetBestSlot(CKM_SHA_1_HMAC, NULL);
-    if (!slot) {
-        return srtp_err_status_bad_param;
+    for (size_t i = 0; i < key_len; i++) {
+        ipad[i] = key[i] ^ 0x36;
+        opad[i] = key[i] ^ 0x5c;
+    }
+    for (size_t i = key_len; i < SHA1_BLOCK_SIZE; i++) {
+        ipad[i] = 0x36;
+        opad[i] = 0x5c;
     }
 
-    /* explicitly cast away const of key */
-    SECItem key_item = { siBuffer, (unsigned char *)(uintptr_t)key, key_len };
-    sym_key = PK11_ImportSymKey(slot, CKM_SHA_1_HMAC, PK11_OriginUnwrap,
-                                CKA_SIGN, &key_item, NULL);
-    PK11_FreeSlot(slot);
+    hmac->outer_state =
+        srtp_hmac_save_pad_state(hmac->ctx, opad, &hmac->outer_state_len);
+    hmac->inner_state =
+        srtp_hmac_save_pad_state(hmac->ctx, ipad, &hmac->inner_state_len);
 
-    if (!sym_key) {
-        return srtp_err_status_auth_fail;
+    /* a digest state has the same size wherever it is saved */
+    if (hmac->inner_state) {
+        hmac->saved_state_len = hmac->inner_state_len;
+        hmac->saved_state = PORT_ZAlloc(hmac->saved_state_len);
     }
 
-    SECItem param_item = { siBuffer, NULL, 0 };
-    ctx = PK11_CreateContextBySymKey(CKM_SHA_1_HMAC, CKA_SIGN, sym_key,
-                                     &param_item);
-    if (!ctx) {
-        PK11_FreeSymKey(sym_key);
-        return srtp_err_status_auth_fail;
+    /* ctx is left holding the inner midstate, ready for update() */
+    if (!hmac->inner_state || !hmac->outer_state || !hmac->saved_state) {
+        srtp_hmac_free_states(hmac);
+        status = srtp_err_status_auth_fail;
     }
 
-    hmac->key = sym_key;
-    hmac->ctx = ctx;
+    octet_string_set_to_zero(ipad, sizeof(ipad));
+    octet_string_set_to_zero(opad, sizeof(opad));
 
-    return srtp_err_status_ok;
+    return status;
 }
 
 static srtp_err_status_t srtp_hmac_update(void *statev,
@@ -236,6 +333,7 @@ static srtp_err_status_t srtp_hmac_compute(void *statev,
 {
     srtp_hmac_nss_ctx_t *hmac;
     hmac = (srtp_hmac_nss_ctx_t *)statev;
+    uint8_t H[SHA1_DIGEST_SIZE];
     uint8_t hash_value[SHA1_DIGEST_SIZE];
     unsigned int len;
 
@@ -251,6 +349,21 @@ static srtp_err_status_t srtp_hmac_compute(void *statev,
         return srtp_err_status_auth_fail;
     }
 
+    if (PK11_DigestFinal(hmac->ctx, H, &len, SHA1_DIGEST_SIZE) !=
+        SECSuccess) {
+        return srtp_err_status_auth_fail;
+    }
+
+    /* outer hash, starting from the cached (key ^ opad) midstate */
+    if (PK11_RestoreContext(hmac->ctx, hmac->outer_state,
+                            (int)hmac->outer_state_len) != SECSuccess) {
+        return srtp_err_status_auth_fail;
+    }
+
+    if (PK11_DigestOp(hmac->ctx, H, SHA1_DIGEST_SIZE) != SECSuccess) {
+        return srtp_err_status_auth_fail;
+    }
+
     if (PK11_DigestFinal(hmac->ctx, hash_value, &len, SHA1_DIGEST_SIZE) !=
         SECSuccess) {
         return srtp_err_status_auth_fail;
@@ -287,5 +400,7 @@ const srtp_auth_type_t srtp_hmac = {
     srtp_hmac_start,        /* */
     srtp_hmac_description,  /* */
     &srtp_hmac_test_case_0, /* */
-    SRTP_HMAC_SHA1          /* */
+    SRTP_HMAC_SHA1,         /* */
+    srtp_hmac_save,         /* */
+    srtp_hmac_restore       /* */
 };
@@ -46,6 +46,9 @@
 #include <config.h>
 #endif
 
+/* the SHA-1 midstates below use the low level SHA1_* functions */
+#define OPENSSL_SUPPRESS_DEPRECATED
+
 #include "auth.h"
 #include "alloc.h"
 #include "err.h" /* for srtp_debug */
@@ -57,13 +60,21 @@
 /* before this version reinit of EVP_MAC_CTX was not supported so need to
  * duplicate the CTX each time */
 #define SRTP_OSSL_MIN_REINIT_VERSION 0x30000030L
+#ifndef OPENSSL_NO_DEPRECATED_3_0
+#define SRTP_OSSL_USE_SHA1_MIDSTATES
+#endif
 #endif
 
 #ifndef SRTP_OSSL_USE_EVP_MAC
 #include <openssl/hmac.h>
 #endif
 
+#ifdef SRTP_OSSL_USE_SHA1_MIDSTATES
+#include <openssl/sha.h>
+#endif
+
 #define SHA1_DIGEST_SIZE 20
+#define SHA1_BLOCK_SIZE 64
 
 /* the debug module for authentication */
 
@@ -83,6 +94,12 @@ srtp_debug_module_t srtp_mod_hmac = {
  * The distinction between cases 2 & 3 needs to be made at runtime, because in a
  * shared library context you might end up building against 3.0.3 and running
  * against 3.0.2.
+ *
+ * Even with reinitialization, an EVP_MAC_CTX for HMAC duplicates the
+ * context of its SHA-1 provider twice per tag, which allocates.  So
+ * unless FIPS mode is enabled, OpenSSL 3 builds keep the SHA-1 midstates
+ * after absorbing (key ^ ipad) and (key ^ opad) in SHA_CTX structures
+ * instead, as the native backend does, and copy them without allocating.
  */
 
 typedef struct {
@@ -91,11 +108,58 @@ typedef struct {
     EVP_MAC_CTX *ctx;
     int use_dup;
     EVP_MAC_CTX *ctx_dup;
+    EVP_MAC_CTX *saved; /* kept by srtp_hmac_save() */
+#ifdef SRTP_OSSL_USE_SHA1_MIDSTATES
+    int use_midstates;
+    SHA_CTX sha_ctx;
+    SHA_CTX inner_ctx;
+    SHA_CTX outer_ctx;
+    SHA_CTX saved_ctx;
+#endif
 #else
     HMAC_CTX *ctx;
+    HMAC_CTX *saved; /* kept by srtp_hmac_save() */
 #endif
 } srtp_hmac_ossl_ctx_t;
 
+#ifdef SRTP_OSSL_USE_SHA1_MIDSTATES
+#define SRTP_OSSL_MIDSTATES(hmac) ((hmac)->use_midstates)
+#else
+#define SRTP_OSSL_MIDSTATES(hmac) 0
+#endif
+
+#ifdef SRTP_OSSL_USE_EVP_MAC
+/*
+ * srtp_hmac_new_evp_mac() fetches the HMAC of the default provider and
+ * creates the EVP_MAC_CTX that the tags are computed with
+ */
+static srtp_err_status_t srtp_hmac_new_evp_mac(srtp_hmac_ossl_ctx_t *hmac)
+{
+    hmac->mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
+    if (hmac->mac == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    hmac->ctx = EVP_MAC_CTX_new(hmac->mac);
+    if (hmac->ctx == NULL) {
+        EVP_MAC_free(hmac->mac);
+        hmac->mac = NULL;
+        return srtp_err_status_alloc_fail;
+    }
+
+    hmac->use_dup =
+        OpenSSL_version_num() < SRTP_OSSL_MIN_REINIT_VERSION ? 1 : 0;
+
+    if (hmac->use_dup) {
+        debug_print0(srtp_mod_hmac, "using EVP_MAC_CTX_dup");
+        hmac->ctx_dup = hmac->ctx;
+        hmac->ctx = NULL;
+    }
+
+    return srtp_err_status_ok;
+}
+#endif
+
 static srtp_err_status_t srtp_hmac_alloc(srtp_auth_t **a,
                                          size_t key_len,
                                          size_t out_len)
@@ -126,35 +190,32 @@ static srtp_err_status_t srtp_hmac_alloc(srtp_auth_t **a,
         return srtp_err_status_alloc_fail;
     }
 
+#ifdef SRTP_OSSL_USE_SHA1_MIDSTATES
+    hmac->use_midstates = !EVP_default_properties_is_fips_enabled(NULL);
+    if (hmac->use_midstates) {
+        debug_print0(srtp_mod_hmac, "using SHA-1 midstates");
+    }
+#endif
+
 #ifdef SRTP_OSSL_USE_EVP_MAC
-    hmac->mac = EVP_MAC_fetch(NULL, "HMAC", NULL);
-    if (hmac->mac == NULL) {
+    if (!SRTP_OSSL_MIDSTATES(hmac) && srtp_hmac_new_evp_mac(hmac)) {
         srtp_crypto_free(hmac);
         srtp_crypto_free(*a);
         *a = NULL;
         return srtp_err_status_alloc_fail;
     }
-
-    hmac->ctx = EVP_MAC_CTX_new(hmac->mac);
+#else
+    hmac->ctx = HMAC_CTX_new();
     if (hmac->ctx == NULL) {
-        EVP_MAC_free(hmac->mac);
         srtp_crypto_free(hmac);
         srtp_crypto_free(*a);
         *a = NULL;
         return srtp_err_status_alloc_fail;
     }
 
-    hmac->use_dup =
-        OpenSSL_version_num() < SRTP_OSSL_MIN_REINIT_VERSION ? 1 : 0;
-
-    if (hmac->use_dup) {
-        debug_print0(srtp_mod_hmac, "using EVP_MAC_CTX_dup");
-        hmac->ctx_dup = hmac->ctx;
-        hmac->ctx = NULL;
-    }
-#else
-    hmac->ctx = HMAC_CTX_new();
-    if (hmac->ctx == NULL) {
+    hmac->saved = HMAC_CTX_new();
+    if (hmac->saved == NULL) {
+        HMAC_CTX_free(hmac->ctx);
         srtp_crypto_free(hmac);
         srtp_crypto_free(*a);
         *a = NULL;
@@ -180,9 +241,11 @@ static srtp_err_status_t srtp_hmac_dealloc(srtp_auth_t *a)
 #ifdef SRTP_OSSL_USE_EVP_MAC
         EVP_MAC_CTX_free(hmac->ctx);
         EVP_MAC_CTX_free(hmac->ctx_dup);
+        EVP_MAC_CTX_free(hmac->saved);
         EVP_MAC_free(hmac->mac);
 #else
         HMAC_CTX_free(hmac->ctx);
+        HMAC_CTX_free(hmac->saved);
 #endif
         /* zeroize entire state*/
         octet_string_set_to_zero(hmac, sizeof(srtp_hmac_ossl_ctx_t));
@@ -203,6 +266,13 @@ static srtp_err_status_t srtp_hmac_start(void *statev)
 {
     srtp_hmac_ossl_ctx_t *hmac = (srtp_hmac_ossl_ctx_t *)statev;
 
+#ifdef SRTP_OSSL_USE_SHA1_MIDSTATES
+    if (hmac->use_midstates) {
+        hmac->sha_ctx = hmac->inner_ctx;
+        return srtp_err_status_ok;
+    }
+#endif
+
 #ifdef SRTP_OSSL_USE_EVP_MAC
     if (hmac->use_dup) {
         EVP_MAC_CTX_free(hmac->ctx);
@@ -223,6 +293,158 @@ static srtp_err_status_t srtp_hmac_start(void *statev)
     return srtp_err_status_ok;
 }
 
+/*
+ * an EVP_MAC_CTX can only be copied by duplicating it, so restore() costs
+ * an allocation there, which is still far cheaper than hashing a packet;
+ * SHA-1 midstates are plain structure copies.  if duplicating fails, the
+ * current context is left as it was, so the caller can start over
+ */
+static srtp_err_status_t srtp_hmac_save(void *statev)
+{
+    srtp_hmac_ossl_ctx_t *hmac = (srtp_hmac_ossl_ctx_t *)statev;
+
+#ifdef SRTP_OSSL_USE_SHA1_MIDSTATES
+    if (hmac->use_midstates) {
+        hmac->saved_ctx = hmac->sha_ctx;
+        return srtp_err_status_ok;
+    }
+#endif
+
+#ifdef SRTP_OSSL_USE_EVP_MAC
+    EVP_MAC_CTX_free(hmac->saved);
+    hmac->saved = NULL;
+    if (hmac->ctx == NULL) {
+        return srtp_err_status_bad_param;
+    }
+    hmac->saved = EVP_MAC_CTX_dup(hmac->ctx);
+    if (hmac->saved == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+#else
+    if (HMAC_CTX_copy(hmac->saved, hmac->ctx) == 0) {
+        return srtp_err_status_auth_fail;
+    }
+#endif
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_restore(void *statev)
+{
+    srtp_hmac_ossl_ctx_t *hmac = (srtp_hmac_ossl_ctx_t *)statev;
+#ifdef SRTP_OSSL_USE_EVP_MAC
+    EVP_MAC_CTX *ctx;
+#endif
+
+#ifdef SRTP_OSSL_USE_SHA1_MIDSTATES
+    if (hmac->use_midstates) {
+        hmac->sha_ctx = hmac->saved_ctx;
+        return srtp_err_status_ok;
+    }
+#endif
+
+#ifdef SRTP_OSSL_USE_EVP_MAC
+    if (hmac->saved == NULL) {
+        return srtp_err_status_bad_param;
+    }
+    ctx = EVP_MAC_CTX_dup(hmac->saved);
+    if (ctx == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    EVP_MAC_CTX_free(hmac->ctx);
+    hmac->ctx = ctx;
+#else
+    if (HMAC_CTX_copy(hmac->ctx, hmac->saved) == 0) {
+        return srtp_err_status_auth_fail;
+    }
+#endif
+    return srtp_err_status_ok;
+}
+
+#ifdef SRTP_OSSL_USE_SHA1_MIDSTATES
+static srtp_err_status_t srtp_hmac_init_midstates(srtp_hmac_ossl_ctx_t *hmac,
+                                                  const uint8_t *key,
+                                                  size_t key_len)
+{
+    uint8_t ipad[SHA1_BLOCK_SIZE];
+    uint8_t opad[SHA1_BLOCK_SIZE];
+    int ok;
+
+    /*
+     * check key length - note that we don't support keys larger
+     * than the block size
+     */
+    if (key_len > SHA1_BLOCK_SIZE) {
+        return srtp_err_status_bad_param;
+    }
+
+    /*
+     * set values of ipad and opad by exoring the key into the
+     * appropriate constant values
+     */
+    for (size_t i = 0; i < key_len; i++) {
+        ipad[i] = key[i] ^ 0x36;
+        opad[i] = key[i] ^ 0x5c;
+    }
+    /* set the rest of ipad, opad to constant values */
+    for (size_t i = key_len; i < SHA1_BLOCK_SIZE; i++) {
+        ipad[i] = 0x36;
+        opad[i] = 0x5c;
+    }
+
+    /* keep the midstates after absorbing ipad and opad */
+    ok = SHA1_Init(&hmac->inner_ctx) &&
+         SHA1_Update(&hmac->inner_ctx, ipad, sizeof(ipad)) &&
+         SHA1_Init(&hmac->outer_ctx) &&
+         SHA1_Update(&hmac->outer_ctx, opad, sizeof(opad));
+
+    octet_string_set_to_zero(ipad, sizeof(ipad));
+    octet_string_set_to_zero(opad, sizeof(opad));
+
+    if (!ok) {
+        return srtp_err_status_auth_fail;
+    }
+
+    hmac->sha_ctx = hmac->inner_ctx;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_hmac_compute_midstates() finishes the inner hash and then hashes
+ * its output starting from the outer midstate
+ */
+static srtp_err_status_t srtp_hmac_compute_midstates(
+    srtp_hmac_ossl_ctx_t *hmac,
+    const uint8_t *message,
+    size_t msg_octets,
+    size_t tag_len,
+    uint8_t *result)
+{
+    uint8_t hash_value[SHA1_DIGEST_SIZE];
+
+    if (SHA1_Update(&hmac->sha_ctx, message, msg_octets) == 0 ||
+        SHA1_Final(hash_value, &hmac->sha_ctx) == 0) {
+        return srtp_err_status_auth_fail;
+    }
+
+    hmac->sha_ctx = hmac->outer_ctx;
+    if (SHA1_Update(&hmac->sha_ctx, hash_value, sizeof(hash_value)) == 0 ||
+        SHA1_Final(hash_value, &hmac->sha_ctx) == 0) {
+        return srtp_err_status_auth_fail;
+    }
+
+    /* copy hash_value to *result */
+    for (size_t i = 0; i < tag_len; i++) {
+        result[i] = hash_value[i];
+    }
+
+    debug_print(srtp_mod_hmac, "output: %s",
+                srtp_octet_string_hex_string(hash_value, tag_len));
+
+    return srtp_err_status_ok;
+}
+#endif
+
 static srtp_err_status_t srtp_hmac_init(void *statev,
                                         const uint8_t *key,
                                         size_t key_len)
@@ -232,6 +454,12 @@ static srtp_err_status_t srtp_hmac_init(void *statev,
 #ifdef SRTP_OSSL_USE_EVP_MAC
     OSSL_PARAM params[2];
 
+#ifdef SRTP_OSSL_USE_SHA1_MIDSTATES
+    if (hmac->use_midstates) {
+        return srtp_hmac_init_midstates(hmac, key, key_len);
+    }
+#endif
+
     params[0] = OSSL_PARAM_construct_utf8_string("digest", "SHA1", 0);
     params[1] = OSSL_PARAM_construct_end();
 
@@ -256,6 +484,15 @@ static srtp_err_status_t srtp_hmac_update(void *statev,
     debug_print(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
 
+#ifdef SRTP_OSSL_USE_SHA1_MIDSTATES
+    if (hmac->use_midstates) {
+        if (SHA1_Update(&hmac->sha_ctx, message, msg_octets) == 0) {
+            return srtp_err_status_auth_fail;
+        }
+        return srtp_err_status_ok;
+    }
+#endif
+
 #ifdef SRTP_OSSL_USE_EVP_MAC
     if (EVP_MAC_update(hmac->ctx, message, msg_octets) == 0) {
         return srtp_err_status_auth_fail;
@@ -290,6 +527,13 @@ static srtp_err_status_t srtp_hmac_compute(void *statev,
         return srtp_err_status_bad_param;
     }
 
+#ifdef SRTP_OSSL_USE_SHA1_MIDSTATES
+    if (hmac->use_midstates) {
+        return srtp_hmac_compute_midstates(hmac, message, msg_octets, tag_len,
+                                           result);
+    }
+#endif
+
     /* hash message, copy output into H */
 #ifdef SRTP_OSSL_USE_EVP_MAC
     if (EVP_MAC_update(hmac->ctx, message, msg_octets) == 0) {
@@ -339,5 +583,7 @@ const srtp_auth_type_t srtp_hmac = {
     srtp_hmac_start,        /* */
     srtp_hmac_description,  /* */
     &srtp_hmac_test_case_0, /* */
-    SRTP_HMAC_SHA1          /* */
+    SRTP_HMAC_SHA1,         /* */
+    srtp_hmac_save,         /* */
+    srtp_hmac_restore       /* */
 };
@@ -48,7 +48,7 @@
 #include <wolfssl/options.h>
 #endif
 #include <wolfssl/wolfcrypt/settings.h>
-#include <wolfssl/wolfcrypt/hmac.h>
+#include <wolfssl/wolfcrypt/sha.h>
 #include "auth.h"
 #include "alloc.h"
 #include "err.h" /* for srtp_debug */
@@ -56,6 +56,18 @@
 
 #define SHA1_DIGEST_SIZE 20
 
+/*
+ * the sha1 midstates after absorbing (key ^ ipad) and (key ^ opad) are
+ * computed once in init, so that start() and compute() only need to
+ * copy them instead of re-hashing a 64 byte pad block per packet
+ */
+typedef struct {
+    wc_Sha ctx;
+    wc_Sha inner_ctx;
+    wc_Sha outer_ctx;
+    wc_Sha saved_ctx; /* kept by srtp_hmac_wolfssl_save() */
+} srtp_hmac_wolfssl_ctx_t;
+
 /* the debug module for authentiation */
 
 srtp_debug_module_t srtp_mod_hmac = {
@@ -68,6 +80,7 @@ static srtp_err_status_t srtp_hmac_wolfssl_alloc(srtp_auth_t **a,
                                                  size_t out_len)
 {
     extern const srtp_auth_type_t srtp_hmac;
+    srtp_hmac_wolfssl_ctx_t *hmac;
     int err;
 
     debug_print(srtp_mod_hmac, "allocating auth func with key length %zu",
@@ -75,6 +88,11 @@ static srtp_err_status_t srtp_hmac_wolfssl_alloc(srtp_auth_t **a,
     debug_print(srtp_mod_hmac, "                          tag length %zu",
                 out_len);
 
+    /* check key length - keys longer than a block are not supported */
+    if (key_len > WC_SHA_BLOCK_SIZE) {
+        return srtp_err_status_bad_param;
+    }
+
     /* check output length - should be less than 20 bytes */
     if (out_len > SHA1_DIGEST_SIZE) {
         return srtp_err_status_bad_param;
@@ -85,15 +103,25 @@ static srtp_err_status_t srtp_hmac_wolfssl_alloc(srtp_auth_t **a,
         return srtp_err_status_alloc_fail;
     }
     // allocate the buffer of wolfssl context.
-    (*a)->state = srtp_crypto_alloc(sizeof(Hmac));
-    if ((*a)->state == NULL) {
+    hmac = (srtp_hmac_wolfssl_ctx_t *)srtp_crypto_alloc(
+        sizeof(srtp_hmac_wolfssl_ctx_t));
+    if (hmac == NULL) {
         srtp_crypto_free(*a);
         *a = NULL;
         return srtp_err_status_alloc_fail;
     }
-    err = wc_HmacInit((Hmac *)(*a)->state, NULL, INVALID_DEVID);
+    err = wc_InitSha_ex(&hmac->ctx, NULL, INVALID_DEVID);
+    if (err == 0) {
+        err = wc_InitSha_ex(&hmac->inner_ctx, NULL, INVALID_DEVID);
+    }
+    if (err == 0) {
+        err = wc_InitSha_ex(&hmac->outer_ctx, NULL, INVALID_DEVID);
+    }
+    if (err == 0) {
+        err = wc_InitSha_ex(&hmac->saved_ctx, NULL, INVALID_DEVID);
+    }
     if (err < 0) {
-        srtp_crypto_free((*a)->state);
+        srtp_crypto_free(hmac);
         srtp_crypto_free(*a);
         *a = NULL;
         debug_print(srtp_mod_hmac, "wolfSSL error code: %d", err);
@@ -101,6 +129,7 @@ static srtp_err_status_t srtp_hmac_wolfssl_alloc(srtp_auth_t **a,
     }
 
     /* set pointers */
+    (*a)->state = hmac;
     (*a)->type = &srtp_hmac;
     (*a)->out_len = out_len;
     (*a)->key_len = key_len;
@@ -111,8 +140,14 @@ static srtp_err_status_t srtp_hmac_wolfssl_alloc(srtp_auth_t **a,
 
 static srtp_err_status_t srtp_hmac_wolfssl_dealloc(srtp_auth_t *a)
 {
-    wc_HmacFree((Hmac *)a->state);
-    srtp_crypto_free(a->state);
+    srtp_hmac_wolfssl_ctx_t *hmac = (srtp_hmac_wolfssl_ctx_t *)a->state;
+
+    wc_ShaFree(&hmac->ctx);
+    wc_ShaFree(&hmac->inner_ctx);
+    wc_ShaFree(&hmac->outer_ctx);
+    wc_ShaFree(&hmac->saved_ctx);
+    octet_string_set_to_zero(hmac, sizeof(srtp_hmac_wolfssl_ctx_t));
+    srtp_crypto_free(hmac);
     /* zeroize entire state*/
     octet_string_set_to_zero(a, sizeof(srtp_auth_t));
 
@@ -124,7 +159,43 @@ static srtp_err_status_t srtp_hmac_wolfssl_dealloc(srtp_auth_t *a)
 
 static srtp_err_status_t srtp_hmac_wolfssl_start(void *statev)
 {
-    (void)statev;
+    srtp_hmac_wolfssl_ctx_t *state = (srtp_hmac_wolfssl_ctx_t *)statev;
+    int err;
+
+    err = wc_ShaCopy(&state->inner_ctx, &state->ctx);
+    if (err < 0) {
+        debug_print(srtp_mod_hmac, "wolfSSL error code: %d", err);
+        return srtp_err_status_auth_fail;
+    }
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_wolfssl_save(void *statev)
+{
+    srtp_hmac_wolfssl_ctx_t *state = (srtp_hmac_wolfssl_ctx_t *)statev;
+    int err;
+
+    err = wc_ShaCopy(&state->ctx, &state->saved_ctx);
+    if (err < 0) {
+        debug_print(srtp_mod_hmac, "wolfSSL error code: %d", err);
+        return srtp_err_status_auth_fail;
+    }
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_hmac_wolfssl_restore(void *statev)
+{
+    srtp_hmac_wolfssl_ctx_t *state = (srtp_hmac_wolfssl_ctx_t *)statev;
+    int err;
+
+    err = wc_ShaCopy(&state->saved_ctx, &state->ctx);
+    if (err < 0) {
+        debug_print(srtp_mod_hmac, "wolfSSL error code: %d", err);
+        return srtp_err_status_auth_fail;
+    }
+
     return srtp_err_status_ok;
 }
 
@@ -132,10 +203,42 @@ static srtp_err_status_t srtp_hmac_wolfssl_init(void *statev,
                                                 const uint8_t *key,
                                                 size_t key_len)
 {
-    Hmac *state = (Hmac *)statev;
+    srtp_hmac_wolfssl_ctx_t *state = (srtp_hmac_wolfssl_ctx_t *)statev;
+    uint8_t ipad[WC_SHA_BLOCK_SIZE];
+    uint8_t opad[WC_SHA_BLOCK_SIZE];
+    size_t i;
     int err;
 
-    err = wc_HmacSetKey(state, WC_SHA, key, key_len);
+    if (key_len > WC_SHA_BLOCK_SIZE) {
+        return srtp_err_status_bad_param;
+    }
+
+    for (i = 0; i < key_len; i++) {
+        ipad[i] = key[i] ^ 0x36;
+        opad[i] = key[i] ^ 0x5c;
+    }
+    for (i = key_len; i < WC_SHA_BLOCK_SIZE; i++) {
+        ipad[i] = 0x36;
+        opad[i] = 0x5c;
+    }
+
+    err = wc_InitSha_ex(&state->inner_ctx, NULL, INVALID_DEVID);
+    if (err == 0) {
+        err = wc_ShaUpdate(&state->inner_ctx, ipad, WC_SHA_BLOCK_SIZE);
+    }
+    if (err == 0) {
+        err = wc_InitSha_ex(&state->outer_ctx, NULL, INVALID_DEVID);
+    }
+    if (err == 0) {
+        err = wc_ShaUpdate(&state->outer_ctx, opad, WC_SHA_BLOCK_SIZE);
+    }
+    if (err == 0) {
+        err = wc_ShaCopy(&state->inner_ctx, &state->ctx);
+    }
+
+    octet_string_set_to_zero(ipad, sizeof(ipad));
+    octet_string_set_to_zero(opad, sizeof(opad));
+
     if (err < 0) {
         debug_print(srtp_mod_hmac, "wolfSSL error code: %d", err);
         return srtp_err_status_auth_fail;
@@ -148,13 +251,13 @@ static srtp_err_status_t srtp_hmac_wolfssl_update(void *statev,
                                                   const uint8_t *message,
                                                   size_t msg_octets)
 {
-    Hmac *state = (Hmac *)statev;
+    srtp_hmac_wolfssl_ctx_t *state = (srtp_hmac_wolfssl_ctx_t *)statev;
     int err;
 
     debug_print(srtp_mod_hmac, "input: %s",
                 srtp_octet_string_hex_string(message, msg_octets));
 
-    err = wc_HmacUpdate(state, message, msg_octets);
+    err = wc_ShaUpdate(&state->ctx, message, msg_octets);
     if (err < 0) {
         debug_print(srtp_mod_hmac, "wolfSSL error code: %d", err);
         return srtp_err_status_auth_fail;
@@ -169,7 +272,8 @@ static srtp_err_status_t srtp_hmac_wolfssl_compute(void *statev,
                                                    size_t tag_len,
                                                    uint8_t *result)
 {
-    Hmac *state = (Hmac *)statev;
+    srtp_hmac_wolfssl_ctx_t *state = (srtp_hmac_wolfssl_ctx_t *)statev;
+    uint8_t H[WC_SHA_DIGEST_SIZE];
     uint8_t hash_value[WC_SHA_DIGEST_SIZE];
     int err;
     int i;
@@ -183,13 +287,21 @@ static srtp_err_status_t srtp_hmac_wolfssl_compute(void *statev,
     }
 
     /* hash message, copy output into H */
-    err = wc_HmacUpdate(state, message, msg_octets);
-    if (err < 0) {
-        debug_print(srtp_mod_hmac, "wolfSSL error code: %d", err);
-        return srtp_err_status_auth_fail;
+    err = wc_ShaUpdate(&state->ctx, message, msg_octets);
+    if (err == 0) {
+        err = wc_ShaFinal(&state->ctx, H);
     }
 
-    err = wc_HmacFinal(state, hash_value);
+    /* outer hash, starting from the cached (key ^ opad) midstate */
+    if (err == 0) {
+        err = wc_ShaCopy(&state->outer_ctx, &state->ctx);
+    }
+    if (err == 0) {
+        err = wc_ShaUpdate(&state->ctx, H, WC_SHA_DIGEST_SIZE);
+    }
+    if (err == 0) {
+        err = wc_ShaFinal(&state->ctx, hash_value);
+    }
     if (err < 0) {
         debug_print(srtp_mod_hmac, "wolfSSL error code: %d", err);
         return srtp_err_status_auth_fail;
@@ -224,5 +336,7 @@ const srtp_auth_type_t srtp_hmac = {
     srtp_hmac_wolfssl_start,       /* */
     srtp_hmac_wolfssl_description, /* */
     &srtp_hmac_test_case_0,        /* */
-    SRTP_HMAC_SHA1                 /* */
+    SRTP_HMAC_SHA1,                /* */
+    srtp_hmac_wolfssl_save,        /* */
+    srtp_hmac_wolfssl_restore      /* */
 };
@@ -69,6 +69,43 @@ void *srtp_crypto_alloc(size_t size);
  */
 void srtp_crypto_free(void *ptr);
 
+/*
+ * SRTP_CACHE_LINE_SIZE is the alignment of state that is written while
+ * processing packets, so that the state of streams that are processed on
+ * different cores does not share cache lines
+ */
+#define SRTP_CACHE_LINE_SIZE 64
+
+/*
+ * srtp_crypto_alloc_aligned
+ *
+ * Allocates a block of memory of given size, initialized to zero's, that
+ * starts at a multiple of alignment, which must be a power of two.  The
+ * block is padded to a multiple of alignment so that no other allocation
+ * shares its first or last cache line.  Free the memory with a call to
+ * srtp_crypto_free_aligned.
+ *
+ * returns pointer to memory on success or else NULL
+ */
+void *srtp_crypto_alloc_aligned(size_t size, size_t alignment);
+
+/*
+ * srtp_crypto_alloc_aligned_size
+ *
+ * Returns the memory that srtp_crypto_alloc_aligned takes from the
+ * allocator for a block of given size and alignment, including padding
+ */
+size_t srtp_crypto_alloc_aligned_size(size_t size, size_t alignment);
+
+/*
+ * srtp_crypto_free_aligned
+ *
+ * Frees the block of memory ptr previously allocated with
+ * srtp_crypto_alloc_aligned.  Like srtp_crypto_free, it does not clear
+ * the block, so a caller that kept keys in it must zeroize it first
+ */
+void srtp_crypto_free_aligned(void *ptr);
+
 #ifdef __cplusplus
 }
 #endif
@@ -78,6 +78,10 @@ typedef srtp_err_status_t (*srtp_auth_update_func)(void *state,
 
 typedef srtp_err_status_t (*srtp_auth_start_func)(void *state);
 
+typedef srtp_err_status_t (*srtp_auth_save_func)(void *state);
+
+typedef srtp_err_status_t (*srtp_auth_restore_func)(void *state);
+
 /* some syntactic sugar on these function types */
 #define srtp_auth_type_alloc(at, a, klen, outlen)                              \
     ((at)->alloc((a), (klen), (outlen)))
@@ -93,6 +97,19 @@ typedef srtp_err_status_t (*srtp_auth_start_func)(void *state);
 
 #define srtp_auth_start(a) (((a)->type)->start((a)->state))
 
+/*
+ * srtp_auth_save() remembers a tag computation that has been started and
+ * updated, and srtp_auth_restore() goes back to it, so that the tags of
+ * several messages with a common prefix hash that prefix only once.  an
+ * auth type leaves both NULL if it cannot do this
+ */
+#define srtp_auth_can_save(a)                                                  \
+    (((a)->type)->save != NULL && ((a)->type)->restore != NULL)
+
+#define srtp_auth_save(a) (((a)->type)->save((a)->state))
+
+#define srtp_auth_restore(a) (((a)->type)->restore((a)->state))
+
 #define srtp_auth_dealloc(c) (((c)->type)->dealloc(c))
 
 /* functions to get information about a particular auth_t */
@@ -131,6 +148,8 @@ typedef struct srtp_auth_type_t {
     const char *description;
     const srtp_auth_test_case_t *test_data;
     srtp_auth_type_id_t id;
+    srtp_auth_save_func save;       /* optional, may be NULL */
+    srtp_auth_restore_func restore; /* optional, may be NULL */
 } srtp_auth_type_t;
 
 typedef struct srtp_auth_t {
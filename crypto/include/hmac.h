@@ -50,9 +50,10 @@
 #include "sha1.h"
 
 typedef struct {
-    uint8_t opad[64];
     srtp_sha1_ctx_t ctx;
-    srtp_sha1_ctx_t init_ctx;
+    srtp_sha1_ctx_t init_ctx;  /* midstate after hashing key ^ ipad */
+    srtp_sha1_ctx_t outer_ctx; /* midstate after hashing key ^ opad */
+    srtp_sha1_ctx_t saved_ctx; /* midstate kept by srtp_hmac_save()  */
 } srtp_hmac_ctx_t;
 
 #endif /* HMAC_H */
@@ -50,6 +50,7 @@
 #include "crypto_kernel.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 /* the debug module for memory allocation */
 
@@ -93,3 +94,55 @@ void srtp_crypto_free(void *ptr)
 
     free(ptr);
 }
+
+/*
+ * an aligned block is carved out of a larger allocation, the pointer to
+ * which is stored just in front of the block.  the allocator aligns
+ * memory to at least the size of a pointer, so there is always room for
+ * it.
+ */
+void *srtp_crypto_alloc_aligned(size_t size, size_t alignment)
+{
+    uint8_t *ptr;
+    uint8_t *aligned;
+
+    if (!size || alignment < sizeof(void *) ||
+        (alignment & (alignment - 1)) != 0 ||
+        size > SIZE_MAX - 2 * alignment) {
+        return NULL;
+    }
+
+    size = (size + alignment - 1) & ~(alignment - 1);
+    ptr = (uint8_t *)calloc(1, size + alignment);
+    if (ptr == NULL) {
+        debug_print(srtp_mod_alloc, "allocation failed (asked for %zu bytes)\n",
+                    size);
+        return NULL;
+    }
+
+    aligned = (uint8_t *)(((uintptr_t)ptr + alignment) & ~(alignment - 1));
+    memcpy(aligned - sizeof(void *), &ptr, sizeof(void *));
+
+    debug_print(srtp_mod_alloc, "(location: %p) allocated", aligned);
+
+    return aligned;
+}
+
+size_t srtp_crypto_alloc_aligned_size(size_t size, size_t alignment)
+{
+    return ((size + alignment - 1) & ~(alignment - 1)) + alignment;
+}
+
+void srtp_crypto_free_aligned(void *ptr)
+{
+    void *block;
+
+    debug_print(srtp_mod_alloc, "(location: %p) freed", ptr);
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    memcpy(&block, (uint8_t *)ptr - sizeof(void *), sizeof(void *));
+    free(block);
+}
@@ -276,7 +276,8 @@ bool bitvector_alloc(bitvector_t *v, size_t length)
         v->length = 0;
         return false;
     } else {
-        v->word = (uint32_t *)srtp_crypto_alloc(l);
+        v->word =
+            (uint32_t *)srtp_crypto_alloc_aligned(l, SRTP_CACHE_LINE_SIZE);
         if (v->word == NULL) {
             v->length = 0;
             return false;
@@ -293,7 +294,7 @@ bool bitvector_alloc(bitvector_t *v, size_t length)
 void bitvector_dealloc(bitvector_t *v)
 {
     if (v->word != NULL) {
-        srtp_crypto_free(v->word);
+        srtp_crypto_free_aligned(v->word);
     }
     v->word = NULL;
     v->length = 0;
@@ -0,0 +1,158 @@
+/*
+ * ekt_priv.h
+ *
+ * encrypted key transport (RFC 8870) for SRTP
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_EKT_PRIV_H
+#define SRTP_EKT_PRIV_H
+
+#include "srtp_priv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern srtp_debug_module_t mod_ekt;
+
+/*
+ * EKTField message types (RFC 8870 Section 4.1)
+ */
+#define SRTP_EKT_MSG_SHORT 0x00
+#define SRTP_EKT_MSG_FULL 0x02
+
+#define SRTP_EKT_SHORT_FIELD_LEN 1
+
+/*
+ * SPI, Epoch, Length and Message Type following the EKTCiphertext of a
+ * FullEKTField
+ */
+#define SRTP_EKT_FULL_FIELD_TRAILER_LEN 7
+
+/*
+ * the EKTPlaintext is the master key length, the master key, the SSRC
+ * and the ROC; AES Key Wrap pads it to a multiple of 8 octets and adds
+ * an 8 octet integrity check value
+ */
+#define SRTP_EKT_MAX_PLAINTEXT_LEN (1 + SRTP_AES_256_KEY_LEN + 4 + 4)
+#define SRTP_EKT_MAX_CIPHERTEXT_LEN                                            \
+    (((SRTP_EKT_MAX_PLAINTEXT_LEN + 7) / 8 + 1) * 8)
+
+/*
+ * srtp_ekt_field_t is the content of a received EKTField, key holds the
+ * master key from the EKTPlaintext followed by the master salt of the
+ * policy so that it can be used as srtp_policy_t::key directly
+ */
+typedef struct srtp_ekt_field_t {
+    bool full;
+    uint32_t ssrc; /* in network order */
+    uint32_t roc;
+    uint8_t key[SRTP_MAX_KEY_LEN];
+} srtp_ekt_field_t;
+
+/*
+ * srtp_ekt_alloc(ekt, policy, key_len, master_key_len) allocates the EKT
+ * context of a stream from policy->ekt.  key_len is the length of the
+ * master key and salt in policy->key and master_key_len the length of the
+ * master key alone, which is what the EKTField carries.  the context is
+ * reference counted so that it can be shared by all streams cloned from a
+ * template or created from a received EKTField.
+ */
+srtp_err_status_t srtp_ekt_alloc(srtp_ekt_ctx_t **ekt,
+                                 const srtp_policy_t *policy,
+                                 size_t key_len,
+                                 size_t master_key_len);
+
+/*
+ * srtp_ekt_ref(ekt) adds a reference to ekt and returns it
+ */
+srtp_ekt_ctx_t *srtp_ekt_ref(srtp_ekt_ctx_t *ekt);
+
+/*
+ * srtp_ekt_dealloc(ekt) drops a reference to ekt, the context is zeroized
+ * and freed when the last reference is gone
+ */
+void srtp_ekt_dealloc(srtp_ekt_ctx_t *ekt);
+
+/*
+ * srtp_ekt_use_full_field(ekt, packet_count) returns true if the packet
+ * with the given per stream count should carry a FullEKTField
+ */
+bool srtp_ekt_use_full_field(const srtp_ekt_ctx_t *ekt, uint64_t packet_count);
+
+/*
+ * srtp_ekt_field_len(ekt, full) returns the length of the EKTField that
+ * srtp_ekt_write_field() writes
+ */
+size_t srtp_ekt_field_len(const srtp_ekt_ctx_t *ekt, bool full);
+
+/*
+ * srtp_ekt_write_field(ekt, full, ssrc, roc, field) writes a FullEKTField
+ * carrying the master key of the policy, ssrc (in network order) and roc,
+ * or a ShortEKTField, to field
+ */
+srtp_err_status_t srtp_ekt_write_field(const srtp_ekt_ctx_t *ekt,
+                                       bool full,
+                                       uint32_t ssrc,
+                                       uint32_t roc,
+                                       uint8_t *field);
+
+/*
+ * srtp_ekt_parse_field(ekt, srtp, srtp_len, field) parses the EKTField at
+ * the end of the packet srtp and reduces *srtp_len by its length.  a
+ * FullEKTField with an unknown SPI is removed but reported as short.
+ */
+srtp_err_status_t srtp_ekt_parse_field(const srtp_ekt_ctx_t *ekt,
+                                       const uint8_t *srtp,
+                                       size_t *srtp_len,
+                                       srtp_ekt_field_t *field);
+
+/*
+ * srtp_ekt_stream_policy(ekt, field, policy) sets policy to the policy of
+ * a stream for the SSRC and master key of field, policy->key points into
+ * field
+ */
+void srtp_ekt_stream_policy(const srtp_ekt_ctx_t *ekt,
+                            srtp_ekt_field_t *field,
+                            srtp_policy_t *policy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_EKT_PRIV_H */
@@ -0,0 +1,156 @@
+/*
+ * index_store_priv.h
+ *
+ * memory-mapped persistence of the packet indices of sending streams
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_INDEX_STORE_PRIV_H
+#define SRTP_INDEX_STORE_PRIV_H
+
+#include "srtp_priv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern srtp_debug_module_t mod_index_store;
+
+/*
+ * the index store file starts with a header followed by one slot per
+ * sending stream.  the file is only meant to be read back on the same
+ * host, so all fields are in host order except the SSRC.
+ */
+#define SRTP_INDEX_STORE_MAGIC "SRTPIDX"
+#define SRTP_INDEX_STORE_VERSION 1
+
+typedef struct srtp_index_store_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_slots;
+} srtp_index_store_header_t;
+
+/*
+ * a slot holds limits that no packet index used by the stream has
+ * reached yet: rtp_limit for the extended RTP index and rtcp_limit for
+ * the SRTCP index
+ */
+struct srtp_index_slot_t {
+    uint32_t ssrc; /* in network order */
+    uint32_t in_use;
+    uint64_t rtp_limit;
+    uint32_t rtcp_limit;
+    uint32_t reserved;
+};
+
+/*
+ * srtp_index_store_alloc(store, path, max_streams, margin) maps the index
+ * store file at path, creating it with room for max_streams streams if it
+ * does not exist.  margin is the number of packets a checkpoint is
+ * written ahead of the index that is used.
+ */
+srtp_err_status_t srtp_index_store_alloc(srtp_index_store_t **store,
+                                         const char *path,
+                                         size_t max_streams,
+                                         uint32_t margin);
+
+/*
+ * srtp_index_store_dealloc(store) unmaps the file without syncing it
+ */
+void srtp_index_store_dealloc(srtp_index_store_t *store);
+
+/*
+ * srtp_index_store_flush(store) writes the mapped checkpoints to the file
+ */
+srtp_err_status_t srtp_index_store_flush(srtp_index_store_t *store);
+
+/*
+ * srtp_index_store_attach(store, stream) assigns the slot of the stream's
+ * SSRC to a sending stream.  if the slot was written by an earlier
+ * process, the SRTCP index of the stream is moved past the limit in the
+ * slot and stream->index_rtp_resume is set to the RTP limit, which
+ * srtp_index_store_resume_rtp() applies to the first RTP packet.
+ *
+ * a stream that finds the store full fails with alloc_fail, and keeps
+ * failing without scanning the store until a slot is freed.
+ */
+srtp_err_status_t srtp_index_store_attach(srtp_index_store_t *store,
+                                          srtp_stream_ctx_t *stream);
+
+/*
+ * srtp_index_store_release(store, slot) frees the slot of a stream that
+ * is removed from its session
+ */
+void srtp_index_store_release(srtp_index_store_t *store,
+                              srtp_index_slot_t *slot);
+
+/*
+ * srtp_index_store_resume_rtp(stream, seq) sets the ROC of a resumed
+ * stream to the lowest one that puts the index of its first RTP packet,
+ * with sequence number seq, at or beyond the persisted RTP limit
+ */
+void srtp_index_store_resume_rtp(srtp_stream_ctx_t *stream, uint16_t seq);
+
+/*
+ * srtp_index_store_lookup(store, ssrc, rtp_limit, rtcp_limit) returns the
+ * limits of the slot of ssrc (in network order), or false if it has none
+ */
+bool srtp_index_store_lookup(const srtp_index_store_t *store,
+                             uint32_t ssrc,
+                             uint64_t *rtp_limit,
+                             uint32_t *rtcp_limit);
+
+/*
+ * srtp_index_store_checkpoint_rtp(store, stream) writes a new RTP limit to
+ * the slot of the stream, it is called before a packet index that has
+ * reached stream->index_rtp_limit is used
+ */
+void srtp_index_store_checkpoint_rtp(const srtp_index_store_t *store,
+                                     srtp_stream_ctx_t *stream);
+
+/*
+ * srtp_index_store_checkpoint_rtcp(store, stream) does the same for the
+ * SRTCP index and stream->index_rtcp_limit
+ */
+void srtp_index_store_checkpoint_rtcp(const srtp_index_store_t *store,
+                                      srtp_stream_ctx_t *stream);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_INDEX_STORE_PRIV_H */
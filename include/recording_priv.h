@@ -0,0 +1,144 @@
+/*
+ * recording_priv.h
+ *
+ * file format of protected recordings
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_RECORDING_PRIV_H
+#define SRTP_RECORDING_PRIV_H
+
+#include "srtp_priv.h"
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern srtp_debug_module_t mod_recording;
+
+/*
+ * a recording is meant to be archived and read on other hosts, so unlike
+ * the index store all fields are in network order.
+ *
+ * The file starts with a header, followed by records, and ends with an
+ * index of the checkpoint records and a trailer once it has been closed:
+ *
+ *   header | record ... | index entry ... | trailer
+ *
+ * Every record starts with a record header and holds either a protected
+ * packet as it was received, or a checkpoint of the packet indices of all
+ * streams seen so far.  A checkpoint is written before the first packet
+ * and then after every checkpoint_interval packets, so the packets
+ * between two checkpoints, a segment, can be unprotected on their own.
+ * A recording without a trailer, e.g. of a writer that crashed, is read by
+ * scanning the records up to the last complete one.
+ */
+#define SRTP_RECORDING_MAGIC "SRTPREC"
+#define SRTP_RECORDING_TRAILER_MAGIC "SRTPEND"
+#define SRTP_RECORDING_VERSION 1
+
+/* magic, version and reserved */
+#define SRTP_RECORDING_HEADER_LEN 16
+/* type, reserved, length and time in microseconds */
+#define SRTP_RECORDING_RECORD_HEADER_LEN 16
+/* a checkpoint is a count followed by the streams */
+#define SRTP_RECORDING_CHECKPOINT_LEN 4
+/* SSRC, ROC, extended index, MKI index and flags */
+#define SRTP_RECORDING_STREAM_LEN 24
+/* time, offset and number of the first packet of a checkpoint */
+#define SRTP_RECORDING_INDEX_ENTRY_LEN 24
+/* index offset, number of checkpoints, reserved and magic */
+#define SRTP_RECORDING_TRAILER_LEN 24
+
+typedef enum {
+    srtp_recording_record_rtp = 1,
+    srtp_recording_record_rtcp = 2,
+    srtp_recording_record_checkpoint = 3,
+} srtp_recording_record_type_t;
+
+/* the stream has received a packet, index is valid */
+#define SRTP_RECORDING_STREAM_SEEN 1
+
+/*
+ * the state of a stream in the writer and in a checkpoint: index is the
+ * highest extended RTP index seen, or ROC << 16 for a stream whose ROC
+ * was set before its first packet
+ */
+typedef struct {
+    uint32_t ssrc; /* host order */
+    uint64_t index;
+    uint32_t mki_index;
+    uint32_t flags;
+} srtp_recording_stream_t;
+
+/* a checkpoint as found in the index */
+typedef struct {
+    uint64_t time_us;
+    uint64_t offset;
+    uint64_t first_packet;
+} srtp_recording_checkpoint_t;
+
+struct srtp_recording_t {
+    FILE *file;
+    uint64_t offset; /* end of the last record */
+    uint64_t last_time_us;
+    uint64_t num_packets;
+    size_t checkpoint_interval;
+    size_t packets_since_checkpoint;
+    bool checkpoint_pending;
+    srtp_recording_stream_t *streams;
+    size_t num_streams;
+    size_t max_streams;
+    srtp_recording_checkpoint_t *checkpoints;
+    size_t num_checkpoints;
+    size_t max_checkpoints;
+};
+
+struct srtp_recording_reader_t {
+    char *path;
+    srtp_recording_checkpoint_t *checkpoints;
+    size_t num_checkpoints;
+    uint64_t end; /* end of the last record */
+};
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_RECORDING_PRIV_H */
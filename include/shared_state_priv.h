@@ -0,0 +1,178 @@
+/*
+ * shared_state_priv.h
+ *
+ * replay and rollover counter state shared between processes
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_SHARED_STATE_PRIV_H
+#define SRTP_SHARED_STATE_PRIV_H
+
+#include "srtp_priv.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern srtp_debug_module_t mod_shared_state;
+
+/*
+ * the shared state file starts with a header followed by num_slots slots.
+ * each process maps the file at its own address, so the file holds no
+ * pointers: slots are located by their offset from the end of the header
+ * and each is followed by the num_words words of its RTP replay window.
+ */
+#define SRTP_SHARED_STATE_MAGIC "SRTPSHM"
+#define SRTP_SHARED_STATE_VERSION 2
+
+/*
+ * a lock is zero or identifies its owner by process id in the low 32 bits
+ * and by the start time of the process in the high 32 bits, so that a
+ * process that reuses the id of a dead owner is not taken for it
+ */
+typedef struct srtp_shared_state_header_t {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_slots;
+    uint32_t num_words; /* capacity of a slot's RTP replay window */
+    uint32_t reserved;
+    uint64_t lock; /* serializes claiming and freeing slots */
+} srtp_shared_state_header_t;
+
+/*
+ * a slot holds the replay database and extended RTP index of one SSRC.
+ * refs counts the streams of all processes that use the slot, it is free
+ * when refs is zero.  dirty is set while the owner of lock writes the
+ * slot so that a process that takes over the lock of a crashed owner
+ * knows the state may be torn.  generation counts the writes, it is zero
+ * as long as no process has written the slot.
+ */
+struct srtp_shared_slot_t {
+    uint64_t lock;
+    uint32_t ssrc; /* in network order */
+    uint32_t refs;
+    uint32_t dirty;
+    uint32_t reserved;
+    uint64_t generation;
+    uint64_t rtp_index;
+    srtp_rdb_t rtcp_rdb;
+    uint32_t rtp_bitmask[];
+};
+
+/*
+ * srtp_shared_state_alloc(state, path, max_streams, window_size) maps the
+ * shared state file at path, creating it with room for max_streams
+ * streams whose replay window is at most window_size packets if it does
+ * not exist
+ */
+srtp_err_status_t srtp_shared_state_alloc(srtp_shared_state_t **state,
+                                          const char *path,
+                                          size_t max_streams,
+                                          size_t window_size);
+
+/*
+ * srtp_shared_state_dealloc(state) unmaps the file, the state stays in the
+ * file for the other processes
+ */
+void srtp_shared_state_dealloc(srtp_shared_state_t *state);
+
+/*
+ * srtp_shared_state_claim(state, ssrc, create, slot) takes a reference to
+ * the slot of ssrc (in network order) and sets slot to it.  if ssrc has
+ * no slot yet, a free one is claimed for it if create is true, otherwise
+ * srtp_err_status_no_ctx is returned.  returns srtp_err_status_alloc_fail
+ * if all slots are in use.
+ */
+srtp_err_status_t srtp_shared_state_claim(srtp_shared_state_t *state,
+                                          uint32_t ssrc,
+                                          bool create,
+                                          srtp_shared_slot_t **slot);
+
+/*
+ * srtp_shared_state_unclaim(state, slot) drops a reference taken by
+ * srtp_shared_state_claim(), the slot is freed with its last reference
+ */
+void srtp_shared_state_unclaim(srtp_shared_state_t *state,
+                               srtp_shared_slot_t *slot);
+
+/*
+ * srtp_shared_state_lock(state, slot) waits until this process owns slot,
+ * srtp_shared_state_unlock(slot) releases it
+ */
+void srtp_shared_state_lock(const srtp_shared_state_t *state,
+                            srtp_shared_slot_t *slot);
+
+void srtp_shared_state_unlock(srtp_shared_slot_t *slot);
+
+/*
+ * srtp_shared_state_load(state, slot, stream) copies the state of the
+ * locked slot to stream, unless the slot has not been written yet or
+ * stream was the last one to write it
+ */
+srtp_err_status_t srtp_shared_state_load(const srtp_shared_state_t *state,
+                                         srtp_shared_slot_t *slot,
+                                         srtp_stream_ctx_t *stream);
+
+/*
+ * srtp_shared_state_store(state, slot, stream) copies the state of stream
+ * to the locked slot
+ */
+srtp_err_status_t srtp_shared_state_store(const srtp_shared_state_t *state,
+                                          srtp_shared_slot_t *slot,
+                                          srtp_stream_ctx_t *stream);
+
+/*
+ * srtp_shared_state_merge(state, slot, stream) adds the indices recorded
+ * in the locked slot to the replay databases of a stream that accepted
+ * packets before it had the slot.  returns srtp_err_status_replay_fail if
+ * the stream accepted an index that the slot had recorded.
+ */
+srtp_err_status_t srtp_shared_state_merge(const srtp_shared_state_t *state,
+                                          const srtp_shared_slot_t *slot,
+                                          srtp_stream_ctx_t *stream);
+
+/*
+ * srtp_shared_state_is_set(slot) returns true if a process has written
+ * the state of slot
+ */
+bool srtp_shared_state_is_set(const srtp_shared_slot_t *slot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_SHARED_STATE_PRIV_H */
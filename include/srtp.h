@@ -95,6 +95,24 @@ extern "C" {
  */
 #define SRTP_MAX_TRAILER_LEN (SRTP_MAX_TAG_LEN + SRTP_MAX_MKI_LEN)
 
+/**
+ * SRTP_TX_CACHE_DEFAULT_PACKET_LEN is the largest RTP packet that is kept
+ * in the retransmission cache when the policy does not set
+ * tx_cache_max_packet_len.
+ */
+#define SRTP_TX_CACHE_DEFAULT_PACKET_LEN 1500
+
+/**
+ * SRTP_MAX_EKT_FIELD_LEN is the maximum length of the EKTField (RFC 8870)
+ * that srtp_protect() appends to an SRTP packet when the stream has an
+ * EKT policy.  It is the length of a FullEKTField carrying an AES Key
+ * Wrap encrypted 256-bit master key.  This is in addition to
+ * SRTP_MAX_TRAILER_LEN.
+ *
+ * @brief the maximum number of octets added by EKT.
+ */
+#define SRTP_MAX_EKT_FIELD_LEN 63
+
 /**
  * SRTP_SRCTP_INDEX_LEN is the size the SRTCP index which is
  * 4 bytes
@@ -216,6 +234,8 @@ typedef enum {
     srtp_err_status_pkt_idx_adv = 27,   /**< packet index advanced, reset    */
                                         /**< needed                          */
     srtp_err_status_buffer_small = 28,  /**< out buffer is too small         */
+    srtp_err_status_quota_fail = 29,    /**< the session quota refused a     */
+                                        /**< new stream                      */
 } srtp_err_status_t;
 
 typedef struct srtp_ctx_t_ srtp_ctx_t;
@@ -300,6 +320,46 @@ typedef struct srtp_master_key_t {
     uint8_t *mki_id;
 } srtp_master_key_t;
 
+/**
+ * @brief srtp_ekt_cipher_t identifies the EKT cipher that protects the
+ * master key carried in an EKTField (RFC 8870 Section 4.4).
+ */
+typedef enum {
+    srtp_ekt_cipher_aeskw_128 = 0, /**< AES Key Wrap, 128-bit EKTKey */
+    srtp_ekt_cipher_aeskw_256 = 1  /**< AES Key Wrap, 256-bit EKTKey */
+} srtp_ekt_cipher_t;
+
+/**
+ * @brief represents the Encrypted Key Transport (RFC 8870) policy of a
+ * stream.
+ *
+ * When a policy element has an EKT policy, srtp_protect() appends an
+ * EKTField to every SRTP packet of the stream.  A FullEKTField carrying
+ * the SRTP master key of the stream, its SSRC and its ROC encrypted with
+ * the EKTKey is sent with the first packet of each SSRC and then every
+ * full_field_interval packets; the other packets carry a ShortEKTField.
+ *
+ * srtp_unprotect() strips the EKTField again.  When an inbound template
+ * (SSRC_ANY_INBOUND) has an EKT policy, a FullEKTField received for an
+ * unknown SSRC creates a stream for that SSRC using the master key
+ * from the EKTField together with the master salt, crypto policies and
+ * other settings of the template.  The stream is only kept if the
+ * packet that carried the EKTField authenticates with that key.
+ *
+ * EKT requires a single master key (srtp_policy_t::key) and only applies
+ * to SRTP, SRTCP packets are not changed.
+ */
+typedef struct srtp_ekt_policy_t {
+    srtp_ekt_cipher_t cipher;   /**< EKT cipher protecting the master key */
+    const uint8_t *key;         /**< EKTKey, 16 or 32 octets depending   */
+                                /**< on cipher.                          */
+    uint16_t spi;               /**< Security Parameter Index of the     */
+                                /**< EKTKey.                             */
+    size_t full_field_interval; /**< Send a FullEKTField every this many */
+                                /**< packets, 0 sends it in every        */
+                                /**< packet.                             */
+} srtp_ekt_policy_t;
+
 /**
  * @brief represents the policy for an SRTP session.
  *
@@ -351,6 +411,17 @@ typedef struct srtp_policy_t {
     uint8_t *enc_xtn_hdr;       /**< List of header ids to encrypt.      */
     size_t enc_xtn_hdr_count;   /**< Number of entries in list of header */
                                 /**<  ids.                               */
+    size_t tx_cache_size;       /**< Number of protected RTP packets     */
+                                /**< kept per sending stream so that     */
+                                /**< retransmissions of unchanged        */
+                                /**< packets are answered without        */
+                                /**< re-protecting them, 0 disables the  */
+                                /**< cache.                              */
+    size_t tx_cache_max_packet_len; /**< Largest RTP packet that is      */
+                                /**< cached, 0 selects                   */
+                                /**< SRTP_TX_CACHE_DEFAULT_PACKET_LEN.   */
+    const srtp_ekt_policy_t *ekt; /**< Encrypted Key Transport policy,   */
+                                /**< NULL if EKT is not used.            */
     struct srtp_policy_t *next; /**< Pointer to next stream policy.      */
 } srtp_policy_t;
 
@@ -398,6 +469,9 @@ srtp_err_status_t srtp_shutdown(void);
  * need not be consecutive, but they @b must be out of order by less
  * than 2^15 = 32,768 packets.
  *
+ * If the stream has an EKT policy, an EKTField of at most
+ * SRTP_MAX_EKT_FIELD_LEN octets is appended to the SRTP packet.
+ *
  * @warning This function assumes that the RTP packet is aligned on a 32-bit
  * boundary.
  *
@@ -450,6 +524,11 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
  * need not be consecutive, but they @b must be out of order by less
  * than 2^15 = 32,768 packets.
  *
+ * If the stream, or the template for an unknown SSRC, has an EKT policy
+ * the EKTField at the end of the packet is removed before the packet is
+ * processed, and a FullEKTField for an unknown SSRC creates a stream for
+ * it (see srtp_ekt_policy_t).
+ *
  * @warning This function assumes that the SRTP packet is aligned on a
  * 32-bit boundary.
  *
@@ -476,6 +555,7 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
  *    - srtp_err_status_replay_fail if the SRTP packet is a replay (e.g. packet
  *                                  has already been processed and accepted).
  *    - srtp_err_status_bad_mki if the MKI in the packet is not a known MKI id
+ *    - srtp_err_status_parse_err if the EKTField of the packet is malformed.
  *    - [other]  if there has been an error in the cryptographic mechanisms.
  *
  */
@@ -485,6 +565,166 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
                                  uint8_t *rtp,
                                  size_t *rtp_len);
 
+/**
+ * @brief srtp_unprotect_token_t carries the result of
+ * srtp_unprotect_verify() to srtp_unprotect_decrypt() and
+ * srtp_unprotect_commit().
+ *
+ * Apart from index, the fields are internal to libSRTP and should not be
+ * modified by the application.
+ */
+typedef struct srtp_unprotect_token_t {
+    uint32_t ssrc;                 /**< SSRC of the packet, network order  */
+    uint64_t index;                /**< Packet index, ROC << 16 | SEQ      */
+    size_t session_keys_index;     /**< Master key used by the packet      */
+    size_t srtp_len;               /**< Length of the verified SRTP packet */
+    size_t enc_start;              /**< Offset of the encrypted portion    */
+    size_t rtp_len;                /**< Length of the resulting RTP packet */
+    const uint8_t *srtp;           /**< The verified SRTP packet           */
+    uint8_t tag[SRTP_MAX_TAG_LEN]; /**< Its authentication tag             */
+    size_t tag_len;                /**< Length of tag                      */
+    bool in_place;                 /**< Whether srtp was decrypted in place */
+    size_t in_place_len;           /**< Payload octets in clear in srtp    */
+} srtp_unprotect_token_t;
+
+/**
+ * @brief srtp_unprotect_verify() is the first step of the split
+ * receiver-side packet processing.
+ *
+ * The function call srtp_unprotect_verify(ctx, srtp, srtp_len, token)
+ * performs the replay check and the message authentication check of
+ * srtp_unprotect() on the SRTP packet pointed to by srtp, without
+ * decrypting it and without updating the replay database.  On success
+ * token describes the packet, including its packet index.
+ *
+ * A packet that is needed in clear is then passed to
+ * srtp_unprotect_decrypt(), and every packet that is accepted must be
+ * passed to srtp_unprotect_commit() to be added to the replay database.
+ * Packets that are dropped after verification, e.g. late packets or
+ * packets that are only stored, never pay for the decryption.
+ *
+ * AEAD ciphers verify the tag in the same pass that decrypts the
+ * payload, so for AES-GCM streams this function returns
+ * srtp_err_status_cant_check and srtp_unprotect() should be used.  The
+ * same applies to sessions that use EKT.
+ *
+ * @param ctx is the SRTP session which applies to the particular packet.
+ *
+ * @param srtp is a pointer to the header of the SRTP packet.
+ *
+ * @param srtp_len is the length in octets of the complete srtp packet.
+ *
+ * @param token is a pointer to the token that is filled in if
+ * srtp_err_status_ok is returned.
+ *
+ * @return
+ *    - srtp_err_status_ok          if the SRTP packet is authentic.
+ *    - srtp_err_status_auth_fail   if the SRTP packet failed the message
+ *                                  authentication check.
+ *    - srtp_err_status_replay_fail if the SRTP packet is a replay.
+ *    - srtp_err_status_cant_check  if the stream uses an AEAD cipher or
+ *                                  EKT.
+ *    - [other]  if there has been an error in the cryptographic mechanisms.
+ */
+srtp_err_status_t srtp_unprotect_verify(srtp_t ctx,
+                                        const uint8_t *srtp,
+                                        size_t srtp_len,
+                                        srtp_unprotect_token_t *token);
+
+/**
+ * @brief srtp_unprotect_decrypt() decrypts a packet that passed
+ * srtp_unprotect_verify().
+ *
+ * The function call srtp_unprotect_decrypt(ctx, token, srtp, srtp_len, rtp,
+ * rtp_len) writes the RTP packet for the SRTP packet described by token to
+ * rtp.  srtp and srtp_len must be the unmodified packet, in the same
+ * buffer, that was passed to srtp_unprotect_verify(); rtp can be the same
+ * as srtp to support in-place io, and *rtp_len is the length of the rtp
+ * buffer before the call and of the RTP packet after it.
+ *
+ * The token is bound to the verified buffer and its authentication tag, so
+ * a packet that was not verified is rejected rather than decrypted.  It
+ * also records what a decryption in place has put in clear, so that only
+ * the rest is decrypted if the packet is passed in again, and a packet
+ * that is partly in clear can then only be decrypted in place.
+ *
+ * @return
+ *    - srtp_err_status_ok           if the packet was decrypted.
+ *    - srtp_err_status_bad_param    if srtp is not the packet that the
+ *                                   token was verified for, or if it was
+ *                                   partly decrypted in place and rtp is
+ *                                   not srtp.
+ *    - srtp_err_status_buffer_small if the rtp buffer is too small.
+ *    - srtp_err_status_no_ctx       if the stream no longer exists.
+ *    - [other]  if there has been an error in the cryptographic mechanisms.
+ */
+srtp_err_status_t srtp_unprotect_decrypt(srtp_t ctx,
+                                         srtp_unprotect_token_t *token,
+                                         const uint8_t *srtp,
+                                         size_t srtp_len,
+                                         uint8_t *rtp,
+                                         size_t *rtp_len);
+
+/**
+ * @brief srtp_unprotect_decrypt_prefix() decrypts the start of the payload
+ * of a packet that passed srtp_unprotect_verify().
+ *
+ * The function call srtp_unprotect_decrypt_prefix(ctx, token, srtp,
+ * srtp_len, payload_prefix_len, rtp, rtp_len) works like
+ * srtp_unprotect_decrypt(), but only the RTP header (including any
+ * encrypted header extensions) and the first payload_prefix_len octets of
+ * the payload are written to rtp, and *rtp_len is set to the length of
+ * that data.  With counter mode ciphers the rest of the payload is never
+ * touched, which lets a middlebox read e.g. a video payload descriptor to
+ * make a routing decision for the cost of a few octets of keystream.  If
+ * more of the payload turns out to be needed the function can be called
+ * again with a larger payload_prefix_len, or srtp_unprotect_decrypt() can
+ * be called for the whole packet; after a call in place (rtp == srtp)
+ * only the part of the payload that is still encrypted is decrypted then.
+ *
+ * The packet is still fully authenticated by srtp_unprotect_verify().  If
+ * the prefix was written to a separate buffer, the packet can be forwarded
+ * unchanged after srtp_unprotect_commit() when the next hop shares the
+ * keys.  A call in place puts any encrypted header extensions and the
+ * prefix in clear, so such a packet can only be decrypted further and
+ * must not be forwarded as SRTP.
+ *
+ * @return
+ *    - srtp_err_status_ok           if the prefix was decrypted.
+ *    - srtp_err_status_bad_param    if srtp is not the packet that the
+ *                                   token was verified for, or if it was
+ *                                   partly decrypted in place and rtp is
+ *                                   not srtp.
+ *    - srtp_err_status_buffer_small if the rtp buffer is too small.
+ *    - srtp_err_status_no_ctx       if the stream no longer exists.
+ *    - [other]  if there has been an error in the cryptographic mechanisms.
+ */
+srtp_err_status_t srtp_unprotect_decrypt_prefix(
+    srtp_t ctx,
+    srtp_unprotect_token_t *token,
+    const uint8_t *srtp,
+    size_t srtp_len,
+    size_t payload_prefix_len,
+    uint8_t *rtp,
+    size_t *rtp_len);
+
+/**
+ * @brief srtp_unprotect_commit() adds a packet that passed
+ * srtp_unprotect_verify() to the replay database.
+ *
+ * The replay check is repeated, so committing the same token twice, or
+ * two tokens for the same packet, fails with srtp_err_status_replay_fail.
+ * If the packet started a new stream from the session template, the
+ * stream is created here.
+ *
+ * @return
+ *    - srtp_err_status_ok          if the packet index was recorded.
+ *    - srtp_err_status_replay_fail if the packet index was already recorded.
+ *    - srtp_err_status_no_ctx      if the stream no longer exists.
+ */
+srtp_err_status_t srtp_unprotect_commit(srtp_t ctx,
+                                        const srtp_unprotect_token_t *token);
+
 /**
  * @brief srtp_create() allocates and initializes an SRTP session.
  *
@@ -508,6 +748,101 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
  */
 srtp_err_status_t srtp_create(srtp_t *session, const srtp_policy_t *policy);
 
+/**
+ * @brief srtp_stream_index_t holds the functions that index the streams
+ * of a session by SSRC.
+ *
+ * The index is an opaque pointer created by alloc.  SSRCs are in network
+ * byte order and streams are opaque.  insert is never called for an SSRC
+ * that is already indexed, and remove only for one that is.  for_each
+ * stops when callback returns false; callback may remove the stream it
+ * was called for but must not otherwise change the index.  dealloc
+ * returns an error if the index is not empty.
+ */
+struct srtp_stream_ctx_t_;
+
+typedef struct srtp_stream_index_t {
+    srtp_err_status_t (*alloc)(void **index);
+    srtp_err_status_t (*dealloc)(void *index);
+    srtp_err_status_t (*insert)(void *index,
+                                uint32_t ssrc,
+                                struct srtp_stream_ctx_t_ *stream);
+    struct srtp_stream_ctx_t_ *(*get)(void *index, uint32_t ssrc);
+    void (*remove)(void *index, uint32_t ssrc);
+    void (*for_each)(void *index,
+                     bool (*callback)(struct srtp_stream_ctx_t_ *stream,
+                                      void *data),
+                     void *data);
+} srtp_stream_index_t;
+
+/**
+ * @brief srtp_create_with_stream_index() allocates and initializes an SRTP
+ * session that indexes its streams with the given functions.
+ *
+ * The function behaves like srtp_create(), which uses the default index:
+ * an array that is searched linearly while the session has few streams
+ * and that is indexed by a hash table once it grows, so that small
+ * sessions stay small and sessions with thousands of streams find them
+ * in constant time.
+ *
+ * @param session is a pointer to the SRTP session to create.
+ *
+ * @param policy is the policy (list) of the session, see srtp_create().
+ *
+ * @param index is the stream index to use, or NULL for the default one.
+ * It has to stay valid for the lifetime of the session.
+ *
+ * @return
+ *    - srtp_err_status_ok           if creation succeeded.
+ *    - srtp_err_status_bad_param    if a function of index is NULL.
+ *    - srtp_err_status_alloc_fail   if allocation failed.
+ *    - srtp_err_status_init_fail    if initialization failed.
+ */
+srtp_err_status_t srtp_create_with_stream_index(
+    srtp_t *session,
+    const srtp_policy_t *policy,
+    const srtp_stream_index_t *index);
+
+/**
+ * @brief srtp_create_fixed() allocates and initializes an SRTP session of
+ * fixed capacity that does not allocate memory while processing packets.
+ *
+ * The function behaves like srtp_create(), but the session holds at most
+ * max_streams streams, including those of the policy, and all of its
+ * state is allocated up front: the stream index is sized for max_streams
+ * and, if the policy has a template (ssrc_any_inbound or
+ * ssrc_any_outbound), max_streams clones of it are prepared.  A stream
+ * for a new SSRC takes a prepared clone and srtp_stream_remove() returns
+ * it, so srtp_protect(), srtp_unprotect(), srtp_protect_rtcp() and
+ * srtp_unprotect_rtcp() neither allocate nor free memory and take no
+ * locks, unless srtp_shared_state_open() or srtp_trace_start() is used.
+ * They return srtp_err_status_alloc_fail for a new SSRC when the session
+ * is full.  Crypto backends may still allocate internally, e.g. the
+ * OpenSSL 3 HMAC when FIPS mode is enabled.
+ *
+ * srtp_stream_add(), srtp_update() and srtp_stream_update() may
+ * allocate.  Policies with EKT can not be used with a fixed capacity
+ * session.
+ *
+ * @param session is a pointer to the SRTP session to create.
+ *
+ * @param policy is the policy (list) of the session, see srtp_create().
+ *
+ * @param max_streams is the maximum number of streams of the session.
+ *
+ * @return
+ *    - srtp_err_status_ok           if creation succeeded.
+ *    - srtp_err_status_bad_param    if max_streams is 0, or the policy uses
+ *                                   EKT.
+ *    - srtp_err_status_alloc_fail   if allocation failed.
+ *    - srtp_err_status_init_fail    if initialization failed.
+ *    - srtp_err_status_no_such_op   if the library was built with its own
+ *                                   stream list (SRTP_NO_STREAM_LIST).
+ */
+srtp_err_status_t srtp_create_fixed(srtp_t *session,
+                                    const srtp_policy_t *policy,
+                                    size_t max_streams);
+
 /**
  * @brief srtp_stream_add() allocates and initializes an SRTP stream
  * within a given SRTP session.
@@ -551,6 +886,41 @@ srtp_err_status_t srtp_stream_add(srtp_t session, const srtp_policy_t *policy);
  */
 srtp_err_status_t srtp_stream_remove(srtp_t session, uint32_t ssrc);
 
+/**
+ * @brief srtp_stream_add_repair() adds a repair stream bound to a media
+ * stream.
+ *
+ * The function call srtp_stream_add_repair(session, media_ssrc,
+ * repair_ssrc) adds a stream for repair_ssrc, such as an RTX (RFC 4588)
+ * or FlexFEC (RFC 8627) stream, that is protected with the session keys
+ * of the existing stream of media_ssrc.  The repair stream shares the
+ * cipher and auth contexts and the key usage limit of the media stream
+ * and keeps only its own packet index and a 64 packet replay window,
+ * instead of a clone of the session keys.
+ *
+ * A repair stream follows its media stream through srtp_update() and
+ * srtp_stream_update(), and is removed with it by srtp_stream_remove().
+ * It can be removed on its own with srtp_stream_remove(session,
+ * repair_ssrc).
+ *
+ * @param session is the SRTP session.
+ *
+ * @param media_ssrc is the SSRC of the media stream, in host byte order.
+ *
+ * @param repair_ssrc is the SSRC of the repair stream, in host byte order.
+ *
+ * @return
+ *    - srtp_err_status_ok         if the repair stream was added.
+ *    - srtp_err_status_no_ctx     if there is no stream for media_ssrc.
+ *    - srtp_err_status_bad_param  if the media stream is a repair stream
+ *                                 itself or there already is a stream for
+ *                                 repair_ssrc.
+ *    - srtp_err_status_alloc_fail if allocation failed.
+ */
+srtp_err_status_t srtp_stream_add_repair(srtp_t session,
+                                         uint32_t media_ssrc,
+                                         uint32_t repair_ssrc);
+
 /**
  * @brief srtp_update() updates all streams in the session.
  *
@@ -1421,6 +1791,44 @@ typedef void(srtp_log_handler_func_t)(srtp_log_level_t level,
 srtp_err_status_t srtp_install_log_handler(srtp_log_handler_func_t func,
                                            void *data);
 
+/**
+ * @brief starts recording API calls to a trace file.
+ *
+ * The function call srtp_trace_start(path) records the calls of
+ * srtp_create(), srtp_dealloc(), srtp_stream_add(), srtp_stream_update()
+ * (and so srtp_update()), srtp_stream_remove(), srtp_protect(),
+ * srtp_unprotect(), srtp_protect_rtcp() and srtp_unprotect_rtcp() of all
+ * sessions to the file at path, until srtp_trace_stop() is called.  Each
+ * record holds the time, duration and result of the call and the policy
+ * or packet metadata without keys or payloads.  The srtp_replay test
+ * application re-drives libSRTP from a trace with synthetic keys and
+ * payloads.
+ *
+ * Sessions are identified in the trace by a number that srtp_create()
+ * assigns, not by their address.  Calls can be made from several threads
+ * while a trace runs, each record is written whole with one fwrite(),
+ * and srtp_trace_stop() waits for the records that are being written.
+ *
+ * @param path is the name of the trace file, it is overwritten.
+ *
+ * @return
+ *    - srtp_err_status_ok         on success
+ *    - srtp_err_status_bad_param  if a trace is already running
+ *    - srtp_err_status_write_fail if the file cannot be created
+ */
+srtp_err_status_t srtp_trace_start(const char *path);
+
+/**
+ * @brief stops recording API calls.
+ *
+ * The function call srtp_trace_stop() flushes and closes the trace file.
+ *
+ * returns srtp_err_status_ok on success, srtp_err_status_bad_param if no
+ * trace is running, srtp_err_status_write_fail if the trace could not be
+ * written completely.
+ */
+srtp_err_status_t srtp_trace_stop(void);
+
 /**
  * @brief srtp_get_protect_trailer_length(session, use_mki, mki_index, length)
  *
@@ -1478,6 +1886,647 @@ srtp_err_status_t srtp_stream_get_roc(srtp_t session,
                                       uint32_t ssrc,
                                       uint32_t *roc);
 
+/**
+ * @brief srtp_stream_find_roc(session, srtp, srtp_len, roc_estimate,
+ * max_distance, roc)
+ *
+ * Find the roll-over-counter an SRTP packet was protected with, for the
+ * first packet of a stream that joined mid-call, e.g. in a capture.  The
+ * ROCs from roc_estimate - max_distance to roc_estimate + max_distance
+ * are tried in the order of their distance from roc_estimate and the
+ * first one for which the tag of the packet verifies is set on the stream
+ * of the packet as srtp_stream_set_roc() would, so that srtp_unprotect()
+ * of the packet then succeeds.  A stream is created from the template of
+ * the session if there is none for the SSRC of the packet yet.
+ *
+ * The packet is hashed once and every candidate then only costs hashing
+ * its ROC, or one decryption for an AEAD cipher.  The packet is not
+ * changed.
+ *
+ * @param roc is set to the ROC that was found.
+ *
+ * @return
+ *    - srtp_err_status_ok          if a ROC was found
+ *    - srtp_err_status_auth_fail   if the tag verifies with none of them
+ *    - srtp_err_status_no_ctx      if there is no stream for the packet
+ *    - srtp_err_status_cant_check  if the stream does not authenticate RTP
+ *                                  or the session uses EKT or shared state
+ *    - @e other                    errors of srtp_unprotect()
+ */
+srtp_err_status_t srtp_stream_find_roc(srtp_t session,
+                                       const uint8_t *srtp,
+                                       size_t srtp_len,
+                                       uint32_t roc_estimate,
+                                       uint32_t max_distance,
+                                       uint32_t *roc);
+
+/**
+ * @brief srtp_set_stream_rocs(session, ssrcs, rocs, count)
+ *
+ * Sets the roll-over-counters of the streams with the count SSRCs in
+ * ssrcs to the values in rocs, as srtp_stream_set_roc() does for one SSRC.
+ * The streams are looked up in one pass over the stream index.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param if there is no
+ * stream for one of the SSRCs, the others are set nonetheless
+ *
+ */
+srtp_err_status_t srtp_set_stream_rocs(srtp_t session,
+                                       const uint32_t *ssrcs,
+                                       const uint32_t *rocs,
+                                       size_t count);
+
+/**
+ * @brief srtp_get_stream_rocs(session, ssrcs, rocs, count)
+ *
+ * Gets the roll-over-counters of the streams with the count SSRCs in ssrcs
+ * into rocs, as srtp_stream_get_roc() does for one SSRC.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param if there is no
+ * stream for one of the SSRCs, whose entry in rocs is left unchanged
+ *
+ */
+srtp_err_status_t srtp_get_stream_rocs(srtp_t session,
+                                       const uint32_t *ssrcs,
+                                       uint32_t *rocs,
+                                       size_t count);
+
+/**
+ * @brief srtp_stream_sync_t is the packet index and replay state of a
+ * stream, which srtp_get_stream_sync() and srtp_set_stream_sync() move
+ * between sessions, e.g. to a standby after failover.
+ *
+ * Bit i of replay, replay[0] holding bits 0 to 63, is set if the RTP
+ * packet with index - i was received.  A replay window of more than 128
+ * packets keeps the older packets as received when it is set.  The SRTCP
+ * state is the SRTCP index and replay window in an opaque form.
+ */
+typedef struct srtp_stream_sync_t {
+    uint32_t ssrc;            /**< SSRC of the stream, in host order    */
+    uint64_t index;           /**< RTP packet index, ROC << 16 | SEQ    */
+    uint64_t replay[2];       /**< RTP replay window                    */
+    uint32_t rtcp_index;      /**< SRTCP replay window start            */
+    uint64_t rtcp_replay[2];  /**< SRTCP replay window                  */
+    srtp_err_status_t status; /**< result for this stream               */
+} srtp_stream_sync_t;
+
+/**
+ * @brief srtp_get_stream_sync(session, sync, count)
+ *
+ * Gets the packet index and replay state of the streams with the SSRCs in
+ * the count entries of sync, in one pass over the stream index.  The
+ * status of an entry is srtp_err_status_ok, or srtp_err_status_no_ctx if
+ * the session has no stream for its SSRC.
+ *
+ * returns err_status_ok if all streams were found, srtp_err_status_no_ctx
+ * if one was not, or srtp_err_status_alloc_fail
+ *
+ */
+srtp_err_status_t srtp_get_stream_sync(srtp_t session,
+                                       srtp_stream_sync_t *sync,
+                                       size_t count);
+
+/**
+ * @brief srtp_set_stream_sync(session, sync, count)
+ *
+ * Sets the packet index and replay state of the streams with the SSRCs in
+ * the count entries of sync, in one pass over the stream index.  Unlike
+ * srtp_stream_set_roc() the state takes effect at once.  The status of an
+ * entry is srtp_err_status_ok, srtp_err_status_no_ctx if the session has
+ * no stream for its SSRC, or srtp_err_status_replay_old if the index would
+ * move the stream back to an earlier roll-over-counter.
+ *
+ * returns err_status_ok if the state of all streams was set, otherwise the
+ * status of the first entry that failed, or srtp_err_status_alloc_fail
+ *
+ */
+srtp_err_status_t srtp_set_stream_sync(srtp_t session,
+                                       srtp_stream_sync_t *sync,
+                                       size_t count);
+
+/**
+ * @brief srtp_stream_get_tx_cache_stats(session, ssrc, hits, misses)
+ *
+ * Get the retransmission cache counters of the stream with the given SSRC.
+ * hits counts packets that srtp_protect() answered from the cache, misses
+ * counts retransmissions that had to be protected again because the
+ * cached copy was evicted or the packet had changed.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param if there is no
+ * stream found or the stream has no retransmission cache
+ *
+ */
+srtp_err_status_t srtp_stream_get_tx_cache_stats(srtp_t session,
+                                                 uint32_t ssrc,
+                                                 uint64_t *hits,
+                                                 uint64_t *misses);
+
+/**
+ * @brief srtp_index_store_open(session, path, max_streams, margin)
+ *
+ * Persist the packet indices of the sending streams of a session in the
+ * file at path, so that a process restarted with the same master keys
+ * does not reuse an RTP or SRTCP index.  The file is memory mapped and
+ * holds max_streams slots, it is created if it does not exist.
+ *
+ * Each sending stream claims a slot on its first protected packet and
+ * records an index limit that is kept margin packets ahead of the index
+ * in use; no system call is made per packet.  A stream that finds its
+ * SSRC in the file resumes at or beyond the recorded limits: its SRTCP
+ * index continues at the SRTCP limit, and its ROC is the lowest one that
+ * puts the index of its first RTP packet at or beyond the RTP limit.
+ * srtp_index_store_get_resume() returns the limits before the first
+ * packet is sent.  A sender that continues its sequence numbers from
+ * the RTP limit keeps the ROC that its receivers expect, otherwise they
+ * have to learn the new ROC, for example from an EKT FullEKTField or by
+ * signaling srtp_stream_get_roc().
+ *
+ * srtp_stream_remove() frees the slot of the stream for another SSRC;
+ * as without an index store, the SSRC of a removed stream must not be
+ * used again with the same master key.  srtp_dealloc() keeps the slots,
+ * since they are what a restarted process resumes from.
+ *
+ * Checkpoints reach the file when the process exits, use
+ * srtp_index_store_sync() periodically to also survive a system crash;
+ * margin has to cover the packets sent between two syncs.  The file is
+ * only valid for the master keys it was used with and has to be removed
+ * when they change.
+ *
+ * @param session is the session to persist.
+ *
+ * @param path is the file name of the index store.
+ *
+ * @param max_streams is the number of slots, it has to match an existing
+ * file.
+ *
+ * @param margin is the number of packets an index limit is kept ahead.
+ *
+ * @return
+ *    - srtp_err_status_ok         on success
+ *    - srtp_err_status_bad_param  on invalid parameters or if the session
+ *                                 already has an index store
+ *    - srtp_err_status_read_fail  if the file cannot be opened or mapped
+ *    - srtp_err_status_parse_err  if the file is not a matching index store
+ *    - srtp_err_status_no_such_op if memory mapped files are not supported
+ *
+ * srtp_protect() and srtp_protect_rtcp() return srtp_err_status_alloc_fail
+ * for a new stream while all slots are used.
+ */
+srtp_err_status_t srtp_index_store_open(srtp_t session,
+                                        const char *path,
+                                        size_t max_streams,
+                                        uint32_t margin);
+
+/**
+ * @brief srtp_index_store_sync(session)
+ *
+ * Write the index store of a session to stable storage.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param if the
+ * session has no index store, srtp_err_status_write_fail if the file could
+ * not be written
+ *
+ */
+srtp_err_status_t srtp_index_store_sync(srtp_t session);
+
+/**
+ * @brief srtp_index_store_get_resume(session, ssrc, rtp_index, rtcp_index)
+ *
+ * Get the RTP packet index and the SRTCP index from which the sending
+ * stream for ssrc (in host order) resumes, or can resume once it is
+ * removed and the process restarted.  Any index below these may have
+ * been used by an earlier process.  The sequence number of the first RTP
+ * packet of a resumed stream is best chosen as rtp_index & 0xffff, which
+ * keeps the ROC at rtp_index >> 16.
+ *
+ * @return
+ *    - srtp_err_status_ok         on success
+ *    - srtp_err_status_bad_param  if the session has no index store
+ *    - srtp_err_status_no_ctx     if the index store has no slot for ssrc
+ */
+srtp_err_status_t srtp_index_store_get_resume(srtp_t session,
+                                              uint32_t ssrc,
+                                              uint64_t *rtp_index,
+                                              uint32_t *rtcp_index);
+
+/**
+ * @brief srtp_shared_state_open(session, path, max_streams, window_size)
+ *
+ * Share the replay databases and rollover counters of a session with
+ * other processes that open the same file, so that any of them can
+ * protect or unprotect any packet of the session.  Each process creates
+ * its own session with the same policies and calls this function after
+ * it has been forked; a file in /dev/shm keeps the state in POSIX shared
+ * memory.
+ *
+ * The file holds max_streams slots located by offset, one per SSRC, and
+ * is created if it does not exist.  A slot is claimed by the streams of
+ * all processes that have a stream for its SSRC: streams of the policy,
+ * streams added with srtp_stream_add(), streams protected from the
+ * template and streams that accepted an authenticated packet.  It is
+ * freed when the last of them is removed or its session deallocated, so
+ * packets that fail authentication never take a slot.
+ *
+ * srtp_protect(), srtp_unprotect(), srtp_protect_rtcp() and
+ * srtp_unprotect_rtcp() lock the slot of the packet's SSRC for the
+ * duration of the call and copy the state of the stream from and back to
+ * it.  A stream that accepts the first packet of an SSRC without a slot
+ * merges its state with the slot it then claims and returns
+ * srtp_err_status_replay_fail if another process accepted the same
+ * packet meanwhile.  A process that waits for the lock of a process that
+ * exited takes the lock over; the owner of a lock is identified by its
+ * process id and start time, so that a new process reusing the id is not
+ * mistaken for it.  If the state was being written, all indices in the
+ * replay windows are treated as seen.
+ *
+ * srtp_unprotect_verify() returns srtp_err_status_cant_check for a
+ * session with shared state, and streams with an EKT policy can not be
+ * used with it.
+ *
+ * @param session is the session whose state is shared.
+ *
+ * @param path is the file name of the shared state.
+ *
+ * @param max_streams is the number of slots, it has to match an existing
+ * file.
+ *
+ * @param window_size is the largest replay window size of the session's
+ * streams, it has to match an existing file.
+ *
+ * @return
+ *    - srtp_err_status_ok         on success
+ *    - srtp_err_status_bad_param  on invalid parameters, if the session
+ *                                 already has shared state or uses EKT
+ *    - srtp_err_status_read_fail  if the file cannot be opened or mapped
+ *    - srtp_err_status_parse_err  if the file is not a matching state file
+ *    - srtp_err_status_alloc_fail if the streams of the session need more
+ *                                 slots than are free
+ *    - srtp_err_status_no_such_op if shared state is not supported
+ *
+ * Adding a stream and the packet functions return
+ * srtp_err_status_alloc_fail for a new SSRC when all slots are used.
+ */
+srtp_err_status_t srtp_shared_state_open(srtp_t session,
+                                         const char *path,
+                                         size_t max_streams,
+                                         size_t window_size);
+
+typedef struct srtp_recording_t srtp_recording_t;
+typedef struct srtp_recording_reader_t srtp_recording_reader_t;
+
+/**
+ * @brief srtp_recording_create(recording, path, checkpoint_interval)
+ *
+ * Create a recording of protected packets in the file at path.  Packets
+ * are appended as they were received, without unprotecting them, and
+ * every checkpoint_interval packets a checkpoint of the SSRC, ROC,
+ * extended packet index and MKI of every RTP stream is written, so that
+ * srtp_recording_decrypt() can start at any checkpoint instead of at the
+ * beginning of the recording.  srtp_recording_close() writes an index of
+ * the checkpoints; a recording that was not closed can still be read.
+ *
+ * The indices of the streams are estimated from the sequence numbers the
+ * way a receiver does, starting at ROC 0 unless srtp_recording_set_roc()
+ * is called before the first packet of the stream.  All fields of the
+ * file are in network order.
+ *
+ * @param recording is set to the new recording.
+ *
+ * @param path is the file name of the recording, an existing file is
+ * replaced.
+ *
+ * @param checkpoint_interval is the number of packets between two
+ * checkpoints, it bounds the packets that are unprotected before the first
+ * requested one.
+ *
+ * @return
+ *    - srtp_err_status_ok          on success
+ *    - srtp_err_status_bad_param   on invalid parameters
+ *    - srtp_err_status_alloc_fail  if memory could not be allocated
+ *    - srtp_err_status_write_fail  if the file could not be written
+ */
+srtp_err_status_t srtp_recording_create(srtp_recording_t **recording,
+                                        const char *path,
+                                        size_t checkpoint_interval);
+
+/**
+ * @brief srtp_recording_set_roc(recording, ssrc, roc)
+ *
+ * Set the ROC of the stream with SSRC ssrc, in host order, for a stream
+ * that did not start at ROC 0, e.g. when recording joins a running
+ * session.  It has to be called before the first packet of the stream is
+ * appended and writes a checkpoint.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param if a packet
+ * of the stream was already appended, or an error of
+ * srtp_recording_append()
+ */
+srtp_err_status_t srtp_recording_set_roc(srtp_recording_t *recording,
+                                         uint32_t ssrc,
+                                         uint32_t roc);
+
+/**
+ * @brief srtp_recording_append(recording, packet, len, is_rtcp, time_us,
+ * mki_index)
+ *
+ * Append a protected SRTP (or SRTCP, if is_rtcp is set) packet received at
+ * time_us microseconds to a recording.  The times of the packets have to
+ * be non-decreasing; they are what srtp_recording_seek() searches.
+ * mki_index is the index of the master key the packet was protected with,
+ * it is kept in the checkpoints.
+ *
+ * @return
+ *    - srtp_err_status_ok          on success
+ *    - srtp_err_status_bad_param   if the packet is too short or longer than
+ *                                  65535 octets, or time_us is earlier than
+ *                                  the time of the previous packet
+ *    - srtp_err_status_alloc_fail  if memory could not be allocated
+ *    - srtp_err_status_write_fail  if the file could not be written
+ */
+srtp_err_status_t srtp_recording_append(srtp_recording_t *recording,
+                                        const uint8_t *packet,
+                                        size_t len,
+                                        bool is_rtcp,
+                                        uint64_t time_us,
+                                        size_t mki_index);
+
+/**
+ * @brief srtp_recording_close(recording)
+ *
+ * Write the index of the checkpoints of a recording, close its file and
+ * free it.  The recording is freed even if the index could not be written.
+ *
+ * returns err_status_ok on success, srtp_err_status_write_fail if the file
+ * could not be written
+ */
+srtp_err_status_t srtp_recording_close(srtp_recording_t *recording);
+
+/**
+ * @brief srtp_recording_packet_t is a packet that srtp_recording_decrypt()
+ * passes to its callback.
+ *
+ * If status is srtp_err_status_ok, data and len are the unprotected
+ * packet, otherwise they are the packet as it was recorded.
+ */
+typedef struct srtp_recording_packet_t {
+    uint64_t number;          /**< number of the packet in the recording */
+    uint64_t time_us;         /**< time the packet was recorded at       */
+    bool is_rtcp;             /**< whether the packet is SRTCP           */
+    const uint8_t *data;      /**< the packet                            */
+    size_t len;               /**< length of the packet in octets        */
+    srtp_err_status_t status; /**< result of unprotecting the packet     */
+} srtp_recording_packet_t;
+
+/**
+ * @brief srtp_recording_packet_func_t is the callback of
+ * srtp_recording_decrypt(), packet is only valid during the call.
+ */
+typedef void (*srtp_recording_packet_func_t)(
+    void *user_data,
+    const srtp_recording_packet_t *packet);
+
+/**
+ * @brief srtp_recording_open(reader, path)
+ *
+ * Open the recording at path for reading.  The index of a closed
+ * recording is read from its end, the one of a recording that was not
+ * closed is rebuilt by scanning the file.  The file is not kept open;
+ * every srtp_recording_decrypt() call opens its own handle, so a reader
+ * can be used by several threads at once to unprotect different segments
+ * in parallel.
+ *
+ * @return
+ *    - srtp_err_status_ok          on success
+ *    - srtp_err_status_bad_param   on invalid parameters
+ *    - srtp_err_status_alloc_fail  if memory could not be allocated
+ *    - srtp_err_status_read_fail   if the file could not be read
+ *    - srtp_err_status_parse_err   if the file is not a recording
+ */
+srtp_err_status_t srtp_recording_open(srtp_recording_reader_t **reader,
+                                      const char *path);
+
+/**
+ * @brief srtp_recording_reader_close(reader)
+ *
+ * Free a reader opened with srtp_recording_open().
+ */
+void srtp_recording_reader_close(srtp_recording_reader_t *reader);
+
+/**
+ * @brief srtp_recording_get_segment_count(reader)
+ *
+ * Returns the number of segments of a recording, each of which starts at
+ * a checkpoint and can be unprotected independently of the others.
+ */
+size_t srtp_recording_get_segment_count(const srtp_recording_reader_t *reader);
+
+/**
+ * @brief srtp_recording_get_segment(reader, segment, time_us, first_packet)
+ *
+ * Get the time of the checkpoint that starts a segment and the number of
+ * its first packet.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param if there is
+ * no such segment
+ */
+srtp_err_status_t srtp_recording_get_segment(
+    const srtp_recording_reader_t *reader,
+    size_t segment,
+    uint64_t *time_us,
+    uint64_t *first_packet);
+
+/**
+ * @brief srtp_recording_seek(reader, time_us, segment)
+ *
+ * Find the first segment that holds packets recorded at time_us, the last
+ * one that starts before it, with a binary search of the index.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param if the
+ * recording has no segments
+ */
+srtp_err_status_t srtp_recording_seek(const srtp_recording_reader_t *reader,
+                                      uint64_t time_us,
+                                      size_t *segment);
+
+/**
+ * @brief srtp_recording_decrypt(reader, policy, segment, start_us, end_us,
+ * func, user_data)
+ *
+ * Unprotect the packets of a segment that were recorded at or after
+ * start_us and before end_us, and pass each of them to func.  A session
+ * is created from policy, which normally uses ssrc_any_inbound, and its
+ * streams are set to the indices of the checkpoint that starts the
+ * segment.  The packets of the segment before start_us are unprotected
+ * too, to track the indices, but not passed to func.
+ *
+ * Calls for different segments of the same reader may run in parallel,
+ * each on its own session, and func is called on the calling thread.
+ *
+ * @return
+ *    - srtp_err_status_ok          on success, including packets that
+ *                                  failed to unprotect
+ *    - srtp_err_status_bad_param   if there is no such segment
+ *    - srtp_err_status_read_fail   if the file could not be read
+ *    - srtp_err_status_parse_err   if the segment is corrupt
+ *    - @e other                    errors of srtp_create()
+ */
+srtp_err_status_t srtp_recording_decrypt(const srtp_recording_reader_t *reader,
+                                         const srtp_policy_t *policy,
+                                         size_t segment,
+                                         uint64_t start_us,
+                                         uint64_t end_us,
+                                         srtp_recording_packet_func_t func,
+                                         void *user_data);
+
+/**
+ * @brief srtp_stream_cost_t holds the sampled processing time of a stream
+ * or of a session.
+ *
+ * samples is the number of timed srtp_protect(), srtp_unprotect(),
+ * srtp_protect_rtcp() and srtp_unprotect_rtcp() calls and sampled_ns the
+ * sum of their durations in nanoseconds.  Multiplied by the sampling
+ * interval they estimate the total.
+ */
+typedef struct srtp_stream_cost_t {
+    uint32_t ssrc;       /**< SSRC of the stream, 0 for a session */
+    uint64_t samples;    /**< number of timed calls               */
+    uint64_t sampled_ns; /**< their total duration in nanoseconds */
+} srtp_stream_cost_t;
+
+/**
+ * @brief srtp_set_cost_sampling(session, interval)
+ *
+ * Time one in interval calls of srtp_protect(), srtp_unprotect(),
+ * srtp_protect_rtcp() and srtp_unprotect_rtcp() on the session and add
+ * the time to the session and to the stream of the packet's SSRC.  Failed
+ * calls are included.  An interval of 0, the default, turns sampling off;
+ * the sampled costs are kept.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param if session is
+ * NULL
+ *
+ */
+srtp_err_status_t srtp_set_cost_sampling(srtp_t session, uint32_t interval);
+
+/**
+ * @brief srtp_get_session_cost(session, cost)
+ *
+ * Get the sampled processing time of all calls on the session, including
+ * those for streams that have since been removed.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param on invalid
+ * parameters
+ *
+ */
+srtp_err_status_t srtp_get_session_cost(srtp_t session,
+                                        srtp_stream_cost_t *cost);
+
+/**
+ * @brief srtp_session_quota_usage_t is what the streams of a session
+ * have used of its quota.
+ */
+typedef struct srtp_session_quota_usage_t {
+    size_t streams;      /**< streams added for new SSRCs              */
+    size_t bytes;        /**< memory those streams allocated           */
+    uint64_t rejections; /**< streams refused since the session began */
+} srtp_session_quota_usage_t;
+
+/**
+ * @brief srtp_set_session_quota(session, max_streams, max_bytes)
+ *
+ * Limit the streams that the template of a session (ssrc_any_inbound or
+ * ssrc_any_outbound) or a FullEKTField adds for new SSRCs to max_streams
+ * streams and max_bytes octets of memory, so that a peer sending packets
+ * with ever new SSRCs can not make the session grow without bound.  A
+ * value of 0, the default, is no limit.  The memory of a clone of the
+ * template is charged before it is allocated, that of a stream added from
+ * an EKTField once its keys are set up, and both are released when the
+ * stream is removed; streams added with srtp_stream_add() are not
+ * charged.  A packet for which the quota refuses a stream fails with
+ * srtp_err_status_quota_fail.  Lowering the quota below its current use
+ * keeps the existing streams.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param if session is
+ * NULL
+ *
+ */
+srtp_err_status_t srtp_set_session_quota(srtp_t session,
+                                         size_t max_streams,
+                                         size_t max_bytes);
+
+/**
+ * @brief srtp_get_session_quota_usage(session, usage)
+ *
+ * Get the streams and memory charged to the quota of a session and the
+ * number of streams it refused.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param on invalid
+ * parameters
+ *
+ */
+srtp_err_status_t srtp_get_session_quota_usage(
+    srtp_t session,
+    srtp_session_quota_usage_t *usage);
+
+/**
+ * @brief srtp_get_top_stream_costs(session, costs, count)
+ *
+ * Get the streams of the session with the largest sampled processing
+ * time, most expensive first.  On input *count is the number of elements
+ * of costs, on output the number filled in.  Streams without samples are
+ * left out.
+ *
+ * returns err_status_ok on success, srtp_err_status_bad_param on invalid
+ * parameters
+ *
+ */
+srtp_err_status_t srtp_get_top_stream_costs(srtp_t session,
+                                            srtp_stream_cost_t *costs,
+                                            size_t *count);
+
+/**
+ * @brief srtp_hdr_xtn_element_t locates an RTP header extension element.
+ */
+typedef struct srtp_hdr_xtn_element_t {
+    uint32_t offset; /**< offset of the element data in the packet  */
+    uint8_t id;      /**< the element ID                            */
+    uint8_t length;  /**< length of the element data in octets      */
+} srtp_hdr_xtn_element_t;
+
+/**
+ * @brief srtp_get_header_extensions(rtp, rtp_len, elements, count)
+ *
+ * Index the elements of the RFC 8285 one-byte or two-byte header
+ * extension of an RTP packet in one pass, skipping padding.  This is the
+ * parser srtp_protect() and srtp_unprotect() use for header extension
+ * encryption; applications can use it to read extensions such as
+ * abs-send-time or transport-cc from a packet returned by
+ * srtp_unprotect().
+ *
+ * @param rtp is the RTP packet.
+ *
+ * @param rtp_len is the length of the packet in octets.
+ *
+ * @param elements receives the elements in packet order.
+ *
+ * @param count is the number of entries in elements on input and the
+ * number filled in on output; a packet without a header extension has
+ * none.
+ *
+ * @return
+ *    - srtp_err_status_ok           on success
+ *    - srtp_err_status_bad_param    on invalid parameters or if the RTP
+ *                                   header is truncated
+ *    - srtp_err_status_parse_err    if the header extension is malformed
+ *                                   or uses another format
+ *    - srtp_err_status_buffer_small if the packet has more elements than
+ *                                   fit into elements
+ */
+srtp_err_status_t srtp_get_header_extensions(const uint8_t *rtp,
+                                             size_t rtp_len,
+                                             srtp_hdr_xtn_element_t *elements,
+                                             size_t *count);
+
 /**
  * @}
  */
@@ -66,6 +66,11 @@ extern "C" {
 typedef struct srtp_stream_ctx_t_ srtp_stream_ctx_t;
 typedef srtp_stream_ctx_t *srtp_stream_t;
 typedef struct srtp_stream_list_ctx_t_ *srtp_stream_list_t;
+typedef struct srtp_ekt_ctx_t_ srtp_ekt_ctx_t;
+typedef struct srtp_index_store_t srtp_index_store_t;
+typedef struct srtp_index_slot_t srtp_index_slot_t;
+typedef struct srtp_shared_state_t srtp_shared_state_t;
+typedef struct srtp_shared_slot_t srtp_shared_slot_t;
 
 /*
  * the following declarations are libSRTP internal functions
@@ -103,12 +108,58 @@ typedef struct srtp_session_keys_t {
     srtp_key_limit_ctx_t *limit;
 } srtp_session_keys_t;
 
+/*
+ * srtp_packet_plan_t holds what processing a packet of a stream needs to
+ * know about its cipher and auth function.  it is computed once when the
+ * stream is initialized, so that the packet path does not inspect the
+ * cipher and auth types of every packet.
+ */
+typedef struct srtp_packet_plan_t {
+    bool aead;         /* the cipher is AES-GCM, which authenticates   */
+    bool icm_iv;       /* the IV is built from the SSRC and the index  */
+    size_t tag_len;    /* length of the tag of the auth function       */
+    size_t prefix_len; /* keystream prefix of a universal hash, or 0   */
+} srtp_packet_plan_t;
+
+/*
+ * srtp_tx_cache_t keeps the most recently protected RTP packets of a
+ * stream, indexed by sequence number, so that a retransmission of an
+ * unchanged packet can be answered with the stored SRTP packet instead of
+ * encrypting and authenticating it again.  each entry points to two slots
+ * of slot_len octets in buffer, holding the RTP and the SRTP packet.  one
+ * more slot, staging, holds the RTP packet being protected until it is
+ * committed, when it is swapped with the RTP slot of its entry.
+ */
+typedef struct srtp_tx_cache_entry_t {
+    bool valid;
+    srtp_xtd_seq_num_t index;
+    size_t mki_index;
+    size_t rtp_len;
+    size_t srtp_len;
+    uint8_t *rtp_slot;
+    uint8_t *srtp_slot;
+} srtp_tx_cache_entry_t;
+
+typedef struct srtp_tx_cache_t {
+    size_t num_entries;
+    size_t max_packet_len;
+    size_t slot_len;
+    srtp_tx_cache_entry_t *entries;
+    uint8_t *buffer;
+    uint8_t *staging;
+    uint64_t hits;
+    uint64_t misses;
+} srtp_tx_cache_t;
+
 /*
  * an srtp_stream_t has its own SSRC, encryption key, authentication
  * key, sequence number, and replay database
  *
  * note that the keys might not actually be unique, in which case the
  * srtp_cipher_t and srtp_auth_t pointers will point to the same structures
+ *
+ * streams are allocated with srtp_crypto_alloc_aligned(), so the state that
+ * is written for every packet never shares a cache line with another stream
  */
 typedef struct srtp_stream_ctx_t_ {
     uint32_t ssrc;
@@ -120,21 +171,56 @@ typedef struct srtp_stream_ctx_t_ {
     srtp_sec_serv_t rtp_services;
     srtp_rdb_t rtcp_rdb;
     srtp_sec_serv_t rtcp_services;
+    srtp_packet_plan_t rtp_plan;
+    srtp_packet_plan_t rtcp_plan;
     direction_t direction;
     bool allow_repeat_tx;
     uint8_t *enc_xtn_hdr;
     size_t enc_xtn_hdr_count;
     uint32_t pending_roc;
+    srtp_tx_cache_t *tx_cache;
+    srtp_ekt_ctx_t *ekt;
+    uint64_t ekt_packet_count;
+    srtp_index_slot_t *index_slot;
+    uint64_t index_rtp_limit;
+    uint32_t index_rtcp_limit;
+    uint64_t index_rtp_resume;
+    uint64_t index_attach_failed;
+    srtp_shared_slot_t *shared_slot;
+    uint64_t shared_generation;
+    uint64_t cost_samples;
+    uint64_t cost_ns;
+    bool is_repair;       /* uses the session keys of its media stream */
+    uint32_t media_ssrc;  /* of a repair stream, in network order      */
+    size_t quota_bytes;   /* charged to the quota of the session       */
 } strp_stream_ctx_t_;
 
 /*
- * an srtp_ctx_t holds a stream list and a service description
+ * an srtp_ctx_t holds a stream index and a service description
  */
 typedef struct srtp_ctx_t_ {
-    srtp_stream_list_t stream_list;             /* linked list of streams     */
+    void *stream_list;                          /* index of streams by SSRC   */
+    const srtp_stream_index_t *stream_index;    /* functions of the index     */
     struct srtp_stream_ctx_t_ *stream_template; /* act as template for other  */
                                                 /* streams                    */
     void *user_data;                            /* user custom data           */
+    bool use_ekt;                               /* a stream has an EKT policy */
+    srtp_index_store_t *index_store;            /* persisted packet indices   */
+    srtp_shared_state_t *shared_state;          /* state shared by processes  */
+    uint32_t cost_interval;                     /* 1 in N calls are timed     */
+    uint32_t cost_countdown;                    /* calls until the next one   */
+    uint64_t cost_samples;                      /* timed calls of the session */
+    uint64_t cost_ns;                           /* their total time           */
+    size_t max_streams;                         /* 0 or the fixed capacity    */
+    struct srtp_stream_ctx_t_ **stream_pool;    /* preallocated clones of the */
+    size_t stream_pool_count;                   /* template                   */
+    size_t repair_streams;                      /* bound repair streams       */
+    size_t quota_max_streams;                   /* 0 or the most clones of    */
+    size_t quota_max_bytes;                     /* the template and memory    */
+    size_t quota_streams;                       /* clones charged to the      */
+    size_t quota_bytes;                         /* quota and their memory     */
+    uint64_t quota_rejections;                  /* clones the quota refused   */
+    uint64_t trace_id;                          /* identifies it in traces    */
 } srtp_ctx_t_;
 
 /*
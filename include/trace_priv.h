@@ -0,0 +1,184 @@
+/*
+ * trace_priv.h
+ *
+ * recording of API calls for offline replay
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifndef SRTP_TRACE_PRIV_H
+#define SRTP_TRACE_PRIV_H
+
+#include "srtp_priv.h"
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * a trace starts with SRTP_TRACE_MAGIC and a 32 bit version, followed by
+ * records.  all integers are in network order.  each record starts with
+ * a header of
+ *
+ *   uint8_t  op
+ *   uint8_t  status       srtp_err_status_t returned by the call
+ *   uint16_t body_len     length of the body following the header
+ *   uint64_t session      id of the srtp_t of the call, the sessions are
+ *                         numbered from 1 in the order of srtp_create()
+ *   uint64_t start        start of the call in ns since srtp_trace_start()
+ *   uint32_t duration     duration of the call in ns
+ *
+ * the body of SRTP_TRACE_STREAM_ADD and SRTP_TRACE_STREAM_UPDATE records
+ * describes the policy without its keys:
+ *
+ *   uint8_t  ssrc type, uint32_t ssrc value
+ *   2 x      uint32_t cipher type, uint16_t cipher key length,
+ *            uint32_t auth type, uint16_t auth key length,
+ *            uint16_t auth tag length, uint8_t security services
+ *            (for RTP, then RTCP)
+ *   uint8_t  number of master keys, use_mki, mki_size
+ *   uint32_t window_size, uint8_t allow_repeat_tx
+ *   uint32_t tx_cache_size, uint32_t tx_cache_max_packet_len
+ *   uint8_t  enc_xtn_hdr_count, followed by as many extension ids
+ *
+ * the body of SRTP_TRACE_STREAM_REMOVE records is the uint32_t SSRC, the
+ * body of packet records describes the packet without its payload:
+ *
+ *   uint32_t ssrc
+ *   uint16_t sequence number (RTP only)
+ *   uint8_t  CSRC count, uint8_t extension bit (RTP only)
+ *   uint16_t header extension length in octets (RTP only)
+ *   uint32_t length of the packet passed in
+ *   uint32_t length of the packet returned, zero on failure
+ *   uint32_t mki index (protect only)
+ */
+#define SRTP_TRACE_MAGIC "SRTPTRC"
+#define SRTP_TRACE_MAGIC_LEN 8
+#define SRTP_TRACE_VERSION 1
+
+#define SRTP_TRACE_HEADER_LEN 24
+#define SRTP_TRACE_PACKET_LEN 22
+#define SRTP_TRACE_POLICY_MIN_LEN 52
+
+typedef enum {
+    SRTP_TRACE_CREATE = 1,
+    SRTP_TRACE_DEALLOC = 2,
+    SRTP_TRACE_STREAM_ADD = 3,
+    SRTP_TRACE_STREAM_UPDATE = 4,
+    SRTP_TRACE_STREAM_REMOVE = 5,
+    SRTP_TRACE_PROTECT = 6,
+    SRTP_TRACE_UNPROTECT = 7,
+    SRTP_TRACE_PROTECT_RTCP = 8,
+    SRTP_TRACE_UNPROTECT_RTCP = 9,
+} srtp_trace_op_t;
+
+/*
+ * srtp_trace_file is the file of the running trace, NULL if no trace is
+ * running.  it is only written under the lock of the trace.  writers
+ * count themselves while they use it, and srtp_trace_stop() waits for
+ * them before it closes the file.
+ */
+extern FILE *srtp_trace_file;
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SRTP_TRACE_ATOMICS
+#define srtp_trace_enabled()                                                   \
+    (__atomic_load_n(&srtp_trace_file, __ATOMIC_ACQUIRE) != NULL)
+#else
+#define srtp_trace_enabled() (srtp_trace_file != NULL)
+#endif
+
+/*
+ * srtp_trace_next_id() returns the id of a new session
+ */
+uint64_t srtp_trace_next_id(void);
+
+/*
+ * srtp_trace_now() returns the time in ns since the trace started
+ */
+uint64_t srtp_trace_now(void);
+
+/*
+ * srtp_trace_call(op, session, start, status) records a call without a
+ * body, started at start.  the record functions do nothing if the trace
+ * was stopped since srtp_trace_enabled() was checked.
+ */
+void srtp_trace_call(srtp_trace_op_t op,
+                     const srtp_ctx_t *session,
+                     uint64_t start,
+                     srtp_err_status_t status);
+
+/*
+ * srtp_trace_policy(op, session, start, policy, status) records a call
+ * that adds or updates a stream with policy
+ */
+void srtp_trace_policy(srtp_trace_op_t op,
+                       const srtp_ctx_t *session,
+                       uint64_t start,
+                       const srtp_policy_t *policy,
+                       srtp_err_status_t status);
+
+/*
+ * srtp_trace_stream_remove(session, start, ssrc, status) records a call
+ * of srtp_stream_remove() for ssrc (in host order)
+ */
+void srtp_trace_stream_remove(const srtp_ctx_t *session,
+                              uint64_t start,
+                              uint32_t ssrc,
+                              srtp_err_status_t status);
+
+/*
+ * srtp_trace_packet(op, session, start, pkt, in_len, out_len, mki_index,
+ * status) records a call that protects or unprotects the packet pkt of
+ * in_len octets, out_len is the length of the result.  pkt has to point
+ * to the RTP or RTCP header after the call.
+ */
+void srtp_trace_packet(srtp_trace_op_t op,
+                       const srtp_ctx_t *session,
+                       uint64_t start,
+                       const uint8_t *pkt,
+                       size_t in_len,
+                       size_t out_len,
+                       size_t mki_index,
+                       srtp_err_status_t status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* SRTP_TRACE_PRIV_H */
@@ -0,0 +1,432 @@
+/*
+ * ekt.c
+ *
+ * encrypted key transport (RFC 8870) for SRTP
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Leave this as the top level import. Ensures the existence of defines
+#include "config.h"
+
+#include "ekt_priv.h"
+#include "aes.h"
+#include "alloc.h" /* for srtp_crypto_alloc() */
+
+#include <string.h>
+
+/*
+ * the EKT context is shared by a template and all streams derived from it,
+ * the master key and policy are kept so that streams can be created for
+ * keys received in EKTFields
+ */
+struct srtp_ekt_ctx_t_ {
+    size_t refcount;
+    srtp_aes_expanded_key_t enc_key;
+    srtp_aes_expanded_key_t dec_key;
+    uint16_t spi;
+    size_t full_field_interval;
+    size_t full_field_len;
+    size_t key_len;
+    size_t master_key_len;
+    uint8_t key[SRTP_MAX_KEY_LEN];
+    srtp_policy_t policy;
+};
+
+srtp_debug_module_t mod_ekt = {
+    false, /* debugging is off by default */
+    "ekt"  /* printable name for module   */
+};
+
+/*
+ * AES Key Wrap with Padding (RFC 5649) is the EKT cipher defined by
+ * RFC 8870 Section 4.4
+ */
+static const uint8_t srtp_ekt_aeskw_aiv[4] = { 0xa6, 0x59, 0x59, 0xa6 };
+
+static size_t srtp_ekt_aeskw_wrapped_len(size_t len)
+{
+    return ((len + 7) / 8 + 1) * 8;
+}
+
+static void srtp_ekt_aeskw_wrap(const srtp_aes_expanded_key_t *kek,
+                                const uint8_t *in,
+                                size_t in_len,
+                                uint8_t *out)
+{
+    size_t n = (in_len + 7) / 8;
+    uint8_t *r = out + 8;
+    v128_t b;
+
+    memcpy(out, srtp_ekt_aeskw_aiv, 4);
+    out[4] = (uint8_t)(in_len >> 24);
+    out[5] = (uint8_t)(in_len >> 16);
+    out[6] = (uint8_t)(in_len >> 8);
+    out[7] = (uint8_t)in_len;
+    memset(r, 0, n * 8);
+    memcpy(r, in, in_len);
+
+    if (n == 1) {
+        memcpy(b.v8, out, 16);
+        srtp_aes_encrypt(&b, kek);
+        memcpy(out, b.v8, 16);
+        return;
+    }
+
+    for (size_t j = 0; j < 6; j++) {
+        for (size_t i = 0; i < n; i++) {
+            uint32_t t = (uint32_t)(n * j + i + 1);
+
+            memcpy(b.v8, out, 8);
+            memcpy(b.v8 + 8, r + i * 8, 8);
+            srtp_aes_encrypt(&b, kek);
+            memcpy(out, b.v8, 8);
+            out[4] ^= (uint8_t)(t >> 24);
+            out[5] ^= (uint8_t)(t >> 16);
+            out[6] ^= (uint8_t)(t >> 8);
+            out[7] ^= (uint8_t)t;
+            memcpy(r + i * 8, b.v8 + 8, 8);
+        }
+    }
+}
+
+/*
+ * unwraps in (in_len octets) to out, which must have room for in_len - 8
+ * octets, and sets *out_len to the length of the unpadded plaintext
+ */
+static srtp_err_status_t srtp_ekt_aeskw_unwrap(
+    const srtp_aes_expanded_key_t *kek,
+    const uint8_t *in,
+    size_t in_len,
+    uint8_t *out,
+    size_t *out_len)
+{
+    uint8_t a[8];
+    uint8_t diff = 0;
+    size_t n, mli;
+    v128_t b;
+
+    if (in_len < 16 || in_len % 8 != 0) {
+        return srtp_err_status_parse_err;
+    }
+    n = in_len / 8 - 1;
+
+    if (n == 1) {
+        memcpy(b.v8, in, 16);
+        srtp_aes_decrypt(&b, kek);
+        memcpy(a, b.v8, 8);
+        memcpy(out, b.v8 + 8, 8);
+    } else {
+        memcpy(a, in, 8);
+        memcpy(out, in + 8, n * 8);
+        for (size_t j = 6; j > 0; j--) {
+            for (size_t i = n; i > 0; i--) {
+                uint32_t t = (uint32_t)(n * (j - 1) + i);
+
+                a[4] ^= (uint8_t)(t >> 24);
+                a[5] ^= (uint8_t)(t >> 16);
+                a[6] ^= (uint8_t)(t >> 8);
+                a[7] ^= (uint8_t)t;
+                memcpy(b.v8, a, 8);
+                memcpy(b.v8 + 8, out + (i - 1) * 8, 8);
+                srtp_aes_decrypt(&b, kek);
+                memcpy(a, b.v8, 8);
+                memcpy(out + (i - 1) * 8, b.v8 + 8, 8);
+            }
+        }
+    }
+
+    /* check the alternative initial value and the padding */
+    for (size_t i = 0; i < 4; i++) {
+        diff |= a[i] ^ srtp_ekt_aeskw_aiv[i];
+    }
+    mli = ((size_t)a[4] << 24) | ((size_t)a[5] << 16) | ((size_t)a[6] << 8) |
+          (size_t)a[7];
+    if (mli <= 8 * (n - 1) || mli > 8 * n) {
+        diff |= 1;
+        mli = 8 * n;
+    }
+    for (size_t i = mli; i < 8 * n; i++) {
+        diff |= out[i];
+    }
+    if (diff != 0) {
+        octet_string_set_to_zero(out, n * 8);
+        return srtp_err_status_auth_fail;
+    }
+
+    *out_len = mli;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_ekt_alloc(srtp_ekt_ctx_t **ekt_ptr,
+                                 const srtp_policy_t *policy,
+                                 size_t key_len,
+                                 size_t master_key_len)
+{
+    const srtp_ekt_policy_t *ekt_policy = policy->ekt;
+    srtp_ekt_ctx_t *ekt;
+    size_t ekt_key_len;
+    srtp_err_status_t status;
+
+    switch (ekt_policy->cipher) {
+    case srtp_ekt_cipher_aeskw_128:
+        ekt_key_len = SRTP_AES_128_KEY_LEN;
+        break;
+    case srtp_ekt_cipher_aeskw_256:
+        ekt_key_len = SRTP_AES_256_KEY_LEN;
+        break;
+    default:
+        return srtp_err_status_bad_param;
+    }
+
+    if (ekt_policy->key == NULL || policy->key == NULL ||
+        key_len > SRTP_MAX_KEY_LEN || master_key_len == 0 ||
+        master_key_len > SRTP_AES_256_KEY_LEN || master_key_len > key_len) {
+        return srtp_err_status_bad_param;
+    }
+
+    ekt = (srtp_ekt_ctx_t *)srtp_crypto_alloc(sizeof(srtp_ekt_ctx_t));
+    if (ekt == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    status = srtp_aes_expand_encryption_key(ekt_policy->key, ekt_key_len,
+                                            &ekt->enc_key);
+    if (status == srtp_err_status_ok) {
+        status = srtp_aes_expand_decryption_key(ekt_policy->key, ekt_key_len,
+                                                &ekt->dec_key);
+    }
+    if (status) {
+        octet_string_set_to_zero(ekt, sizeof(srtp_ekt_ctx_t));
+        srtp_crypto_free(ekt);
+        return status;
+    }
+
+    ekt->refcount = 1;
+    ekt->spi = ekt_policy->spi;
+    ekt->full_field_interval = ekt_policy->full_field_interval;
+    ekt->full_field_len =
+        srtp_ekt_aeskw_wrapped_len(1 + master_key_len + 4 + 4) +
+        SRTP_EKT_FULL_FIELD_TRAILER_LEN;
+    ekt->key_len = key_len;
+    ekt->master_key_len = master_key_len;
+    memcpy(ekt->key, policy->key, key_len);
+
+    /* streams created from EKTFields only receive, so there is no cache */
+    ekt->policy = *policy;
+    ekt->policy.key = NULL;
+    ekt->policy.tx_cache_size = 0;
+    ekt->policy.tx_cache_max_packet_len = 0;
+    ekt->policy.ekt = NULL;
+    ekt->policy.next = NULL;
+    ekt->policy.enc_xtn_hdr = NULL;
+    ekt->policy.enc_xtn_hdr_count = 0;
+    if (policy->enc_xtn_hdr && policy->enc_xtn_hdr_count > 0) {
+        ekt->policy.enc_xtn_hdr = (uint8_t *)srtp_crypto_alloc(
+            policy->enc_xtn_hdr_count * sizeof(policy->enc_xtn_hdr[0]));
+        if (ekt->policy.enc_xtn_hdr == NULL) {
+            srtp_ekt_dealloc(ekt);
+            return srtp_err_status_alloc_fail;
+        }
+        memcpy(ekt->policy.enc_xtn_hdr, policy->enc_xtn_hdr,
+               policy->enc_xtn_hdr_count * sizeof(policy->enc_xtn_hdr[0]));
+        ekt->policy.enc_xtn_hdr_count = policy->enc_xtn_hdr_count;
+    }
+
+    debug_print(mod_ekt, "allocated EKT context (SPI: 0x%04x)",
+                (unsigned int)ekt->spi);
+
+    *ekt_ptr = ekt;
+
+    return srtp_err_status_ok;
+}
+
+srtp_ekt_ctx_t *srtp_ekt_ref(srtp_ekt_ctx_t *ekt)
+{
+    ekt->refcount++;
+    return ekt;
+}
+
+void srtp_ekt_dealloc(srtp_ekt_ctx_t *ekt)
+{
+    if (ekt == NULL || --ekt->refcount > 0) {
+        return;
+    }
+
+    if (ekt->policy.enc_xtn_hdr) {
+        srtp_crypto_free(ekt->policy.enc_xtn_hdr);
+    }
+    octet_string_set_to_zero(ekt, sizeof(srtp_ekt_ctx_t));
+    srtp_crypto_free(ekt);
+}
+
+bool srtp_ekt_use_full_field(const srtp_ekt_ctx_t *ekt, uint64_t packet_count)
+{
+    if (ekt->full_field_interval == 0) {
+        return true;
+    }
+    return packet_count % ekt->full_field_interval == 0;
+}
+
+size_t srtp_ekt_field_len(const srtp_ekt_ctx_t *ekt, bool full)
+{
+    return full ? ekt->full_field_len : SRTP_EKT_SHORT_FIELD_LEN;
+}
+
+srtp_err_status_t srtp_ekt_write_field(const srtp_ekt_ctx_t *ekt,
+                                       bool full,
+                                       uint32_t ssrc,
+                                       uint32_t roc,
+                                       uint8_t *field)
+{
+    uint8_t plaintext[SRTP_EKT_MAX_PLAINTEXT_LEN];
+    size_t plaintext_len;
+    uint8_t *trailer;
+
+    if (!full) {
+        field[0] = SRTP_EKT_MSG_SHORT;
+        return srtp_err_status_ok;
+    }
+
+    /* EKTPlaintext: master key length, master key, SSRC and ROC */
+    plaintext[0] = (uint8_t)ekt->master_key_len;
+    memcpy(plaintext + 1, ekt->key, ekt->master_key_len);
+    plaintext_len = 1 + ekt->master_key_len;
+    memcpy(plaintext + plaintext_len, &ssrc, 4);
+    plaintext_len += 4;
+    roc = htonl(roc);
+    memcpy(plaintext + plaintext_len, &roc, 4);
+    plaintext_len += 4;
+
+    srtp_ekt_aeskw_wrap(&ekt->enc_key, plaintext, plaintext_len, field);
+    octet_string_set_to_zero(plaintext, sizeof(plaintext));
+
+    /* SPI, Epoch, EKT Length and Message Type */
+    trailer = field + ekt->full_field_len - SRTP_EKT_FULL_FIELD_TRAILER_LEN;
+    trailer[0] = (uint8_t)(ekt->spi >> 8);
+    trailer[1] = (uint8_t)ekt->spi;
+    trailer[2] = 0;
+    trailer[3] = 0;
+    trailer[4] = (uint8_t)(ekt->full_field_len >> 8);
+    trailer[5] = (uint8_t)ekt->full_field_len;
+    trailer[6] = SRTP_EKT_MSG_FULL;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_ekt_parse_field(const srtp_ekt_ctx_t *ekt,
+                                       const uint8_t *srtp,
+                                       size_t *srtp_len,
+                                       srtp_ekt_field_t *field)
+{
+    uint8_t plaintext[SRTP_EKT_MAX_CIPHERTEXT_LEN - 8];
+    size_t plaintext_len;
+    const uint8_t *trailer;
+    size_t len = *srtp_len;
+    size_t field_len;
+    uint16_t spi;
+    srtp_err_status_t status;
+
+    field->full = false;
+
+    if (len == 0) {
+        return srtp_err_status_parse_err;
+    }
+
+    if (srtp[len - 1] == SRTP_EKT_MSG_SHORT) {
+        *srtp_len = len - SRTP_EKT_SHORT_FIELD_LEN;
+        return srtp_err_status_ok;
+    }
+
+    if (srtp[len - 1] != SRTP_EKT_MSG_FULL ||
+        len < SRTP_EKT_FULL_FIELD_TRAILER_LEN) {
+        return srtp_err_status_parse_err;
+    }
+
+    trailer = srtp + len - SRTP_EKT_FULL_FIELD_TRAILER_LEN;
+    spi = (uint16_t)((trailer[0] << 8) | trailer[1]);
+    field_len = ((size_t)trailer[4] << 8) | (size_t)trailer[5];
+    if (field_len > len || field_len < SRTP_EKT_FULL_FIELD_TRAILER_LEN + 16) {
+        return srtp_err_status_parse_err;
+    }
+    *srtp_len = len - field_len;
+
+    /* an EKTField for another EKTKey is ignored (RFC 8870 Section 4.3.2) */
+    if (spi != ekt->spi) {
+        debug_print(mod_ekt, "ignoring EKTField with unknown SPI 0x%04x",
+                    (unsigned int)spi);
+        return srtp_err_status_ok;
+    }
+
+    if (field_len != ekt->full_field_len) {
+        return srtp_err_status_parse_err;
+    }
+
+    status = srtp_ekt_aeskw_unwrap(
+        &ekt->dec_key, srtp + *srtp_len,
+        field_len - SRTP_EKT_FULL_FIELD_TRAILER_LEN, plaintext, &plaintext_len);
+    if (status) {
+        return status;
+    }
+
+    if (plaintext[0] != ekt->master_key_len ||
+        plaintext_len != 1 + ekt->master_key_len + 4 + 4) {
+        octet_string_set_to_zero(plaintext, sizeof(plaintext));
+        return srtp_err_status_parse_err;
+    }
+
+    /* the received master key replaces the one of the policy */
+    memcpy(field->key, ekt->key, ekt->key_len);
+    memcpy(field->key, plaintext + 1, ekt->master_key_len);
+    memcpy(&field->ssrc, plaintext + 1 + ekt->master_key_len, 4);
+    memcpy(&field->roc, plaintext + 1 + ekt->master_key_len + 4, 4);
+    field->roc = ntohl(field->roc);
+    field->full = true;
+    octet_string_set_to_zero(plaintext, sizeof(plaintext));
+
+    return srtp_err_status_ok;
+}
+
+void srtp_ekt_stream_policy(const srtp_ekt_ctx_t *ekt,
+                            srtp_ekt_field_t *field,
+                            srtp_policy_t *policy)
+{
+    *policy = ekt->policy;
+    policy->ssrc.type = ssrc_specific;
+    policy->ssrc.value = ntohl(field->ssrc);
+    policy->key = field->key;
+}
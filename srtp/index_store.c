@@ -0,0 +1,342 @@
+/*
+ * index_store.c
+ *
+ * memory-mapped persistence of the packet indices of sending streams
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Leave this as the top level import. Ensures the existence of defines
+#include "config.h"
+
+#include "index_store_priv.h"
+#include "alloc.h" /* for srtp_crypto_alloc() */
+
+#include <string.h>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct srtp_index_store_t {
+    int fd;
+    void *map;
+    size_t map_len;
+    srtp_index_slot_t *slots;
+    size_t num_slots;
+    uint32_t margin;
+    bool *claimed;       /* slots in use by a stream of this process */
+    uint64_t generation; /* incremented whenever a slot is freed     */
+};
+
+srtp_debug_module_t mod_index_store = {
+    false,        /* debugging is off by default */
+    "index store" /* printable name for module   */
+};
+
+/*
+ * a resumed stream continues with the SRTCP index at its SRTCP limit, its
+ * ROC is only known once the sequence number of its first RTP packet is
+ */
+static void srtp_index_store_resume(const srtp_index_slot_t *slot,
+                                    srtp_stream_ctx_t *stream)
+{
+    stream->index_rtp_resume = slot->rtp_limit;
+
+    if (slot->rtcp_limit > stream->rtcp_rdb.window_start) {
+        stream->rtcp_rdb.window_start = slot->rtcp_limit;
+    }
+
+    debug_print2(mod_index_store,
+                 "resuming stream from RTP index %" PRIu64 ", SRTCP index %u",
+                 slot->rtp_limit, (unsigned int)stream->rtcp_rdb.window_start);
+}
+
+void srtp_index_store_resume_rtp(srtp_stream_ctx_t *stream, uint16_t seq)
+{
+    uint64_t limit = stream->index_rtp_resume;
+    uint32_t roc = (uint32_t)(limit >> 16);
+
+    if ((((uint64_t)roc << 16) | seq) < limit) {
+        roc++;
+    }
+
+    if (roc > stream->pending_roc &&
+        roc > srtp_rdbx_get_roc(&stream->rtp_rdbx)) {
+        stream->pending_roc = roc;
+    }
+    stream->index_rtp_resume = 0;
+
+    debug_print(mod_index_store, "resumed stream with ROC %u",
+                (unsigned int)roc);
+}
+
+srtp_err_status_t srtp_index_store_attach(srtp_index_store_t *store,
+                                          srtp_stream_ctx_t *stream)
+{
+    srtp_index_slot_t *slot = NULL;
+    size_t i;
+    size_t free_slot = store->num_slots;
+
+    /* the store was full for this stream and no slot was freed since */
+    if (stream->index_attach_failed == store->generation + 1) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    for (i = 0; i < store->num_slots; i++) {
+        if (store->slots[i].in_use) {
+            if (store->slots[i].ssrc == stream->ssrc) {
+                slot = &store->slots[i];
+                break;
+            }
+        } else if (free_slot == store->num_slots) {
+            free_slot = i;
+        }
+    }
+
+    if (slot != NULL) {
+        /* only the first stream of this process resumes from the slot */
+        if (!store->claimed[i]) {
+            srtp_index_store_resume(slot, stream);
+            store->claimed[i] = true;
+        }
+    } else {
+        if (free_slot == store->num_slots) {
+            debug_print(mod_index_store, "no free slot for SSRC 0x%08x",
+                        (unsigned int)ntohl(stream->ssrc));
+            stream->index_attach_failed = store->generation + 1;
+            return srtp_err_status_alloc_fail;
+        }
+        slot = &store->slots[free_slot];
+        slot->rtp_limit = 0;
+        slot->rtcp_limit = 0;
+        slot->ssrc = stream->ssrc;
+        slot->in_use = 1;
+        store->claimed[free_slot] = true;
+    }
+
+    stream->index_slot = slot;
+    stream->index_rtp_limit = slot->rtp_limit;
+    stream->index_rtcp_limit = slot->rtcp_limit;
+    stream->index_attach_failed = 0;
+
+    return srtp_err_status_ok;
+}
+
+void srtp_index_store_release(srtp_index_store_t *store,
+                              srtp_index_slot_t *slot)
+{
+    slot->in_use = 0;
+    slot->ssrc = 0;
+    slot->rtp_limit = 0;
+    slot->rtcp_limit = 0;
+    store->claimed[slot - store->slots] = false;
+    store->generation++;
+}
+
+bool srtp_index_store_lookup(const srtp_index_store_t *store,
+                             uint32_t ssrc,
+                             uint64_t *rtp_limit,
+                             uint32_t *rtcp_limit)
+{
+    for (size_t i = 0; i < store->num_slots; i++) {
+        if (store->slots[i].in_use && store->slots[i].ssrc == ssrc) {
+            *rtp_limit = store->slots[i].rtp_limit;
+            *rtcp_limit = store->slots[i].rtcp_limit;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void srtp_index_store_checkpoint_rtp(const srtp_index_store_t *store,
+                                     srtp_stream_ctx_t *stream)
+{
+    uint64_t limit = stream->rtp_rdbx.index + store->margin;
+
+    stream->index_slot->rtp_limit = limit;
+    stream->index_rtp_limit = limit;
+}
+
+void srtp_index_store_checkpoint_rtcp(const srtp_index_store_t *store,
+                                      srtp_stream_ctx_t *stream)
+{
+    uint64_t limit = (uint64_t)stream->rtcp_rdb.window_start + store->margin;
+
+    /* SRTCP indices are 31 bits */
+    if (limit > SRTCP_INDEX_MASK) {
+        limit = SRTCP_INDEX_MASK;
+    }
+
+    stream->index_slot->rtcp_limit = (uint32_t)limit;
+    stream->index_rtcp_limit = (uint32_t)limit;
+}
+
+#ifdef HAVE_SYS_MMAN_H
+
+srtp_err_status_t srtp_index_store_alloc(srtp_index_store_t **store_ptr,
+                                         const char *path,
+                                         size_t max_streams,
+                                         uint32_t margin)
+{
+    srtp_index_store_t *store;
+    srtp_index_store_header_t *header;
+    struct stat st;
+
+    if (path == NULL || max_streams == 0 || max_streams > UINT32_MAX ||
+        margin == 0) {
+        return srtp_err_status_bad_param;
+    }
+
+    store = (srtp_index_store_t *)srtp_crypto_alloc(sizeof(srtp_index_store_t));
+    if (store == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    store->fd = -1;
+    store->map = MAP_FAILED;
+    store->num_slots = max_streams;
+    store->margin = margin;
+    store->map_len = sizeof(srtp_index_store_header_t) +
+                     max_streams * sizeof(srtp_index_slot_t);
+
+    store->claimed = (bool *)srtp_crypto_alloc(max_streams * sizeof(bool));
+    if (store->claimed == NULL) {
+        srtp_index_store_dealloc(store);
+        return srtp_err_status_alloc_fail;
+    }
+
+    store->fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (store->fd < 0 || fstat(store->fd, &st) != 0) {
+        srtp_index_store_dealloc(store);
+        return srtp_err_status_read_fail;
+    }
+
+    /* a new file is zero filled, which is a valid empty store */
+    if (st.st_size == 0) {
+        if (ftruncate(store->fd, (off_t)store->map_len) != 0) {
+            srtp_index_store_dealloc(store);
+            return srtp_err_status_write_fail;
+        }
+    } else if ((size_t)st.st_size != store->map_len) {
+        srtp_index_store_dealloc(store);
+        return srtp_err_status_parse_err;
+    }
+
+    store->map = mmap(NULL, store->map_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, store->fd, 0);
+    if (store->map == MAP_FAILED) {
+        srtp_index_store_dealloc(store);
+        return srtp_err_status_read_fail;
+    }
+
+    header = (srtp_index_store_header_t *)store->map;
+    store->slots = (srtp_index_slot_t *)(header + 1);
+
+    if (header->magic[0] == '\0') {
+        memcpy(header->magic, SRTP_INDEX_STORE_MAGIC, sizeof(header->magic));
+        header->version = SRTP_INDEX_STORE_VERSION;
+        header->num_slots = (uint32_t)max_streams;
+    } else if (memcmp(header->magic, SRTP_INDEX_STORE_MAGIC,
+                      sizeof(header->magic)) != 0 ||
+               header->version != SRTP_INDEX_STORE_VERSION ||
+               header->num_slots != max_streams) {
+        srtp_index_store_dealloc(store);
+        return srtp_err_status_parse_err;
+    }
+
+    debug_print2(mod_index_store, "mapped %s with %u slots", path,
+                 (unsigned int)max_streams);
+
+    *store_ptr = store;
+
+    return srtp_err_status_ok;
+}
+
+void srtp_index_store_dealloc(srtp_index_store_t *store)
+{
+    if (store->map != MAP_FAILED) {
+        munmap(store->map, store->map_len);
+    }
+    if (store->fd >= 0) {
+        close(store->fd);
+    }
+    if (store->claimed) {
+        srtp_crypto_free(store->claimed);
+    }
+    srtp_crypto_free(store);
+}
+
+srtp_err_status_t srtp_index_store_flush(srtp_index_store_t *store)
+{
+    if (msync(store->map, store->map_len, MS_SYNC) != 0) {
+        return srtp_err_status_write_fail;
+    }
+
+    return srtp_err_status_ok;
+}
+
+#else /* HAVE_SYS_MMAN_H */
+
+srtp_err_status_t srtp_index_store_alloc(srtp_index_store_t **store_ptr,
+                                         const char *path,
+                                         size_t max_streams,
+                                         uint32_t margin)
+{
+    (void)store_ptr;
+    (void)path;
+    (void)max_streams;
+    (void)margin;
+
+    return srtp_err_status_no_such_op;
+}
+
+void srtp_index_store_dealloc(srtp_index_store_t *store)
+{
+    (void)store;
+}
+
+srtp_err_status_t srtp_index_store_flush(srtp_index_store_t *store)
+{
+    (void)store;
+
+    return srtp_err_status_no_such_op;
+}
+
+#endif /* HAVE_SYS_MMAN_H */
@@ -0,0 +1,888 @@
+/*
+ * recording.c
+ *
+ * recordings of protected packets that can be unprotected from any
+ * checkpoint
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Leave this as the top level import. Ensures the existence of defines
+#include "config.h"
+
+#include "recording_priv.h"
+#include "alloc.h" /* for srtp_crypto_alloc() */
+
+#include <string.h>
+
+srtp_debug_module_t mod_recording = {
+    false,      /* debugging is off by default */
+    "recording" /* printable name for module   */
+};
+
+/* large enough for any recorded packet, which is at most 65535 octets */
+#define SRTP_RECORDING_MAX_PACKET_LEN 65536
+
+static void recording_put32(uint8_t *p, uint32_t v)
+{
+    v = htonl(v);
+    memcpy(p, &v, 4);
+}
+
+static void recording_put64(uint8_t *p, uint64_t v)
+{
+    recording_put32(p, (uint32_t)(v >> 32));
+    recording_put32(p + 4, (uint32_t)v);
+}
+
+static uint32_t recording_get32(const uint8_t *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+    return ntohl(v);
+}
+
+static uint64_t recording_get64(const uint8_t *p)
+{
+    return ((uint64_t)recording_get32(p) << 32) | recording_get32(p + 4);
+}
+
+static int recording_file_seek(FILE *file, uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET);
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+static srtp_err_status_t recording_file_size(FILE *file, uint64_t *size)
+{
+#ifdef _WIN32
+    __int64 end;
+
+    if (_fseeki64(file, 0, SEEK_END) != 0 || (end = _ftelli64(file)) < 0) {
+        return srtp_err_status_read_fail;
+    }
+#else
+    off_t end;
+
+    if (fseeko(file, 0, SEEK_END) != 0 || (end = ftello(file)) < 0) {
+        return srtp_err_status_read_fail;
+    }
+#endif
+    *size = (uint64_t)end;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * recording_grow(array, max, size) doubles the capacity *max of an array
+ * of elements of size octets
+ */
+static srtp_err_status_t recording_grow(void **array, size_t *max, size_t size)
+{
+    size_t new_max = *max ? *max * 2 : 16;
+    void *new_array = srtp_crypto_alloc(new_max * size);
+
+    if (new_array == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    if (*array != NULL) {
+        memcpy(new_array, *array, *max * size);
+        srtp_crypto_free(*array);
+    }
+    *array = new_array;
+    *max = new_max;
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t recording_write_record(
+    srtp_recording_t *recording,
+    srtp_recording_record_type_t type,
+    uint64_t time_us,
+    const uint8_t *data,
+    size_t len)
+{
+    uint8_t header[SRTP_RECORDING_RECORD_HEADER_LEN] = { 0 };
+
+    header[0] = (uint8_t)type;
+    recording_put32(header + 4, (uint32_t)len);
+    recording_put64(header + 8, time_us);
+
+    if (fwrite(header, sizeof(header), 1, recording->file) != 1 ||
+        (len && fwrite(data, len, 1, recording->file) != 1)) {
+        return srtp_err_status_write_fail;
+    }
+    recording->offset += sizeof(header) + len;
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t recording_write_checkpoint(
+    srtp_recording_t *recording,
+    uint64_t time_us)
+{
+    srtp_recording_checkpoint_t *checkpoint;
+    srtp_err_status_t status;
+    size_t len = SRTP_RECORDING_CHECKPOINT_LEN +
+                 recording->num_streams * SRTP_RECORDING_STREAM_LEN;
+    uint8_t *body;
+    uint8_t *p;
+
+    if (recording->num_checkpoints == recording->max_checkpoints) {
+        status = recording_grow((void **)&recording->checkpoints,
+                                &recording->max_checkpoints,
+                                sizeof(srtp_recording_checkpoint_t));
+        if (status) {
+            return status;
+        }
+    }
+
+    body = (uint8_t *)srtp_crypto_alloc(len);
+    if (body == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    recording_put32(body, (uint32_t)recording->num_streams);
+    p = body + SRTP_RECORDING_CHECKPOINT_LEN;
+    for (size_t i = 0; i < recording->num_streams; i++) {
+        const srtp_recording_stream_t *stream = &recording->streams[i];
+
+        recording_put32(p, stream->ssrc);
+        recording_put32(p + 4, (uint32_t)(stream->index >> 16));
+        recording_put64(p + 8, stream->index);
+        recording_put32(p + 16, stream->mki_index);
+        recording_put32(p + 20, stream->flags);
+        p += SRTP_RECORDING_STREAM_LEN;
+    }
+
+    checkpoint = &recording->checkpoints[recording->num_checkpoints];
+    checkpoint->time_us = time_us;
+    checkpoint->offset = recording->offset;
+    checkpoint->first_packet = recording->num_packets;
+
+    status = recording_write_record(
+        recording, srtp_recording_record_checkpoint, time_us, body, len);
+    srtp_crypto_free(body);
+    if (status) {
+        return status;
+    }
+
+    recording->num_checkpoints++;
+    recording->packets_since_checkpoint = 0;
+    recording->checkpoint_pending = false;
+
+    debug_print2(mod_recording, "checkpoint of %u streams before packet %u",
+                 (unsigned int)recording->num_streams,
+                 (unsigned int)recording->num_packets);
+
+    return srtp_err_status_ok;
+}
+
+static srtp_recording_stream_t *recording_find_stream(
+    srtp_recording_t *recording,
+    uint32_t ssrc)
+{
+    for (size_t i = 0; i < recording->num_streams; i++) {
+        if (recording->streams[i].ssrc == ssrc) {
+            return &recording->streams[i];
+        }
+    }
+
+    return NULL;
+}
+
+static srtp_err_status_t recording_add_stream(
+    srtp_recording_t *recording,
+    uint32_t ssrc,
+    srtp_recording_stream_t **stream)
+{
+    srtp_err_status_t status;
+
+    if (recording->num_streams == recording->max_streams) {
+        status = recording_grow((void **)&recording->streams,
+                                &recording->max_streams,
+                                sizeof(srtp_recording_stream_t));
+        if (status) {
+            return status;
+        }
+    }
+
+    *stream = &recording->streams[recording->num_streams++];
+    (*stream)->ssrc = ssrc;
+    (*stream)->index = 0;
+    (*stream)->mki_index = 0;
+    (*stream)->flags = 0;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_recording_create(srtp_recording_t **recording_ptr,
+                                        const char *path,
+                                        size_t checkpoint_interval)
+{
+    srtp_recording_t *recording;
+    uint8_t header[SRTP_RECORDING_HEADER_LEN] = { 0 };
+
+    if (recording_ptr == NULL || path == NULL || checkpoint_interval == 0) {
+        return srtp_err_status_bad_param;
+    }
+
+    recording = (srtp_recording_t *)srtp_crypto_alloc(sizeof(srtp_recording_t));
+    if (recording == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    recording->checkpoint_interval = checkpoint_interval;
+    recording->checkpoint_pending = true;
+
+    recording->file = fopen(path, "wb");
+    if (recording->file == NULL) {
+        srtp_crypto_free(recording);
+        return srtp_err_status_write_fail;
+    }
+
+    memcpy(header, SRTP_RECORDING_MAGIC, sizeof(SRTP_RECORDING_MAGIC));
+    recording_put32(header + 8, SRTP_RECORDING_VERSION);
+    if (fwrite(header, sizeof(header), 1, recording->file) != 1) {
+        fclose(recording->file);
+        srtp_crypto_free(recording);
+        return srtp_err_status_write_fail;
+    }
+    recording->offset = sizeof(header);
+
+    *recording_ptr = recording;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_recording_set_roc(srtp_recording_t *recording,
+                                         uint32_t ssrc,
+                                         uint32_t roc)
+{
+    srtp_recording_stream_t *stream;
+    srtp_err_status_t status;
+
+    if (recording == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    stream = recording_find_stream(recording, ssrc);
+    if (stream == NULL) {
+        status = recording_add_stream(recording, ssrc, &stream);
+        if (status) {
+            return status;
+        }
+    } else if (stream->flags & SRTP_RECORDING_STREAM_SEEN) {
+        return srtp_err_status_bad_param;
+    }
+    stream->index = (uint64_t)roc << 16;
+
+    /* the stream may start before the next regular checkpoint */
+    recording->checkpoint_pending = true;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * recording_track(recording, packet, mki_index) moves the index of the
+ * stream of an RTP packet forward as srtp_unprotect() would
+ */
+static srtp_err_status_t recording_track(srtp_recording_t *recording,
+                                         const uint8_t *packet,
+                                         size_t mki_index)
+{
+    srtp_recording_stream_t *stream;
+    srtp_xtd_seq_num_t guess;
+    srtp_err_status_t status;
+    uint32_t ssrc = recording_get32(packet + 8);
+    uint16_t seq = (uint16_t)((packet[2] << 8) | packet[3]);
+
+    stream = recording_find_stream(recording, ssrc);
+    if (stream == NULL) {
+        status = recording_add_stream(recording, ssrc, &stream);
+        if (status) {
+            return status;
+        }
+    }
+
+    if (!(stream->flags & SRTP_RECORDING_STREAM_SEEN)) {
+        stream->index = (stream->index & ~(uint64_t)0xffff) | seq;
+        stream->flags |= SRTP_RECORDING_STREAM_SEEN;
+    } else if (srtp_index_guess(&stream->index, &guess, seq) > 0) {
+        stream->index = guess;
+    }
+    stream->mki_index = (uint32_t)mki_index;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_recording_append(srtp_recording_t *recording,
+                                        const uint8_t *packet,
+                                        size_t len,
+                                        bool is_rtcp,
+                                        uint64_t time_us,
+                                        size_t mki_index)
+{
+    srtp_err_status_t status;
+
+    if (recording == NULL || packet == NULL ||
+        len < (is_rtcp ? sizeof(srtcp_hdr_t) : sizeof(srtp_hdr_t)) ||
+        len >= SRTP_RECORDING_MAX_PACKET_LEN ||
+        time_us < recording->last_time_us) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (recording->checkpoint_pending ||
+        recording->packets_since_checkpoint >=
+            recording->checkpoint_interval) {
+        status = recording_write_checkpoint(recording, time_us);
+        if (status) {
+            return status;
+        }
+    }
+
+    if (!is_rtcp) {
+        status = recording_track(recording, packet, mki_index);
+        if (status) {
+            return status;
+        }
+    }
+
+    status = recording_write_record(recording,
+                                    is_rtcp ? srtp_recording_record_rtcp
+                                            : srtp_recording_record_rtp,
+                                    time_us, packet, len);
+    if (status) {
+        return status;
+    }
+
+    recording->last_time_us = time_us;
+    recording->num_packets++;
+    recording->packets_since_checkpoint++;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_recording_close(srtp_recording_t *recording)
+{
+    srtp_err_status_t status = srtp_err_status_ok;
+    uint8_t entry[SRTP_RECORDING_INDEX_ENTRY_LEN];
+    uint8_t trailer[SRTP_RECORDING_TRAILER_LEN] = { 0 };
+
+    if (recording == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    for (size_t i = 0; i < recording->num_checkpoints; i++) {
+        recording_put64(entry, recording->checkpoints[i].time_us);
+        recording_put64(entry + 8, recording->checkpoints[i].offset);
+        recording_put64(entry + 16, recording->checkpoints[i].first_packet);
+        if (fwrite(entry, sizeof(entry), 1, recording->file) != 1) {
+            status = srtp_err_status_write_fail;
+        }
+    }
+
+    recording_put64(trailer, recording->offset);
+    recording_put32(trailer + 8, (uint32_t)recording->num_checkpoints);
+    memcpy(trailer + 16, SRTP_RECORDING_TRAILER_MAGIC,
+           sizeof(SRTP_RECORDING_TRAILER_MAGIC));
+    if (fwrite(trailer, sizeof(trailer), 1, recording->file) != 1) {
+        status = srtp_err_status_write_fail;
+    }
+
+    if (fclose(recording->file) != 0) {
+        status = srtp_err_status_write_fail;
+    }
+    if (recording->streams) {
+        srtp_crypto_free(recording->streams);
+    }
+    if (recording->checkpoints) {
+        srtp_crypto_free(recording->checkpoints);
+    }
+    srtp_crypto_free(recording);
+
+    return status;
+}
+
+/*
+ * recording_read_index(reader, file, size) reads the index of a closed
+ * recording, it returns srtp_err_status_parse_err if there is none
+ */
+static srtp_err_status_t recording_read_index(srtp_recording_reader_t *reader,
+                                              FILE *file,
+                                              uint64_t size)
+{
+    uint8_t trailer[SRTP_RECORDING_TRAILER_LEN];
+    uint8_t entry[SRTP_RECORDING_INDEX_ENTRY_LEN];
+    uint64_t index_offset;
+    size_t count;
+
+    if (size < SRTP_RECORDING_HEADER_LEN + SRTP_RECORDING_TRAILER_LEN ||
+        recording_file_seek(file, size - SRTP_RECORDING_TRAILER_LEN) != 0 ||
+        fread(trailer, sizeof(trailer), 1, file) != 1 ||
+        memcmp(trailer + 16, SRTP_RECORDING_TRAILER_MAGIC,
+               sizeof(SRTP_RECORDING_TRAILER_MAGIC)) != 0) {
+        return srtp_err_status_parse_err;
+    }
+
+    index_offset = recording_get64(trailer);
+    count = recording_get32(trailer + 8);
+    if (index_offset < SRTP_RECORDING_HEADER_LEN ||
+        index_offset + (uint64_t)count * SRTP_RECORDING_INDEX_ENTRY_LEN +
+                SRTP_RECORDING_TRAILER_LEN !=
+            size) {
+        return srtp_err_status_parse_err;
+    }
+
+    if (count) {
+        reader->checkpoints = (srtp_recording_checkpoint_t *)srtp_crypto_alloc(
+            count * sizeof(srtp_recording_checkpoint_t));
+        if (reader->checkpoints == NULL) {
+            return srtp_err_status_alloc_fail;
+        }
+    }
+    if (recording_file_seek(file, index_offset) != 0) {
+        return srtp_err_status_read_fail;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (fread(entry, sizeof(entry), 1, file) != 1) {
+            return srtp_err_status_read_fail;
+        }
+        reader->checkpoints[i].time_us = recording_get64(entry);
+        reader->checkpoints[i].offset = recording_get64(entry + 8);
+        reader->checkpoints[i].first_packet = recording_get64(entry + 16);
+        if (reader->checkpoints[i].offset >= index_offset) {
+            return srtp_err_status_parse_err;
+        }
+    }
+    reader->num_checkpoints = count;
+    reader->end = index_offset;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * recording_scan(reader, file, size) rebuilds the index of a recording
+ * that was not closed from its records, up to the last complete one
+ */
+static srtp_err_status_t recording_scan(srtp_recording_reader_t *reader,
+                                        FILE *file,
+                                        uint64_t size)
+{
+    uint8_t header[SRTP_RECORDING_RECORD_HEADER_LEN];
+    srtp_recording_checkpoint_t *checkpoint;
+    srtp_err_status_t status;
+    uint64_t offset = SRTP_RECORDING_HEADER_LEN;
+    uint64_t num_packets = 0;
+    size_t max_checkpoints = reader->num_checkpoints;
+    uint64_t len;
+
+    if (recording_file_seek(file, offset) != 0) {
+        return srtp_err_status_read_fail;
+    }
+
+    while (offset + sizeof(header) <= size &&
+           fread(header, sizeof(header), 1, file) == 1) {
+        len = recording_get32(header + 4);
+        if (offset + sizeof(header) + len > size) {
+            break;
+        }
+
+        if (header[0] == srtp_recording_record_checkpoint) {
+            if (reader->num_checkpoints == max_checkpoints) {
+                status = recording_grow((void **)&reader->checkpoints,
+                                        &max_checkpoints,
+                                        sizeof(srtp_recording_checkpoint_t));
+                if (status) {
+                    return status;
+                }
+            }
+            checkpoint = &reader->checkpoints[reader->num_checkpoints++];
+            checkpoint->time_us = recording_get64(header + 8);
+            checkpoint->offset = offset;
+            checkpoint->first_packet = num_packets;
+        } else if (header[0] == srtp_recording_record_rtp ||
+                   header[0] == srtp_recording_record_rtcp) {
+            num_packets++;
+        } else {
+            return srtp_err_status_parse_err;
+        }
+
+        offset += sizeof(header) + len;
+        if (recording_file_seek(file, offset) != 0) {
+            return srtp_err_status_read_fail;
+        }
+    }
+    reader->end = offset;
+
+    debug_print(mod_recording, "rebuilt index of %u checkpoints",
+                (unsigned int)reader->num_checkpoints);
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_recording_open(srtp_recording_reader_t **reader_ptr,
+                                      const char *path)
+{
+    srtp_recording_reader_t *reader;
+    uint8_t header[SRTP_RECORDING_HEADER_LEN];
+    srtp_err_status_t status;
+    uint64_t size;
+    FILE *file;
+
+    if (reader_ptr == NULL || path == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        return srtp_err_status_read_fail;
+    }
+    if (fread(header, sizeof(header), 1, file) != 1 ||
+        memcmp(header, SRTP_RECORDING_MAGIC, sizeof(SRTP_RECORDING_MAGIC)) !=
+            0 ||
+        recording_get32(header + 8) != SRTP_RECORDING_VERSION) {
+        fclose(file);
+        return srtp_err_status_parse_err;
+    }
+
+    reader = (srtp_recording_reader_t *)srtp_crypto_alloc(
+        sizeof(srtp_recording_reader_t));
+    if (reader == NULL) {
+        fclose(file);
+        return srtp_err_status_alloc_fail;
+    }
+    reader->path = (char *)srtp_crypto_alloc(strlen(path) + 1);
+    if (reader->path == NULL) {
+        srtp_recording_reader_close(reader);
+        fclose(file);
+        return srtp_err_status_alloc_fail;
+    }
+    memcpy(reader->path, path, strlen(path) + 1);
+
+    status = recording_file_size(file, &size);
+    if (status == srtp_err_status_ok) {
+        status = recording_read_index(reader, file, size);
+        if (status == srtp_err_status_parse_err) {
+            status = recording_scan(reader, file, size);
+        }
+    }
+    fclose(file);
+
+    if (status) {
+        srtp_recording_reader_close(reader);
+        return status;
+    }
+
+    *reader_ptr = reader;
+
+    return srtp_err_status_ok;
+}
+
+void srtp_recording_reader_close(srtp_recording_reader_t *reader)
+{
+    if (reader == NULL) {
+        return;
+    }
+    if (reader->path) {
+        srtp_crypto_free(reader->path);
+    }
+    if (reader->checkpoints) {
+        srtp_crypto_free(reader->checkpoints);
+    }
+    srtp_crypto_free(reader);
+}
+
+size_t srtp_recording_get_segment_count(const srtp_recording_reader_t *reader)
+{
+    return reader ? reader->num_checkpoints : 0;
+}
+
+srtp_err_status_t srtp_recording_get_segment(
+    const srtp_recording_reader_t *reader,
+    size_t segment,
+    uint64_t *time_us,
+    uint64_t *first_packet)
+{
+    if (reader == NULL || segment >= reader->num_checkpoints) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (time_us) {
+        *time_us = reader->checkpoints[segment].time_us;
+    }
+    if (first_packet) {
+        *first_packet = reader->checkpoints[segment].first_packet;
+    }
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_recording_seek(const srtp_recording_reader_t *reader,
+                                      uint64_t time_us,
+                                      size_t *segment)
+{
+    size_t low = 0;
+    size_t high;
+
+    if (reader == NULL || segment == NULL || reader->num_checkpoints == 0) {
+        return srtp_err_status_bad_param;
+    }
+
+    /*
+     * the last checkpoint before time_us, or the first one; packets at the
+     * time of a checkpoint may also precede it
+     */
+    high = reader->num_checkpoints;
+    while (high - low > 1) {
+        size_t mid = low + (high - low) / 2;
+
+        if (reader->checkpoints[mid].time_us < time_us) {
+            low = mid;
+        } else {
+            high = mid;
+        }
+    }
+    *segment = low;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * recording_restore(session, policy, body, len) creates the streams of a
+ * checkpoint in a session and sets their packet indices
+ */
+static srtp_err_status_t recording_restore(srtp_t session,
+                                           const srtp_policy_t *policy,
+                                           const uint8_t *body,
+                                           size_t len)
+{
+    const srtp_policy_t *template_policy = NULL;
+    srtp_stream_sync_t sync;
+    srtp_policy_t stream_policy;
+    srtp_err_status_t status;
+    const uint8_t *p;
+    size_t count;
+    uint32_t flags;
+
+    if (len < SRTP_RECORDING_CHECKPOINT_LEN) {
+        return srtp_err_status_parse_err;
+    }
+    count = recording_get32(body);
+    if (len != SRTP_RECORDING_CHECKPOINT_LEN +
+                   count * (size_t)SRTP_RECORDING_STREAM_LEN) {
+        return srtp_err_status_parse_err;
+    }
+
+    for (; policy != NULL; policy = policy->next) {
+        if (policy->ssrc.type == ssrc_any_inbound) {
+            template_policy = policy;
+        }
+    }
+
+    p = body + SRTP_RECORDING_CHECKPOINT_LEN;
+    for (size_t i = 0; i < count; i++, p += SRTP_RECORDING_STREAM_LEN) {
+        memset(&sync, 0, sizeof(sync));
+        sync.ssrc = recording_get32(p);
+        sync.index = recording_get64(p + 8);
+        flags = recording_get32(p + 20);
+
+        if (srtp_get_stream(session, htonl(sync.ssrc)) == NULL) {
+            if (template_policy == NULL) {
+                /* the packets of the stream will fail with no_ctx */
+                continue;
+            }
+            stream_policy = *template_policy;
+            stream_policy.ssrc.type = ssrc_specific;
+            stream_policy.ssrc.value = sync.ssrc;
+            stream_policy.next = NULL;
+            status = srtp_stream_add(session, &stream_policy);
+            if (status) {
+                return status;
+            }
+        }
+
+        if (flags & SRTP_RECORDING_STREAM_SEEN) {
+            status = srtp_set_stream_sync(session, &sync, 1);
+        } else {
+            /* the ROC applies to the first packet, as for a receiver */
+            status = srtp_stream_set_roc(session, sync.ssrc,
+                                         (uint32_t)(sync.index >> 16));
+        }
+        if (status) {
+            return status;
+        }
+    }
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_recording_decrypt(const srtp_recording_reader_t *reader,
+                                         const srtp_policy_t *policy,
+                                         size_t segment,
+                                         uint64_t start_us,
+                                         uint64_t end_us,
+                                         srtp_recording_packet_func_t func,
+                                         void *user_data)
+{
+    uint8_t header[SRTP_RECORDING_RECORD_HEADER_LEN];
+    srtp_recording_packet_t packet;
+    srtp_err_status_t status;
+    srtp_t session = NULL;
+    uint8_t *body = NULL;
+    uint8_t *in = NULL;
+    uint8_t *out;
+    uint64_t offset;
+    uint64_t end;
+    size_t len;
+    FILE *file;
+
+    if (reader == NULL || policy == NULL || func == NULL ||
+        segment >= reader->num_checkpoints) {
+        return srtp_err_status_bad_param;
+    }
+
+    offset = reader->checkpoints[segment].offset;
+    end = segment + 1 < reader->num_checkpoints
+              ? reader->checkpoints[segment + 1].offset
+              : reader->end;
+    packet.number = reader->checkpoints[segment].first_packet;
+
+    file = fopen(reader->path, "rb");
+    if (file == NULL) {
+        return srtp_err_status_read_fail;
+    }
+
+    in = (uint8_t *)srtp_crypto_alloc(2 * SRTP_RECORDING_MAX_PACKET_LEN);
+    if (in == NULL) {
+        status = srtp_err_status_alloc_fail;
+        goto done;
+    }
+    out = in + SRTP_RECORDING_MAX_PACKET_LEN;
+
+    /* the checkpoint record */
+    if (recording_file_seek(file, offset) != 0 ||
+        fread(header, sizeof(header), 1, file) != 1) {
+        status = srtp_err_status_read_fail;
+        goto done;
+    }
+    len = recording_get32(header + 4);
+    if (header[0] != srtp_recording_record_checkpoint ||
+        offset + sizeof(header) + len > end) {
+        status = srtp_err_status_parse_err;
+        goto done;
+    }
+    body = (uint8_t *)srtp_crypto_alloc(len);
+    if (body == NULL) {
+        status = srtp_err_status_alloc_fail;
+        goto done;
+    }
+    if (fread(body, len, 1, file) != 1) {
+        status = srtp_err_status_read_fail;
+        goto done;
+    }
+
+    status = srtp_create(&session, policy);
+    if (status) {
+        session = NULL;
+        goto done;
+    }
+    status = recording_restore(session, policy, body, len);
+    if (status) {
+        goto done;
+    }
+    offset += sizeof(header) + len;
+
+    /* the packets up to the next checkpoint */
+    while (offset < end) {
+        if (fread(header, sizeof(header), 1, file) != 1) {
+            status = srtp_err_status_read_fail;
+            goto done;
+        }
+        len = recording_get32(header + 4);
+        packet.time_us = recording_get64(header + 8);
+        packet.is_rtcp = header[0] == srtp_recording_record_rtcp;
+        if ((header[0] != srtp_recording_record_rtp && !packet.is_rtcp) ||
+            len >= SRTP_RECORDING_MAX_PACKET_LEN) {
+            status = srtp_err_status_parse_err;
+            goto done;
+        }
+        if (packet.time_us >= end_us) {
+            break;
+        }
+        if (fread(in, len, 1, file) != 1) {
+            status = srtp_err_status_read_fail;
+            goto done;
+        }
+        offset += sizeof(header) + len;
+
+        packet.len = SRTP_RECORDING_MAX_PACKET_LEN;
+        if (packet.is_rtcp) {
+            packet.status =
+                srtp_unprotect_rtcp(session, in, len, out, &packet.len);
+        } else {
+            packet.status = srtp_unprotect(session, in, len, out, &packet.len);
+        }
+        if (packet.status == srtp_err_status_ok) {
+            packet.data = out;
+        } else {
+            packet.data = in;
+            packet.len = len;
+        }
+
+        if (packet.time_us >= start_us) {
+            func(user_data, &packet);
+        }
+        packet.number++;
+    }
+    status = srtp_err_status_ok;
+
+done:
+    if (session) {
+        srtp_dealloc(session);
+    }
+    if (body) {
+        srtp_crypto_free(body);
+    }
+    if (in) {
+        srtp_crypto_free(in);
+    }
+    fclose(file);
+
+    return status;
+}
@@ -0,0 +1,576 @@
+/*
+ * shared_state.c
+ *
+ * replay and rollover counter state shared between processes
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Leave this as the top level import. Ensures the existence of defines
+#include "config.h"
+
+#include "shared_state_priv.h"
+#include "alloc.h" /* for srtp_crypto_alloc() */
+
+#include <string.h>
+
+/*
+ * the slot locks use the atomic builtins of GCC and clang on memory that
+ * is mapped by all processes
+ */
+#if defined(HAVE_SYS_MMAN_H) && (defined(__GNUC__) || defined(__clang__))
+#define SRTP_SHARED_STATE_SUPPORTED
+#endif
+
+#ifdef SRTP_SHARED_STATE_SUPPORTED
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* spins before the owner of a lock is checked for being alive */
+#define SRTP_SHARED_STATE_SPINS 1024
+
+struct srtp_shared_state_t {
+    int fd;
+    void *map;
+    size_t map_len;
+    srtp_shared_state_header_t *header;
+    uint8_t *slots;
+    size_t slot_len;
+    size_t num_slots;
+    uint32_t num_words;
+    uint64_t owner; /* lock word of this process */
+};
+
+srtp_debug_module_t mod_shared_state = {
+    false,         /* debugging is off by default */
+    "shared state" /* printable name for module   */
+};
+
+static srtp_shared_slot_t *srtp_shared_state_slot(
+    const srtp_shared_state_t *state,
+    size_t i)
+{
+    return (srtp_shared_slot_t *)(state->slots + i * state->slot_len);
+}
+
+bool srtp_shared_state_is_set(const srtp_shared_slot_t *slot)
+{
+    return slot->generation != 0;
+}
+
+static uint32_t srtp_stream_window_words(const srtp_stream_ctx_t *stream)
+{
+    return (uint32_t)(bitvector_get_length(&stream->rtp_rdbx.bitmask) / 32);
+}
+
+srtp_err_status_t srtp_shared_state_load(const srtp_shared_state_t *state,
+                                         srtp_shared_slot_t *slot,
+                                         srtp_stream_ctx_t *stream)
+{
+    uint32_t num_words = srtp_stream_window_words(stream);
+
+    if (num_words > state->num_words) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (slot->generation == 0 ||
+        (stream->shared_slot == slot &&
+         stream->shared_generation == slot->generation)) {
+        return srtp_err_status_ok;
+    }
+
+    stream->rtp_rdbx.index = slot->rtp_index;
+    memcpy(stream->rtp_rdbx.bitmask.word, slot->rtp_bitmask,
+           num_words * sizeof(uint32_t));
+    stream->rtcp_rdb = slot->rtcp_rdb;
+    stream->shared_generation = slot->generation;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_shared_state_store(const srtp_shared_state_t *state,
+                                          srtp_shared_slot_t *slot,
+                                          srtp_stream_ctx_t *stream)
+{
+    uint32_t num_words = srtp_stream_window_words(stream);
+
+    if (num_words > state->num_words) {
+        return srtp_err_status_bad_param;
+    }
+
+    slot->dirty = 1;
+    slot->rtp_index = stream->rtp_rdbx.index;
+    memcpy(slot->rtp_bitmask, stream->rtp_rdbx.bitmask.word,
+           num_words * sizeof(uint32_t));
+    slot->rtcp_rdb = stream->rtcp_rdb;
+    slot->generation++;
+    slot->dirty = 0;
+
+    stream->shared_generation = slot->generation;
+
+    return srtp_err_status_ok;
+}
+
+static bool srtp_shared_slot_get_bit(const srtp_shared_slot_t *slot,
+                                     uint32_t bit)
+{
+    return (slot->rtp_bitmask[bit >> 5] >> (bit & 31)) & 1;
+}
+
+srtp_err_status_t srtp_shared_state_merge(const srtp_shared_state_t *state,
+                                          const srtp_shared_slot_t *slot,
+                                          srtp_stream_ctx_t *stream)
+{
+    srtp_rdbx_t *rdbx = &stream->rtp_rdbx;
+    srtp_rdb_t *rdb = &stream->rtcp_rdb;
+    uint32_t num_words = srtp_stream_window_words(stream);
+    uint32_t ws = num_words * 32;
+    uint64_t age;
+    uint32_t b;
+    bool replay = false;
+
+    if (num_words > state->num_words) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (slot->generation == 0) {
+        return srtp_err_status_ok;
+    }
+
+    /* move the RTP window of the stream to the highest index of the two */
+    if (slot->rtp_index > rdbx->index) {
+        age = slot->rtp_index - rdbx->index;
+        bitvector_left_shift(&rdbx->bitmask, age < ws ? (size_t)age : ws);
+        rdbx->index = slot->rtp_index;
+    }
+
+    /* bit b of a window of length ws records the index ws - 1 - b back */
+    for (b = 0; b < ws; b++) {
+        if (!srtp_shared_slot_get_bit(slot, b) ||
+            slot->rtp_index < ws - 1 - b) {
+            continue;
+        }
+        age = rdbx->index - (slot->rtp_index - (ws - 1 - b));
+        if (age >= ws) {
+            continue;
+        }
+        if (bitvector_get_bit(&rdbx->bitmask, ws - 1 - (uint32_t)age)) {
+            replay = true;
+        }
+        bitvector_set_bit(&rdbx->bitmask, ws - 1 - (uint32_t)age);
+    }
+
+    /* the RTCP indices of the slot are added as if they were received */
+    for (b = 0; b < 8 * sizeof(v128_t); b++) {
+        if (!v128_get_bit(&slot->rtcp_rdb.bitmask, b)) {
+            continue;
+        }
+        switch (srtp_rdb_check(rdb, slot->rtcp_rdb.window_start + b)) {
+        case srtp_err_status_ok:
+            srtp_rdb_add_index(rdb, slot->rtcp_rdb.window_start + b);
+            break;
+        case srtp_err_status_replay_fail:
+            replay = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    return replay ? srtp_err_status_replay_fail : srtp_err_status_ok;
+}
+
+#ifdef SRTP_SHARED_STATE_SUPPORTED
+
+/*
+ * srtp_shared_state_start_time(pid) returns the start time of process pid
+ * in clock ticks since boot, truncated to 32 bits, or zero if it is not
+ * known
+ */
+static uint32_t srtp_shared_state_start_time(pid_t pid)
+{
+#ifdef __linux__
+    char buf[1024];
+    const char *p;
+    ssize_t len;
+    int fd;
+    int i;
+
+    snprintf(buf, sizeof(buf), "/proc/%d/stat", (int)pid);
+    fd = open(buf, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    len = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (len <= 0) {
+        return 0;
+    }
+    buf[len] = '\0';
+
+    /*
+     * the start time is field 22, the command in field 2 may contain
+     * spaces but ends with the last ')'
+     */
+    p = strrchr(buf, ')');
+    for (i = 2; p != NULL && i < 22; i++) {
+        p = strchr(p + 1, ' ');
+    }
+    if (p == NULL) {
+        return 0;
+    }
+
+    return (uint32_t)strtoull(p + 1, NULL, 10);
+#else
+    (void)pid;
+    return 0;
+#endif
+}
+
+static uint64_t srtp_shared_state_owner(pid_t pid)
+{
+    return (uint64_t)srtp_shared_state_start_time(pid) << 32 | (uint32_t)pid;
+}
+
+static bool srtp_shared_state_owner_died(uint64_t owner)
+{
+    pid_t pid = (pid_t)(uint32_t)owner;
+    uint32_t start_time = (uint32_t)(owner >> 32);
+    uint32_t current;
+
+    if (owner == 0) {
+        return false;
+    }
+
+    if (kill(pid, 0) != 0 && errno == ESRCH) {
+        return true;
+    }
+
+    /* the process id of the owner may be used by a newer process */
+    current = srtp_shared_state_start_time(pid);
+    return start_time != 0 && current != 0 && current != start_time;
+}
+
+static void srtp_shared_state_acquire(const srtp_shared_state_t *state,
+                                      uint64_t *lock)
+{
+    uint64_t owner;
+    unsigned int spins = 0;
+
+    for (;;) {
+        owner = 0;
+        if (__atomic_compare_exchange_n(lock, &owner, state->owner, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return;
+        }
+
+        if (++spins < SRTP_SHARED_STATE_SPINS) {
+            continue;
+        }
+        spins = 0;
+
+        /* take over the lock of a process that exited while holding it */
+        if (srtp_shared_state_owner_died(owner) &&
+            __atomic_compare_exchange_n(lock, &owner, state->owner, false,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            debug_print(mod_shared_state, "took over lock of process %u",
+                        (unsigned int)(uint32_t)owner);
+            return;
+        }
+        sched_yield();
+    }
+}
+
+static void srtp_shared_state_release(uint64_t *lock)
+{
+    __atomic_store_n(lock, 0, __ATOMIC_RELEASE);
+}
+
+void srtp_shared_state_lock(const srtp_shared_state_t *state,
+                            srtp_shared_slot_t *slot)
+{
+    srtp_shared_state_acquire(state, &slot->lock);
+
+    /*
+     * the previous owner died while writing the slot, so treat every
+     * index in the replay windows as seen rather than accept a replay
+     */
+    if (slot->dirty) {
+        memset(slot->rtp_bitmask, 0xff, state->num_words * sizeof(uint32_t));
+        memset(&slot->rtcp_rdb.bitmask, 0xff, sizeof(slot->rtcp_rdb.bitmask));
+        slot->generation++;
+        slot->dirty = 0;
+    }
+}
+
+void srtp_shared_state_unlock(srtp_shared_slot_t *slot)
+{
+    srtp_shared_state_release(&slot->lock);
+}
+
+/* clears the state a slot may still hold for the SSRC that freed it */
+static void srtp_shared_state_clear(const srtp_shared_state_t *state,
+                                    srtp_shared_slot_t *slot)
+{
+    slot->dirty = 0;
+    slot->generation = 0;
+    slot->rtp_index = 0;
+    memset(&slot->rtcp_rdb, 0, sizeof(slot->rtcp_rdb));
+    memset(slot->rtp_bitmask, 0, state->num_words * sizeof(uint32_t));
+}
+
+srtp_err_status_t srtp_shared_state_claim(srtp_shared_state_t *state,
+                                          uint32_t ssrc,
+                                          bool create,
+                                          srtp_shared_slot_t **slot_ptr)
+{
+    srtp_shared_slot_t *slot = NULL;
+    srtp_shared_slot_t *free_slot = NULL;
+    srtp_shared_slot_t *s;
+    size_t i;
+
+    srtp_shared_state_acquire(state, &state->header->lock);
+
+    for (i = 0; i < state->num_slots; i++) {
+        s = srtp_shared_state_slot(state, i);
+        if (s->refs == 0) {
+            if (free_slot == NULL) {
+                free_slot = s;
+            }
+        } else if (s->ssrc == ssrc) {
+            slot = s;
+            break;
+        }
+    }
+
+    if (slot == NULL && create && free_slot != NULL) {
+        slot = free_slot;
+        srtp_shared_state_clear(state, slot);
+        slot->ssrc = ssrc;
+    }
+    if (slot != NULL) {
+        slot->refs++;
+    }
+
+    srtp_shared_state_release(&state->header->lock);
+
+    if (slot == NULL) {
+        if (!create) {
+            return srtp_err_status_no_ctx;
+        }
+        debug_print(mod_shared_state, "no free slot for SSRC 0x%08x",
+                    (unsigned int)ntohl(ssrc));
+        return srtp_err_status_alloc_fail;
+    }
+
+    *slot_ptr = slot;
+
+    return srtp_err_status_ok;
+}
+
+void srtp_shared_state_unclaim(srtp_shared_state_t *state,
+                               srtp_shared_slot_t *slot)
+{
+    srtp_shared_state_acquire(state, &state->header->lock);
+    if (slot->refs > 0 && --slot->refs == 0) {
+        slot->ssrc = 0;
+    }
+    srtp_shared_state_release(&state->header->lock);
+}
+
+srtp_err_status_t srtp_shared_state_alloc(srtp_shared_state_t **state_ptr,
+                                          const char *path,
+                                          size_t max_streams,
+                                          size_t window_size)
+{
+    srtp_shared_state_t *state;
+    srtp_shared_state_header_t *header;
+    struct stat st;
+    size_t num_words;
+
+    if (path == NULL || max_streams == 0 || max_streams > UINT32_MAX ||
+        window_size < 64 || window_size >= 0x8000) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* the replay window of a stream rounded up as by bitvector_alloc() */
+    num_words = (window_size + 31) / 32;
+
+    state = (srtp_shared_state_t *)srtp_crypto_alloc(
+        sizeof(srtp_shared_state_t));
+    if (state == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    state->fd = -1;
+    state->map = MAP_FAILED;
+    state->num_slots = max_streams;
+    state->num_words = (uint32_t)num_words;
+    state->owner = srtp_shared_state_owner(getpid());
+    state->slot_len = (sizeof(srtp_shared_slot_t) +
+                       num_words * sizeof(uint32_t) + 7) &
+                      ~(size_t)7;
+    state->map_len =
+        sizeof(srtp_shared_state_header_t) + max_streams * state->slot_len;
+
+    state->fd = open(path, O_RDWR | O_CREAT, 0600);
+    if (state->fd < 0 || fstat(state->fd, &st) != 0) {
+        srtp_shared_state_dealloc(state);
+        return srtp_err_status_read_fail;
+    }
+
+    /*
+     * processes that open the file at the same time all see it empty and
+     * extend it to the same length, which is harmless
+     */
+    if (st.st_size == 0) {
+        if (ftruncate(state->fd, (off_t)state->map_len) != 0) {
+            srtp_shared_state_dealloc(state);
+            return srtp_err_status_write_fail;
+        }
+    } else if ((size_t)st.st_size != state->map_len) {
+        srtp_shared_state_dealloc(state);
+        return srtp_err_status_parse_err;
+    }
+
+    state->map = mmap(NULL, state->map_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, state->fd, 0);
+    if (state->map == MAP_FAILED) {
+        srtp_shared_state_dealloc(state);
+        return srtp_err_status_read_fail;
+    }
+
+    header = (srtp_shared_state_header_t *)state->map;
+    state->header = header;
+    state->slots = (uint8_t *)(header + 1);
+
+    /* the first process to take the lock of an empty file initializes it */
+    srtp_shared_state_acquire(state, &header->lock);
+    if (header->magic[0] == '\0') {
+        header->version = SRTP_SHARED_STATE_VERSION;
+        header->num_slots = (uint32_t)max_streams;
+        header->num_words = (uint32_t)num_words;
+        memcpy(header->magic, SRTP_SHARED_STATE_MAGIC, sizeof(header->magic));
+    }
+    srtp_shared_state_release(&header->lock);
+
+    if (memcmp(header->magic, SRTP_SHARED_STATE_MAGIC,
+               sizeof(header->magic)) != 0 ||
+        header->version != SRTP_SHARED_STATE_VERSION ||
+        header->num_slots != max_streams || header->num_words != num_words) {
+        srtp_shared_state_dealloc(state);
+        return srtp_err_status_parse_err;
+    }
+
+    debug_print2(mod_shared_state, "mapped %s with %u slots", path,
+                 (unsigned int)max_streams);
+
+    *state_ptr = state;
+
+    return srtp_err_status_ok;
+}
+
+void srtp_shared_state_dealloc(srtp_shared_state_t *state)
+{
+    if (state->map != MAP_FAILED) {
+        munmap(state->map, state->map_len);
+    }
+    if (state->fd >= 0) {
+        close(state->fd);
+    }
+    srtp_crypto_free(state);
+}
+
+#else /* SRTP_SHARED_STATE_SUPPORTED */
+
+void srtp_shared_state_lock(const srtp_shared_state_t *state,
+                            srtp_shared_slot_t *slot)
+{
+    (void)state;
+    (void)slot;
+}
+
+void srtp_shared_state_unlock(srtp_shared_slot_t *slot)
+{
+    (void)slot;
+}
+
+srtp_err_status_t srtp_shared_state_claim(srtp_shared_state_t *state,
+                                          uint32_t ssrc,
+                                          bool create,
+                                          srtp_shared_slot_t **slot_ptr)
+{
+    (void)state;
+    (void)ssrc;
+    (void)create;
+    (void)slot_ptr;
+
+    return srtp_err_status_no_such_op;
+}
+
+void srtp_shared_state_unclaim(srtp_shared_state_t *state,
+                               srtp_shared_slot_t *slot)
+{
+    (void)state;
+    (void)slot;
+}
+
+srtp_err_status_t srtp_shared_state_alloc(srtp_shared_state_t **state_ptr,
+                                          const char *path,
+                                          size_t max_streams,
+                                          size_t window_size)
+{
+    (void)state_ptr;
+    (void)path;
+    (void)max_streams;
+    (void)window_size;
+
+    return srtp_err_status_no_such_op;
+}
+
+void srtp_shared_state_dealloc(srtp_shared_state_t *state)
+{
+    (void)state;
+}
+
+#endif /* SRTP_SHARED_STATE_SUPPORTED */
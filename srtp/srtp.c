@@ -47,6 +47,11 @@
 
 #include "srtp_priv.h"
 #include "stream_list_priv.h"
+#include "ekt_priv.h"
+#include "index_store_priv.h"
+#include "shared_state_priv.h"
+#include "recording_priv.h"
+#include "trace_priv.h"
 #include "crypto_types.h"
 #include "err.h"
 #include "alloc.h" /* for srtp_crypto_alloc() */
@@ -55,6 +60,11 @@
 #include "aes_gcm.h" /* for AES GCM mode */
 #endif
 
+#if !defined(OPENSSL) && !defined(WOLFSSL) && !defined(MBEDTLS) &&           \
+    !defined(NSS)
+#include "aes.h" /* for the key derivation function */
+#endif
+
 #ifdef OPENSSL_KDF
 #include <openssl/kdf.h>
 #include "aes_icm_ext.h"
@@ -74,6 +84,8 @@
 #endif
 
 #include <limits.h>
+#include <stdlib.h> /* for qsort() */
+#include <time.h>
 #ifdef HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #elif defined(HAVE_WINSOCK2_H)
@@ -191,6 +203,100 @@ unsigned int srtp_get_version(void)
     return rv;
 }
 
+/*
+ * each entry of a retransmission cache has a slot for the RTP and one for
+ * the SRTP packet, and one more slot stages the RTP packet being protected
+ */
+static size_t srtp_tx_cache_buffer_len(size_t num_entries, size_t slot_len)
+{
+    return (2 * num_entries + 1) * slot_len;
+}
+
+static srtp_err_status_t srtp_tx_cache_alloc(srtp_tx_cache_t **cache_ptr,
+                                             size_t num_entries,
+                                             size_t max_packet_len)
+{
+    srtp_tx_cache_t *cache;
+
+    *cache_ptr = NULL;
+
+    if (num_entries == 0) {
+        return srtp_err_status_ok;
+    }
+
+    if (max_packet_len == 0) {
+        max_packet_len = SRTP_TX_CACHE_DEFAULT_PACKET_LEN;
+    }
+
+    /* keep the buffer size computation below from overflowing */
+    if (num_entries > 0x10000 || max_packet_len > 0x10000) {
+        return srtp_err_status_bad_param;
+    }
+
+    cache = (srtp_tx_cache_t *)srtp_crypto_alloc(sizeof(srtp_tx_cache_t));
+    if (cache == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    cache->num_entries = num_entries;
+    cache->max_packet_len = max_packet_len;
+    cache->slot_len = max_packet_len + SRTP_MAX_TRAILER_LEN;
+
+    cache->entries = (srtp_tx_cache_entry_t *)srtp_crypto_alloc(
+        num_entries * sizeof(srtp_tx_cache_entry_t));
+    cache->buffer = (uint8_t *)srtp_crypto_alloc(
+        srtp_tx_cache_buffer_len(num_entries, cache->slot_len));
+    if (cache->entries == NULL || cache->buffer == NULL) {
+        srtp_crypto_free(cache->entries);
+        srtp_crypto_free(cache->buffer);
+        srtp_crypto_free(cache);
+        return srtp_err_status_alloc_fail;
+    }
+
+    for (size_t i = 0; i < num_entries; i++) {
+        cache->entries[i].rtp_slot = cache->buffer + (2 * i) * cache->slot_len;
+        cache->entries[i].srtp_slot =
+            cache->buffer + (2 * i + 1) * cache->slot_len;
+    }
+    cache->staging = cache->buffer + 2 * num_entries * cache->slot_len;
+
+    *cache_ptr = cache;
+
+    return srtp_err_status_ok;
+}
+
+static void srtp_tx_cache_dealloc(srtp_tx_cache_t *cache)
+{
+    if (cache == NULL) {
+        return;
+    }
+
+    /* the cache holds plaintext, so zeroize it before freeing */
+    octet_string_set_to_zero(
+        cache->buffer,
+        srtp_tx_cache_buffer_len(cache->num_entries, cache->slot_len));
+    srtp_crypto_free(cache->buffer);
+    srtp_crypto_free(cache->entries);
+    srtp_crypto_free(cache);
+}
+
+/*
+ * srtp_tx_cache_reset() empties the cache of a stream that is reused for
+ * another SSRC, zeroizing the plaintext of the previous one
+ */
+static void srtp_tx_cache_reset(srtp_tx_cache_t *cache)
+{
+    for (size_t i = 0; i < cache->num_entries; i++) {
+        cache->entries[i].valid = false;
+    }
+    cache->hits = 0;
+    cache->misses = 0;
+
+    octet_string_set_to_zero(
+        cache->buffer,
+        srtp_tx_cache_buffer_len(cache->num_entries, cache->slot_len));
+}
+
 static srtp_err_status_t srtp_stream_dealloc(
     srtp_stream_ctx_t *stream,
     const srtp_stream_ctx_t *stream_template)
@@ -204,7 +310,8 @@ static srtp_err_status_t srtp_stream_dealloc(
      * fails, then we report that fact without trying to deallocate
      * anything else
      */
-    if (stream->session_keys) {
+    /* a repair stream uses the session keys of its media stream */
+    if (stream->session_keys && !stream->is_repair) {
         for (size_t i = 0; i < stream->num_master_keys; i++) {
             session_keys = &stream->session_keys[i];
 
@@ -303,7 +410,7 @@ static srtp_err_status_t srtp_stream_dealloc(
                 session_keys->limit == template_session_keys->limit) {
                 /* do nothing */
             } else if (session_keys->limit) {
-                srtp_crypto_free(session_keys->limit);
+                srtp_crypto_free_aligned(session_keys->limit);
             }
         }
         srtp_crypto_free(stream->session_keys);
@@ -314,43 +421,179 @@ static srtp_err_status_t srtp_stream_dealloc(
         return status;
     }
 
-    if (stream_template &&
-        stream->enc_xtn_hdr == stream_template->enc_xtn_hdr) {
+    srtp_tx_cache_dealloc(stream->tx_cache);
+
+    srtp_ekt_dealloc(stream->ekt);
+
+    if (stream->is_repair ||
+        (stream_template &&
+         stream->enc_xtn_hdr == stream_template->enc_xtn_hdr)) {
         /* do nothing */
     } else if (stream->enc_xtn_hdr) {
         srtp_crypto_free(stream->enc_xtn_hdr);
     }
 
     /* deallocate srtp stream context */
-    srtp_crypto_free(stream);
+    srtp_crypto_free_aligned(stream);
 
     return srtp_err_status_ok;
 }
 
-/* try to insert stream in list or deallocate it */
-static srtp_err_status_t srtp_insert_or_dealloc_stream(srtp_stream_list_t list,
+/*
+ * srtp_release_stream() returns a stream that is no longer used to the
+ * stream pool of a fixed capacity session if it is a clone of the current
+ * template and the pool has room, or deallocates it
+ */
+static srtp_err_status_t srtp_release_stream(srtp_t session,
+                                             srtp_stream_t stream,
+                                             srtp_stream_t template)
+{
+    /* a removed stream gives its index store slot to the next new SSRC */
+    if (stream->index_slot != NULL) {
+        srtp_index_store_release(session->index_store, stream->index_slot);
+        stream->index_slot = NULL;
+    }
+
+    if (stream->shared_slot != NULL) {
+        srtp_shared_state_unclaim(session->shared_state, stream->shared_slot);
+        stream->shared_slot = NULL;
+    }
+
+    if (stream->quota_bytes) {
+        session->quota_streams--;
+        session->quota_bytes -= stream->quota_bytes;
+        stream->quota_bytes = 0;
+    }
+
+    if (stream->is_repair) {
+        session->repair_streams--;
+        return srtp_stream_dealloc(stream, NULL);
+    }
+
+    if (session->stream_pool != NULL && template != NULL &&
+        template == session->stream_template &&
+        stream->num_master_keys == template->num_master_keys &&
+        stream->session_keys[0].rtp_cipher ==
+            template->session_keys[0].rtp_cipher &&
+        session->stream_pool_count < session->max_streams) {
+        session->stream_pool[session->stream_pool_count++] = stream;
+        return srtp_err_status_ok;
+    }
+
+    return srtp_stream_dealloc(stream, template);
+}
+
+/*
+ * srtp_stream_slots_t holds the index store and shared state slots of a
+ * stream that is replaced by srtp_update() or srtp_stream_update(), so
+ * that they are handed to the replacement instead of being freed with the
+ * old stream
+ */
+typedef struct srtp_stream_slots_t {
+    srtp_index_slot_t *index_slot;
+    uint64_t index_rtp_limit;
+    uint32_t index_rtcp_limit;
+    uint64_t index_rtp_resume;
+    srtp_shared_slot_t *shared_slot;
+} srtp_stream_slots_t;
+
+static void srtp_stream_take_slots(srtp_stream_ctx_t *stream,
+                                   srtp_stream_slots_t *slots)
+{
+    slots->index_slot = stream->index_slot;
+    slots->index_rtp_limit = stream->index_rtp_limit;
+    slots->index_rtcp_limit = stream->index_rtcp_limit;
+    slots->index_rtp_resume = stream->index_rtp_resume;
+    slots->shared_slot = stream->shared_slot;
+    stream->index_slot = NULL;
+    stream->shared_slot = NULL;
+}
+
+/* frees the slots that could not be handed to a replacement */
+static void srtp_stream_drop_slots(srtp_t session, srtp_stream_slots_t *slots)
+{
+    if (slots->index_slot != NULL) {
+        srtp_index_store_release(session->index_store, slots->index_slot);
+        slots->index_slot = NULL;
+    }
+    if (slots->shared_slot != NULL) {
+        srtp_shared_state_unclaim(session->shared_state, slots->shared_slot);
+        slots->shared_slot = NULL;
+    }
+}
+
+static void srtp_stream_give_slots(srtp_t session,
+                                   srtp_stream_ctx_t *stream,
+                                   srtp_stream_slots_t *slots)
+{
+    stream->index_slot = slots->index_slot;
+    stream->index_rtp_limit = slots->index_rtp_limit;
+    stream->index_rtcp_limit = slots->index_rtcp_limit;
+    stream->index_rtp_resume = slots->index_rtp_resume;
+    slots->index_slot = NULL;
+
+    /* a replacement added by stream_add() has claimed the slot again */
+    if (stream->shared_slot != NULL) {
+        srtp_stream_drop_slots(session, slots);
+        return;
+    }
+    /* the next packet loads the whole replay window from the slot */
+    stream->shared_slot = slots->shared_slot;
+    stream->shared_generation = 0;
+    slots->shared_slot = NULL;
+}
+
+/*
+ * srtp_stream_claim_shared() claims the shared state slot of a stream
+ * that is added to a session, so that the slot is only taken by streams
+ * that were added explicitly or accepted an authenticated packet
+ */
+static srtp_err_status_t srtp_stream_claim_shared(srtp_t session,
+                                                  srtp_stream_t stream)
+{
+    if (session->shared_state == NULL || stream->shared_slot != NULL) {
+        return srtp_err_status_ok;
+    }
+
+    stream->shared_generation = 0;
+    return srtp_shared_state_claim(session->shared_state, stream->ssrc, true,
+                                   &stream->shared_slot);
+}
+
+/* try to insert stream in the index of the session or deallocate it */
+static srtp_err_status_t srtp_insert_or_dealloc_stream(srtp_t session,
                                                        srtp_stream_t stream,
                                                        srtp_stream_t template)
 {
-    srtp_err_status_t status = srtp_stream_list_insert(list, stream);
+    srtp_err_status_t status = srtp_stream_claim_shared(session, stream);
+    if (status == srtp_err_status_ok) {
+        status = session->stream_index->insert(session->stream_list,
+                                               stream->ssrc, stream);
+    }
     /* on failure, ownership wasn't transferred and we need to deallocate */
     if (status) {
-        srtp_stream_dealloc(stream, template);
+        srtp_release_stream(session, stream, template);
     }
     return status;
 }
 
 struct remove_and_dealloc_streams_data {
     srtp_err_status_t status;
-    srtp_stream_list_t list;
+    const srtp_stream_index_t *index;
+    void *list;
     srtp_stream_t template;
+    srtp_shared_state_t *shared_state;
 };
 
 static bool remove_and_dealloc_streams_cb(srtp_stream_t stream, void *data)
 {
     struct remove_and_dealloc_streams_data *d =
         (struct remove_and_dealloc_streams_data *)data;
-    srtp_stream_list_remove(d->list, stream);
+    d->index->remove(d->list, stream->ssrc);
+    if (stream->shared_slot != NULL) {
+        srtp_shared_state_unclaim(d->shared_state, stream->shared_slot);
+        stream->shared_slot = NULL;
+    }
     d->status = srtp_stream_dealloc(stream, d->template);
     if (d->status) {
         return false;
@@ -359,12 +602,15 @@ static bool remove_and_dealloc_streams_cb(srtp_stream_t stream, void *data)
 }
 
 static srtp_err_status_t srtp_remove_and_dealloc_streams(
-    srtp_stream_list_t list,
-    srtp_stream_t template)
+    const srtp_stream_index_t *index,
+    void *list,
+    srtp_stream_t template,
+    srtp_shared_state_t *shared_state)
 {
-    struct remove_and_dealloc_streams_data data = { srtp_err_status_ok, list,
-                                                    template };
-    srtp_stream_list_for_each(list, remove_and_dealloc_streams_cb, &data);
+    struct remove_and_dealloc_streams_data data = {
+        srtp_err_status_ok, index, list, template, shared_state
+    };
+    index->for_each(list, remove_and_dealloc_streams_cb, &data);
     return data.status;
 }
 
@@ -405,6 +651,11 @@ static srtp_err_status_t srtp_valid_policy(const srtp_policy_t *policy)
         }
     }
 
+    /* EKT carries a single master key */
+    if (policy->ekt != NULL && policy->key == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
     return srtp_err_status_ok;
 }
 
@@ -430,7 +681,8 @@ static srtp_err_status_t srtp_stream_alloc(srtp_stream_ctx_t **str_ptr,
      */
 
     /* allocate srtp stream and set str_ptr */
-    str = (srtp_stream_ctx_t *)srtp_crypto_alloc(sizeof(srtp_stream_ctx_t));
+    str = (srtp_stream_ctx_t *)srtp_crypto_alloc_aligned(
+        sizeof(srtp_stream_ctx_t), SRTP_CACHE_LINE_SIZE);
     if (str == NULL) {
         return srtp_err_status_alloc_fail;
     }
@@ -500,8 +752,9 @@ static srtp_err_status_t srtp_stream_alloc(srtp_stream_ctx_t **str_ptr,
         session_keys->mki_id = NULL;
 
         /* allocate key limit structure */
-        session_keys->limit = (srtp_key_limit_ctx_t *)srtp_crypto_alloc(
-            sizeof(srtp_key_limit_ctx_t));
+        session_keys->limit =
+            (srtp_key_limit_ctx_t *)srtp_crypto_alloc_aligned(
+                sizeof(srtp_key_limit_ctx_t), SRTP_CACHE_LINE_SIZE);
         if (session_keys->limit == NULL) {
             srtp_stream_dealloc(str, NULL);
             return srtp_err_status_alloc_fail;
@@ -563,6 +816,14 @@ static srtp_err_status_t srtp_stream_alloc(srtp_stream_ctx_t **str_ptr,
         str->enc_xtn_hdr_count = 0;
     }
 
+    /* allocate retransmission cache, if requested */
+    stat = srtp_tx_cache_alloc(&str->tx_cache, p->tx_cache_size,
+                               p->tx_cache_max_packet_len);
+    if (stat) {
+        srtp_stream_dealloc(str, NULL);
+        return stat;
+    }
+
     return srtp_err_status_ok;
 }
 
@@ -588,7 +849,8 @@ static srtp_err_status_t srtp_stream_clone(
                 (unsigned int)ntohl(ssrc));
 
     /* allocate srtp stream and set str_ptr */
-    str = (srtp_stream_ctx_t *)srtp_crypto_alloc(sizeof(srtp_stream_ctx_t));
+    str = (srtp_stream_ctx_t *)srtp_crypto_alloc_aligned(
+        sizeof(srtp_stream_ctx_t), SRTP_CACHE_LINE_SIZE);
     if (str == NULL) {
         return srtp_err_status_alloc_fail;
     }
@@ -669,11 +931,224 @@ static srtp_err_status_t srtp_stream_clone(
     str->direction = stream_template->direction;
     str->rtp_services = stream_template->rtp_services;
     str->rtcp_services = stream_template->rtcp_services;
+    str->rtp_plan = stream_template->rtp_plan;
+    str->rtcp_plan = stream_template->rtcp_plan;
 
     /* copy information about extensions header encryption */
     str->enc_xtn_hdr = stream_template->enc_xtn_hdr;
     str->enc_xtn_hdr_count = stream_template->enc_xtn_hdr_count;
 
+    /* cached packets are per ssrc, so each clone gets its own cache */
+    if (stream_template->tx_cache) {
+        status = srtp_tx_cache_alloc(&str->tx_cache,
+                                     stream_template->tx_cache->num_entries,
+                                     stream_template->tx_cache->max_packet_len);
+        if (status) {
+            srtp_stream_dealloc(*str_ptr, stream_template);
+            *str_ptr = NULL;
+            return status;
+        }
+    }
+
+    /* the EKT context is shared with the template */
+    if (stream_template->ekt) {
+        str->ekt = srtp_ekt_ref(stream_template->ekt);
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_reset_clone(stream, stream_template, ssrc) returns a clone
+ * of stream_template taken from the stream pool to the state that
+ * srtp_stream_clone() leaves a new clone in, without allocating
+ */
+static void srtp_stream_reset_clone(srtp_stream_ctx_t *str,
+                                    const srtp_stream_ctx_t *stream_template,
+                                    uint32_t ssrc)
+{
+    bitvector_set_to_zero(&str->rtp_rdbx.bitmask);
+    srtp_index_init(&str->rtp_rdbx.index);
+    srtp_rdb_init(&str->rtcp_rdb);
+
+    str->ssrc = ssrc;
+    str->pending_roc = 0;
+    str->direction = stream_template->direction;
+
+    if (str->tx_cache) {
+        srtp_tx_cache_reset(str->tx_cache);
+    }
+
+    /* bind the key limits to those of the template as a new clone does */
+    for (size_t i = 0; i < str->num_master_keys; i++) {
+        srtp_key_limit_clone(stream_template->session_keys[i].limit,
+                             &str->session_keys[i].limit);
+    }
+
+    str->ekt_packet_count = 0;
+    str->index_slot = NULL;
+    str->index_rtp_limit = 0;
+    str->index_rtcp_limit = 0;
+    str->index_rtp_resume = 0;
+    str->index_attach_failed = 0;
+    str->shared_slot = NULL;
+    str->shared_generation = 0;
+    str->cost_samples = 0;
+    str->cost_ns = 0;
+    str->quota_bytes = 0;
+}
+
+/*
+ * srtp_stream_pool_fill(session) clones the template of a fixed capacity
+ * session until its stream pool is full
+ */
+static srtp_err_status_t srtp_stream_pool_fill(srtp_t session)
+{
+    srtp_err_status_t status;
+
+    while (session->stream_pool_count < session->max_streams) {
+        srtp_stream_ctx_t *str;
+
+        status = srtp_stream_clone(session->stream_template, 0, &str);
+        if (status) {
+            return status;
+        }
+        session->stream_pool[session->stream_pool_count++] = str;
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_pool_empty(session) deallocates the streams in the stream
+ * pool, which are clones of the current template
+ */
+static void srtp_stream_pool_empty(srtp_t session)
+{
+    while (session->stream_pool_count > 0) {
+        session->stream_pool_count--;
+        srtp_stream_dealloc(session->stream_pool[session->stream_pool_count],
+                            session->stream_template);
+    }
+}
+
+/*
+ * srtp_stream_size(stream, is_clone) is the memory that stream allocated,
+ * including the padding of aligned allocations, which is charged to the
+ * quota of the session.  a clone shares the key limits and header
+ * extension ids of its template.  the cipher and auth contexts of a
+ * stream that is not a clone are allocated by the crypto kernel and are
+ * not counted.
+ */
+static size_t srtp_stream_size(const srtp_stream_ctx_t *stream, bool is_clone)
+{
+    const srtp_tx_cache_t *cache = stream->tx_cache;
+    size_t size;
+
+    size = srtp_crypto_alloc_aligned_size(sizeof(srtp_stream_ctx_t),
+                                          SRTP_CACHE_LINE_SIZE);
+    size += stream->num_master_keys *
+            (sizeof(srtp_session_keys_t) + stream->mki_size);
+
+    /* bitvector_alloc() rounds the window up to 16 octets */
+    size += srtp_crypto_alloc_aligned_size(
+        (bitvector_get_length(&stream->rtp_rdbx.bitmask) / 8 + 15) &
+            ~(size_t)15,
+        SRTP_CACHE_LINE_SIZE);
+
+    if (cache) {
+        size += sizeof(srtp_tx_cache_t) +
+                cache->num_entries * sizeof(srtp_tx_cache_entry_t) +
+                srtp_tx_cache_buffer_len(cache->num_entries, cache->slot_len);
+    }
+
+    if (!is_clone) {
+        size += stream->num_master_keys *
+                srtp_crypto_alloc_aligned_size(sizeof(srtp_key_limit_ctx_t),
+                                               SRTP_CACHE_LINE_SIZE);
+        size += stream->enc_xtn_hdr_count * sizeof(*stream->enc_xtn_hdr);
+    }
+
+    return size;
+}
+
+/*
+ * srtp_stream_clone_size(stream_template) is the memory that a clone of
+ * stream_template allocates, it is known before the clone is allocated
+ * since the clone copies the dimensions of the template
+ */
+static size_t srtp_stream_clone_size(const srtp_stream_ctx_t *stream_template)
+{
+    return srtp_stream_size(stream_template, true);
+}
+
+/*
+ * srtp_quota_reserve(ctx, size) charges a clone of size octets to the
+ * quota of the session before it is allocated, or counts a rejection
+ */
+static srtp_err_status_t srtp_quota_reserve(srtp_ctx_t *ctx, size_t size)
+{
+    if ((ctx->quota_max_streams &&
+         ctx->quota_streams >= ctx->quota_max_streams) ||
+        (ctx->quota_max_bytes &&
+         ctx->quota_bytes + size > ctx->quota_max_bytes)) {
+        ctx->quota_rejections++;
+        debug_print(mod_srtp, "stream quota exceeded, %u streams",
+                    (unsigned int)ctx->quota_streams);
+        return srtp_err_status_quota_fail;
+    }
+
+    ctx->quota_streams++;
+    ctx->quota_bytes += size;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_clone_template_stream(ctx, ssrc, stream) adds a stream for ssrc
+ * (in network order) cloned from the template of the session, a fixed
+ * capacity session takes it from its stream pool
+ */
+static srtp_err_status_t srtp_clone_template_stream(srtp_ctx_t *ctx,
+                                                    uint32_t ssrc,
+                                                    srtp_stream_ctx_t **stream)
+{
+    srtp_err_status_t status;
+    srtp_stream_ctx_t *str;
+    size_t size = srtp_stream_clone_size(ctx->stream_template);
+
+    /* a peer sending new SSRCs is bounded before anything is allocated */
+    status = srtp_quota_reserve(ctx, size);
+    if (status) {
+        return status;
+    }
+
+    if (ctx->stream_pool != NULL) {
+        if (ctx->stream_pool_count == 0) {
+            ctx->quota_streams--;
+            ctx->quota_bytes -= size;
+            return srtp_err_status_alloc_fail;
+        }
+        str = ctx->stream_pool[--ctx->stream_pool_count];
+        srtp_stream_reset_clone(str, ctx->stream_template, ssrc);
+    } else {
+        status = srtp_stream_clone(ctx->stream_template, ssrc, &str);
+        if (status) {
+            ctx->quota_streams--;
+            ctx->quota_bytes -= size;
+            return status;
+        }
+    }
+    str->quota_bytes = size;
+
+    /* add new stream to the list, which releases the quota on failure */
+    status = srtp_insert_or_dealloc_stream(ctx, str, ctx->stream_template);
+    if (status) {
+        return status;
+    }
+
+    *stream = str;
+
     return srtp_err_status_ok;
 }
 
@@ -872,7 +1347,8 @@ static srtp_err_status_t srtp_kdf_clear(srtp_kdf_t *kdf)
     return srtp_err_status_ok;
 }
 
-#else  /* if OPENSSL_KDF || WOLFSSL_KDF */
+#elif defined(OPENSSL) || defined(WOLFSSL) || defined(MBEDTLS) ||          \
+    defined(NSS)
 
 /*
  * srtp_kdf_t represents a key derivation function.  The SRTP
@@ -955,6 +1431,84 @@ static srtp_err_status_t srtp_kdf_clear(srtp_kdf_t *kdf)
     kdf->cipher = NULL;
     return srtp_err_status_ok;
 }
+
+#else /* built-in crypto */
+
+/*
+ * srtp_kdf_t represents a key derivation function.  The SRTP
+ * default KDF is the only one implemented at present.  with the
+ * built-in crypto the master key is expanded into the srtp_kdf_t
+ * itself, which lives on the stack of srtp_stream_init_keys(), so
+ * deriving the keys of a stream does not allocate a cipher.
+ */
+typedef struct {
+    srtp_aes_expanded_key_t expanded_key; /* expanded master key        */
+    v128_t master_salt;                   /* master salt, zero padded   */
+} srtp_kdf_t;
+
+static srtp_err_status_t srtp_kdf_init(srtp_kdf_t *kdf,
+                                       const uint8_t *key,
+                                       size_t key_len)
+{
+    size_t base_key_len;
+
+    switch (key_len) {
+    case SRTP_AES_ICM_256_KEY_LEN_WSALT:
+        base_key_len = SRTP_AES_256_KEY_LEN;
+        break;
+    case SRTP_AES_ICM_128_KEY_LEN_WSALT:
+        base_key_len = SRTP_AES_128_KEY_LEN;
+        break;
+    default:
+        return srtp_err_status_bad_param;
+        break;
+    }
+
+    v128_set_to_zero(&kdf->master_salt);
+    memcpy(&kdf->master_salt, key + base_key_len, SRTP_SALT_LEN);
+
+    return srtp_aes_expand_encryption_key(key, base_key_len,
+                                          &kdf->expanded_key);
+}
+
+/*
+ * srtp_kdf_generate() writes the AES-CM keystream of the label straight
+ * into key: block i is the encryption of the master salt, XORed with
+ * the label in octet 7, with i in the last two octets (RFC 3711 4.3.3)
+ */
+static srtp_err_status_t srtp_kdf_generate(srtp_kdf_t *kdf,
+                                           srtp_prf_label label,
+                                           uint8_t *key,
+                                           size_t length)
+{
+    v128_t block;
+    size_t i = 0;
+
+    while (length > 0) {
+        size_t block_len = length < sizeof(v128_t) ? length : sizeof(v128_t);
+
+        v128_copy(&block, &kdf->master_salt);
+        block.v8[7] ^= (uint8_t)label;
+        block.v8[14] = (uint8_t)(i >> 8);
+        block.v8[15] = (uint8_t)i;
+        srtp_aes_encrypt(&block, &kdf->expanded_key);
+
+        memcpy(key, &block, block_len);
+        key += block_len;
+        length -= block_len;
+        i++;
+    }
+    octet_string_set_to_zero(&block, sizeof(block));
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_kdf_clear(srtp_kdf_t *kdf)
+{
+    octet_string_set_to_zero(kdf, sizeof(srtp_kdf_t));
+
+    return srtp_err_status_ok;
+}
 #endif /* else OPENSSL_KDF || WOLFSSL_KDF */
 
 /*
@@ -1433,6 +1987,50 @@ srtp_err_status_t srtp_stream_init_all_master_keys(srtp_stream_ctx_t *srtp,
     return status;
 }
 
+/*
+ * srtp_stream_init_ekt(stream, policy) allocates the EKT context of a
+ * stream, the EKTField carries the master key without the salt
+ */
+static srtp_err_status_t srtp_stream_init_ekt(srtp_stream_ctx_t *stream,
+                                              const srtp_policy_t *p)
+{
+    const srtp_session_keys_t *session_keys = &stream->session_keys[0];
+    size_t key_len, rtcp_key_len, master_key_len;
+
+    key_len = full_key_length(session_keys->rtp_cipher->type);
+    rtcp_key_len = full_key_length(session_keys->rtcp_cipher->type);
+    if (rtcp_key_len > key_len) {
+        key_len = rtcp_key_len;
+    }
+
+    master_key_len = base_key_length(session_keys->rtp_cipher->type,
+                                     srtp_cipher_get_key_length(
+                                         session_keys->rtp_cipher));
+    if (master_key_len == 0) {
+        /* the null cipher still derives keys from a 128-bit master key */
+        master_key_len = SRTP_AES_128_KEY_LEN;
+    }
+
+    return srtp_ekt_alloc(&stream->ekt, p, key_len, master_key_len);
+}
+
+/*
+ * srtp_packet_plan_init(plan, cipher, auth) sets the packet plan for a
+ * cipher and auth function
+ */
+static void srtp_packet_plan_init(srtp_packet_plan_t *plan,
+                                  const srtp_cipher_t *cipher,
+                                  const srtp_auth_t *auth)
+{
+    plan->aead = cipher->algorithm == SRTP_AES_GCM_128 ||
+                 cipher->algorithm == SRTP_AES_GCM_256;
+    plan->icm_iv = cipher->type->id == SRTP_AES_ICM_128 ||
+                   cipher->type->id == SRTP_AES_ICM_192 ||
+                   cipher->type->id == SRTP_AES_ICM_256;
+    plan->tag_len = srtp_auth_get_tag_length(auth);
+    plan->prefix_len = srtp_auth_get_prefix_length(auth);
+}
+
 static srtp_err_status_t srtp_stream_init(srtp_stream_ctx_t *srtp,
                                           const srtp_policy_t *p)
 {
@@ -1499,6 +2097,21 @@ static srtp_err_status_t srtp_stream_init(srtp_stream_ctx_t *srtp,
         return err;
     }
 
+    /* all master keys use the same cipher and auth types */
+    srtp_packet_plan_init(&srtp->rtp_plan, srtp->session_keys[0].rtp_cipher,
+                          srtp->session_keys[0].rtp_auth);
+    srtp_packet_plan_init(&srtp->rtcp_plan, srtp->session_keys[0].rtcp_cipher,
+                          srtp->session_keys[0].rtcp_auth);
+
+    /* initialize encrypted key transport */
+    if (p->ekt != NULL) {
+        err = srtp_stream_init_ekt(srtp, p);
+        if (err) {
+            srtp_rdbx_dealloc(&srtp->rtp_rdbx);
+            return err;
+        }
+    }
+
     return srtp_err_status_ok;
 }
 
@@ -1583,6 +2196,108 @@ static bool srtp_protect_extension_header(srtp_stream_ctx_t *stream, uint8_t id)
     return false;
 }
 
+/*
+ * srtp_skip_xtn_padding() returns the first octet from data on that is not
+ * header extension padding, or end
+ */
+static const uint8_t *srtp_skip_xtn_padding(const uint8_t *data,
+                                            const uint8_t *end)
+{
+#if defined(__SSE2__)
+    const __m128i zero = _mm_setzero_si128();
+
+    /* skip whole blocks of 16 padding octets */
+    while (end - data >= 16) {
+        __m128i block = _mm_loadu_si128((const __m128i *)data);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(block, zero)) != 0xffff) {
+            break;
+        }
+        data += 16;
+    }
+#endif
+
+    while (data < end && *data == 0) {
+        data++;
+    }
+
+    return data;
+}
+
+/*
+ * srtp_next_xtn_element() parses the element at *pos of a one-byte
+ * (RFC 8285, section 4.2) or two-byte (section 4.3) header extension
+ * block ending at end.  it sets *id, *len and *data to the element and
+ * advances *pos past the element and the padding following it; *data is
+ * NULL when the block holds no further element.
+ */
+static srtp_err_status_t srtp_next_xtn_element(const uint8_t **pos,
+                                               const uint8_t *end,
+                                               bool two_byte,
+                                               uint8_t *id,
+                                               size_t *len,
+                                               const uint8_t **data)
+{
+    const uint8_t *p = *pos;
+
+    *data = NULL;
+
+    if (two_byte) {
+        if (p + 1 >= end) {
+            return srtp_err_status_ok;
+        }
+        *id = p[0];
+        *len = p[1];
+        p += 2;
+    } else {
+        if (p >= end) {
+            return srtp_err_status_ok;
+        }
+        *id = (p[0] & 0xf0) >> 4;
+        *len = (p[0] & 0x0f) + 1;
+        p++;
+    }
+
+    if (*len > (size_t)(end - p)) {
+        return srtp_err_status_parse_err;
+    }
+
+    if (!two_byte && *id == 15) {
+        /* found header 15, stop further processing */
+        return srtp_err_status_ok;
+    }
+
+    *data = p;
+    *pos = srtp_skip_xtn_padding(p + *len, end);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_get_xtn_block() returns the start and end of the elements of the
+ * header extension xtn_hdr and whether it uses two-byte headers
+ */
+static srtp_err_status_t srtp_get_xtn_block(const srtp_hdr_xtnd_t *xtn_hdr,
+                                            const uint8_t **start,
+                                            const uint8_t **end,
+                                            bool *two_byte)
+{
+    uint16_t profile = ntohs(xtn_hdr->profile_specific);
+
+    if (profile == 0xbede) {
+        *two_byte = false;
+    } else if ((profile & 0xfff0) == 0x1000) {
+        *two_byte = true;
+    } else {
+        /* unsupported extension header format. */
+        return srtp_err_status_parse_err;
+    }
+
+    *start = (const uint8_t *)xtn_hdr + octets_in_rtp_xtn_hdr;
+    *end = *start + ntohs(xtn_hdr->length) * sizeof(uint32_t);
+
+    return srtp_err_status_ok;
+}
+
 /*
  * extensions header encryption RFC 6904
  */
@@ -1593,87 +2308,49 @@ static srtp_err_status_t srtp_process_header_encryption(
 {
     srtp_err_status_t status;
     uint8_t keystream[257]; /* Maximum 2 bytes header + 255 bytes data. */
-    size_t keystream_pos;
-    uint8_t *xtn_hdr_data = ((uint8_t *)xtn_hdr) + octets_in_rtp_xtn_hdr;
-    uint8_t *xtn_hdr_end =
-        xtn_hdr_data + (ntohs(xtn_hdr->length) * sizeof(uint32_t));
-
-    if (ntohs(xtn_hdr->profile_specific) == 0xbede) {
-        /* RFC 5285, section 4.2. One-Byte Header */
-        while (xtn_hdr_data < xtn_hdr_end) {
-            uint8_t xid = (*xtn_hdr_data & 0xf0) >> 4;
-            size_t xlen = (*xtn_hdr_data & 0x0f) + 1;
-            size_t xlen_with_header = 1 + xlen;
-            xtn_hdr_data++;
-
-            if (xtn_hdr_data + xlen > xtn_hdr_end) {
-                return srtp_err_status_parse_err;
-            }
-
-            if (xid == 15) {
-                /* found header 15, stop further processing */
-                break;
-            }
-
-            status = srtp_cipher_output(session_keys->rtp_xtn_hdr_cipher,
-                                        keystream, &xlen_with_header);
-            if (status) {
-                return srtp_err_status_cipher_fail;
-            }
+    const uint8_t *xtn_hdr_start;
+    const uint8_t *xtn_hdr_end;
+    const uint8_t *pos;
+    const uint8_t *data;
+    size_t xhdr_len;
+    bool two_byte;
+
+    status = srtp_get_xtn_block(xtn_hdr, &xtn_hdr_start, &xtn_hdr_end,
+                                &two_byte);
+    if (status) {
+        return status;
+    }
 
-            if (srtp_protect_extension_header(stream, xid)) {
-                keystream_pos = 1;
-                while (xlen > 0) {
-                    *xtn_hdr_data ^= keystream[keystream_pos++];
-                    xtn_hdr_data++;
-                    xlen--;
-                }
-            } else {
-                xtn_hdr_data += xlen;
-            }
+    xhdr_len = two_byte ? 2 : 1;
+    pos = xtn_hdr_start;
+    while (true) {
+        uint8_t xid;
+        size_t xlen;
+        size_t xlen_with_header;
 
-            /* skip padding bytes */
-            while (xtn_hdr_data < xtn_hdr_end && *xtn_hdr_data == 0) {
-                xtn_hdr_data++;
-            }
+        status = srtp_next_xtn_element(&pos, xtn_hdr_end, two_byte, &xid,
+                                       &xlen, &data);
+        if (status) {
+            return status;
+        }
+        if (data == NULL) {
+            break;
         }
-    } else if ((ntohs(xtn_hdr->profile_specific) & 0xfff0) == 0x1000) {
-        /* RFC 5285, section 4.3. Two-Byte Header */
-        while (xtn_hdr_data + 1 < xtn_hdr_end) {
-            uint8_t xid = *xtn_hdr_data;
-            size_t xlen = *(xtn_hdr_data + 1);
-            size_t xlen_with_header = 2 + xlen;
-            xtn_hdr_data += 2;
-
-            if (xtn_hdr_data + xlen > xtn_hdr_end) {
-                return srtp_err_status_parse_err;
-            }
-
-            status = srtp_cipher_output(session_keys->rtp_xtn_hdr_cipher,
-                                        keystream, &xlen_with_header);
-            if (status) {
-                return srtp_err_status_cipher_fail;
-            }
 
-            if (xlen > 0 && srtp_protect_extension_header(stream, xid)) {
-                keystream_pos = 2;
-                while (xlen > 0) {
-                    *xtn_hdr_data ^= keystream[keystream_pos++];
-                    xtn_hdr_data++;
-                    xlen--;
-                }
-            } else {
-                xtn_hdr_data += xlen;
-            }
+        xlen_with_header = xhdr_len + xlen;
+        status = srtp_cipher_output(session_keys->rtp_xtn_hdr_cipher,
+                                    keystream, &xlen_with_header);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
 
-            /* skip padding bytes. */
-            while (xtn_hdr_data < xtn_hdr_end && *xtn_hdr_data == 0) {
-                xtn_hdr_data++;
+        if (xlen > 0 && srtp_protect_extension_header(stream, xid)) {
+            uint8_t *xtn_hdr_data =
+                (uint8_t *)xtn_hdr + (data - (const uint8_t *)xtn_hdr);
+            for (size_t i = 0; i < xlen; i++) {
+                xtn_hdr_data[i] ^= keystream[xhdr_len + i];
             }
         }
-    } else {
-        /* unsupported extension header format. */
-        return srtp_err_status_parse_err;
     }
 
     return srtp_err_status_ok;
@@ -1787,15 +2464,8 @@ static srtp_err_status_t srtp_get_session_keys_for_rtp_packet(
     size_t pkt_octet_len,
     srtp_session_keys_t **session_keys)
 {
-    size_t tag_len = 0;
-
-    // Determine the authentication tag size
-    if (stream->session_keys[0].rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
-        stream->session_keys[0].rtp_cipher->algorithm == SRTP_AES_GCM_256) {
-        tag_len = 0;
-    } else {
-        tag_len = srtp_auth_get_tag_length(stream->session_keys[0].rtp_auth);
-    }
+    /* an AEAD tag is part of the ciphertext, it does not precede the MKI */
+    size_t tag_len = stream->rtp_plan.aead ? 0 : stream->rtp_plan.tag_len;
 
     return srtp_get_session_keys_for_packet(stream, hdr, pkt_octet_len, tag_len,
                                             session_keys);
@@ -1807,20 +2477,36 @@ static srtp_err_status_t srtp_get_session_keys_for_rtcp_packet(
     size_t pkt_octet_len,
     srtp_session_keys_t **session_keys)
 {
-    size_t tag_len = 0;
-
-    // Determine the authentication tag size
-    if (stream->session_keys[0].rtcp_cipher->algorithm == SRTP_AES_GCM_128 ||
-        stream->session_keys[0].rtcp_cipher->algorithm == SRTP_AES_GCM_256) {
-        tag_len = 0;
-    } else {
-        tag_len = srtp_auth_get_tag_length(stream->session_keys[0].rtcp_auth);
-    }
+    /* an AEAD tag is part of the ciphertext, it does not precede the MKI */
+    size_t tag_len = stream->rtcp_plan.aead ? 0 : stream->rtcp_plan.tag_len;
 
     return srtp_get_session_keys_for_packet(stream, hdr, pkt_octet_len, tag_len,
                                             session_keys);
 }
 
+/*
+ * srtp_checkpoint_rtp_index() and srtp_checkpoint_rtcp_index() move the
+ * persisted limit of a sending stream ahead before an index at or beyond
+ * it is used, so that a restarted process never reuses an index
+ */
+static inline void srtp_checkpoint_rtp_index(srtp_ctx_t *ctx,
+                                             srtp_stream_ctx_t *stream)
+{
+    if (stream->index_slot != NULL &&
+        stream->rtp_rdbx.index >= stream->index_rtp_limit) {
+        srtp_index_store_checkpoint_rtp(ctx->index_store, stream);
+    }
+}
+
+static inline void srtp_checkpoint_rtcp_index(srtp_ctx_t *ctx,
+                                              srtp_stream_ctx_t *stream)
+{
+    if (stream->index_slot != NULL &&
+        stream->rtcp_rdb.window_start >= stream->index_rtcp_limit) {
+        srtp_index_store_checkpoint_rtcp(ctx->index_store, stream);
+    }
+}
+
 static srtp_err_status_t srtp_estimate_index(srtp_rdbx_t *rdbx,
                                              uint32_t roc,
                                              srtp_xtd_seq_num_t *est,
@@ -1866,6 +2552,87 @@ static srtp_err_status_t srtp_get_est_pkt_index(const srtp_hdr_t *hdr,
     return result;
 }
 
+/*
+ * srtp_tx_cache_lookup() returns the entry holding the protected copy of
+ * the packet rtp with the packet index est, or NULL if that packet was
+ * not protected before or has changed since
+ */
+static srtp_tx_cache_entry_t *srtp_tx_cache_lookup(srtp_tx_cache_t *cache,
+                                                   srtp_xtd_seq_num_t est,
+                                                   size_t mki_index,
+                                                   const uint8_t *rtp,
+                                                   size_t rtp_len)
+{
+    srtp_tx_cache_entry_t *entry = &cache->entries[est % cache->num_entries];
+
+    if (!entry->valid || entry->index != est ||
+        entry->mki_index != mki_index || entry->rtp_len != rtp_len) {
+        return NULL;
+    }
+
+    if (memcmp(entry->rtp_slot, rtp, rtp_len) != 0) {
+        return NULL;
+    }
+
+    return entry;
+}
+
+/*
+ * srtp_tx_cache_prepare() copies the unprotected packet into the staging
+ * slot of the cache, since rtp may be protected in place.  no entry is
+ * touched until srtp_tx_cache_commit() is called for a packet that was
+ * protected successfully.  returns false if the packet is too large to
+ * be cached.
+ */
+static bool srtp_tx_cache_prepare(srtp_tx_cache_t *cache,
+                                  const uint8_t *rtp,
+                                  size_t rtp_len)
+{
+    if (rtp_len > cache->max_packet_len) {
+        return false;
+    }
+
+    memcpy(cache->staging, rtp, rtp_len);
+
+    return true;
+}
+
+/*
+ * srtp_tx_cache_commit() stores the staged packet with index est and its
+ * protected copy srtp in the entry for est.  an entry holding a newer
+ * packet is kept, so that protecting an old index again cannot evict it.
+ */
+static void srtp_tx_cache_commit(srtp_tx_cache_t *cache,
+                                 srtp_xtd_seq_num_t est,
+                                 size_t mki_index,
+                                 size_t rtp_len,
+                                 const uint8_t *srtp,
+                                 size_t srtp_len)
+{
+    srtp_tx_cache_entry_t *entry = &cache->entries[est % cache->num_entries];
+    uint8_t *slot;
+
+    if (srtp_len > cache->slot_len) {
+        return;
+    }
+
+    if (entry->valid && entry->index > est) {
+        return;
+    }
+
+    /* the staged packet becomes the entry's, its old slot is the next stage */
+    slot = entry->rtp_slot;
+    entry->rtp_slot = cache->staging;
+    cache->staging = slot;
+
+    entry->index = est;
+    entry->mki_index = mki_index;
+    entry->rtp_len = rtp_len;
+    entry->srtp_len = srtp_len;
+    memcpy(entry->srtp_slot, srtp, srtp_len);
+    entry->valid = true;
+}
+
 /*
  * This function handles outgoing SRTP packets while in AEAD mode,
  * which currently supports AES-GCM encryption.  All packets are
@@ -1909,7 +2676,7 @@ static srtp_err_status_t srtp_protect_aead(srtp_ctx_t *ctx,
     }
 
     /* get tag length from stream */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtp_auth);
+    tag_len = stream->rtp_plan.tag_len;
 
     /*
      * find starting point for encryption and length of data to be
@@ -1962,6 +2729,7 @@ static srtp_err_status_t srtp_protect_aead(srtp_ctx_t *ctx,
         }
         srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
     }
+    srtp_checkpoint_rtp_index(ctx, stream);
 
     debug_print(mod_srtp, "estimated packet index: %016" PRIx64, est);
 
@@ -2058,7 +2826,7 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
     debug_print(mod_srtp, "estimated u_packet index: %016" PRIx64, est);
 
     /* get tag length from stream */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtp_auth);
+    tag_len = stream->rtp_plan.tag_len;
 
     /*
      * AEAD uses a new IV formation method
@@ -2190,15 +2958,7 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
          * stream, and some implementations will want to not return
          * failure here
          */
-        status =
-            srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
-        if (status) {
-            return status;
-        }
-
-        /* add new stream to the list */
-        status = srtp_insert_or_dealloc_stream(ctx->stream_list, new_stream,
-                                               ctx->stream_template);
+        status = srtp_clone_template_stream(ctx, hdr->ssrc, &new_stream);
         if (status) {
             return status;
         }
@@ -2226,12 +2986,183 @@ static srtp_err_status_t srtp_unprotect_aead(srtp_ctx_t *ctx,
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_protect(srtp_t ctx,
-                               const uint8_t *rtp,
-                               size_t rtp_len,
-                               uint8_t *srtp,
-                               size_t *srtp_len,
-                               size_t mki_index)
+/*
+ * the cost sampler times one in cost_interval packet calls of a session
+ * and attributes the time to the session and to the stream of the
+ * packet's SSRC
+ */
+static uint64_t srtp_cost_clock(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+    return (uint64_t)clock() * (1000000000u / CLOCKS_PER_SEC);
+#endif
+}
+
+static inline bool srtp_cost_sample(srtp_ctx_t *ctx)
+{
+    if (ctx->cost_interval == 0 || --ctx->cost_countdown != 0) {
+        return false;
+    }
+
+    ctx->cost_countdown = ctx->cost_interval;
+    return true;
+}
+
+/*
+ * srtp_cost_attribute() adds the time since start to the session and to
+ * the stream of the packet, if the packet is long enough to hold an SSRC
+ * at ssrc_offset and the stream exists
+ */
+static void srtp_cost_attribute(srtp_ctx_t *ctx,
+                                const uint8_t *pkt,
+                                size_t pkt_len,
+                                size_t ssrc_offset,
+                                uint64_t start)
+{
+    uint64_t elapsed = srtp_cost_clock() - start;
+    srtp_stream_ctx_t *stream;
+    uint32_t ssrc;
+
+    ctx->cost_samples++;
+    ctx->cost_ns += elapsed;
+
+    if (pkt_len < ssrc_offset + sizeof(ssrc)) {
+        return;
+    }
+
+    memcpy(&ssrc, pkt + ssrc_offset, sizeof(ssrc));
+    stream = srtp_get_stream(ctx, ssrc);
+    if (stream != NULL) {
+        stream->cost_samples++;
+        stream->cost_ns += elapsed;
+    }
+}
+
+/*
+ * srtp_shared_call_t records what srtp_shared_enter() did for a call, so
+ * that srtp_shared_leave() can undo it
+ */
+typedef struct srtp_shared_call_t {
+    bool entered;
+    srtp_shared_slot_t *slot; /* the locked slot, if the SSRC had one  */
+    bool claimed;             /* the slot was claimed for this call    */
+    bool provisional;         /* the stream was cloned for this call   */
+} srtp_shared_call_t;
+
+/*
+ * srtp_shared_leave() stores the state of the stream of ssrc, if there is
+ * one, and unlocks the slot.  a stream that accepted the first packet of
+ * an SSRC without a slot has claimed one when it was added, its state is
+ * merged with what other processes stored there meanwhile.  a stream that
+ * srtp_shared_enter() cloned for a packet that was not accepted is
+ * removed again.  returns status, or the error of storing the state if
+ * status is srtp_err_status_ok.
+ */
+static srtp_err_status_t srtp_shared_leave(srtp_ctx_t *ctx,
+                                           uint32_t ssrc,
+                                           srtp_shared_call_t *call,
+                                           srtp_err_status_t status)
+{
+    srtp_stream_ctx_t *stream;
+    srtp_shared_slot_t *slot = call->slot;
+    srtp_err_status_t store_status = srtp_err_status_ok;
+
+    stream = srtp_get_stream(ctx, ssrc);
+
+    if (slot == NULL) {
+        if (status || stream == NULL || stream->shared_slot == NULL) {
+            return status;
+        }
+        slot = stream->shared_slot;
+        srtp_shared_state_lock(ctx->shared_state, slot);
+        status = srtp_shared_state_merge(ctx->shared_state, slot, stream);
+    }
+
+    if (stream != NULL && status && call->provisional) {
+        ctx->stream_index->remove(ctx->stream_list, ssrc);
+        srtp_release_stream(ctx, stream, ctx->stream_template);
+        stream = NULL;
+    }
+
+    if (stream != NULL) {
+        store_status = srtp_shared_state_store(ctx->shared_state, slot, stream);
+    }
+
+    srtp_shared_state_unlock(slot);
+
+    if (call->claimed) {
+        srtp_shared_state_unclaim(ctx->shared_state, slot);
+    }
+
+    return status ? status : store_status;
+}
+
+/*
+ * srtp_shared_enter() locks the shared state slot of ssrc (in network
+ * order) and loads it into the stream.  a stream that another process
+ * has already used is created from the template first, so that the
+ * template is not used to accept a packet the other process has seen.
+ * the slot of an SSRC that no process has a stream for is only claimed
+ * if create is set, so that unauthenticated packets can not use up the
+ * slots.
+ */
+static srtp_err_status_t srtp_shared_enter(srtp_ctx_t *ctx,
+                                           uint32_t ssrc,
+                                           bool create,
+                                           srtp_shared_call_t *call)
+{
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
+
+    stream = srtp_get_stream(ctx, ssrc);
+    if (stream != NULL && stream->shared_slot != NULL) {
+        call->slot = stream->shared_slot;
+    } else {
+        status = srtp_shared_state_claim(ctx->shared_state, ssrc, create,
+                                         &call->slot);
+        if (status == srtp_err_status_no_ctx) {
+            call->entered = true;
+            return srtp_err_status_ok;
+        }
+        if (status) {
+            return status;
+        }
+        call->claimed = true;
+    }
+
+    srtp_shared_state_lock(ctx->shared_state, call->slot);
+
+    status = srtp_err_status_ok;
+    if (stream == NULL && ctx->stream_template != NULL &&
+        srtp_shared_state_is_set(call->slot)) {
+        status = srtp_clone_template_stream(ctx, ssrc, &stream);
+        call->provisional = !create;
+    }
+
+    if (status == srtp_err_status_ok && stream != NULL) {
+        status = srtp_shared_state_load(ctx->shared_state, call->slot, stream);
+    }
+
+    if (status) {
+        return srtp_shared_leave(ctx, ssrc, call, status);
+    }
+
+    call->entered = true;
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_protect_rtp(srtp_t ctx,
+                                          const uint8_t *rtp,
+                                          size_t rtp_len,
+                                          uint8_t *srtp,
+                                          size_t *srtp_len,
+                                          size_t mki_index)
 {
     const srtp_hdr_t *hdr = (const srtp_hdr_t *)rtp;
     size_t enc_start;         /* offset to start of encrypted portion   */
@@ -2245,6 +3176,8 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
     srtp_stream_ctx_t *stream;
     size_t prefix_len;
     srtp_session_keys_t *session_keys = NULL;
+    srtp_xtd_seq_num_t tx_cache_est = 0;
+    bool tx_cache_staged = false;
 
     debug_print0(mod_srtp, "function srtp_protect");
 
@@ -2272,15 +3205,7 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
             srtp_stream_ctx_t *new_stream;
 
             /* allocate and initialize a new stream */
-            status =
-                srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
-            if (status) {
-                return status;
-            }
-
-            /* add new stream to the list */
-            status = srtp_insert_or_dealloc_stream(ctx->stream_list, new_stream,
-                                                   ctx->stream_template);
+            status = srtp_clone_template_stream(ctx, hdr->ssrc, &new_stream);
             if (status) {
                 return status;
             }
@@ -2311,19 +3236,65 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
         }
     }
 
+    if (ctx->index_store != NULL && stream->index_slot == NULL) {
+        status = srtp_index_store_attach(ctx->index_store, stream);
+        if (status) {
+            return status;
+        }
+    }
+    if (stream->index_rtp_resume != 0) {
+        srtp_index_store_resume_rtp(stream, ntohs(hdr->seq));
+    }
+
     status = srtp_get_session_keys(stream, mki_index, &session_keys);
     if (status) {
         return status;
     }
 
+    /*
+     * if the stream keeps a retransmission cache and this packet has
+     * already been protected unchanged, return the stored SRTP packet;
+     * the same output is sent again so no keystream is reused, which is
+     * why this does not depend on allow_repeat_tx
+     */
+    if (stream->tx_cache) {
+        srtp_tx_cache_entry_t *cached;
+
+        status = srtp_get_est_pkt_index(hdr, stream, &est, &delta);
+        if (status == srtp_err_status_ok) {
+            if (srtp_rdbx_check(&stream->rtp_rdbx, delta) !=
+                srtp_err_status_ok) {
+                cached = srtp_tx_cache_lookup(stream->tx_cache, est,
+                                              mki_index, rtp, rtp_len);
+                if (cached) {
+                    if (*srtp_len < cached->srtp_len) {
+                        return srtp_err_status_buffer_small;
+                    }
+                    memcpy(srtp, cached->srtp_slot, cached->srtp_len);
+                    *srtp_len = cached->srtp_len;
+                    stream->tx_cache->hits++;
+                    return srtp_err_status_ok;
+                }
+                stream->tx_cache->misses++;
+            }
+            tx_cache_est = est;
+            tx_cache_staged =
+                srtp_tx_cache_prepare(stream->tx_cache, rtp, rtp_len);
+        }
+    }
+
     /*
      * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
      * the request to our AEAD handler.
      */
-    if (session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
-        session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_256) {
-        return srtp_protect_aead(ctx, stream, rtp, rtp_len, srtp, srtp_len,
-                                 session_keys);
+    if (stream->rtp_plan.aead) {
+        status = srtp_protect_aead(ctx, stream, rtp, rtp_len, srtp, srtp_len,
+                                   session_keys);
+        if (status == srtp_err_status_ok && tx_cache_staged) {
+            srtp_tx_cache_commit(stream->tx_cache, tx_cache_est, mki_index,
+                                 rtp_len, srtp, *srtp_len);
+        }
+        return status;
     }
 
     /*
@@ -2345,7 +3316,7 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
     }
 
     /* get tag length from stream */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtp_auth);
+    tag_len = stream->rtp_plan.tag_len;
 
     /*
      * find starting point for encryption and length of data to be
@@ -2414,15 +3385,14 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
         }
         srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
     }
+    srtp_checkpoint_rtp_index(ctx, stream);
 
     debug_print(mod_srtp, "estimated packet index: %016" PRIx64, est);
 
     /*
      * if we're using rindael counter mode, set nonce and seq
      */
-    if (session_keys->rtp_cipher->type->id == SRTP_AES_ICM_128 ||
-        session_keys->rtp_cipher->type->id == SRTP_AES_ICM_192 ||
-        session_keys->rtp_cipher->type->id == SRTP_AES_ICM_256) {
+    if (stream->rtp_plan.icm_iv) {
         v128_t iv;
 
         iv.v32[0] = 0;
@@ -2459,7 +3429,7 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
      * prefix into the authentication tag
      */
     if (auth_start) {
-        prefix_len = srtp_auth_get_prefix_length(session_keys->rtp_auth);
+        prefix_len = stream->rtp_plan.prefix_len;
         if (prefix_len) {
             status = srtp_cipher_output(session_keys->rtp_cipher, auth_tag,
                                         &prefix_len);
@@ -2531,23 +3501,150 @@ srtp_err_status_t srtp_protect(srtp_t ctx,
     /* increate the packet length by the mki size if used */
     *srtp_len += stream->mki_size;
 
+    if (tx_cache_staged) {
+        srtp_tx_cache_commit(stream->tx_cache, tx_cache_est, mki_index,
+                             rtp_len, srtp, *srtp_len);
+    }
+
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_unprotect(srtp_t ctx,
-                                 const uint8_t *srtp,
-                                 size_t srtp_len,
-                                 uint8_t *rtp,
-                                 size_t *rtp_len)
+/*
+ * srtp_protect_ekt() protects an RTP packet of a session that uses EKT,
+ * room for the EKTField of the stream is reserved in the srtp buffer and
+ * the field is appended once the packet has been protected
+ */
+static srtp_err_status_t srtp_protect_ekt(srtp_t ctx,
+                                          const uint8_t *rtp,
+                                          size_t rtp_len,
+                                          uint8_t *srtp,
+                                          size_t *srtp_len,
+                                          size_t mki_index)
 {
-    const srtp_hdr_t *hdr = (const srtp_hdr_t *)srtp;
-    size_t enc_start;               /* pointer to start of encrypted portion  */
-    const uint8_t *auth_start;      /* pointer to start of auth. portion      */
-    size_t enc_octet_len = 0;       /* number of octets in encrypted portion  */
-    const uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
-    srtp_xtd_seq_num_t est;         /* estimated xtd_seq_num_t of *hdr        */
-    ssize_t delta;                  /* delta of local pkt idx and that in hdr */
-    v128_t iv;
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)rtp;
+    srtp_stream_ctx_t *stream;
+    const srtp_ekt_ctx_t *ekt = NULL;
+    size_t field_len;
+    size_t buffer_len = *srtp_len;
+    bool full = true;
+    srtp_err_status_t status;
+
+    if (rtp_len < octets_in_rtp_header) {
+        return srtp_err_status_bad_param;
+    }
+
+    /* a stream that is about to be cloned starts with a FullEKTField */
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+    if (stream != NULL) {
+        ekt = stream->ekt;
+        if (ekt != NULL) {
+            full = srtp_ekt_use_full_field(ekt, stream->ekt_packet_count);
+        }
+    } else if (ctx->stream_template != NULL) {
+        ekt = ctx->stream_template->ekt;
+    }
+
+    if (ekt == NULL) {
+        return srtp_protect_rtp(ctx, rtp, rtp_len, srtp, srtp_len, mki_index);
+    }
+
+    field_len = srtp_ekt_field_len(ekt, full);
+    if (buffer_len < field_len) {
+        return srtp_err_status_buffer_small;
+    }
+    *srtp_len = buffer_len - field_len;
+
+    status = srtp_protect_rtp(ctx, rtp, rtp_len, srtp, srtp_len, mki_index);
+    if (status) {
+        return status;
+    }
+
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+    if (stream == NULL) {
+        return srtp_err_status_no_ctx;
+    }
+
+    status = srtp_ekt_write_field(ekt, full, stream->ssrc,
+                                  srtp_rdbx_get_roc(&stream->rtp_rdbx),
+                                  srtp + *srtp_len);
+    if (status) {
+        return status;
+    }
+
+    stream->ekt_packet_count++;
+    *srtp_len += field_len;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_protect(srtp_t ctx,
+                               const uint8_t *rtp,
+                               size_t rtp_len,
+                               uint8_t *srtp,
+                               size_t *srtp_len,
+                               size_t mki_index)
+{
+    srtp_shared_call_t shared = { false, NULL, false, false };
+    srtp_err_status_t status;
+    uint32_t ssrc = 0;
+    uint64_t trace_start = 0;
+    uint64_t cost_start = 0;
+    bool cost_sample = srtp_cost_sample(ctx);
+
+    if (srtp_trace_enabled()) {
+        trace_start = srtp_trace_now();
+    }
+
+    if (cost_sample) {
+        cost_start = srtp_cost_clock();
+    }
+
+    if (ctx->shared_state != NULL && rtp_len >= octets_in_rtp_header) {
+        ssrc = ((const srtp_hdr_t *)rtp)->ssrc;
+        status = srtp_shared_enter(ctx, ssrc, true, &shared);
+        if (status) {
+            return status;
+        }
+    }
+
+    if (ctx->use_ekt) {
+        status =
+            srtp_protect_ekt(ctx, rtp, rtp_len, srtp, srtp_len, mki_index);
+    } else {
+        status =
+            srtp_protect_rtp(ctx, rtp, rtp_len, srtp, srtp_len, mki_index);
+    }
+
+    if (shared.entered) {
+        status = srtp_shared_leave(ctx, ssrc, &shared, status);
+    }
+
+    if (cost_sample) {
+        srtp_cost_attribute(ctx, rtp, rtp_len, 8, cost_start);
+    }
+
+    if (srtp_trace_enabled()) {
+        srtp_trace_packet(SRTP_TRACE_PROTECT, ctx, trace_start, rtp, rtp_len,
+                          *srtp_len, mki_index, status);
+    }
+
+    return status;
+}
+
+static srtp_err_status_t srtp_unprotect_rtp(srtp_t ctx,
+                                            const uint8_t *srtp,
+                                            size_t srtp_len,
+                                            uint8_t *rtp,
+                                            size_t *rtp_len)
+{
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)srtp;
+    size_t enc_start;               /* pointer to start of encrypted portion  */
+    const uint8_t *auth_start;      /* pointer to start of auth. portion      */
+    size_t enc_octet_len = 0;       /* number of octets in encrypted portion  */
+    const uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
+    srtp_xtd_seq_num_t est;         /* estimated xtd_seq_num_t of *hdr        */
+    ssize_t delta;                  /* delta of local pkt idx and that in hdr */
+    v128_t iv;
     srtp_err_status_t status;
     srtp_stream_ctx_t *stream;
     uint8_t tmp_tag[SRTP_MAX_TAG_LEN];
@@ -2632,22 +3729,19 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
      * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
      * the request to our AEAD handler.
      */
-    if (session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
-        session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_256) {
+    if (stream->rtp_plan.aead) {
         return srtp_unprotect_aead(ctx, stream, delta, est, srtp, srtp_len, rtp,
                                    rtp_len, session_keys, advance_packet_index);
     }
 
     /* get tag length from stream */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtp_auth);
+    tag_len = stream->rtp_plan.tag_len;
 
     /*
      * set the cipher's IV properly, depending on whatever cipher we
      * happen to be using
      */
-    if (session_keys->rtp_cipher->type->id == SRTP_AES_ICM_128 ||
-        session_keys->rtp_cipher->type->id == SRTP_AES_ICM_192 ||
-        session_keys->rtp_cipher->type->id == SRTP_AES_ICM_256) {
+    if (stream->rtp_plan.icm_iv) {
         /* aes counter mode */
         iv.v32[0] = 0;
         iv.v32[1] = hdr->ssrc; /* still in network order */
@@ -2722,7 +3816,7 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
          * the authenticator isn't using a universal hash function
          */
         if (session_keys->rtp_auth->prefix_len != 0) {
-            prefix_len = srtp_auth_get_prefix_length(session_keys->rtp_auth);
+            prefix_len = stream->rtp_plan.prefix_len;
             status = srtp_cipher_output(session_keys->rtp_cipher, tmp_tag,
                                         &prefix_len);
             debug_print(mod_srtp, "keystream prefix: %s",
@@ -2835,15 +3929,7 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
          * stream, and some implementations will want to not return
          * failure here
          */
-        status =
-            srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
-        if (status) {
-            return status;
-        }
-
-        /* add new stream to the list */
-        status = srtp_insert_or_dealloc_stream(ctx->stream_list, new_stream,
-                                               ctx->stream_template);
+        status = srtp_clone_template_stream(ctx, hdr->ssrc, &new_stream);
         if (status) {
             return status;
         }
@@ -2869,2016 +3955,4060 @@ srtp_err_status_t srtp_unprotect(srtp_t ctx,
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_init(void)
+static srtp_err_status_t stream_remove(srtp_t session, uint32_t ssrc);
+
+/*
+ * srtp_stream_add_ekt(ctx, ekt, field) adds a receiving stream for the
+ * SSRC, master key and ROC carried in a FullEKTField, all other settings
+ * are those of the template that ekt belongs to
+ */
+static srtp_err_status_t srtp_stream_add_ekt(srtp_t ctx,
+                                             srtp_ekt_ctx_t *ekt,
+                                             srtp_ekt_field_t *field)
 {
+    srtp_policy_t policy;
+    srtp_stream_ctx_t *stream;
     srtp_err_status_t status;
+    size_t size;
 
-    /* initialize crypto kernel */
-    status = srtp_crypto_kernel_init();
-    if (status) {
-        return status;
-    }
-
-    /* load srtp debug module into the kernel */
-    status = srtp_crypto_kernel_load_debug_module(&mod_srtp);
-    if (status) {
-        return status;
-    }
-
-    return srtp_err_status_ok;
-}
+    debug_print(mod_srtp, "adding stream from EKTField (SSRC: 0x%08x)",
+                (unsigned int)ntohl(field->ssrc));
 
-srtp_err_status_t srtp_shutdown(void)
-{
-    srtp_err_status_t status;
+    srtp_ekt_stream_policy(ekt, field, &policy);
 
-    /* shut down crypto kernel */
-    status = srtp_crypto_kernel_shutdown();
+    status = srtp_stream_alloc(&stream, &policy);
     if (status) {
         return status;
     }
 
-    /* shutting down crypto kernel frees the srtp debug module as well */
-
-    return srtp_err_status_ok;
-}
-
-srtp_stream_ctx_t *srtp_get_stream(srtp_t srtp, uint32_t ssrc)
-{
-    return srtp_stream_list_get(srtp->stream_list, ssrc);
-}
-
-srtp_err_status_t srtp_dealloc(srtp_t session)
-{
-    srtp_err_status_t status;
-
-    /*
-     * we take a conservative deallocation strategy - if we encounter an
-     * error deallocating a stream, then we stop trying to deallocate
-     * memory and just return an error
-     */
-
-    /* deallocate streams */
-    status = srtp_remove_and_dealloc_streams(session->stream_list,
-                                             session->stream_template);
+    status = srtp_stream_init(stream, &policy);
     if (status) {
+        srtp_stream_dealloc(stream, NULL);
         return status;
     }
 
-    /* deallocate stream template, if there is one */
-    if (session->stream_template != NULL) {
-        status = srtp_stream_dealloc(session->stream_template, NULL);
-        if (status) {
-            return status;
-        }
-    }
+    /* later packets of the stream carry EKTFields as well */
+    stream->ekt = srtp_ekt_ref(ekt);
+    stream->direction = dir_srtp_receiver;
+    stream->pending_roc = field->roc;
 
-    /* deallocate stream list */
-    status = srtp_stream_list_dealloc(session->stream_list);
+    /* a peer sending new SSRCs is bounded like for template clones */
+    size = srtp_stream_size(stream, false);
+    status = srtp_quota_reserve(ctx, size);
     if (status) {
+        srtp_stream_dealloc(stream, NULL);
         return status;
     }
+    stream->quota_bytes = size;
 
-    /* deallocate session context */
-    srtp_crypto_free(session);
-
-    return srtp_err_status_ok;
+    /* add the stream to the list, which releases the quota on failure */
+    return srtp_insert_or_dealloc_stream(ctx, stream, ctx->stream_template);
 }
 
-srtp_err_status_t srtp_stream_add(srtp_t session, const srtp_policy_t *policy)
+/*
+ * srtp_unprotect_ekt() removes the EKTField from an SRTP packet of a
+ * session that uses EKT before unprotecting it.  a FullEKTField for an
+ * unknown SSRC adds a stream with the received key, which is removed
+ * again if the packet does not authenticate with that key.
+ */
+static srtp_err_status_t srtp_unprotect_ekt(srtp_t ctx,
+                                            const uint8_t *srtp,
+                                            size_t srtp_len,
+                                            uint8_t *rtp,
+                                            size_t *rtp_len)
 {
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)srtp;
+    srtp_stream_ctx_t *stream;
+    srtp_ekt_ctx_t *ekt = NULL;
+    srtp_ekt_field_t field;
+    bool stream_added = false;
     srtp_err_status_t status;
-    srtp_stream_t tmp;
 
-    /* sanity check arguments */
-    if (session == NULL) {
+    if (srtp_len < octets_in_rtp_header) {
         return srtp_err_status_bad_param;
     }
 
-    status = srtp_valid_policy(policy);
-    if (status != srtp_err_status_ok) {
-        return status;
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+    if (stream != NULL) {
+        ekt = stream->ekt;
+    } else if (ctx->stream_template != NULL) {
+        ekt = ctx->stream_template->ekt;
     }
 
-    /* allocate stream  */
-    status = srtp_stream_alloc(&tmp, policy);
-    if (status) {
-        return status;
+    if (ekt == NULL) {
+        return srtp_unprotect_rtp(ctx, srtp, srtp_len, rtp, rtp_len);
     }
 
-    /* initialize stream  */
-    status = srtp_stream_init(tmp, policy);
+    status = srtp_ekt_parse_field(ekt, srtp, &srtp_len, &field);
     if (status) {
-        srtp_stream_dealloc(tmp, NULL);
         return status;
     }
 
     /*
-     * set the head of the stream list or the template to point to the
-     * stream that we've just alloced and init'ed, depending on whether
-     * or not it has a wildcard SSRC value or not
-     *
-     * if the template stream has already been set, then the policy is
-     * inconsistent, so we return a bad_param error code
+     * a FullEKTField for a stream that already exists is not used, and one
+     * that names another SSRC is discarded (RFC 8870 Section 4.3.2)
      */
-    switch (policy->ssrc.type) {
-    case (ssrc_any_outbound):
-        if (session->stream_template) {
-            srtp_stream_dealloc(tmp, NULL);
-            return srtp_err_status_bad_param;
-        }
-        session->stream_template = tmp;
-        session->stream_template->direction = dir_srtp_sender;
-        break;
-    case (ssrc_any_inbound):
-        if (session->stream_template) {
-            srtp_stream_dealloc(tmp, NULL);
-            return srtp_err_status_bad_param;
-        }
-        session->stream_template = tmp;
-        session->stream_template->direction = dir_srtp_receiver;
-        break;
-    case (ssrc_specific):
-        status = srtp_insert_or_dealloc_stream(session->stream_list, tmp,
-                                               session->stream_template);
+    if (field.full && stream == NULL && field.ssrc == hdr->ssrc) {
+        status = srtp_stream_add_ekt(ctx, ekt, &field);
         if (status) {
+            octet_string_set_to_zero(field.key, sizeof(field.key));
             return status;
         }
-        break;
-    case (ssrc_undefined):
-    default:
-        srtp_stream_dealloc(tmp, NULL);
-        return srtp_err_status_bad_param;
+        stream_added = true;
     }
+    octet_string_set_to_zero(field.key, sizeof(field.key));
 
-    return srtp_err_status_ok;
+    status = srtp_unprotect_rtp(ctx, srtp, srtp_len, rtp, rtp_len);
+    if (status && stream_added) {
+        stream_remove(ctx, ntohl(hdr->ssrc));
+    }
+
+    return status;
 }
 
-srtp_err_status_t srtp_create(srtp_t *session, /* handle for session     */
-                              const srtp_policy_t *policy)
-{ /* SRTP policy (list)     */
-    srtp_err_status_t stat;
-    srtp_ctx_t *ctx;
+srtp_err_status_t srtp_unprotect(srtp_t ctx,
+                                 const uint8_t *srtp,
+                                 size_t srtp_len,
+                                 uint8_t *rtp,
+                                 size_t *rtp_len)
+{
+    srtp_shared_call_t shared = { false, NULL, false, false };
+    srtp_err_status_t status;
+    uint32_t ssrc = 0;
+    uint64_t trace_start = 0;
+    uint64_t cost_start = 0;
+    bool cost_sample = srtp_cost_sample(ctx);
 
-    /* sanity check arguments */
-    if (session == NULL) {
-        return srtp_err_status_bad_param;
+    if (srtp_trace_enabled()) {
+        trace_start = srtp_trace_now();
     }
 
-    if (policy) {
-        stat = srtp_valid_policy(policy);
-        if (stat != srtp_err_status_ok) {
-            return stat;
-        }
+    if (cost_sample) {
+        cost_start = srtp_cost_clock();
     }
 
-    /* allocate srtp context and set ctx_ptr */
-    ctx = (srtp_ctx_t *)srtp_crypto_alloc(sizeof(srtp_ctx_t));
-    if (ctx == NULL) {
-        return srtp_err_status_alloc_fail;
+    if (ctx->shared_state != NULL && srtp_len >= octets_in_rtp_header) {
+        ssrc = ((const srtp_hdr_t *)srtp)->ssrc;
+        status = srtp_shared_enter(ctx, ssrc, false, &shared);
+        if (status) {
+            return status;
+        }
     }
-    *session = ctx;
 
-    ctx->stream_template = NULL;
-    ctx->stream_list = NULL;
-    ctx->user_data = NULL;
+    if (ctx->use_ekt) {
+        status = srtp_unprotect_ekt(ctx, srtp, srtp_len, rtp, rtp_len);
+    } else {
+        status = srtp_unprotect_rtp(ctx, srtp, srtp_len, rtp, rtp_len);
+    }
 
-    /* allocate stream list */
-    stat = srtp_stream_list_alloc(&ctx->stream_list);
-    if (stat) {
-        /* clean up everything */
-        srtp_dealloc(*session);
-        *session = NULL;
-        return stat;
+    if (shared.entered) {
+        status = srtp_shared_leave(ctx, ssrc, &shared, status);
     }
 
-    /*
-     * loop over elements in the policy list, allocating and
-     * initializing a stream for each element
-     */
-    while (policy != NULL) {
-        stat = srtp_stream_add(ctx, policy);
-        if (stat) {
-            /* clean up everything */
-            srtp_dealloc(*session);
-            *session = NULL;
-            return stat;
-        }
+    if (cost_sample) {
+        srtp_cost_attribute(ctx, srtp, srtp_len, 8, cost_start);
+    }
 
-        /* set policy to next item in list  */
-        policy = policy->next;
+    if (srtp_trace_enabled()) {
+        srtp_trace_packet(SRTP_TRACE_UNPROTECT, ctx, trace_start, srtp,
+                          srtp_len, *rtp_len, 0, status);
     }
 
-    return srtp_err_status_ok;
+    return status;
 }
 
-srtp_err_status_t srtp_stream_remove(srtp_t session, uint32_t ssrc)
+/*
+ * srtp_set_rtp_iv() sets the iv of the rtp ciphers of session_keys of
+ * stream for the packet with ssrc (network order) and packet index est
+ */
+static srtp_err_status_t srtp_set_rtp_iv(const srtp_stream_ctx_t *stream,
+                                         srtp_session_keys_t *session_keys,
+                                         uint32_t ssrc,
+                                         srtp_xtd_seq_num_t est,
+                                         srtp_cipher_direction_t direction)
 {
-    srtp_stream_ctx_t *stream;
     srtp_err_status_t status;
+    v128_t iv;
 
-    /* sanity check arguments */
-    if (session == NULL) {
-        return srtp_err_status_bad_param;
-    }
-
-    /* find and remove stream from the list */
-    stream = srtp_stream_list_get(session->stream_list, htonl(ssrc));
-    if (stream == NULL) {
-        return srtp_err_status_no_ctx;
+    if (stream->rtp_plan.icm_iv) {
+        /* aes counter mode */
+        iv.v32[0] = 0;
+        iv.v32[1] = ssrc;
+        iv.v64[1] = be64_to_cpu(est << 16);
+    } else {
+        /* no particular format - set the iv to the packet index */
+        iv.v64[0] = 0;
+        iv.v64[1] = be64_to_cpu(est);
     }
 
-    srtp_stream_list_remove(session->stream_list, stream);
-
-    /* deallocate the stream */
-    status = srtp_stream_dealloc(stream, session->stream_template);
+    status =
+        srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv, direction);
+    if (!status && session_keys->rtp_xtn_hdr_cipher) {
+        status = srtp_cipher_set_iv(session_keys->rtp_xtn_hdr_cipher,
+                                    (uint8_t *)&iv, direction);
+    }
     if (status) {
-        return status;
+        return srtp_err_status_cipher_fail;
     }
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_update(srtp_t session, const srtp_policy_t *policy)
+srtp_err_status_t srtp_unprotect_verify(srtp_t ctx,
+                                        const uint8_t *srtp,
+                                        size_t srtp_len,
+                                        srtp_unprotect_token_t *token)
 {
-    srtp_err_status_t stat;
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)srtp;
+    size_t enc_start;       /* offset to start of encrypted portion   */
+    srtp_xtd_seq_num_t est; /* estimated xtd_seq_num_t of *hdr        */
+    uint64_t est_net;       /* est shifted, in network byte order     */
+    ssize_t delta;          /* delta of local pkt idx and that in hdr */
+    srtp_err_status_t status;
+    srtp_stream_ctx_t *stream;
+    uint8_t tmp_tag[SRTP_MAX_TAG_LEN];
+    size_t tag_len, prefix_len;
+    srtp_session_keys_t *session_keys = NULL;
 
-    /* sanity check arguments */
-    if (session == NULL) {
+    debug_print0(mod_srtp, "function srtp_unprotect_verify");
+
+    /* Verify RTP header */
+    status = srtp_validate_rtp_header(srtp, srtp_len);
+    if (status) {
+        return status;
+    }
+
+    /* check the packet length - it must at least contain a full header */
+    if (srtp_len < octets_in_rtp_header) {
         return srtp_err_status_bad_param;
     }
 
-    stat = srtp_valid_policy(policy);
-    if (stat != srtp_err_status_ok) {
-        return stat;
+    /*
+     * the EKTField is only removed by srtp_unprotect(), and shared state
+     * is only locked for the duration of one call
+     */
+    if (ctx->use_ekt || ctx->shared_state != NULL) {
+        return srtp_err_status_cant_check;
     }
 
-    while (policy != NULL) {
-        stat = srtp_stream_update(session, policy);
-        if (stat) {
-            return stat;
+    /* look up the stream, falling back to the template as srtp_unprotect */
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+    if (stream == NULL) {
+        if (ctx->stream_template == NULL) {
+            return srtp_err_status_no_ctx;
+        }
+        stream = ctx->stream_template;
+        est = (srtp_xtd_seq_num_t)ntohs(hdr->seq);
+    } else {
+        status = srtp_get_est_pkt_index(hdr, stream, &est, &delta);
+        if (status && (status != srtp_err_status_pkt_idx_adv)) {
+            return status;
         }
 
-        /* set policy to next item in list  */
-        policy = policy->next;
+        /* check replay database */
+        if (status != srtp_err_status_pkt_idx_adv) {
+            status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
+            if (status) {
+                return status;
+            }
+        }
     }
-    return srtp_err_status_ok;
-}
 
-struct update_template_stream_data {
-    srtp_err_status_t status;
-    srtp_t session;
-    srtp_stream_t new_stream_template;
-    srtp_stream_list_t new_stream_list;
-};
+    debug_print(mod_srtp, "estimated u_packet index: %016" PRIx64, est);
 
-static bool update_template_stream_cb(srtp_stream_t stream, void *raw_data)
-{
-    struct update_template_stream_data *data =
-        (struct update_template_stream_data *)raw_data;
-    srtp_t session = data->session;
-    uint32_t ssrc = stream->ssrc;
-    srtp_xtd_seq_num_t old_index;
-    srtp_rdb_t old_rtcp_rdb;
+    /* Determine if MKI is being used and what session keys should be used */
+    status = srtp_get_session_keys_for_rtp_packet(stream, srtp, srtp_len,
+                                                  &session_keys);
+    if (status) {
+        return status;
+    }
 
-    /* old / non-template streams are copied unchanged */
-    if (stream->session_keys[0].rtp_auth !=
-        session->stream_template->session_keys[0].rtp_auth) {
-        srtp_stream_list_remove(session->stream_list, stream);
-        data->status = srtp_insert_or_dealloc_stream(
-            data->new_stream_list, stream, session->stream_template);
-        if (data->status) {
-            return false;
-        }
-        return true;
+    /* AEAD ciphers can not check the tag without decrypting */
+    if (stream->rtp_plan.aead) {
+        return srtp_err_status_cant_check;
     }
 
-    /* save old extended seq */
-    old_index = stream->rtp_rdbx.index;
-    old_rtcp_rdb = stream->rtcp_rdb;
+    /* get tag length from stream */
+    tag_len = stream->rtp_plan.tag_len;
 
-    /* remove stream */
-    data->status = srtp_stream_remove(session, ntohl(ssrc));
-    if (data->status) {
-        return false;
+    enc_start = srtp_get_rtp_hdr_len(hdr);
+    if (hdr->x == 1) {
+        enc_start += srtp_get_rtp_xtn_hdr_len(hdr, srtp);
     }
 
-    /* allocate and initialize a new stream */
-    data->status = srtp_stream_clone(data->new_stream_template, ssrc, &stream);
-    if (data->status) {
-        return false;
+    if (enc_start > srtp_len - tag_len - stream->mki_size) {
+        return srtp_err_status_parse_err;
     }
 
-    /* add new stream to the head of the new_stream_list */
-    data->status = srtp_insert_or_dealloc_stream(data->new_stream_list, stream,
-                                                 data->new_stream_template);
-    if (data->status) {
-        return false;
-    }
+    if (stream->rtp_services & sec_serv_auth) {
+        /* a universal hash needs the keystream prefix, see srtp_unprotect */
+        if (session_keys->rtp_auth->prefix_len != 0) {
+            status = srtp_set_rtp_iv(stream, session_keys, hdr->ssrc, est,
+                                     srtp_direction_decrypt);
+            if (status) {
+                return status;
+            }
+            prefix_len = stream->rtp_plan.prefix_len;
+            status = srtp_cipher_output(session_keys->rtp_cipher, tmp_tag,
+                                        &prefix_len);
+            if (status) {
+                return srtp_err_status_cipher_fail;
+            }
+        }
 
-    /* restore old extended seq */
-    stream->rtp_rdbx.index = old_index;
-    stream->rtcp_rdb = old_rtcp_rdb;
+        /* shift est, put into network byte order */
+        est_net = be64_to_cpu(est << 16);
 
-    return true;
-}
+        status = srtp_auth_start(session_keys->rtp_auth);
+        if (status) {
+            return status;
+        }
 
-static srtp_err_status_t is_update_policy_compatable(
-    srtp_stream_t stream,
-    const srtp_policy_t *policy)
-{
-    if (stream->use_mki != policy->use_mki) {
-        return srtp_err_status_bad_param;
+        status = srtp_auth_update(session_keys->rtp_auth, srtp,
+                                  srtp_len - tag_len - stream->mki_size);
+        if (status) {
+            return status;
+        }
+
+        status = srtp_auth_compute(session_keys->rtp_auth, (uint8_t *)&est_net,
+                                   4, tmp_tag);
+        if (status) {
+            return srtp_err_status_auth_fail;
+        }
+
+        if (!srtp_octet_string_equal(tmp_tag, srtp + srtp_len - tag_len,
+                                     tag_len)) {
+            return srtp_err_status_auth_fail;
+        }
     }
 
-    if (stream->use_mki && stream->mki_size != policy->mki_size) {
-        return srtp_err_status_bad_param;
+    /* update the key usage limit, as srtp_unprotect does */
+    switch (srtp_key_limit_update(session_keys->limit)) {
+    case srtp_key_event_normal:
+        break;
+    case srtp_key_event_soft_limit:
+        srtp_handle_event(ctx, stream, event_key_soft_limit);
+        break;
+    case srtp_key_event_hard_limit:
+        srtp_handle_event(ctx, stream, event_key_hard_limit);
+        return srtp_err_status_key_expired;
+    default:
+        break;
     }
 
+    token->ssrc = hdr->ssrc;
+    token->index = est;
+    token->session_keys_index = (size_t)(session_keys - stream->session_keys);
+    token->srtp_len = srtp_len;
+    token->enc_start = enc_start;
+    token->rtp_len = srtp_len - stream->mki_size - tag_len;
+    token->srtp = srtp;
+    token->tag_len = tag_len;
+    memcpy(token->tag, srtp + srtp_len - tag_len, tag_len);
+    token->in_place = false;
+    token->in_place_len = 0;
+
     return srtp_err_status_ok;
 }
 
-static srtp_err_status_t update_template_streams(srtp_t session,
-                                                 const srtp_policy_t *policy)
+/*
+ * srtp_unprotect_decrypt_payload() writes the rtp header and the first
+ * payload_len octets of the decrypted payload of the packet described by
+ * token to rtp; counter mode lets the rest of the payload be skipped.
+ * when rtp is srtp, token records what is in clear already, so that a
+ * later call only decrypts the part of the payload that is still missing
+ */
+static srtp_err_status_t srtp_unprotect_decrypt_payload(
+    srtp_t ctx,
+    srtp_unprotect_token_t *token,
+    const uint8_t *srtp,
+    size_t srtp_len,
+    size_t payload_len,
+    uint8_t *rtp,
+    size_t *rtp_len)
 {
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)srtp;
+    size_t enc_octet_len;
     srtp_err_status_t status;
-    srtp_stream_t new_stream_template;
-    srtp_stream_list_t new_stream_list;
+    srtp_stream_ctx_t *stream;
+    uint8_t tmp_tag[SRTP_MAX_TAG_LEN];
+    uint8_t keystream[64];
+    size_t prefix_len;
+    size_t skip_len = 0;
+    size_t chunk_len;
+    srtp_session_keys_t *session_keys;
+
+    /* only the buffer that was verified is decrypted under the token */
+    if (srtp != token->srtp || srtp_len != token->srtp_len ||
+        hdr->ssrc != token->ssrc || token->tag_len > SRTP_MAX_TAG_LEN ||
+        token->tag_len > srtp_len ||
+        !srtp_octet_string_equal(token->tag, srtp + srtp_len - token->tag_len,
+                                 token->tag_len)) {
+        return srtp_err_status_bad_param;
+    }
 
-    status = srtp_valid_policy(policy);
-    if (status != srtp_err_status_ok) {
-        return status;
+    /* once part of it is in clear, the packet can only be decrypted in place */
+    if (token->in_place && rtp != srtp) {
+        return srtp_err_status_bad_param;
     }
 
-    if (session->stream_template == NULL) {
+    stream = srtp_get_stream(ctx, token->ssrc);
+    if (stream == NULL) {
+        if (ctx->stream_template == NULL) {
+            return srtp_err_status_no_ctx;
+        }
+        stream = ctx->stream_template;
+    }
+
+    if (token->session_keys_index >= stream->num_master_keys) {
         return srtp_err_status_bad_param;
     }
+    session_keys = &stream->session_keys[token->session_keys_index];
 
-    status = is_update_policy_compatable(session->stream_template, policy);
-    if (status != srtp_err_status_ok) {
-        return status;
+    enc_octet_len = token->rtp_len - token->enc_start;
+    if (payload_len < enc_octet_len) {
+        enc_octet_len = payload_len;
     }
 
-    /* allocate new template stream  */
-    status = srtp_stream_alloc(&new_stream_template, policy);
-    if (status) {
-        return status;
+    /* check output length */
+    if (*rtp_len < token->enc_start + enc_octet_len) {
+        return srtp_err_status_buffer_small;
     }
 
-    /* initialize new template stream  */
-    status = srtp_stream_init(new_stream_template, policy);
-    if (status) {
-        srtp_crypto_free(new_stream_template);
-        return status;
+    if (token->in_place) {
+        if (enc_octet_len <= token->in_place_len) {
+            *rtp_len = token->enc_start + enc_octet_len;
+            return srtp_err_status_ok;
+        }
+        skip_len = token->in_place_len;
     }
 
-    /* allocate new stream list */
-    status = srtp_stream_list_alloc(&new_stream_list);
+    status = srtp_set_rtp_iv(stream, session_keys, token->ssrc, token->index,
+                             srtp_direction_decrypt);
     if (status) {
-        srtp_crypto_free(new_stream_template);
         return status;
     }
 
-    /* process streams */
-    struct update_template_stream_data data = { srtp_err_status_ok, session,
-                                                new_stream_template,
-                                                new_stream_list };
-    srtp_stream_list_for_each(session->stream_list, update_template_stream_cb,
-                              &data);
-    if (data.status) {
-        /* free new allocations */
-        srtp_remove_and_dealloc_streams(new_stream_list, new_stream_template);
-        srtp_stream_list_dealloc(new_stream_list);
-        srtp_stream_dealloc(new_stream_template, NULL);
-        return data.status;
+    /* skip the keystream prefix used by a universal hash */
+    if ((stream->rtp_services & sec_serv_auth) &&
+        session_keys->rtp_auth->prefix_len != 0) {
+        prefix_len = stream->rtp_plan.prefix_len;
+        status =
+            srtp_cipher_output(session_keys->rtp_cipher, tmp_tag, &prefix_len);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
     }
 
-    /* dealloc old list / template */
-    srtp_remove_and_dealloc_streams(session->stream_list,
-                                    session->stream_template);
-    srtp_stream_list_dealloc(session->stream_list);
-    srtp_stream_dealloc(session->stream_template, NULL);
+    /* if not-inplace then need to copy full rtp header */
+    if (srtp != rtp) {
+        memcpy(rtp, srtp, token->enc_start);
+    }
 
-    /* set new list / template */
-    session->stream_template = new_stream_template;
-    session->stream_list = new_stream_list;
-    return srtp_err_status_ok;
-}
+    /* an earlier call in place has decrypted the extensions already */
+    if (hdr->x == 1 && session_keys->rtp_xtn_hdr_cipher && !token->in_place) {
+        /* extensions header encryption RFC 6904 */
+        status = srtp_process_header_encryption(
+            stream, srtp_get_rtp_xtn_hdr(hdr, rtp), session_keys);
+        if (status) {
+            return status;
+        }
+    }
 
-static srtp_err_status_t stream_update(srtp_t session,
-                                       const srtp_policy_t *policy)
-{
-    srtp_err_status_t status;
-    srtp_xtd_seq_num_t old_index;
-    srtp_rdb_t old_rtcp_rdb;
-    srtp_stream_t stream;
+    /* if we're decrypting, add keystream into ciphertext */
+    if (stream->rtp_services & sec_serv_conf) {
+        /* step over the keystream of the payload that is in clear already */
+        while (skip_len > 0) {
+            chunk_len = skip_len < sizeof(keystream) ? skip_len
+                                                     : sizeof(keystream);
+            status = srtp_cipher_output(session_keys->rtp_cipher, keystream,
+                                        &chunk_len);
+            if (status) {
+                octet_string_set_to_zero(keystream, sizeof(keystream));
+                return srtp_err_status_cipher_fail;
+            }
+            skip_len -= chunk_len;
+        }
+        octet_string_set_to_zero(keystream, sizeof(keystream));
 
-    status = srtp_valid_policy(policy);
-    if (status != srtp_err_status_ok) {
-        return status;
+        chunk_len = enc_octet_len - token->in_place_len;
+        status = srtp_cipher_decrypt(
+            session_keys->rtp_cipher,
+            srtp + token->enc_start + token->in_place_len, chunk_len,
+            rtp + token->enc_start + token->in_place_len, &chunk_len);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    } else if (rtp != srtp) {
+        /* if no encryption and not-inplace then need to copy the payload */
+        memcpy(rtp + token->enc_start, srtp + token->enc_start, enc_octet_len);
     }
 
-    stream = srtp_get_stream(session, htonl(policy->ssrc.value));
-    if (stream == NULL) {
-        return srtp_err_status_bad_param;
+    if (rtp == srtp) {
+        token->in_place = true;
+        token->in_place_len = enc_octet_len;
     }
 
-    status = is_update_policy_compatable(stream, policy);
-    if (status != srtp_err_status_ok) {
-        return status;
-    }
+    *rtp_len = token->enc_start + enc_octet_len;
 
-    /* save old extendard seq */
-    old_index = stream->rtp_rdbx.index;
-    old_rtcp_rdb = stream->rtcp_rdb;
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_unprotect_decrypt(srtp_t ctx,
+                                         srtp_unprotect_token_t *token,
+                                         const uint8_t *srtp,
+                                         size_t srtp_len,
+                                         uint8_t *rtp,
+                                         size_t *rtp_len)
+{
+    debug_print0(mod_srtp, "function srtp_unprotect_decrypt");
+
+    return srtp_unprotect_decrypt_payload(ctx, token, srtp, srtp_len,
+                                          token->rtp_len - token->enc_start,
+                                          rtp, rtp_len);
+}
+
+srtp_err_status_t srtp_unprotect_decrypt_prefix(
+    srtp_t ctx,
+    srtp_unprotect_token_t *token,
+    const uint8_t *srtp,
+    size_t srtp_len,
+    size_t payload_prefix_len,
+    uint8_t *rtp,
+    size_t *rtp_len)
+{
+    debug_print0(mod_srtp, "function srtp_unprotect_decrypt_prefix");
+
+    return srtp_unprotect_decrypt_payload(ctx, token, srtp, srtp_len,
+                                          payload_prefix_len, rtp, rtp_len);
+}
+
+srtp_err_status_t srtp_unprotect_commit(srtp_t ctx,
+                                        const srtp_unprotect_token_t *token)
+{
+    srtp_err_status_t status;
+    srtp_stream_ctx_t *stream;
+    srtp_xtd_seq_num_t est;
+    ssize_t delta;
+
+    debug_print0(mod_srtp, "function srtp_unprotect_commit");
+
+    stream = srtp_get_stream(ctx, token->ssrc);
+    if (stream == NULL) {
+        if (ctx->stream_template == NULL) {
+            return srtp_err_status_no_ctx;
+        }
+        stream = ctx->stream_template;
+    }
+
+    /* detect ssrc collisions, see srtp_unprotect */
+    if (stream->direction != dir_srtp_receiver) {
+        if (stream->direction == dir_unknown) {
+            stream->direction = dir_srtp_receiver;
+        } else {
+            srtp_handle_event(ctx, stream, event_ssrc_collision);
+        }
+    }
+
+    /* the packet authenticated, so a provisional stream becomes real */
+    if (stream == ctx->stream_template) {
+        srtp_stream_ctx_t *new_stream;
 
-    status = srtp_stream_remove(session, policy->ssrc.value);
+        status = srtp_clone_template_stream(ctx, token->ssrc, &new_stream);
+        if (status) {
+            return status;
+        }
+
+        stream = new_stream;
+    }
+
+    /*
+     * the replay database may have moved since the packet was verified, so
+     * recompute delta against its current state and check again
+     */
+    status = srtp_estimate_index(
+        &stream->rtp_rdbx, (uint32_t)(token->index >> 16), &est,
+        (srtp_sequence_number_t)token->index, &delta);
+    if (status == srtp_err_status_pkt_idx_adv) {
+        srtp_rdbx_set_roc_seq(&stream->rtp_rdbx, (uint32_t)(est >> 16),
+                              (uint16_t)(est & 0xFFFF));
+        stream->pending_roc = 0;
+        srtp_rdbx_add_index(&stream->rtp_rdbx, 0);
+        return srtp_err_status_ok;
+    }
     if (status) {
         return status;
     }
 
-    status = srtp_stream_add(session, policy);
+    status = srtp_rdbx_check(&stream->rtp_rdbx, delta);
     if (status) {
         return status;
     }
+    srtp_rdbx_add_index(&stream->rtp_rdbx, delta);
 
-    stream = srtp_get_stream(session, htonl(policy->ssrc.value));
-    if (stream == NULL) {
-        return srtp_err_status_fail;
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_find_roc() decrypts AEAD packets with up to this many
+ * octets after the header into a buffer on the stack, larger ones into
+ * an allocated one
+ */
+#define SRTP_FIND_ROC_SCRATCH_LEN 1500
+
+/*
+ * srtp_check_roc() checks the tag of the packet srtp, whose encrypted
+ * portion starts at enc_start, as if it had been protected with roc;
+ * scratch has room for the decrypted payload of an AEAD cipher.  if
+ * saved is set, the auth function has hashed the packet already and
+ * srtp_auth_save()d its state, so only the ROC is left to add, unless
+ * restoring that state fails
+ */
+static srtp_err_status_t srtp_check_roc(const srtp_stream_ctx_t *stream,
+                                        srtp_session_keys_t *session_keys,
+                                        const uint8_t *srtp,
+                                        size_t srtp_len,
+                                        size_t enc_start,
+                                        uint32_t roc,
+                                        bool saved,
+                                        uint8_t *scratch)
+{
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)srtp;
+    size_t tag_len = stream->rtp_plan.tag_len;
+    srtp_xtd_seq_num_t est;
+    uint8_t tmp_tag[SRTP_MAX_TAG_LEN];
+    uint32_t roc_net;
+    size_t prefix_len;
+    size_t enc_octet_len;
+    v128_t iv;
+    srtp_err_status_t status;
+
+    est = ((srtp_xtd_seq_num_t)roc << 16) | ntohs(hdr->seq);
+
+    if (stream->rtp_plan.aead) {
+        /* the tag of an AEAD cipher is only checked by decrypting */
+        srtp_calc_aead_iv(session_keys, &iv, &est, hdr);
+        if (srtp_cipher_set_iv(session_keys->rtp_cipher, (uint8_t *)&iv,
+                               srtp_direction_decrypt) ||
+            srtp_cipher_set_aad(session_keys->rtp_cipher, srtp, enc_start)) {
+            return srtp_err_status_cipher_fail;
+        }
+        enc_octet_len = srtp_len - enc_start - stream->mki_size;
+        return srtp_cipher_decrypt(session_keys->rtp_cipher, srtp + enc_start,
+                                   enc_octet_len, scratch, &enc_octet_len);
     }
 
-    /* restore old extended seq */
-    stream->rtp_rdbx.index = old_index;
-    stream->rtcp_rdb = old_rtcp_rdb;
+    /* a universal hash needs the keystream prefix, see srtp_unprotect */
+    if (session_keys->rtp_auth->prefix_len != 0) {
+        status = srtp_set_rtp_iv(stream, session_keys, hdr->ssrc, est,
+                                 srtp_direction_decrypt);
+        if (status) {
+            return status;
+        }
+        prefix_len = stream->rtp_plan.prefix_len;
+        status =
+            srtp_cipher_output(session_keys->rtp_cipher, tmp_tag, &prefix_len);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    }
+
+    roc_net = htonl(roc);
+    status = srtp_err_status_no_ctx;
+    if (saved) {
+        status = srtp_auth_restore(session_keys->rtp_auth);
+    }
+    if (status) {
+        /* nothing saved or the restore failed, so hash the packet again */
+        status = srtp_auth_start(session_keys->rtp_auth);
+        if (!status) {
+            status = srtp_auth_update(session_keys->rtp_auth, srtp,
+                                      srtp_len - tag_len - stream->mki_size);
+        }
+    }
+    if (status) {
+        return status;
+    }
+    status = srtp_auth_compute(session_keys->rtp_auth, (uint8_t *)&roc_net, 4,
+                               tmp_tag);
+    if (status) {
+        return srtp_err_status_auth_fail;
+    }
+
+    if (!srtp_octet_string_equal(tmp_tag, srtp + srtp_len - tag_len,
+                                 tag_len)) {
+        return srtp_err_status_auth_fail;
+    }
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_stream_update(srtp_t session,
-                                     const srtp_policy_t *policy)
+srtp_err_status_t srtp_stream_find_roc(srtp_t ctx,
+                                       const uint8_t *srtp,
+                                       size_t srtp_len,
+                                       uint32_t roc_estimate,
+                                       uint32_t max_distance,
+                                       uint32_t *roc)
 {
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)srtp;
+    srtp_stream_ctx_t *stream;
+    srtp_session_keys_t *session_keys = NULL;
+    uint8_t scratch_buf[SRTP_FIND_ROC_SCRATCH_LEN];
+    uint8_t *scratch = NULL;
+    bool saved = false;
+    size_t enc_start;
+    uint64_t candidate = roc_estimate;
     srtp_err_status_t status;
 
-    /* sanity check arguments */
-    if (session == NULL) {
+    debug_print0(mod_srtp, "function srtp_stream_find_roc");
+
+    if (ctx == NULL || srtp == NULL || roc == NULL) {
         return srtp_err_status_bad_param;
     }
 
-    status = srtp_valid_policy(policy);
-    if (status != srtp_err_status_ok) {
+    status = srtp_validate_rtp_header(srtp, srtp_len);
+    if (status) {
         return status;
     }
 
-    switch (policy->ssrc.type) {
-    case (ssrc_any_outbound):
-    case (ssrc_any_inbound):
-        status = update_template_streams(session, policy);
-        break;
-    case (ssrc_specific):
-        status = stream_update(session, policy);
-        break;
-    case (ssrc_undefined):
-    default:
-        return srtp_err_status_bad_param;
+    /* as for srtp_unprotect_verify(), the EKTField would be in the way */
+    if (ctx->use_ekt || ctx->shared_state != NULL) {
+        return srtp_err_status_cant_check;
     }
 
-    return status;
-}
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+    if (stream == NULL) {
+        if (ctx->stream_template == NULL) {
+            return srtp_err_status_no_ctx;
+        }
+        stream = ctx->stream_template;
+    }
 
-/*
- * The default policy - provides a convenient way for callers to use
- * the default security policy
- *
- * The default policy is defined in RFC 3711
- * (Section 5. Default and mandatory-to-implement Transforms)
- *
- */
+    /* without a tag every ROC is as good as any other */
+    if (!(stream->rtp_services & sec_serv_auth) && !stream->rtp_plan.aead) {
+        return srtp_err_status_cant_check;
+    }
 
-/*
- * NOTE: cipher_key_len is really key len (128 bits) plus salt len
- *  (112 bits)
- */
-/* There are hard-coded 16's for base_key_len in the key generation code */
+    status = srtp_get_session_keys_for_rtp_packet(stream, srtp, srtp_len,
+                                                  &session_keys);
+    if (status) {
+        return status;
+    }
 
-void srtp_crypto_policy_set_rtp_default(srtp_crypto_policy_t *p)
-{
-    p->cipher_type = SRTP_AES_ICM_128;
-    p->cipher_key_len =
-        SRTP_AES_ICM_128_KEY_LEN_WSALT; /* default 128 bits per RFC 3711 */
-    p->auth_type = SRTP_HMAC_SHA1;
-    p->auth_key_len = 20; /* default 160 bits per RFC 3711 */
-    p->auth_tag_len = 10; /* default 80 bits per RFC 3711 */
-    p->sec_serv = sec_serv_conf_and_auth;
-}
+    enc_start = srtp_get_rtp_hdr_len(hdr);
+    if (hdr->x == 1) {
+        enc_start += srtp_get_rtp_xtn_hdr_len(hdr, srtp);
+    }
+    if (srtp_len < enc_start + stream->rtp_plan.tag_len + stream->mki_size) {
+        return srtp_err_status_parse_err;
+    }
 
-void srtp_crypto_policy_set_rtcp_default(srtp_crypto_policy_t *p)
-{
-    p->cipher_type = SRTP_AES_ICM_128;
-    p->cipher_key_len =
-        SRTP_AES_ICM_128_KEY_LEN_WSALT; /* default 128 bits per RFC 3711 */
-    p->auth_type = SRTP_HMAC_SHA1;
-    p->auth_key_len = 20; /* default 160 bits per RFC 3711 */
-    p->auth_tag_len = 10; /* default 80 bits per RFC 3711 */
-    p->sec_serv = sec_serv_conf_and_auth;
-}
+    if (stream->rtp_plan.aead) {
+        if (srtp_len - enc_start <= sizeof(scratch_buf)) {
+            scratch = scratch_buf;
+        } else {
+            scratch = (uint8_t *)srtp_crypto_alloc(srtp_len - enc_start);
+            if (scratch == NULL) {
+                return srtp_err_status_alloc_fail;
+            }
+        }
+    } else if (session_keys->rtp_auth->prefix_len == 0 &&
+               srtp_auth_can_save(session_keys->rtp_auth)) {
+        /*
+         * the ROC is appended after the packet, so the packet is hashed
+         * once here and every candidate only adds its ROC to a copy; if
+         * that fails, every candidate hashes the packet again instead
+         */
+        status = srtp_auth_start(session_keys->rtp_auth);
+        if (!status) {
+            status = srtp_auth_update(
+                session_keys->rtp_auth, srtp,
+                srtp_len - stream->rtp_plan.tag_len - stream->mki_size);
+        }
+        if (!status) {
+            status = srtp_auth_save(session_keys->rtp_auth);
+        }
+        if (status) {
+            debug_print(mod_srtp, "could not save auth state (%d)", status);
+        }
+        saved = status == srtp_err_status_ok;
+    }
 
-void srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(srtp_crypto_policy_t *p)
-{
     /*
-     * corresponds to RFC 4568
-     *
-     * note that this crypto policy is intended for SRTP, but not SRTCP
+     * try the estimate first and then the ROCs above and below it in turn,
+     * so that the one nearest to the estimate wins
      */
+    status = srtp_err_status_auth_fail;
+    for (uint64_t distance = 0;
+         distance <= max_distance && status == srtp_err_status_auth_fail;
+         distance++) {
+        for (int sign = 0;
+             sign < (distance ? 2 : 1) && status == srtp_err_status_auth_fail;
+             sign++) {
+            if (sign == 0) {
+                candidate = (uint64_t)roc_estimate + distance;
+            } else if (distance <= roc_estimate) {
+                candidate = (uint64_t)roc_estimate - distance;
+            } else {
+                continue;
+            }
+            if (candidate > UINT32_MAX) {
+                continue;
+            }
 
-    p->cipher_type = SRTP_AES_ICM_128;
-    p->cipher_key_len =
-        SRTP_AES_ICM_128_KEY_LEN_WSALT; /* 128 bit key, 112 bit salt */
-    p->auth_type = SRTP_HMAC_SHA1;
-    p->auth_key_len = 20; /* 160 bit key               */
-    p->auth_tag_len = 4;  /* 32 bit tag                */
-    p->sec_serv = sec_serv_conf_and_auth;
-}
+            status = srtp_check_roc(stream, session_keys, srtp, srtp_len,
+                                    enc_start, (uint32_t)candidate, saved,
+                                    scratch);
+        }
+    }
 
-void srtp_crypto_policy_set_aes_cm_128_null_auth(srtp_crypto_policy_t *p)
-{
-    /*
-     * corresponds to RFC 4568
-     *
-     * note that this crypto policy is intended for SRTP, but not SRTCP
-     */
+    if (scratch != NULL && scratch != scratch_buf) {
+        srtp_crypto_free(scratch);
+    }
+    if (status) {
+        return status;
+    }
 
-    p->cipher_type = SRTP_AES_ICM_128;
-    p->cipher_key_len =
-        SRTP_AES_ICM_128_KEY_LEN_WSALT; /* 128 bit key, 112 bit salt */
-    p->auth_type = SRTP_NULL_AUTH;
-    p->auth_key_len = 0;
-    p->auth_tag_len = 0;
-    p->sec_serv = sec_serv_conf;
-}
+    debug_print2(mod_srtp, "found roc %u for ssrc 0x%08x",
+                 (unsigned int)candidate, (unsigned int)ntohl(hdr->ssrc));
 
-void srtp_crypto_policy_set_null_cipher_hmac_sha1_80(srtp_crypto_policy_t *p)
-{
-    /*
-     * corresponds to RFC 4568
-     */
+    /* lock the ROC in for the packet, as srtp_stream_set_roc() does */
+    if (stream == ctx->stream_template) {
+        status = srtp_clone_template_stream(ctx, hdr->ssrc, &stream);
+        if (status) {
+            return status;
+        }
+    }
+    stream->pending_roc = (uint32_t)candidate;
+    *roc = (uint32_t)candidate;
 
-    p->cipher_type = SRTP_NULL_CIPHER;
-    p->cipher_key_len =
-        SRTP_AES_ICM_128_KEY_LEN_WSALT; /* 128 bit key, 112 bit salt */
-    p->auth_type = SRTP_HMAC_SHA1;
-    p->auth_key_len = 20;
-    p->auth_tag_len = 10;
-    p->sec_serv = sec_serv_auth;
+    return srtp_err_status_ok;
 }
 
-void srtp_crypto_policy_set_null_cipher_hmac_null(srtp_crypto_policy_t *p)
+srtp_err_status_t srtp_init(void)
 {
-    /*
-     * Should only be used for testing
-     */
-
-    p->cipher_type = SRTP_NULL_CIPHER;
-    p->cipher_key_len =
-        SRTP_AES_ICM_128_KEY_LEN_WSALT; /* 128 bit key, 112 bit salt */
-    p->auth_type = SRTP_NULL_AUTH;
-    p->auth_key_len = 0;
-    p->auth_tag_len = 0;
-    p->sec_serv = sec_serv_none;
-}
+    srtp_err_status_t status;
 
-void srtp_crypto_policy_set_aes_cm_256_hmac_sha1_80(srtp_crypto_policy_t *p)
-{
-    /*
-     * corresponds to RFC 6188
-     */
-
-    p->cipher_type = SRTP_AES_ICM_256;
-    p->cipher_key_len = SRTP_AES_ICM_256_KEY_LEN_WSALT;
-    p->auth_type = SRTP_HMAC_SHA1;
-    p->auth_key_len = 20; /* default 160 bits per RFC 3711 */
-    p->auth_tag_len = 10; /* default 80 bits per RFC 3711 */
-    p->sec_serv = sec_serv_conf_and_auth;
-}
+    /* initialize crypto kernel */
+    status = srtp_crypto_kernel_init();
+    if (status) {
+        return status;
+    }
 
-void srtp_crypto_policy_set_aes_cm_256_hmac_sha1_32(srtp_crypto_policy_t *p)
-{
-    /*
-     * corresponds to RFC 6188
-     *
-     * note that this crypto policy is intended for SRTP, but not SRTCP
-     */
+    /* load srtp debug module into the kernel */
+    status = srtp_crypto_kernel_load_debug_module(&mod_srtp);
+    if (status) {
+        return status;
+    }
 
-    p->cipher_type = SRTP_AES_ICM_256;
-    p->cipher_key_len = SRTP_AES_ICM_256_KEY_LEN_WSALT;
-    p->auth_type = SRTP_HMAC_SHA1;
-    p->auth_key_len = 20; /* default 160 bits per RFC 3711 */
-    p->auth_tag_len = 4;  /* default 80 bits per RFC 3711 */
-    p->sec_serv = sec_serv_conf_and_auth;
-}
+    /* load ekt debug module into the kernel */
+    status = srtp_crypto_kernel_load_debug_module(&mod_ekt);
+    if (status) {
+        return status;
+    }
+    status = srtp_crypto_kernel_load_debug_module(&mod_index_store);
+    if (status) {
+        return status;
+    }
+    status = srtp_crypto_kernel_load_debug_module(&mod_shared_state);
+    if (status) {
+        return status;
+    }
+    status = srtp_crypto_kernel_load_debug_module(&mod_recording);
+    if (status) {
+        return status;
+    }
 
-/*
- * AES-256 with no authentication.
- */
-void srtp_crypto_policy_set_aes_cm_256_null_auth(srtp_crypto_policy_t *p)
-{
-    p->cipher_type = SRTP_AES_ICM_256;
-    p->cipher_key_len = SRTP_AES_ICM_256_KEY_LEN_WSALT;
-    p->auth_type = SRTP_NULL_AUTH;
-    p->auth_key_len = 0;
-    p->auth_tag_len = 0;
-    p->sec_serv = sec_serv_conf;
+    return srtp_err_status_ok;
 }
 
-void srtp_crypto_policy_set_aes_cm_192_hmac_sha1_80(srtp_crypto_policy_t *p)
+srtp_err_status_t srtp_shutdown(void)
 {
-    /*
-     * corresponds to RFC 6188
-     */
-
-    p->cipher_type = SRTP_AES_ICM_192;
-    p->cipher_key_len = SRTP_AES_ICM_192_KEY_LEN_WSALT;
-    p->auth_type = SRTP_HMAC_SHA1;
-    p->auth_key_len = 20; /* default 160 bits per RFC 3711 */
-    p->auth_tag_len = 10; /* default 80 bits per RFC 3711 */
-    p->sec_serv = sec_serv_conf_and_auth;
-}
+    srtp_err_status_t status;
 
-void srtp_crypto_policy_set_aes_cm_192_hmac_sha1_32(srtp_crypto_policy_t *p)
-{
-    /*
-     * corresponds to RFC 6188
-     *
-     * note that this crypto policy is intended for SRTP, but not SRTCP
-     */
+    /* shut down crypto kernel */
+    status = srtp_crypto_kernel_shutdown();
+    if (status) {
+        return status;
+    }
 
-    p->cipher_type = SRTP_AES_ICM_192;
-    p->cipher_key_len = SRTP_AES_ICM_192_KEY_LEN_WSALT;
-    p->auth_type = SRTP_HMAC_SHA1;
-    p->auth_key_len = 20; /* default 160 bits per RFC 3711 */
-    p->auth_tag_len = 4;  /* default 80 bits per RFC 3711 */
-    p->sec_serv = sec_serv_conf_and_auth;
-}
+    /* shutting down crypto kernel frees the srtp debug module as well */
 
-/*
- * AES-192 with no authentication.
- */
-void srtp_crypto_policy_set_aes_cm_192_null_auth(srtp_crypto_policy_t *p)
-{
-    p->cipher_type = SRTP_AES_ICM_192;
-    p->cipher_key_len = SRTP_AES_ICM_192_KEY_LEN_WSALT;
-    p->auth_type = SRTP_NULL_AUTH;
-    p->auth_key_len = 0;
-    p->auth_tag_len = 0;
-    p->sec_serv = sec_serv_conf;
+    return srtp_err_status_ok;
 }
 
-/*
- * AES-128 GCM mode with 16 octet auth tag.
- */
-void srtp_crypto_policy_set_aes_gcm_128_16_auth(srtp_crypto_policy_t *p)
+srtp_stream_ctx_t *srtp_get_stream(srtp_t srtp, uint32_t ssrc)
 {
-    p->cipher_type = SRTP_AES_GCM_128;
-    p->cipher_key_len = SRTP_AES_GCM_128_KEY_LEN_WSALT;
-    p->auth_type = SRTP_NULL_AUTH; /* GCM handles the auth for us */
-    p->auth_key_len = 0;
-    p->auth_tag_len = 16; /* 16 octet tag length */
-    p->sec_serv = sec_serv_conf_and_auth;
+    return srtp->stream_index->get(srtp->stream_list, ssrc);
 }
 
-/*
- * AES-256 GCM mode with 16 octet auth tag.
- */
-void srtp_crypto_policy_set_aes_gcm_256_16_auth(srtp_crypto_policy_t *p)
+srtp_err_status_t srtp_dealloc(srtp_t session)
 {
-    p->cipher_type = SRTP_AES_GCM_256;
-    p->cipher_key_len = SRTP_AES_GCM_256_KEY_LEN_WSALT;
-    p->auth_type = SRTP_NULL_AUTH; /* GCM handles the auth for us */
-    p->auth_key_len = 0;
-    p->auth_tag_len = 16; /* 16 octet tag length */
-    p->sec_serv = sec_serv_conf_and_auth;
-}
+    srtp_err_status_t status;
 
-/*
- * secure rtcp functions
- */
+    if (srtp_trace_enabled()) {
+        srtp_trace_call(SRTP_TRACE_DEALLOC, session, srtp_trace_now(),
+                        srtp_err_status_ok);
+    }
 
-/*
- * AEAD uses a new IV formation method.  This function implements
- * section 9.1 (SRTCP IV Formation for AES-GCM) from RFC7714.
- * The calculation is defined as, where (+) is the xor operation:
- *
- *                0  1  2  3  4  5  6  7  8  9 10 11
- *               +--+--+--+--+--+--+--+--+--+--+--+--+
- *               |00|00|    SSRC   |00|00|0+SRTCP Idx|---+
- *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
- *                                                       |
- *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
- *               |         Encryption Salt           |->(+)
- *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
- *                                                       |
- *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
- *               |       Initialization Vector       |<--+
- *               +--+--+--+--+--+--+--+--+--+--+--+--+*
- *
- * Input:  *session_keys - pointer to SRTP stream context session keys,
- *                        used to retrieve the SALT
- *         *iv           - Pointer to recieve the calculated IV
- *         seq_num       - The SEQ value to use for the IV calculation.
- *         *hdr          - The RTP header, used to get the SSRC value
- *
- * Returns: srtp_err_status_ok if no error or srtp_err_status_bad_param
- *          if seq_num is invalid
- *
- */
-static srtp_err_status_t srtp_calc_aead_iv_srtcp(
-    srtp_session_keys_t *session_keys,
-    v128_t *iv,
-    uint32_t seq_num,
-    const srtcp_hdr_t *hdr)
-{
-    v128_t in;
-    v128_t salt;
+    /*
+     * we take a conservative deallocation strategy - if we encounter an
+     * error deallocating a stream, then we stop trying to deallocate
+     * memory and just return an error
+     */
 
-    memset(&in, 0, sizeof(v128_t));
-    memset(&salt, 0, sizeof(v128_t));
+    /* deallocate streams */
+    if (session->stream_list != NULL) {
+        status = srtp_remove_and_dealloc_streams(
+            session->stream_index, session->stream_list,
+            session->stream_template, session->shared_state);
+        if (status) {
+            return status;
+        }
+    }
 
-    in.v16[0] = 0;
-    memcpy(&in.v16[1], &hdr->ssrc, 4); /* still in network order! */
-    in.v16[3] = 0;
+    /* deallocate the stream pool of a fixed capacity session */
+    if (session->stream_pool != NULL) {
+        srtp_stream_pool_empty(session);
+        srtp_crypto_free(session->stream_pool);
+        session->stream_pool = NULL;
+    }
 
-    /*
-     *  The SRTCP index (seq_num) spans bits 0 through 30 inclusive.
-     *  The most significant bit should be zero.
-     */
-    if (seq_num & 0x80000000UL) {
-        return srtp_err_status_bad_param;
+    /* deallocate stream template, if there is one */
+    if (session->stream_template != NULL) {
+        status = srtp_stream_dealloc(session->stream_template, NULL);
+        if (status) {
+            return status;
+        }
     }
-    in.v32[2] = htonl(seq_num);
 
-    debug_print(mod_srtp, "Pre-salted RTCP IV = %s\n", v128_hex_string(&in));
+    /* deallocate stream index */
+    if (session->stream_list != NULL) {
+        status = session->stream_index->dealloc(session->stream_list);
+        if (status) {
+            return status;
+        }
+    }
 
-    /*
-     * Get the SALT value from the context
-     */
-    memcpy(salt.v8, session_keys->c_salt, 12);
-    debug_print(mod_srtp, "RTCP SALT = %s\n", v128_hex_string(&salt));
+    /* the streams are gone, so the index store can be unmapped */
+    if (session->index_store != NULL) {
+        srtp_index_store_dealloc(session->index_store);
+    }
+    if (session->shared_state != NULL) {
+        srtp_shared_state_dealloc(session->shared_state);
+    }
 
-    /*
-     * Finally, apply the SALT to the input
-     */
-    v128_xor(iv, &in, &salt);
+    /* deallocate session context */
+    srtp_crypto_free_aligned(session);
 
     return srtp_err_status_ok;
 }
 
-/*
- * This code handles AEAD ciphers for outgoing RTCP.  We currently support
- * AES-GCM mode with 128 or 256 bit keys.
- */
-static srtp_err_status_t srtp_protect_rtcp_aead(
-    srtp_stream_ctx_t *stream,
-    const uint8_t *rtcp,
-    size_t rtcp_len,
-    uint8_t *srtcp,
-    size_t *srtcp_len,
-    srtp_session_keys_t *session_keys)
+static srtp_err_status_t stream_add(srtp_t session,
+                                    const srtp_policy_t *policy)
 {
-    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)rtcp;
-    size_t enc_start;         /* pointer to start of encrypted portion  */
-    uint8_t *trailer_p;       /* pointer to start of trailer            */
-    uint32_t trailer;         /* trailer value                          */
-    size_t enc_octet_len = 0; /* number of octets in encrypted portion  */
     srtp_err_status_t status;
-    size_t tag_len;
-    uint32_t seq_num;
-    v128_t iv;
+    srtp_stream_t tmp;
 
-    /* get tag length from stream context */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
+    status = srtp_valid_policy(policy);
+    if (status != srtp_err_status_ok) {
+        return status;
+    }
 
     /*
-     * set encryption start and encryption length - if we're not
-     * providing confidentiality, set enc_start to NULL
+     * EKT creates streams that shared state can not follow and that fixed
+     * capacity sessions can not preallocate
      */
-    enc_start = octets_in_rtcp_header;
-    enc_octet_len = rtcp_len - enc_start;
+    if (policy->ekt != NULL &&
+        (session->shared_state != NULL || session->max_streams > 0)) {
+        return srtp_err_status_bad_param;
+    }
 
-    /* check output length */
-    if (*srtcp_len <
-        rtcp_len + sizeof(srtcp_trailer_t) + stream->mki_size + tag_len) {
-        return srtp_err_status_buffer_small;
+    /* allocate stream  */
+    status = srtp_stream_alloc(&tmp, policy);
+    if (status) {
+        return status;
     }
 
-    /* if not-inplace then need to copy full rtcp header */
-    if (rtcp != srtcp) {
-        memcpy(srtcp, rtcp, enc_start);
-    }
-
-    /* NOTE: hdr->length is not usable - it refers to only the first
-     * RTCP report in the compound packet!
-     */
-    trailer_p = srtcp + enc_start + enc_octet_len + tag_len;
-
-    if (stream->rtcp_services & sec_serv_conf) {
-        trailer = htonl(SRTCP_E_BIT); /* set encrypt bit */
-    } else {
-        /* 0 is network-order independent */
-        trailer = 0x00000000; /* set encrypt bit */
-    }
-
-    if (stream->use_mki) {
-        srtp_inject_mki(srtcp + rtcp_len + tag_len + sizeof(srtcp_trailer_t),
-                        session_keys, stream->mki_size);
-    }
-
-    /*
-     * check sequence number for overruns, and copy it into the packet
-     * if its value isn't too big
-     */
-    status = srtp_rdb_increment(&stream->rtcp_rdb);
+    /* initialize stream  */
+    status = srtp_stream_init(tmp, policy);
     if (status) {
+        srtp_stream_dealloc(tmp, NULL);
         return status;
     }
-    seq_num = srtp_rdb_get_value(&stream->rtcp_rdb);
-    trailer |= htonl(seq_num);
-    debug_print(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
-
-    memcpy(trailer_p, &trailer, sizeof(trailer));
-
-    /*
-     * Calculate and set the IV
-     */
-    status = srtp_calc_aead_iv_srtcp(session_keys, &iv, seq_num, hdr);
-    if (status) {
-        return srtp_err_status_cipher_fail;
-    }
-    status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
-                                srtp_direction_encrypt);
-    if (status) {
-        return srtp_err_status_cipher_fail;
-    }
 
     /*
-     * Set the AAD for GCM mode
+     * set the head of the stream list or the template to point to the
+     * stream that we've just alloced and init'ed, depending on whether
+     * or not it has a wildcard SSRC value or not
+     *
+     * if the template stream has already been set, then the policy is
+     * inconsistent, so we return a bad_param error code
      */
-    if (stream->rtcp_services & sec_serv_conf) {
-        /*
-         * If payload encryption is enabled, then the AAD consist of
-         * the RTCP header and the seq# at the end of the packet
-         */
-        status = srtp_cipher_set_aad(session_keys->rtcp_cipher, rtcp,
-                                     octets_in_rtcp_header);
-        if (status) {
-            return srtp_err_status_cipher_fail;
+    switch (policy->ssrc.type) {
+    case (ssrc_any_outbound):
+        if (session->stream_template) {
+            srtp_stream_dealloc(tmp, NULL);
+            return srtp_err_status_bad_param;
         }
-    } else {
-        /*
-         * Since payload encryption is not enabled, we must authenticate
-         * the entire packet as described in RFC 7714 (Section 9.3. Data
-         * Types in Unencrypted SRTCP Compound Packets)
-         */
-        status = srtp_cipher_set_aad(session_keys->rtcp_cipher, rtcp, rtcp_len);
+        session->stream_template = tmp;
+        session->stream_template->direction = dir_srtp_sender;
+        break;
+    case (ssrc_any_inbound):
+        if (session->stream_template) {
+            srtp_stream_dealloc(tmp, NULL);
+            return srtp_err_status_bad_param;
+        }
+        session->stream_template = tmp;
+        session->stream_template->direction = dir_srtp_receiver;
+        break;
+    case (ssrc_specific):
+        status = srtp_insert_or_dealloc_stream(session, tmp,
+                                               session->stream_template);
         if (status) {
-            return (srtp_err_status_cipher_fail);
+            return status;
         }
-    }
-    /*
-     * Process the sequence# as AAD
-     */
-    status = srtp_cipher_set_aad(session_keys->rtcp_cipher, (uint8_t *)&trailer,
-                                 sizeof(trailer));
-    if (status) {
-        return (srtp_err_status_cipher_fail);
+        break;
+    case (ssrc_undefined):
+    default:
+        srtp_stream_dealloc(tmp, NULL);
+        return srtp_err_status_bad_param;
     }
 
-    /* if we're encrypting, exor keystream into the message */
-    if (stream->rtcp_services & sec_serv_conf) {
-        size_t out_len = *srtcp_len - enc_start;
-        status =
-            srtp_cipher_encrypt(session_keys->rtcp_cipher, rtcp + enc_start,
-                                enc_octet_len, srtcp + enc_start, &out_len);
-        enc_octet_len = out_len;
+    /* a fixed capacity session clones the template streams up front */
+    if (session->stream_pool != NULL && session->stream_template == tmp) {
+        status = srtp_stream_pool_fill(session);
         if (status) {
-            return srtp_err_status_cipher_fail;
-        }
-    } else {
-        /* if no encryption and not-inplace then need to copy rest of packet */
-        if (rtcp != srtcp) {
-            memcpy(srtcp + enc_start, rtcp + enc_start, enc_octet_len);
+            srtp_stream_pool_empty(session);
+            session->stream_template = NULL;
+            srtp_stream_dealloc(tmp, NULL);
+            return status;
         }
+    }
 
-        /*
-         * Even though we're not encrypting the payload, we need
-         * to run the cipher to get the auth tag.
-         */
-        uint8_t *auth_tag = srtcp + enc_start + enc_octet_len;
-        size_t out_len = *srtcp_len - enc_start - enc_octet_len;
-        status = srtp_cipher_encrypt(session_keys->rtcp_cipher, NULL, 0,
-                                     auth_tag, &out_len);
-        if (status) {
-            return srtp_err_status_cipher_fail;
-        }
-        enc_octet_len += out_len;
+    if (policy->ekt != NULL) {
+        session->use_ekt = true;
     }
 
-    *srtcp_len = octets_in_rtcp_header + enc_octet_len;
+    return srtp_err_status_ok;
+}
 
-    /* increase the packet length by the length of the seq_num*/
-    *srtcp_len += sizeof(srtcp_trailer_t);
+srtp_err_status_t srtp_stream_add(srtp_t session, const srtp_policy_t *policy)
+{
+    srtp_err_status_t status;
+    uint64_t trace_start = 0;
 
-    /* increase the packet by the mki_size */
-    *srtcp_len += stream->mki_size;
+    /* sanity check arguments */
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
 
-    return srtp_err_status_ok;
+    if (srtp_trace_enabled()) {
+        trace_start = srtp_trace_now();
+    }
+
+    status = stream_add(session, policy);
+
+    if (srtp_trace_enabled() && policy != NULL) {
+        srtp_trace_policy(SRTP_TRACE_STREAM_ADD, session, trace_start, policy,
+                          status);
+    }
+
+    return status;
 }
 
 /*
- * This function handles incoming SRTCP packets while in AEAD mode,
- * which currently supports AES-GCM encryption.  Note, the auth tag is
- * at the end of the packet stream and is automatically checked by GCM
- * when decrypting the payload.
+ * the default stream index of a session is the stream list, which can be
+ * replaced at compile time by defining SRTP_NO_STREAM_LIST
  */
-static srtp_err_status_t srtp_unprotect_rtcp_aead(
-    srtp_t ctx,
-    srtp_stream_ctx_t *stream,
-    const uint8_t *srtcp,
-    size_t srtcp_len,
-    uint8_t *rtcp,
-    size_t *rtcp_len,
-    srtp_session_keys_t *session_keys)
+static srtp_err_status_t stream_list_index_alloc(void **index)
 {
-    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)srtcp;
-    size_t enc_start;               /* pointer to start of encrypted portion  */
-    const uint8_t *trailer_p;       /* pointer to start of trailer            */
-    uint32_t trailer;               /* trailer value                          */
-    size_t enc_octet_len = 0;       /* number of octets in encrypted portion  */
-    const uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
+    srtp_stream_list_t list;
     srtp_err_status_t status;
-    size_t tag_len;
-    size_t tmp_len;
-    uint32_t seq_num;
-    v128_t iv;
 
-    /* get tag length from stream context */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
+    status = srtp_stream_list_alloc(&list);
+    if (status) {
+        return status;
+    }
 
-    enc_start = octets_in_rtcp_header;
+    *index = list;
 
-    /*
-     * set encryption start, encryption length, and trailer
-     */
-    /* index & E (encryption) bit follow normal data. hdr->len is the number of
-     * words (32-bit) in the normal packet minus 1
-     */
-    /* This should point trailer to the word past the end of the normal data. */
-    /* This would need to be modified for optional mikey data */
-    trailer_p = srtcp + srtcp_len - sizeof(srtcp_trailer_t) - stream->mki_size;
-    memcpy(&trailer, trailer_p, sizeof(trailer));
+    return srtp_err_status_ok;
+}
 
-    /*
-     * We pass the tag down to the cipher when doing GCM mode
-     */
-    enc_octet_len = srtcp_len - (octets_in_rtcp_header +
-                                 sizeof(srtcp_trailer_t) + stream->mki_size);
-    auth_tag = srtcp + (srtcp_len - tag_len - stream->mki_size -
-                        sizeof(srtcp_trailer_t));
+static srtp_err_status_t stream_list_index_dealloc(void *index)
+{
+    return srtp_stream_list_dealloc((srtp_stream_list_t)index);
+}
 
-    /*
-     * check the sequence number for replays
-     */
-    /* this is easier than dealing with bitfield access */
-    seq_num = ntohl(trailer) & SRTCP_INDEX_MASK;
-    debug_print(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
-    status = srtp_rdb_check(&stream->rtcp_rdb, seq_num);
-    if (status) {
-        return status;
-    }
+static srtp_err_status_t stream_list_index_insert(void *index,
+                                                  uint32_t ssrc,
+                                                  srtp_stream_t stream)
+{
+    (void)ssrc;
+    return srtp_stream_list_insert((srtp_stream_list_t)index, stream);
+}
 
-    /*
-     * Calculate and set the IV
-     */
-    status = srtp_calc_aead_iv_srtcp(session_keys, &iv, seq_num, hdr);
-    if (status) {
-        return srtp_err_status_cipher_fail;
-    }
-    status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
-                                srtp_direction_decrypt);
-    if (status) {
-        return srtp_err_status_cipher_fail;
-    }
+static srtp_stream_t stream_list_index_get(void *index, uint32_t ssrc)
+{
+    return srtp_stream_list_get((srtp_stream_list_t)index, ssrc);
+}
 
-    /* check output length */
-    if (*rtcp_len <
-        srtcp_len - sizeof(srtcp_trailer_t) - stream->mki_size - tag_len) {
-        return srtp_err_status_buffer_small;
+static void stream_list_index_remove(void *index, uint32_t ssrc)
+{
+    srtp_stream_list_t list = (srtp_stream_list_t)index;
+    srtp_stream_t stream = srtp_stream_list_get(list, ssrc);
+
+    if (stream != NULL) {
+        srtp_stream_list_remove(list, stream);
     }
+}
 
-    /* if not inplace need to copy rtcp header */
-    if (srtcp != rtcp) {
-        memcpy(rtcp, srtcp, enc_start);
+static void stream_list_index_for_each(void *index,
+                                       bool (*callback)(srtp_stream_t, void *),
+                                       void *data)
+{
+    srtp_stream_list_for_each((srtp_stream_list_t)index, callback, data);
+}
+
+static const srtp_stream_index_t srtp_stream_list_index = {
+    stream_list_index_alloc,  stream_list_index_dealloc,
+    stream_list_index_insert, stream_list_index_get,
+    stream_list_index_remove, stream_list_index_for_each,
+};
+
+#ifndef SRTP_NO_STREAM_LIST
+static srtp_err_status_t srtp_stream_list_alloc_fixed(
+    srtp_stream_list_t *list_ptr,
+    size_t capacity);
+#endif
+
+/*
+ * srtp_stream_index_alloc(session, index) allocates an empty stream index
+ * for the session, a fixed capacity session gets a stream list that
+ * never grows
+ */
+static srtp_err_status_t srtp_stream_index_alloc(srtp_t session, void **index)
+{
+#ifndef SRTP_NO_STREAM_LIST
+    if (session->max_streams > 0) {
+        srtp_stream_list_t list;
+        srtp_err_status_t status;
+
+        status = srtp_stream_list_alloc_fixed(&list, session->max_streams);
+        if (status) {
+            return status;
+        }
+        *index = list;
+        return srtp_err_status_ok;
     }
+#endif
 
-    /*
-     * Set the AAD for GCM mode
-     */
-    if (*trailer_p & SRTCP_E_BYTE_BIT) {
-        /*
-         * If payload encryption is enabled, then the AAD consist of
-         * the RTCP header and the seq# at the end of the packet
-         */
-        status = srtp_cipher_set_aad(session_keys->rtcp_cipher, srtcp,
-                                     octets_in_rtcp_header);
-        if (status) {
-            return srtp_err_status_cipher_fail;
-        }
-    } else {
-        /*
-         * Since payload encryption is not enabled, we must authenticate
-         * the entire packet as described in RFC 7714 (Section 9.3. Data
-         * Types in Unencrypted SRTCP Compound Packets)
-         */
-        status = srtp_cipher_set_aad(
-            session_keys->rtcp_cipher, srtcp,
-            (srtcp_len - tag_len - sizeof(srtcp_trailer_t) - stream->mki_size));
-        if (status) {
-            return (srtp_err_status_cipher_fail);
-        }
-    }
+    return session->stream_index->alloc(index);
+}
 
-    /*
-     * Process the sequence# as AAD
-     */
-    status = srtp_cipher_set_aad(session_keys->rtcp_cipher, (uint8_t *)&trailer,
-                                 sizeof(trailer));
-    if (status) {
-        return (srtp_err_status_cipher_fail);
+srtp_err_status_t srtp_create(srtp_t *session, /* handle for session     */
+                              const srtp_policy_t *policy)
+{ /* SRTP policy (list)     */
+    return srtp_create_with_stream_index(session, policy, NULL);
+}
+
+static srtp_err_status_t session_create(srtp_t *session,
+                                        const srtp_policy_t *policy,
+                                        const srtp_stream_index_t *index,
+                                        size_t max_streams)
+{
+    srtp_err_status_t stat;
+    srtp_ctx_t *ctx;
+
+    /* sanity check arguments */
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
     }
 
-    /* if we're decrypting, exor keystream into the message */
-    if (*trailer_p & SRTCP_E_BYTE_BIT) {
-        status = srtp_cipher_decrypt(session_keys->rtcp_cipher,
-                                     srtcp + enc_start, enc_octet_len,
-                                     rtcp + enc_start, &enc_octet_len);
-        if (status) {
-            return status;
-        }
-    } else {
-        /* if no encryption and not-inplace then need to copy rest of packet */
-        if (rtcp != srtcp) {
-            memcpy(rtcp + enc_start, srtcp + enc_start, enc_octet_len);
-        }
+    if (index == NULL) {
+        index = &srtp_stream_list_index;
+    } else if (index->alloc == NULL || index->dealloc == NULL ||
+               index->insert == NULL || index->get == NULL ||
+               index->remove == NULL || index->for_each == NULL) {
+        return srtp_err_status_bad_param;
+    }
 
-        /*
-         * Still need to run the cipher to check the tag
-         */
-        tmp_len = 0;
-        status = srtp_cipher_decrypt(session_keys->rtcp_cipher, auth_tag,
-                                     tag_len, NULL, &tmp_len);
-        if (status) {
-            return status;
+    if (policy) {
+        stat = srtp_valid_policy(policy);
+        if (stat != srtp_err_status_ok) {
+            return stat;
         }
     }
 
-    *rtcp_len = srtcp_len;
+    /* allocate srtp context and set ctx_ptr */
+    ctx = (srtp_ctx_t *)srtp_crypto_alloc_aligned(sizeof(srtp_ctx_t),
+                                                  SRTP_CACHE_LINE_SIZE);
+    if (ctx == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    *session = ctx;
 
-    /* decrease the packet length by the length of the auth tag and seq_num*/
-    *rtcp_len -= (tag_len + sizeof(srtcp_trailer_t) + stream->mki_size);
+    ctx->stream_template = NULL;
+    ctx->stream_list = NULL;
+    ctx->stream_index = index;
+    ctx->max_streams = max_streams;
+    ctx->stream_pool = NULL;
+    ctx->stream_pool_count = 0;
+    ctx->user_data = NULL;
+    ctx->use_ekt = false;
+    ctx->index_store = NULL;
+    ctx->shared_state = NULL;
+    ctx->cost_interval = 0;
+    ctx->cost_samples = 0;
+    ctx->cost_ns = 0;
+    ctx->repair_streams = 0;
+    ctx->quota_max_streams = 0;
+    ctx->quota_max_bytes = 0;
+    ctx->quota_streams = 0;
+    ctx->quota_bytes = 0;
+    ctx->quota_rejections = 0;
+    ctx->trace_id = srtp_trace_next_id();
+
+    if (srtp_trace_enabled()) {
+        srtp_trace_call(SRTP_TRACE_CREATE, ctx, srtp_trace_now(),
+                        srtp_err_status_ok);
+    }
+
+    /* allocate stream index */
+    stat = srtp_stream_index_alloc(ctx, &ctx->stream_list);
+    if (stat) {
+        /* clean up everything */
+        srtp_dealloc(*session);
+        *session = NULL;
+        return stat;
+    }
 
-    /*
-     * verify that stream is for received traffic - this check will
-     * detect SSRC collisions, since a stream that appears in both
-     * srtp_protect() and srtp_unprotect() will fail this test in one of
-     * those functions.
-     *
-     * we do this check *after* the authentication check, so that the
-     * latter check will catch any attempts to fool us into thinking
-     * that we've got a collision
-     */
-    if (stream->direction != dir_srtp_receiver) {
-        if (stream->direction == dir_unknown) {
-            stream->direction = dir_srtp_receiver;
-        } else {
-            srtp_handle_event(ctx, stream, event_ssrc_collision);
+    /* allocate the stream pool of a fixed capacity session */
+    if (max_streams > 0) {
+        ctx->stream_pool = (srtp_stream_ctx_t **)srtp_crypto_alloc(
+            sizeof(srtp_stream_ctx_t *) * max_streams);
+        if (ctx->stream_pool == NULL) {
+            srtp_dealloc(*session);
+            *session = NULL;
+            return srtp_err_status_alloc_fail;
         }
     }
 
     /*
-     * if the stream is a 'provisional' one, in which the template context
-     * is used, then we need to allocate a new stream at this point, since
-     * the authentication passed
+     * loop over elements in the policy list, allocating and
+     * initializing a stream for each element
      */
-    if (stream == ctx->stream_template) {
-        srtp_stream_ctx_t *new_stream;
-
-        /*
-         * allocate and initialize a new stream
-         *
-         * note that we indicate failure if we can't allocate the new
-         * stream, and some implementations will want to not return
-         * failure here
-         */
-        status =
-            srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
-        if (status) {
-            return status;
-        }
-
-        /* add new stream to the list */
-        status = srtp_insert_or_dealloc_stream(ctx->stream_list, new_stream,
-                                               ctx->stream_template);
-        if (status) {
-            return status;
+    while (policy != NULL) {
+        stat = srtp_stream_add(ctx, policy);
+        if (stat) {
+            /* clean up everything */
+            srtp_dealloc(*session);
+            *session = NULL;
+            return stat;
         }
 
-        /* set stream (the pointer used in this function) */
-        stream = new_stream;
+        /* set policy to next item in list  */
+        policy = policy->next;
     }
 
-    /* we've passed the authentication check, so add seq_num to the rdb */
-    srtp_rdb_add_index(&stream->rtcp_rdb, seq_num);
-
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_protect_rtcp(srtp_t ctx,
-                                    const uint8_t *rtcp,
-                                    size_t rtcp_len,
-                                    uint8_t *srtcp,
-                                    size_t *srtcp_len,
-                                    size_t mki_index)
+srtp_err_status_t srtp_create_with_stream_index(
+    srtp_t *session,
+    const srtp_policy_t *policy,
+    const srtp_stream_index_t *index)
 {
-    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)rtcp;
-    size_t enc_start;         /* pointer to start of encrypted portion  */
-    uint8_t *auth_start;      /* pointer to start of auth. portion      */
-    uint8_t *trailer_p;       /* pointer to start of trailer            */
-    uint32_t trailer;         /* trailer value                          */
-    size_t enc_octet_len = 0; /* number of octets in encrypted portion  */
-    uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
-    srtp_err_status_t status;
-    size_t tag_len;
-    srtp_stream_ctx_t *stream;
-    size_t prefix_len;
-    uint32_t seq_num;
-    srtp_session_keys_t *session_keys = NULL;
+    return session_create(session, policy, index, 0);
+}
 
-    /* check the packet length - it must at least contain a full header */
-    if (rtcp_len < octets_in_rtcp_header) {
+srtp_err_status_t srtp_create_fixed(srtp_t *session,
+                                    const srtp_policy_t *policy,
+                                    size_t max_streams)
+{
+#ifdef SRTP_NO_STREAM_LIST
+    (void)session;
+    (void)policy;
+    (void)max_streams;
+    return srtp_err_status_no_such_op;
+#else
+    if (max_streams == 0 || max_streams >= UINT32_MAX) {
         return srtp_err_status_bad_param;
     }
 
-    /*
-     * look up ssrc in srtp_stream list, and process the packet with
-     * the appropriate stream.  if we haven't seen this stream before,
-     * there's only one key for this srtp_session, and the cipher
-     * supports key-sharing, then we assume that a new stream using
-     * that key has just started up
-     */
-    stream = srtp_get_stream(ctx, hdr->ssrc);
-    if (stream == NULL) {
-        if (ctx->stream_template != NULL) {
-            srtp_stream_ctx_t *new_stream;
+    return session_create(session, policy, NULL, max_streams);
+#endif
+}
 
-            /* allocate and initialize a new stream */
-            status =
-                srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
-            if (status) {
-                return status;
-            }
+/*
+ * repair streams carry their own sequence numbers, which are sent in
+ * order, so the smallest replay window a policy may ask for is enough
+ */
+#define SRTP_REPAIR_WINDOW_SIZE 64
 
-            /* add new stream to the list */
-            status = srtp_insert_or_dealloc_stream(ctx->stream_list, new_stream,
-                                                   ctx->stream_template);
-            if (status) {
-                return status;
-            }
+/*
+ * srtp_bind_repair_stream(repair, media) makes repair use the session
+ * keys, cipher and auth contexts of media, which it does not own
+ */
+static void srtp_bind_repair_stream(srtp_stream_ctx_t *repair,
+                                    const srtp_stream_ctx_t *media)
+{
+    repair->session_keys = media->session_keys;
+    repair->num_master_keys = media->num_master_keys;
+    repair->use_mki = media->use_mki;
+    repair->mki_size = media->mki_size;
+    repair->rtp_services = media->rtp_services;
+    repair->rtcp_services = media->rtcp_services;
+    repair->rtp_plan = media->rtp_plan;
+    repair->rtcp_plan = media->rtcp_plan;
+    repair->allow_repeat_tx = media->allow_repeat_tx;
+    repair->enc_xtn_hdr = media->enc_xtn_hdr;
+    repair->enc_xtn_hdr_count = media->enc_xtn_hdr_count;
+}
 
-            /* set stream (the pointer used in this function) */
-            stream = new_stream;
-        } else {
-            /* no template stream, so we return an error */
-            return srtp_err_status_no_ctx;
-        }
-    }
+static bool bind_repair_streams_cb(srtp_stream_t stream, void *data)
+{
+    srtp_t session = (srtp_t)data;
+    srtp_stream_t media;
 
-    /*
-     * verify that stream is for sending traffic - this check will
-     * detect SSRC collisions, since a stream that appears in both
-     * srtp_protect() and srtp_unprotect() will fail this test in one of
-     * those functions.
-     */
-    if (stream->direction != dir_srtp_sender) {
-        if (stream->direction == dir_unknown) {
-            stream->direction = dir_srtp_sender;
-        } else {
-            srtp_handle_event(ctx, stream, event_ssrc_collision);
-        }
+    if (!stream->is_repair) {
+        return true;
     }
 
-    status = srtp_get_session_keys(stream, mki_index, &session_keys);
-    if (status) {
-        return status;
+    media = session->stream_index->get(session->stream_list,
+                                       stream->media_ssrc);
+    if (media != NULL && !media->is_repair) {
+        srtp_bind_repair_stream(stream, media);
+        return true;
     }
 
-    /*
-     * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
-     * the request to our AEAD handler.
-     */
-    if (session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
-        session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_256) {
-        return srtp_protect_rtcp_aead(stream, rtcp, rtcp_len, srtcp, srtcp_len,
-                                      session_keys);
+    /* the media stream is gone, and with it the session keys */
+    session->stream_index->remove(session->stream_list, stream->ssrc);
+    srtp_release_stream(session, stream, session->stream_template);
+
+    return true;
+}
+
+/*
+ * srtp_bind_repair_streams(session) binds the repair streams of the
+ * session to their media streams again after media streams have been
+ * removed or replaced, and removes those whose media stream is gone
+ */
+static void srtp_bind_repair_streams(srtp_t session)
+{
+    if (session->repair_streams == 0) {
+        return;
     }
 
-    /* get tag length from stream context */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
+    session->stream_index->for_each(session->stream_list,
+                                    bind_repair_streams_cb, session);
+}
 
-    /*
-     * set encryption start and encryption length
-     */
-    enc_start = octets_in_rtcp_header;
-    enc_octet_len = rtcp_len - enc_start;
+static srtp_err_status_t stream_remove(srtp_t session, uint32_t ssrc)
+{
+    srtp_stream_ctx_t *stream;
+    srtp_err_status_t status;
 
-    /* check output length */
-    if (*srtcp_len <
-        rtcp_len + sizeof(srtcp_trailer_t) + stream->mki_size + tag_len) {
-        return srtp_err_status_buffer_small;
+    /* find and remove stream from the list */
+    stream = session->stream_index->get(session->stream_list, htonl(ssrc));
+    if (stream == NULL) {
+        return srtp_err_status_no_ctx;
     }
 
-    /* if not in place then need to copy rtcp header */
-    if (rtcp != srtcp) {
-        memcpy(srtcp, rtcp, enc_start);
+    session->stream_index->remove(session->stream_list, stream->ssrc);
+
+    /* deallocate the stream */
+    status = srtp_release_stream(session, stream, session->stream_template);
+    if (status) {
+        return status;
     }
 
-    /* all of the packet, except the header, gets encrypted */
-    /*
-     * NOTE: hdr->length is not usable - it refers to only the first RTCP report
-     * in the compound packet!
-     */
-    trailer_p = srtcp + enc_start + enc_octet_len;
+    return srtp_err_status_ok;
+}
 
-    if (stream->rtcp_services & sec_serv_conf) {
-        trailer = htonl(SRTCP_E_BIT); /* set encrypt bit */
-    } else {
-        /* 0 is network-order independant */
-        trailer = 0x00000000; /* set encrypt bit */
+srtp_err_status_t srtp_stream_remove(srtp_t session, uint32_t ssrc)
+{
+    srtp_err_status_t status;
+    uint64_t trace_start = 0;
+
+    /* sanity check arguments */
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
     }
 
-    if (stream->use_mki) {
-        srtp_inject_mki(srtcp + rtcp_len + sizeof(srtcp_trailer_t),
-                        session_keys, stream->mki_size);
+    if (srtp_trace_enabled()) {
+        trace_start = srtp_trace_now();
     }
 
-    /*
-     * set the auth_start and auth_tag pointers to the proper locations
-     * (note that srtpc *always* provides authentication, unlike srtp)
-     */
-    /* Note: This would need to change for optional mikey data */
-    auth_start = srtcp;
-    auth_tag = srtcp + rtcp_len + sizeof(srtcp_trailer_t) + stream->mki_size;
+    status = stream_remove(session, ssrc);
+    srtp_bind_repair_streams(session);
 
-    /*
-     * check sequence number for overruns, and copy it into the packet
-     * if its value isn't too big
-     */
-    status = srtp_rdb_increment(&stream->rtcp_rdb);
+    if (srtp_trace_enabled()) {
+        srtp_trace_stream_remove(session, trace_start, ssrc, status);
+    }
+
+    return status;
+}
+
+srtp_err_status_t srtp_stream_add_repair(srtp_t session,
+                                         uint32_t media_ssrc,
+                                         uint32_t repair_ssrc)
+{
+    srtp_stream_ctx_t *media;
+    srtp_stream_ctx_t *str;
+    srtp_err_status_t status;
+
+    if (session == NULL || media_ssrc == repair_ssrc) {
+        return srtp_err_status_bad_param;
+    }
+
+    media = srtp_get_stream(session, htonl(media_ssrc));
+    if (media == NULL) {
+        return srtp_err_status_no_ctx;
+    }
+    if (media->is_repair || srtp_get_stream(session, htonl(repair_ssrc))) {
+        return srtp_err_status_bad_param;
+    }
+
+    str = (srtp_stream_ctx_t *)srtp_crypto_alloc_aligned(
+        sizeof(srtp_stream_ctx_t), SRTP_CACHE_LINE_SIZE);
+    if (str == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    str->is_repair = true;
+    str->media_ssrc = media->ssrc;
+    str->ssrc = htonl(repair_ssrc);
+    str->direction = media->direction;
+    srtp_bind_repair_stream(str, media);
+
+    status = srtp_rdbx_init(&str->rtp_rdbx, SRTP_REPAIR_WINDOW_SIZE);
     if (status) {
+        srtp_stream_dealloc(str, NULL);
         return status;
     }
-    seq_num = srtp_rdb_get_value(&stream->rtcp_rdb);
-    trailer |= htonl(seq_num);
-    debug_print(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
+    srtp_rdb_init(&str->rtcp_rdb);
 
-    memcpy(trailer_p, &trailer, sizeof(trailer));
+    if (media->ekt) {
+        str->ekt = srtp_ekt_ref(media->ekt);
+    }
+
+    status = srtp_stream_claim_shared(session, str);
+    if (status == srtp_err_status_ok) {
+        status = session->stream_index->insert(session->stream_list,
+                                               str->ssrc, str);
+    }
+    if (status) {
+        if (str->shared_slot != NULL) {
+            srtp_shared_state_unclaim(session->shared_state, str->shared_slot);
+        }
+        srtp_stream_dealloc(str, NULL);
+        return status;
+    }
+    session->repair_streams++;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_update(srtp_t session, const srtp_policy_t *policy)
+{
+    srtp_err_status_t stat;
+
+    /* sanity check arguments */
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    stat = srtp_valid_policy(policy);
+    if (stat != srtp_err_status_ok) {
+        return stat;
+    }
+
+    while (policy != NULL) {
+        stat = srtp_stream_update(session, policy);
+        if (stat) {
+            return stat;
+        }
+
+        /* set policy to next item in list  */
+        policy = policy->next;
+    }
+    return srtp_err_status_ok;
+}
+
+struct update_template_stream_data {
+    srtp_err_status_t status;
+    srtp_t session;
+    srtp_stream_t new_stream_template;
+    void *new_stream_list;
+};
+
+static bool update_template_stream_cb(srtp_stream_t stream, void *raw_data)
+{
+    struct update_template_stream_data *data =
+        (struct update_template_stream_data *)raw_data;
+    srtp_t session = data->session;
+    uint32_t ssrc = stream->ssrc;
+    srtp_xtd_seq_num_t old_index;
+    srtp_rdb_t old_rtcp_rdb;
+    srtp_stream_slots_t slots;
+    bool charged;
 
     /*
-     * if we're using rindael counter mode, set nonce and seq
+     * old / non-template streams are copied unchanged, repair streams are
+     * bound to their new media streams afterwards
      */
-    if (session_keys->rtcp_cipher->type->id == SRTP_AES_ICM_128 ||
-        session_keys->rtcp_cipher->type->id == SRTP_AES_ICM_192 ||
-        session_keys->rtcp_cipher->type->id == SRTP_AES_ICM_256) {
-        v128_t iv;
+    if (stream->is_repair ||
+        stream->session_keys[0].rtp_auth !=
+            session->stream_template->session_keys[0].rtp_auth) {
+        session->stream_index->remove(session->stream_list, ssrc);
+        data->status = session->stream_index->insert(data->new_stream_list,
+                                                     ssrc, stream);
+        if (data->status) {
+            srtp_stream_take_slots(stream, &slots);
+            srtp_stream_drop_slots(session, &slots);
+            srtp_stream_dealloc(stream, session->stream_template);
+            return false;
+        }
+        return true;
+    }
 
-        iv.v32[0] = 0;
-        iv.v32[1] = hdr->ssrc; /* still in network order! */
-        iv.v32[2] = htonl(seq_num >> 16);
-        iv.v32[3] = htonl(seq_num << 16);
-        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
-                                    srtp_direction_encrypt);
+    /* save old extended seq */
+    old_index = stream->rtp_rdbx.index;
+    old_rtcp_rdb = stream->rtcp_rdb;
+    charged = stream->quota_bytes != 0;
+    srtp_stream_take_slots(stream, &slots);
 
-    } else {
-        v128_t iv;
+    /* remove stream */
+    data->status = stream_remove(session, ntohl(ssrc));
+    if (data->status) {
+        srtp_stream_drop_slots(session, &slots);
+        return false;
+    }
 
-        /* otherwise, just set the index to seq_num */
-        iv.v32[0] = 0;
-        iv.v32[1] = 0;
-        iv.v32[2] = 0;
-        iv.v32[3] = htonl(seq_num);
-        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
-                                    srtp_direction_encrypt);
+    /* allocate and initialize a new stream */
+    data->status = srtp_stream_clone(data->new_stream_template, ssrc, &stream);
+    if (data->status) {
+        srtp_stream_drop_slots(session, &slots);
+        return false;
+    }
+
+    /* add new stream to the new_stream_list */
+    data->status =
+        session->stream_index->insert(data->new_stream_list, ssrc, stream);
+    if (data->status) {
+        srtp_stream_dealloc(stream, data->new_stream_template);
+        srtp_stream_drop_slots(session, &slots);
+        return false;
+    }
+
+    /* restore old extended seq */
+    stream->rtp_rdbx.index = old_index;
+    stream->rtcp_rdb = old_rtcp_rdb;
+    srtp_stream_give_slots(session, stream, &slots);
+
+    /* the new clone replaces the old one, so it is never refused */
+    if (charged) {
+        stream->quota_bytes = srtp_stream_clone_size(data->new_stream_template);
+        session->quota_streams++;
+        session->quota_bytes += stream->quota_bytes;
+    }
+
+    return true;
+}
+
+static bool quota_recount_cb(srtp_stream_t stream, void *raw_data)
+{
+    srtp_t session = (srtp_t)raw_data;
+
+    if (stream->quota_bytes) {
+        session->quota_streams++;
+        session->quota_bytes += stream->quota_bytes;
+    }
+
+    return true;
+}
+
+static srtp_err_status_t is_update_policy_compatable(
+    srtp_stream_t stream,
+    const srtp_policy_t *policy)
+{
+    if (stream->use_mki != policy->use_mki) {
+        return srtp_err_status_bad_param;
+    }
+
+    if (stream->use_mki && stream->mki_size != policy->mki_size) {
+        return srtp_err_status_bad_param;
+    }
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t update_template_streams(srtp_t session,
+                                                 const srtp_policy_t *policy)
+{
+    srtp_err_status_t status;
+    srtp_stream_t new_stream_template;
+    void *new_stream_list;
+
+    status = srtp_valid_policy(policy);
+    if (status != srtp_err_status_ok) {
+        return status;
+    }
+
+    if (session->stream_template == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = is_update_policy_compatable(session->stream_template, policy);
+    if (status != srtp_err_status_ok) {
+        return status;
     }
+
+    /* allocate new template stream  */
+    status = srtp_stream_alloc(&new_stream_template, policy);
     if (status) {
-        return srtp_err_status_cipher_fail;
+        return status;
     }
 
-    /*
-     * if we're authenticating using a universal hash, put the keystream
-     * prefix into the authentication tag
-     */
+    /* initialize new template stream  */
+    status = srtp_stream_init(new_stream_template, policy);
+    if (status) {
+        srtp_stream_dealloc(new_stream_template, NULL);
+        return status;
+    }
 
-    /* if auth_start is non-null, then put keystream into tag  */
-    if (auth_start) {
-        /* put keystream prefix into auth_tag */
-        prefix_len = srtp_auth_get_prefix_length(session_keys->rtcp_auth);
-        status = srtp_cipher_output(session_keys->rtcp_cipher, auth_tag,
-                                    &prefix_len);
+    /* allocate new stream list */
+    status = srtp_stream_index_alloc(session, &new_stream_list);
+    if (status) {
+        srtp_stream_dealloc(new_stream_template, NULL);
+        return status;
+    }
 
-        debug_print(mod_srtp, "keystream prefix: %s",
-                    srtp_octet_string_hex_string(auth_tag, prefix_len));
+    /* process streams */
+    struct update_template_stream_data data = { srtp_err_status_ok, session,
+                                                new_stream_template,
+                                                new_stream_list };
+    session->stream_index->for_each(session->stream_list,
+                                    update_template_stream_cb, &data);
+    if (data.status) {
+        /* free new allocations */
+        srtp_remove_and_dealloc_streams(session->stream_index, new_stream_list,
+                                        new_stream_template,
+                                        session->shared_state);
+        session->stream_index->dealloc(new_stream_list);
+        srtp_stream_dealloc(new_stream_template, NULL);
+        srtp_bind_repair_streams(session);
 
-        if (status) {
-            return srtp_err_status_cipher_fail;
-        }
+        /* the clones that were already replaced are gone */
+        session->quota_streams = 0;
+        session->quota_bytes = 0;
+        session->stream_index->for_each(session->stream_list,
+                                        quota_recount_cb, session);
+        return data.status;
     }
 
-    /* if we're encrypting, exor keystream into the message */
-    if (stream->rtcp_services & sec_serv_conf) {
-        status = srtp_cipher_encrypt(session_keys->rtcp_cipher,
-                                     rtcp + enc_start, enc_octet_len,
-                                     srtcp + enc_start, &enc_octet_len);
-        if (status) {
-            return srtp_err_status_cipher_fail;
+    /* dealloc old list / template */
+    srtp_remove_and_dealloc_streams(session->stream_index,
+                                    session->stream_list,
+                                    session->stream_template,
+                                    session->shared_state);
+    session->stream_index->dealloc(session->stream_list);
+    srtp_stream_pool_empty(session);
+    srtp_stream_dealloc(session->stream_template, NULL);
+
+    /* set new list / template */
+    session->stream_template = new_stream_template;
+    session->stream_list = new_stream_list;
+    srtp_bind_repair_streams(session);
+
+    /* refill the stream pool with clones of the new template */
+    if (session->stream_pool != NULL) {
+        return srtp_stream_pool_fill(session);
+    }
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t stream_update(srtp_t session,
+                                       const srtp_policy_t *policy)
+{
+    srtp_err_status_t status;
+    srtp_xtd_seq_num_t old_index;
+    srtp_rdb_t old_rtcp_rdb;
+    srtp_stream_slots_t slots;
+    srtp_stream_t stream;
+
+    status = srtp_valid_policy(policy);
+    if (status != srtp_err_status_ok) {
+        return status;
+    }
+
+    stream = srtp_get_stream(session, htonl(policy->ssrc.value));
+    if (stream == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = is_update_policy_compatable(stream, policy);
+    if (status != srtp_err_status_ok) {
+        return status;
+    }
+
+    /* save old extendard seq */
+    old_index = stream->rtp_rdbx.index;
+    old_rtcp_rdb = stream->rtcp_rdb;
+    srtp_stream_take_slots(stream, &slots);
+
+    status = stream_remove(session, policy->ssrc.value);
+    if (status) {
+        srtp_stream_drop_slots(session, &slots);
+        return status;
+    }
+
+    status = stream_add(session, policy);
+    srtp_bind_repair_streams(session);
+    if (status) {
+        srtp_stream_drop_slots(session, &slots);
+        return status;
+    }
+
+    stream = srtp_get_stream(session, htonl(policy->ssrc.value));
+    if (stream == NULL) {
+        srtp_stream_drop_slots(session, &slots);
+        return srtp_err_status_fail;
+    }
+
+    /* restore old extended seq */
+    stream->rtp_rdbx.index = old_index;
+    stream->rtcp_rdb = old_rtcp_rdb;
+    srtp_stream_give_slots(session, stream, &slots);
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_stream_update(srtp_t session,
+                                     const srtp_policy_t *policy)
+{
+    srtp_err_status_t status;
+    uint64_t trace_start = 0;
+
+    /* sanity check arguments */
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = srtp_valid_policy(policy);
+    if (status != srtp_err_status_ok) {
+        return status;
+    }
+
+    if (srtp_trace_enabled()) {
+        trace_start = srtp_trace_now();
+    }
+
+    switch (policy->ssrc.type) {
+    case (ssrc_any_outbound):
+    case (ssrc_any_inbound):
+        status = update_template_streams(session, policy);
+        break;
+    case (ssrc_specific):
+        status = stream_update(session, policy);
+        break;
+    case (ssrc_undefined):
+    default:
+        return srtp_err_status_bad_param;
+    }
+
+    if (status == srtp_err_status_ok && policy->ekt != NULL) {
+        session->use_ekt = true;
+    }
+
+    if (srtp_trace_enabled()) {
+        srtp_trace_policy(SRTP_TRACE_STREAM_UPDATE, session, trace_start,
+                          policy, status);
+    }
+
+    return status;
+}
+
+/*
+ * The default policy - provides a convenient way for callers to use
+ * the default security policy
+ *
+ * The default policy is defined in RFC 3711
+ * (Section 5. Default and mandatory-to-implement Transforms)
+ *
+ */
+
+/*
+ * NOTE: cipher_key_len is really key len (128 bits) plus salt len
+ *  (112 bits)
+ */
+/* There are hard-coded 16's for base_key_len in the key generation code */
+
+void srtp_crypto_policy_set_rtp_default(srtp_crypto_policy_t *p)
+{
+    p->cipher_type = SRTP_AES_ICM_128;
+    p->cipher_key_len =
+        SRTP_AES_ICM_128_KEY_LEN_WSALT; /* default 128 bits per RFC 3711 */
+    p->auth_type = SRTP_HMAC_SHA1;
+    p->auth_key_len = 20; /* default 160 bits per RFC 3711 */
+    p->auth_tag_len = 10; /* default 80 bits per RFC 3711 */
+    p->sec_serv = sec_serv_conf_and_auth;
+}
+
+void srtp_crypto_policy_set_rtcp_default(srtp_crypto_policy_t *p)
+{
+    p->cipher_type = SRTP_AES_ICM_128;
+    p->cipher_key_len =
+        SRTP_AES_ICM_128_KEY_LEN_WSALT; /* default 128 bits per RFC 3711 */
+    p->auth_type = SRTP_HMAC_SHA1;
+    p->auth_key_len = 20; /* default 160 bits per RFC 3711 */
+    p->auth_tag_len = 10; /* default 80 bits per RFC 3711 */
+    p->sec_serv = sec_serv_conf_and_auth;
+}
+
+void srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(srtp_crypto_policy_t *p)
+{
+    /*
+     * corresponds to RFC 4568
+     *
+     * note that this crypto policy is intended for SRTP, but not SRTCP
+     */
+
+    p->cipher_type = SRTP_AES_ICM_128;
+    p->cipher_key_len =
+        SRTP_AES_ICM_128_KEY_LEN_WSALT; /* 128 bit key, 112 bit salt */
+    p->auth_type = SRTP_HMAC_SHA1;
+    p->auth_key_len = 20; /* 160 bit key               */
+    p->auth_tag_len = 4;  /* 32 bit tag                */
+    p->sec_serv = sec_serv_conf_and_auth;
+}
+
+void srtp_crypto_policy_set_aes_cm_128_null_auth(srtp_crypto_policy_t *p)
+{
+    /*
+     * corresponds to RFC 4568
+     *
+     * note that this crypto policy is intended for SRTP, but not SRTCP
+     */
+
+    p->cipher_type = SRTP_AES_ICM_128;
+    p->cipher_key_len =
+        SRTP_AES_ICM_128_KEY_LEN_WSALT; /* 128 bit key, 112 bit salt */
+    p->auth_type = SRTP_NULL_AUTH;
+    p->auth_key_len = 0;
+    p->auth_tag_len = 0;
+    p->sec_serv = sec_serv_conf;
+}
+
+void srtp_crypto_policy_set_null_cipher_hmac_sha1_80(srtp_crypto_policy_t *p)
+{
+    /*
+     * corresponds to RFC 4568
+     */
+
+    p->cipher_type = SRTP_NULL_CIPHER;
+    p->cipher_key_len =
+        SRTP_AES_ICM_128_KEY_LEN_WSALT; /* 128 bit key, 112 bit salt */
+    p->auth_type = SRTP_HMAC_SHA1;
+    p->auth_key_len = 20;
+    p->auth_tag_len = 10;
+    p->sec_serv = sec_serv_auth;
+}
+
+void srtp_crypto_policy_set_null_cipher_hmac_null(srtp_crypto_policy_t *p)
+{
+    /*
+     * Should only be used for testing
+     */
+
+    p->cipher_type = SRTP_NULL_CIPHER;
+    p->cipher_key_len =
+        SRTP_AES_ICM_128_KEY_LEN_WSALT; /* 128 bit key, 112 bit salt */
+    p->auth_type = SRTP_NULL_AUTH;
+    p->auth_key_len = 0;
+    p->auth_tag_len = 0;
+    p->sec_serv = sec_serv_none;
+}
+
+void srtp_crypto_policy_set_aes_cm_256_hmac_sha1_80(srtp_crypto_policy_t *p)
+{
+    /*
+     * corresponds to RFC 6188
+     */
+
+    p->cipher_type = SRTP_AES_ICM_256;
+    p->cipher_key_len = SRTP_AES_ICM_256_KEY_LEN_WSALT;
+    p->auth_type = SRTP_HMAC_SHA1;
+    p->auth_key_len = 20; /* default 160 bits per RFC 3711 */
+    p->auth_tag_len = 10; /* default 80 bits per RFC 3711 */
+    p->sec_serv = sec_serv_conf_and_auth;
+}
+
+void srtp_crypto_policy_set_aes_cm_256_hmac_sha1_32(srtp_crypto_policy_t *p)
+{
+    /*
+     * corresponds to RFC 6188
+     *
+     * note that this crypto policy is intended for SRTP, but not SRTCP
+     */
+
+    p->cipher_type = SRTP_AES_ICM_256;
+    p->cipher_key_len = SRTP_AES_ICM_256_KEY_LEN_WSALT;
+    p->auth_type = SRTP_HMAC_SHA1;
+    p->auth_key_len = 20; /* default 160 bits per RFC 3711 */
+    p->auth_tag_len = 4;  /* default 80 bits per RFC 3711 */
+    p->sec_serv = sec_serv_conf_and_auth;
+}
+
+/*
+ * AES-256 with no authentication.
+ */
+void srtp_crypto_policy_set_aes_cm_256_null_auth(srtp_crypto_policy_t *p)
+{
+    p->cipher_type = SRTP_AES_ICM_256;
+    p->cipher_key_len = SRTP_AES_ICM_256_KEY_LEN_WSALT;
+    p->auth_type = SRTP_NULL_AUTH;
+    p->auth_key_len = 0;
+    p->auth_tag_len = 0;
+    p->sec_serv = sec_serv_conf;
+}
+
+void srtp_crypto_policy_set_aes_cm_192_hmac_sha1_80(srtp_crypto_policy_t *p)
+{
+    /*
+     * corresponds to RFC 6188
+     */
+
+    p->cipher_type = SRTP_AES_ICM_192;
+    p->cipher_key_len = SRTP_AES_ICM_192_KEY_LEN_WSALT;
+    p->auth_type = SRTP_HMAC_SHA1;
+    p->auth_key_len = 20; /* default 160 bits per RFC 3711 */
+    p->auth_tag_len = 10; /* default 80 bits per RFC 3711 */
+    p->sec_serv = sec_serv_conf_and_auth;
+}
+
+void srtp_crypto_policy_set_aes_cm_192_hmac_sha1_32(srtp_crypto_policy_t *p)
+{
+    /*
+     * corresponds to RFC 6188
+     *
+     * note that this crypto policy is intended for SRTP, but not SRTCP
+     */
+
+    p->cipher_type = SRTP_AES_ICM_192;
+    p->cipher_key_len = SRTP_AES_ICM_192_KEY_LEN_WSALT;
+    p->auth_type = SRTP_HMAC_SHA1;
+    p->auth_key_len = 20; /* default 160 bits per RFC 3711 */
+    p->auth_tag_len = 4;  /* default 80 bits per RFC 3711 */
+    p->sec_serv = sec_serv_conf_and_auth;
+}
+
+/*
+ * AES-192 with no authentication.
+ */
+void srtp_crypto_policy_set_aes_cm_192_null_auth(srtp_crypto_policy_t *p)
+{
+    p->cipher_type = SRTP_AES_ICM_192;
+    p->cipher_key_len = SRTP_AES_ICM_192_KEY_LEN_WSALT;
+    p->auth_type = SRTP_NULL_AUTH;
+    p->auth_key_len = 0;
+    p->auth_tag_len = 0;
+    p->sec_serv = sec_serv_conf;
+}
+
+/*
+ * AES-128 GCM mode with 16 octet auth tag.
+ */
+void srtp_crypto_policy_set_aes_gcm_128_16_auth(srtp_crypto_policy_t *p)
+{
+    p->cipher_type = SRTP_AES_GCM_128;
+    p->cipher_key_len = SRTP_AES_GCM_128_KEY_LEN_WSALT;
+    p->auth_type = SRTP_NULL_AUTH; /* GCM handles the auth for us */
+    p->auth_key_len = 0;
+    p->auth_tag_len = 16; /* 16 octet tag length */
+    p->sec_serv = sec_serv_conf_and_auth;
+}
+
+/*
+ * AES-256 GCM mode with 16 octet auth tag.
+ */
+void srtp_crypto_policy_set_aes_gcm_256_16_auth(srtp_crypto_policy_t *p)
+{
+    p->cipher_type = SRTP_AES_GCM_256;
+    p->cipher_key_len = SRTP_AES_GCM_256_KEY_LEN_WSALT;
+    p->auth_type = SRTP_NULL_AUTH; /* GCM handles the auth for us */
+    p->auth_key_len = 0;
+    p->auth_tag_len = 16; /* 16 octet tag length */
+    p->sec_serv = sec_serv_conf_and_auth;
+}
+
+/*
+ * secure rtcp functions
+ */
+
+/*
+ * AEAD uses a new IV formation method.  This function implements
+ * section 9.1 (SRTCP IV Formation for AES-GCM) from RFC7714.
+ * The calculation is defined as, where (+) is the xor operation:
+ *
+ *                0  1  2  3  4  5  6  7  8  9 10 11
+ *               +--+--+--+--+--+--+--+--+--+--+--+--+
+ *               |00|00|    SSRC   |00|00|0+SRTCP Idx|---+
+ *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
+ *                                                       |
+ *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
+ *               |         Encryption Salt           |->(+)
+ *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
+ *                                                       |
+ *               +--+--+--+--+--+--+--+--+--+--+--+--+   |
+ *               |       Initialization Vector       |<--+
+ *               +--+--+--+--+--+--+--+--+--+--+--+--+*
+ *
+ * Input:  *session_keys - pointer to SRTP stream context session keys,
+ *                        used to retrieve the SALT
+ *         *iv           - Pointer to recieve the calculated IV
+ *         seq_num       - The SEQ value to use for the IV calculation.
+ *         *hdr          - The RTP header, used to get the SSRC value
+ *
+ * Returns: srtp_err_status_ok if no error or srtp_err_status_bad_param
+ *          if seq_num is invalid
+ *
+ */
+static srtp_err_status_t srtp_calc_aead_iv_srtcp(
+    srtp_session_keys_t *session_keys,
+    v128_t *iv,
+    uint32_t seq_num,
+    const srtcp_hdr_t *hdr)
+{
+    v128_t in;
+    v128_t salt;
+
+    memset(&in, 0, sizeof(v128_t));
+    memset(&salt, 0, sizeof(v128_t));
+
+    in.v16[0] = 0;
+    memcpy(&in.v16[1], &hdr->ssrc, 4); /* still in network order! */
+    in.v16[3] = 0;
+
+    /*
+     *  The SRTCP index (seq_num) spans bits 0 through 30 inclusive.
+     *  The most significant bit should be zero.
+     */
+    if (seq_num & 0x80000000UL) {
+        return srtp_err_status_bad_param;
+    }
+    in.v32[2] = htonl(seq_num);
+
+    debug_print(mod_srtp, "Pre-salted RTCP IV = %s\n", v128_hex_string(&in));
+
+    /*
+     * Get the SALT value from the context
+     */
+    memcpy(salt.v8, session_keys->c_salt, 12);
+    debug_print(mod_srtp, "RTCP SALT = %s\n", v128_hex_string(&salt));
+
+    /*
+     * Finally, apply the SALT to the input
+     */
+    v128_xor(iv, &in, &salt);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This code handles AEAD ciphers for outgoing RTCP.  We currently support
+ * AES-GCM mode with 128 or 256 bit keys.
+ */
+static srtp_err_status_t srtp_protect_rtcp_aead(
+    srtp_ctx_t *ctx,
+    srtp_stream_ctx_t *stream,
+    const uint8_t *rtcp,
+    size_t rtcp_len,
+    uint8_t *srtcp,
+    size_t *srtcp_len,
+    srtp_session_keys_t *session_keys)
+{
+    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)rtcp;
+    size_t enc_start;         /* pointer to start of encrypted portion  */
+    uint8_t *trailer_p;       /* pointer to start of trailer            */
+    uint32_t trailer;         /* trailer value                          */
+    size_t enc_octet_len = 0; /* number of octets in encrypted portion  */
+    srtp_err_status_t status;
+    size_t tag_len;
+    uint32_t seq_num;
+    v128_t iv;
+
+    /* get tag length from stream context */
+    tag_len = stream->rtcp_plan.tag_len;
+
+    /*
+     * set encryption start and encryption length - if we're not
+     * providing confidentiality, set enc_start to NULL
+     */
+    enc_start = octets_in_rtcp_header;
+    enc_octet_len = rtcp_len - enc_start;
+
+    /* check output length */
+    if (*srtcp_len <
+        rtcp_len + sizeof(srtcp_trailer_t) + stream->mki_size + tag_len) {
+        return srtp_err_status_buffer_small;
+    }
+
+    /* if not-inplace then need to copy full rtcp header */
+    if (rtcp != srtcp) {
+        memcpy(srtcp, rtcp, enc_start);
+    }
+
+    /* NOTE: hdr->length is not usable - it refers to only the first
+     * RTCP report in the compound packet!
+     */
+    trailer_p = srtcp + enc_start + enc_octet_len + tag_len;
+
+    if (stream->rtcp_services & sec_serv_conf) {
+        trailer = htonl(SRTCP_E_BIT); /* set encrypt bit */
+    } else {
+        /* 0 is network-order independent */
+        trailer = 0x00000000; /* set encrypt bit */
+    }
+
+    if (stream->use_mki) {
+        srtp_inject_mki(srtcp + rtcp_len + tag_len + sizeof(srtcp_trailer_t),
+                        session_keys, stream->mki_size);
+    }
+
+    /*
+     * check sequence number for overruns, and copy it into the packet
+     * if its value isn't too big
+     */
+    status = srtp_rdb_increment(&stream->rtcp_rdb);
+    if (status) {
+        return status;
+    }
+    srtp_checkpoint_rtcp_index(ctx, stream);
+    seq_num = srtp_rdb_get_value(&stream->rtcp_rdb);
+    trailer |= htonl(seq_num);
+    debug_print(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
+
+    memcpy(trailer_p, &trailer, sizeof(trailer));
+
+    /*
+     * Calculate and set the IV
+     */
+    status = srtp_calc_aead_iv_srtcp(session_keys, &iv, seq_num, hdr);
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+    status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
+                                srtp_direction_encrypt);
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+
+    /*
+     * Set the AAD for GCM mode
+     */
+    if (stream->rtcp_services & sec_serv_conf) {
+        /*
+         * If payload encryption is enabled, then the AAD consist of
+         * the RTCP header and the seq# at the end of the packet
+         */
+        status = srtp_cipher_set_aad(session_keys->rtcp_cipher, rtcp,
+                                     octets_in_rtcp_header);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    } else {
+        /*
+         * Since payload encryption is not enabled, we must authenticate
+         * the entire packet as described in RFC 7714 (Section 9.3. Data
+         * Types in Unencrypted SRTCP Compound Packets)
+         */
+        status = srtp_cipher_set_aad(session_keys->rtcp_cipher, rtcp, rtcp_len);
+        if (status) {
+            return (srtp_err_status_cipher_fail);
+        }
+    }
+    /*
+     * Process the sequence# as AAD
+     */
+    status = srtp_cipher_set_aad(session_keys->rtcp_cipher, (uint8_t *)&trailer,
+                                 sizeof(trailer));
+    if (status) {
+        return (srtp_err_status_cipher_fail);
+    }
+
+    /* if we're encrypting, exor keystream into the message */
+    if (stream->rtcp_services & sec_serv_conf) {
+        size_t out_len = *srtcp_len - enc_start;
+        status =
+            srtp_cipher_encrypt(session_keys->rtcp_cipher, rtcp + enc_start,
+                                enc_octet_len, srtcp + enc_start, &out_len);
+        enc_octet_len = out_len;
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    } else {
+        /* if no encryption and not-inplace then need to copy rest of packet */
+        if (rtcp != srtcp) {
+            memcpy(srtcp + enc_start, rtcp + enc_start, enc_octet_len);
+        }
+
+        /*
+         * Even though we're not encrypting the payload, we need
+         * to run the cipher to get the auth tag.
+         */
+        uint8_t *auth_tag = srtcp + enc_start + enc_octet_len;
+        size_t out_len = *srtcp_len - enc_start - enc_octet_len;
+        status = srtp_cipher_encrypt(session_keys->rtcp_cipher, NULL, 0,
+                                     auth_tag, &out_len);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+        enc_octet_len += out_len;
+    }
+
+    *srtcp_len = octets_in_rtcp_header + enc_octet_len;
+
+    /* increase the packet length by the length of the seq_num*/
+    *srtcp_len += sizeof(srtcp_trailer_t);
+
+    /* increase the packet by the mki_size */
+    *srtcp_len += stream->mki_size;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * This function handles incoming SRTCP packets while in AEAD mode,
+ * which currently supports AES-GCM encryption.  Note, the auth tag is
+ * at the end of the packet stream and is automatically checked by GCM
+ * when decrypting the payload.
+ */
+static srtp_err_status_t srtp_unprotect_rtcp_aead(
+    srtp_t ctx,
+    srtp_stream_ctx_t *stream,
+    const uint8_t *srtcp,
+    size_t srtcp_len,
+    uint8_t *rtcp,
+    size_t *rtcp_len,
+    srtp_session_keys_t *session_keys)
+{
+    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)srtcp;
+    size_t enc_start;               /* pointer to start of encrypted portion  */
+    const uint8_t *trailer_p;       /* pointer to start of trailer            */
+    uint32_t trailer;               /* trailer value                          */
+    size_t enc_octet_len = 0;       /* number of octets in encrypted portion  */
+    const uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
+    srtp_err_status_t status;
+    size_t tag_len;
+    size_t tmp_len;
+    uint32_t seq_num;
+    v128_t iv;
+
+    /* get tag length from stream context */
+    tag_len = stream->rtcp_plan.tag_len;
+
+    enc_start = octets_in_rtcp_header;
+
+    /*
+     * set encryption start, encryption length, and trailer
+     */
+    /* index & E (encryption) bit follow normal data. hdr->len is the number of
+     * words (32-bit) in the normal packet minus 1
+     */
+    /* This should point trailer to the word past the end of the normal data. */
+    /* This would need to be modified for optional mikey data */
+    trailer_p = srtcp + srtcp_len - sizeof(srtcp_trailer_t) - stream->mki_size;
+    memcpy(&trailer, trailer_p, sizeof(trailer));
+
+    /*
+     * We pass the tag down to the cipher when doing GCM mode
+     */
+    enc_octet_len = srtcp_len - (octets_in_rtcp_header +
+                                 sizeof(srtcp_trailer_t) + stream->mki_size);
+    auth_tag = srtcp + (srtcp_len - tag_len - stream->mki_size -
+                        sizeof(srtcp_trailer_t));
+
+    /*
+     * check the sequence number for replays
+     */
+    /* this is easier than dealing with bitfield access */
+    seq_num = ntohl(trailer) & SRTCP_INDEX_MASK;
+    debug_print(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
+    status = srtp_rdb_check(&stream->rtcp_rdb, seq_num);
+    if (status) {
+        return status;
+    }
+
+    /*
+     * Calculate and set the IV
+     */
+    status = srtp_calc_aead_iv_srtcp(session_keys, &iv, seq_num, hdr);
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+    status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
+                                srtp_direction_decrypt);
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+
+    /* check output length */
+    if (*rtcp_len <
+        srtcp_len - sizeof(srtcp_trailer_t) - stream->mki_size - tag_len) {
+        return srtp_err_status_buffer_small;
+    }
+
+    /* if not inplace need to copy rtcp header */
+    if (srtcp != rtcp) {
+        memcpy(rtcp, srtcp, enc_start);
+    }
+
+    /*
+     * Set the AAD for GCM mode
+     */
+    if (*trailer_p & SRTCP_E_BYTE_BIT) {
+        /*
+         * If payload encryption is enabled, then the AAD consist of
+         * the RTCP header and the seq# at the end of the packet
+         */
+        status = srtp_cipher_set_aad(session_keys->rtcp_cipher, srtcp,
+                                     octets_in_rtcp_header);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    } else {
+        /*
+         * Since payload encryption is not enabled, we must authenticate
+         * the entire packet as described in RFC 7714 (Section 9.3. Data
+         * Types in Unencrypted SRTCP Compound Packets)
+         */
+        status = srtp_cipher_set_aad(
+            session_keys->rtcp_cipher, srtcp,
+            (srtcp_len - tag_len - sizeof(srtcp_trailer_t) - stream->mki_size));
+        if (status) {
+            return (srtp_err_status_cipher_fail);
+        }
+    }
+
+    /*
+     * Process the sequence# as AAD
+     */
+    status = srtp_cipher_set_aad(session_keys->rtcp_cipher, (uint8_t *)&trailer,
+                                 sizeof(trailer));
+    if (status) {
+        return (srtp_err_status_cipher_fail);
+    }
+
+    /* if we're decrypting, exor keystream into the message */
+    if (*trailer_p & SRTCP_E_BYTE_BIT) {
+        status = srtp_cipher_decrypt(session_keys->rtcp_cipher,
+                                     srtcp + enc_start, enc_octet_len,
+                                     rtcp + enc_start, &enc_octet_len);
+        if (status) {
+            return status;
+        }
+    } else {
+        /* if no encryption and not-inplace then need to copy rest of packet */
+        if (rtcp != srtcp) {
+            memcpy(rtcp + enc_start, srtcp + enc_start, enc_octet_len);
+        }
+
+        /*
+         * Still need to run the cipher to check the tag
+         */
+        tmp_len = 0;
+        status = srtp_cipher_decrypt(session_keys->rtcp_cipher, auth_tag,
+                                     tag_len, NULL, &tmp_len);
+        if (status) {
+            return status;
+        }
+    }
+
+    *rtcp_len = srtcp_len;
+
+    /* decrease the packet length by the length of the auth tag and seq_num*/
+    *rtcp_len -= (tag_len + sizeof(srtcp_trailer_t) + stream->mki_size);
+
+    /*
+     * verify that stream is for received traffic - this check will
+     * detect SSRC collisions, since a stream that appears in both
+     * srtp_protect() and srtp_unprotect() will fail this test in one of
+     * those functions.
+     *
+     * we do this check *after* the authentication check, so that the
+     * latter check will catch any attempts to fool us into thinking
+     * that we've got a collision
+     */
+    if (stream->direction != dir_srtp_receiver) {
+        if (stream->direction == dir_unknown) {
+            stream->direction = dir_srtp_receiver;
+        } else {
+            srtp_handle_event(ctx, stream, event_ssrc_collision);
+        }
+    }
+
+    /*
+     * if the stream is a 'provisional' one, in which the template context
+     * is used, then we need to allocate a new stream at this point, since
+     * the authentication passed
+     */
+    if (stream == ctx->stream_template) {
+        srtp_stream_ctx_t *new_stream;
+
+        /*
+         * allocate and initialize a new stream
+         *
+         * note that we indicate failure if we can't allocate the new
+         * stream, and some implementations will want to not return
+         * failure here
+         */
+        status = srtp_clone_template_stream(ctx, hdr->ssrc, &new_stream);
+        if (status) {
+            return status;
+        }
+
+        /* set stream (the pointer used in this function) */
+        stream = new_stream;
+    }
+
+    /* we've passed the authentication check, so add seq_num to the rdb */
+    srtp_rdb_add_index(&stream->rtcp_rdb, seq_num);
+
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t srtp_protect_rtcp_packet(srtp_t ctx,
+                                                  const uint8_t *rtcp,
+                                                  size_t rtcp_len,
+                                                  uint8_t *srtcp,
+                                                  size_t *srtcp_len,
+                                                  size_t mki_index)
+{
+    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)rtcp;
+    size_t enc_start;         /* pointer to start of encrypted portion  */
+    uint8_t *auth_start;      /* pointer to start of auth. portion      */
+    uint8_t *trailer_p;       /* pointer to start of trailer            */
+    uint32_t trailer;         /* trailer value                          */
+    size_t enc_octet_len = 0; /* number of octets in encrypted portion  */
+    uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
+    srtp_err_status_t status;
+    size_t tag_len;
+    srtp_stream_ctx_t *stream;
+    size_t prefix_len;
+    uint32_t seq_num;
+    srtp_session_keys_t *session_keys = NULL;
+
+    /* check the packet length - it must at least contain a full header */
+    if (rtcp_len < octets_in_rtcp_header) {
+        return srtp_err_status_bad_param;
+    }
+
+    /*
+     * look up ssrc in srtp_stream list, and process the packet with
+     * the appropriate stream.  if we haven't seen this stream before,
+     * there's only one key for this srtp_session, and the cipher
+     * supports key-sharing, then we assume that a new stream using
+     * that key has just started up
+     */
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+    if (stream == NULL) {
+        if (ctx->stream_template != NULL) {
+            srtp_stream_ctx_t *new_stream;
+
+            /* allocate and initialize a new stream */
+            status = srtp_clone_template_stream(ctx, hdr->ssrc, &new_stream);
+            if (status) {
+                return status;
+            }
+
+            /* set stream (the pointer used in this function) */
+            stream = new_stream;
+        } else {
+            /* no template stream, so we return an error */
+            return srtp_err_status_no_ctx;
+        }
+    }
+
+    /*
+     * verify that stream is for sending traffic - this check will
+     * detect SSRC collisions, since a stream that appears in both
+     * srtp_protect() and srtp_unprotect() will fail this test in one of
+     * those functions.
+     */
+    if (stream->direction != dir_srtp_sender) {
+        if (stream->direction == dir_unknown) {
+            stream->direction = dir_srtp_sender;
+        } else {
+            srtp_handle_event(ctx, stream, event_ssrc_collision);
+        }
+    }
+
+    if (ctx->index_store != NULL && stream->index_slot == NULL) {
+        status = srtp_index_store_attach(ctx->index_store, stream);
+        if (status) {
+            return status;
+        }
+    }
+
+    status = srtp_get_session_keys(stream, mki_index, &session_keys);
+    if (status) {
+        return status;
+    }
+
+    /*
+     * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
+     * the request to our AEAD handler.
+     */
+    if (stream->rtcp_plan.aead) {
+        return srtp_protect_rtcp_aead(ctx, stream, rtcp, rtcp_len, srtcp,
+                                      srtcp_len, session_keys);
+    }
+
+    /* get tag length from stream context */
+    tag_len = stream->rtcp_plan.tag_len;
+
+    /*
+     * set encryption start and encryption length
+     */
+    enc_start = octets_in_rtcp_header;
+    enc_octet_len = rtcp_len - enc_start;
+
+    /* check output length */
+    if (*srtcp_len <
+        rtcp_len + sizeof(srtcp_trailer_t) + stream->mki_size + tag_len) {
+        return srtp_err_status_buffer_small;
+    }
+
+    /* if not in place then need to copy rtcp header */
+    if (rtcp != srtcp) {
+        memcpy(srtcp, rtcp, enc_start);
+    }
+
+    /* all of the packet, except the header, gets encrypted */
+    /*
+     * NOTE: hdr->length is not usable - it refers to only the first RTCP report
+     * in the compound packet!
+     */
+    trailer_p = srtcp + enc_start + enc_octet_len;
+
+    if (stream->rtcp_services & sec_serv_conf) {
+        trailer = htonl(SRTCP_E_BIT); /* set encrypt bit */
+    } else {
+        /* 0 is network-order independant */
+        trailer = 0x00000000; /* set encrypt bit */
+    }
+
+    if (stream->use_mki) {
+        srtp_inject_mki(srtcp + rtcp_len + sizeof(srtcp_trailer_t),
+                        session_keys, stream->mki_size);
+    }
+
+    /*
+     * set the auth_start and auth_tag pointers to the proper locations
+     * (note that srtpc *always* provides authentication, unlike srtp)
+     */
+    /* Note: This would need to change for optional mikey data */
+    auth_start = srtcp;
+    auth_tag = srtcp + rtcp_len + sizeof(srtcp_trailer_t) + stream->mki_size;
+
+    /*
+     * check sequence number for overruns, and copy it into the packet
+     * if its value isn't too big
+     */
+    status = srtp_rdb_increment(&stream->rtcp_rdb);
+    if (status) {
+        return status;
+    }
+    srtp_checkpoint_rtcp_index(ctx, stream);
+    seq_num = srtp_rdb_get_value(&stream->rtcp_rdb);
+    trailer |= htonl(seq_num);
+    debug_print(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
+
+    memcpy(trailer_p, &trailer, sizeof(trailer));
+
+    /*
+     * if we're using rindael counter mode, set nonce and seq
+     */
+    if (stream->rtcp_plan.icm_iv) {
+        v128_t iv;
+
+        iv.v32[0] = 0;
+        iv.v32[1] = hdr->ssrc; /* still in network order! */
+        iv.v32[2] = htonl(seq_num >> 16);
+        iv.v32[3] = htonl(seq_num << 16);
+        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
+                                    srtp_direction_encrypt);
+
+    } else {
+        v128_t iv;
+
+        /* otherwise, just set the index to seq_num */
+        iv.v32[0] = 0;
+        iv.v32[1] = 0;
+        iv.v32[2] = 0;
+        iv.v32[3] = htonl(seq_num);
+        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
+                                    srtp_direction_encrypt);
+    }
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+
+    /*
+     * if we're authenticating using a universal hash, put the keystream
+     * prefix into the authentication tag
+     */
+
+    /* if auth_start is non-null, then put keystream into tag  */
+    if (auth_start) {
+        /* put keystream prefix into auth_tag */
+        prefix_len = stream->rtcp_plan.prefix_len;
+        status = srtp_cipher_output(session_keys->rtcp_cipher, auth_tag,
+                                    &prefix_len);
+
+        debug_print(mod_srtp, "keystream prefix: %s",
+                    srtp_octet_string_hex_string(auth_tag, prefix_len));
+
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    }
+
+    /* if we're encrypting, exor keystream into the message */
+    if (stream->rtcp_services & sec_serv_conf) {
+        status = srtp_cipher_encrypt(session_keys->rtcp_cipher,
+                                     rtcp + enc_start, enc_octet_len,
+                                     srtcp + enc_start, &enc_octet_len);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    } else if (rtcp != srtcp) {
+        /* if no encryption and not-inplace then need to copy rest of packet */
+        memcpy(srtcp + enc_start, rtcp + enc_start, enc_octet_len);
+    }
+
+    /* initialize auth func context */
+    status = srtp_auth_start(session_keys->rtcp_auth);
+    if (status) {
+        return status;
+    }
+
+    /*
+     * run auth func over packet (including trailer), and write the
+     * result at auth_tag
+     */
+    status = srtp_auth_compute(session_keys->rtcp_auth, auth_start,
+                               rtcp_len + sizeof(srtcp_trailer_t), auth_tag);
+    debug_print(mod_srtp, "srtcp auth tag:    %s",
+                srtp_octet_string_hex_string(auth_tag, tag_len));
+    if (status) {
+        return srtp_err_status_auth_fail;
+    }
+
+    *srtcp_len = enc_start + enc_octet_len;
+
+    /* increase the packet length by the length of the auth tag and seq_num*/
+    *srtcp_len += (tag_len + sizeof(srtcp_trailer_t));
+
+    /* increase the packet by the mki_size */
+    *srtcp_len += stream->mki_size;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_protect_rtcp(srtp_t ctx,
+                                    const uint8_t *rtcp,
+                                    size_t rtcp_len,
+                                    uint8_t *srtcp,
+                                    size_t *srtcp_len,
+                                    size_t mki_index)
+{
+    srtp_shared_call_t shared = { false, NULL, false, false };
+    srtp_err_status_t status;
+    uint32_t ssrc = 0;
+    uint64_t trace_start = 0;
+    uint64_t cost_start = 0;
+    bool cost_sample = srtp_cost_sample(ctx);
+
+    if (srtp_trace_enabled()) {
+        trace_start = srtp_trace_now();
+    }
+
+    if (cost_sample) {
+        cost_start = srtp_cost_clock();
+    }
+
+    if (ctx->shared_state != NULL && rtcp_len >= octets_in_rtcp_header) {
+        ssrc = ((const srtcp_hdr_t *)rtcp)->ssrc;
+        status = srtp_shared_enter(ctx, ssrc, true, &shared);
+        if (status) {
+            return status;
+        }
+    }
+
+    status = srtp_protect_rtcp_packet(ctx, rtcp, rtcp_len, srtcp, srtcp_len,
+                                      mki_index);
+
+    if (shared.entered) {
+        status = srtp_shared_leave(ctx, ssrc, &shared, status);
+    }
+
+    if (cost_sample) {
+        srtp_cost_attribute(ctx, rtcp, rtcp_len, 4, cost_start);
+    }
+
+    if (srtp_trace_enabled()) {
+        srtp_trace_packet(SRTP_TRACE_PROTECT_RTCP, ctx, trace_start, rtcp,
+                          rtcp_len, *srtcp_len, mki_index, status);
+    }
+
+    return status;
+}
+
+static srtp_err_status_t srtp_unprotect_rtcp_packet(srtp_t ctx,
+                                                    const uint8_t *srtcp,
+                                                    size_t srtcp_len,
+                                                    uint8_t *rtcp,
+                                                    size_t *rtcp_len)
+{
+    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)srtcp;
+    size_t enc_start;               /* pointer to start of encrypted portion  */
+    const uint8_t *auth_start;      /* pointer to start of auth. portion      */
+    const uint8_t *trailer_p;       /* pointer to start of trailer            */
+    uint32_t trailer;               /* trailer value                          */
+    size_t enc_octet_len = 0;       /* number of octets in encrypted portion  */
+    const uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
+    uint8_t tmp_tag[SRTP_MAX_TAG_LEN];
+    srtp_err_status_t status;
+    size_t auth_len;
+    size_t tag_len;
+    srtp_stream_ctx_t *stream;
+    size_t prefix_len;
+    uint32_t seq_num;
+    bool e_bit_in_packet;          /* E-bit was found in the packet */
+    bool sec_serv_confidentiality; /* whether confidentiality was requested */
+    srtp_session_keys_t *session_keys = NULL;
+
+    /*
+     * check that the length value is sane; we'll check again once we
+     * know the tag length, but we at least want to know that it is
+     * a positive value
+     */
+    if (srtcp_len < octets_in_rtcp_header + sizeof(srtcp_trailer_t)) {
+        return srtp_err_status_bad_param;
+    }
+
+    /*
+     * look up ssrc in srtp_stream list, and process the packet with
+     * the appropriate stream.  if we haven't seen this stream before,
+     * there's only one key for this srtp_session, and the cipher
+     * supports key-sharing, then we assume that a new stream using
+     * that key has just started up
+     */
+    stream = srtp_get_stream(ctx, hdr->ssrc);
+    if (stream == NULL) {
+        if (ctx->stream_template != NULL) {
+            stream = ctx->stream_template;
+
+            debug_print(mod_srtp,
+                        "srtcp using provisional stream (SSRC: 0x%08x)",
+                        (unsigned int)ntohl(hdr->ssrc));
+        } else {
+            /* no template stream, so we return an error */
+            return srtp_err_status_no_ctx;
+        }
+    }
+
+    /*
+     * Determine if MKI is being used and what session keys should be used
+     */
+    status = srtp_get_session_keys_for_rtcp_packet(stream, srtcp, srtcp_len,
+                                                   &session_keys);
+    if (status) {
+        return status;
+    }
+
+    /* get tag length from stream context */
+    tag_len = stream->rtcp_plan.tag_len;
+
+    /* check the packet length - it must contain at least a full RTCP
+       header, an auth tag (if applicable), and the SRTCP encrypted flag
+       and 31-bit index value */
+    if (srtcp_len < octets_in_rtcp_header + sizeof(srtcp_trailer_t) +
+                        stream->mki_size + tag_len) {
+        return srtp_err_status_bad_param;
+    }
+
+    /*
+     * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
+     * the request to our AEAD handler.
+     */
+    if (stream->rtcp_plan.aead) {
+        return srtp_unprotect_rtcp_aead(ctx, stream, srtcp, srtcp_len, rtcp,
+                                        rtcp_len, session_keys);
+    }
+
+    sec_serv_confidentiality = stream->rtcp_services == sec_serv_conf ||
+                               stream->rtcp_services == sec_serv_conf_and_auth;
+
+    /*
+     * set encryption start, encryption length, and trailer
+     */
+    enc_start = octets_in_rtcp_header;
+    enc_octet_len = srtcp_len - (octets_in_rtcp_header + tag_len +
+                                 stream->mki_size + sizeof(srtcp_trailer_t));
+    /*
+     *index & E (encryption) bit follow normal data. hdr->len is the number of
+     * words (32-bit) in the normal packet minus 1
+     */
+    /* This should point trailer to the word past the end of the normal data. */
+    /* This would need to be modified for optional mikey data */
+    trailer_p = srtcp + srtcp_len -
+                (tag_len + stream->mki_size + sizeof(srtcp_trailer_t));
+    memcpy(&trailer, trailer_p, sizeof(trailer));
+
+    e_bit_in_packet = (*trailer_p & SRTCP_E_BYTE_BIT) == SRTCP_E_BYTE_BIT;
+    if (e_bit_in_packet != sec_serv_confidentiality) {
+        return srtp_err_status_cant_check;
+    }
+
+    /*
+     * set the auth_start and auth_tag pointers to the proper locations
+     * (note that srtcp *always* uses authentication, unlike srtp)
+     */
+    auth_start = srtcp;
+
+    /*
+     * The location of the auth tag in the packet needs to know MKI
+     * could be present.  The data needed to calculate the Auth tag
+     * must not include the MKI
+     */
+    auth_len = srtcp_len - tag_len - stream->mki_size;
+    auth_tag = srtcp + auth_len + stream->mki_size;
+
+    /*
+     * check the sequence number for replays
+     */
+    /* this is easier than dealing with bitfield access */
+    seq_num = ntohl(trailer) & SRTCP_INDEX_MASK;
+    debug_print(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
+    status = srtp_rdb_check(&stream->rtcp_rdb, seq_num);
+    if (status) {
+        return status;
+    }
+
+    /*
+     * if we're using aes counter mode, set nonce and seq
+     */
+    if (stream->rtcp_plan.icm_iv) {
+        v128_t iv;
+
+        iv.v32[0] = 0;
+        iv.v32[1] = hdr->ssrc; /* still in network order! */
+        iv.v32[2] = htonl(seq_num >> 16);
+        iv.v32[3] = htonl(seq_num << 16);
+        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
+                                    srtp_direction_decrypt);
+
+    } else {
+        v128_t iv;
+
+        /* otherwise, just set the index to seq_num */
+        iv.v32[0] = 0;
+        iv.v32[1] = 0;
+        iv.v32[2] = 0;
+        iv.v32[3] = htonl(seq_num);
+        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
+                                    srtp_direction_decrypt);
+    }
+    if (status) {
+        return srtp_err_status_cipher_fail;
+    }
+
+    /*
+     * if we're authenticating using a universal hash, put the keystream
+     * prefix into the authentication tag
+     */
+    prefix_len = stream->rtcp_plan.prefix_len;
+    if (prefix_len) {
+        status =
+            srtp_cipher_output(session_keys->rtcp_cipher, tmp_tag, &prefix_len);
+        debug_print(mod_srtp, "keystream prefix: %s",
+                    srtp_octet_string_hex_string(tmp_tag, prefix_len));
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    }
+
+    /* initialize auth func context */
+    status = srtp_auth_start(session_keys->rtcp_auth);
+    if (status) {
+        return status;
+    }
+
+    /* run auth func over packet, put result into tmp_tag */
+    status = srtp_auth_compute(session_keys->rtcp_auth, auth_start, auth_len,
+                               tmp_tag);
+    debug_print(mod_srtp, "srtcp computed tag:       %s",
+                srtp_octet_string_hex_string(tmp_tag, tag_len));
+    if (status) {
+        return srtp_err_status_auth_fail;
+    }
+
+    /* compare the tag just computed with the one in the packet */
+    debug_print(mod_srtp, "srtcp tag from packet:    %s",
+                srtp_octet_string_hex_string(auth_tag, tag_len));
+    if (!srtp_octet_string_equal(tmp_tag, auth_tag, tag_len)) {
+        return srtp_err_status_auth_fail;
+    }
+
+    /* check output length */
+    if (*rtcp_len <
+        srtcp_len - sizeof(srtcp_trailer_t) - stream->mki_size - tag_len) {
+        return srtp_err_status_buffer_small;
+    }
+
+    /* if not inplace need to copy rtcp header */
+    if (srtcp != rtcp) {
+        memcpy(rtcp, srtcp, enc_start);
+    }
+
+    /* if we're decrypting, exor keystream into the message */
+    if (sec_serv_confidentiality) {
+        status = srtp_cipher_decrypt(session_keys->rtcp_cipher,
+                                     srtcp + enc_start, enc_octet_len,
+                                     rtcp + enc_start, &enc_octet_len);
+        if (status) {
+            return srtp_err_status_cipher_fail;
+        }
+    } else if (srtcp != rtcp) {
+        /* if no encryption and not-inplace then need to copy rest of packet */
+        memcpy(rtcp + enc_start, srtcp + enc_start, enc_octet_len);
+    }
+
+    *rtcp_len = srtcp_len;
+
+    /* decrease the packet length by the length of the auth tag and seq_num */
+    *rtcp_len -= (tag_len + sizeof(srtcp_trailer_t));
+
+    /* decrease the packet length by the length of the mki_size */
+    *rtcp_len -= stream->mki_size;
+
+    /*
+     * verify that stream is for received traffic - this check will
+     * detect SSRC collisions, since a stream that appears in both
+     * srtp_protect() and srtp_unprotect() will fail this test in one of
+     * those functions.
+     *
+     * we do this check *after* the authentication check, so that the
+     * latter check will catch any attempts to fool us into thinking
+     * that we've got a collision
+     */
+    if (stream->direction != dir_srtp_receiver) {
+        if (stream->direction == dir_unknown) {
+            stream->direction = dir_srtp_receiver;
+        } else {
+            srtp_handle_event(ctx, stream, event_ssrc_collision);
+        }
+    }
+
+    /*
+     * if the stream is a 'provisional' one, in which the template context
+     * is used, then we need to allocate a new stream at this point, since
+     * the authentication passed
+     */
+    if (stream == ctx->stream_template) {
+        srtp_stream_ctx_t *new_stream;
+
+        /*
+         * allocate and initialize a new stream
+         *
+         * note that we indicate failure if we can't allocate the new
+         * stream, and some implementations will want to not return
+         * failure here
+         */
+        status = srtp_clone_template_stream(ctx, hdr->ssrc, &new_stream);
+        if (status) {
+            return status;
+        }
+
+        /* set stream (the pointer used in this function) */
+        stream = new_stream;
+    }
+
+    /* we've passed the authentication check, so add seq_num to the rdb */
+    srtp_rdb_add_index(&stream->rtcp_rdb, seq_num);
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_unprotect_rtcp(srtp_t ctx,
+                                      const uint8_t *srtcp,
+                                      size_t srtcp_len,
+                                      uint8_t *rtcp,
+                                      size_t *rtcp_len)
+{
+    srtp_shared_call_t shared = { false, NULL, false, false };
+    srtp_err_status_t status;
+    uint32_t ssrc = 0;
+    uint64_t trace_start = 0;
+    uint64_t cost_start = 0;
+    bool cost_sample = srtp_cost_sample(ctx);
+
+    if (srtp_trace_enabled()) {
+        trace_start = srtp_trace_now();
+    }
+
+    if (cost_sample) {
+        cost_start = srtp_cost_clock();
+    }
+
+    if (ctx->shared_state != NULL && srtcp_len >= octets_in_rtcp_header) {
+        ssrc = ((const srtcp_hdr_t *)srtcp)->ssrc;
+        status = srtp_shared_enter(ctx, ssrc, false, &shared);
+        if (status) {
+            return status;
+        }
+    }
+
+    status = srtp_unprotect_rtcp_packet(ctx, srtcp, srtcp_len, rtcp, rtcp_len);
+
+    if (shared.entered) {
+        status = srtp_shared_leave(ctx, ssrc, &shared, status);
+    }
+
+    if (cost_sample) {
+        srtp_cost_attribute(ctx, srtcp, srtcp_len, 4, cost_start);
+    }
+
+    if (srtp_trace_enabled()) {
+        srtp_trace_packet(SRTP_TRACE_UNPROTECT_RTCP, ctx, trace_start, srtcp,
+                          srtcp_len, *rtcp_len, 0, status);
+    }
+
+    return status;
+}
+
+/*
+ * user data within srtp_t context
+ */
+
+void srtp_set_user_data(srtp_t ctx, void *data)
+{
+    ctx->user_data = data;
+}
+
+void *srtp_get_user_data(srtp_t ctx)
+{
+    return ctx->user_data;
+}
+
+srtp_err_status_t srtp_crypto_policy_set_from_profile_for_rtp(
+    srtp_crypto_policy_t *policy,
+    srtp_profile_t profile)
+{
+    /* set SRTP policy from the SRTP profile in the key set */
+    switch (profile) {
+    case srtp_profile_aes128_cm_sha1_80:
+        srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(policy);
+        break;
+    case srtp_profile_aes128_cm_sha1_32:
+        srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(policy);
+        break;
+    case srtp_profile_null_sha1_80:
+        srtp_crypto_policy_set_null_cipher_hmac_sha1_80(policy);
+        break;
+#ifdef GCM
+    case srtp_profile_aead_aes_128_gcm:
+        srtp_crypto_policy_set_aes_gcm_128_16_auth(policy);
+        break;
+    case srtp_profile_aead_aes_256_gcm:
+        srtp_crypto_policy_set_aes_gcm_256_16_auth(policy);
+        break;
+#endif
+    /* the following profiles are not (yet) supported */
+    case srtp_profile_null_sha1_32:
+    default:
+        return srtp_err_status_bad_param;
+    }
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_crypto_policy_set_from_profile_for_rtcp(
+    srtp_crypto_policy_t *policy,
+    srtp_profile_t profile)
+{
+    /* set SRTP policy from the SRTP profile in the key set */
+    switch (profile) {
+    case srtp_profile_aes128_cm_sha1_80:
+        srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(policy);
+        break;
+    case srtp_profile_aes128_cm_sha1_32:
+        /* We do not honor the 32-bit auth tag request since
+         * this is not compliant with RFC 3711 */
+        srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(policy);
+        break;
+    case srtp_profile_null_sha1_80:
+        srtp_crypto_policy_set_null_cipher_hmac_sha1_80(policy);
+        break;
+#ifdef GCM
+    case srtp_profile_aead_aes_128_gcm:
+        srtp_crypto_policy_set_aes_gcm_128_16_auth(policy);
+        break;
+    case srtp_profile_aead_aes_256_gcm:
+        srtp_crypto_policy_set_aes_gcm_256_16_auth(policy);
+        break;
+#endif
+    /* the following profiles are not (yet) supported */
+    case srtp_profile_null_sha1_32:
+    default:
+        return srtp_err_status_bad_param;
+    }
+
+    return srtp_err_status_ok;
+}
+
+void srtp_append_salt_to_key(uint8_t *key,
+                             size_t bytes_in_key,
+                             uint8_t *salt,
+                             size_t bytes_in_salt)
+{
+    memcpy(key + bytes_in_key, salt, bytes_in_salt);
+}
+
+size_t srtp_profile_get_master_key_length(srtp_profile_t profile)
+{
+    switch (profile) {
+    case srtp_profile_aes128_cm_sha1_80:
+        return SRTP_AES_128_KEY_LEN;
+        break;
+    case srtp_profile_aes128_cm_sha1_32:
+        return SRTP_AES_128_KEY_LEN;
+        break;
+    case srtp_profile_null_sha1_80:
+        return SRTP_AES_128_KEY_LEN;
+        break;
+    case srtp_profile_aead_aes_128_gcm:
+        return SRTP_AES_128_KEY_LEN;
+        break;
+    case srtp_profile_aead_aes_256_gcm:
+        return SRTP_AES_256_KEY_LEN;
+        break;
+    /* the following profiles are not (yet) supported */
+    case srtp_profile_null_sha1_32:
+    default:
+        return 0; /* indicate error by returning a zero */
+    }
+}
+
+size_t srtp_profile_get_master_salt_length(srtp_profile_t profile)
+{
+    switch (profile) {
+    case srtp_profile_aes128_cm_sha1_80:
+        return SRTP_SALT_LEN;
+        break;
+    case srtp_profile_aes128_cm_sha1_32:
+        return SRTP_SALT_LEN;
+        break;
+    case srtp_profile_null_sha1_80:
+        return SRTP_SALT_LEN;
+        break;
+    case srtp_profile_aead_aes_128_gcm:
+        return SRTP_AEAD_SALT_LEN;
+        break;
+    case srtp_profile_aead_aes_256_gcm:
+        return SRTP_AEAD_SALT_LEN;
+        break;
+    /* the following profiles are not (yet) supported */
+    case srtp_profile_null_sha1_32:
+    default:
+        return 0; /* indicate error by returning a zero */
+    }
+}
+
+srtp_err_status_t stream_get_protect_trailer_length(srtp_stream_ctx_t *stream,
+                                                    bool is_rtp,
+                                                    size_t mki_index,
+                                                    size_t *length)
+{
+    *length = 0;
+
+    if (stream->use_mki) {
+        if (mki_index >= stream->num_master_keys) {
+            return srtp_err_status_bad_mki;
+        }
+        *length += stream->mki_size;
+    }
+    if (is_rtp) {
+        *length += stream->rtp_plan.tag_len;
+    } else {
+        *length += stream->rtcp_plan.tag_len;
+        *length += sizeof(srtcp_trailer_t);
+    }
+
+    return srtp_err_status_ok;
+}
+
+struct get_protect_trailer_length_data {
+    bool found_stream; /* whether at least one matching stream was found */
+    size_t length;     /* maximum trailer length found so far */
+    bool is_rtp;
+    size_t mki_index;
+};
+
+static bool get_protect_trailer_length_cb(srtp_stream_t stream, void *raw_data)
+{
+    struct get_protect_trailer_length_data *data =
+        (struct get_protect_trailer_length_data *)raw_data;
+    size_t temp_length;
+
+    if (stream_get_protect_trailer_length(stream, data->is_rtp, data->mki_index,
+                                          &temp_length) == srtp_err_status_ok) {
+        data->found_stream = true;
+        if (temp_length > data->length) {
+            data->length = temp_length;
+        }
+    }
+
+    return true;
+}
+
+srtp_err_status_t get_protect_trailer_length(srtp_t session,
+                                             bool is_rtp,
+                                             size_t mki_index,
+                                             size_t *length)
+{
+    srtp_stream_ctx_t *stream;
+    struct get_protect_trailer_length_data data = { false, 0, is_rtp,
+                                                    mki_index };
+
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    stream = session->stream_template;
+
+    if (stream != NULL) {
+        data.found_stream = true;
+        stream_get_protect_trailer_length(stream, is_rtp, mki_index,
+                                          &data.length);
+    }
+
+    session->stream_index->for_each(session->stream_list,
+                                    get_protect_trailer_length_cb, &data);
+
+    if (!data.found_stream) {
+        return srtp_err_status_bad_param;
+    }
+
+    *length = data.length;
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_get_protect_trailer_length(srtp_t session,
+                                                  size_t mki_index,
+                                                  size_t *length)
+{
+    return get_protect_trailer_length(session, true, mki_index, length);
+}
+
+srtp_err_status_t srtp_get_protect_rtcp_trailer_length(srtp_t session,
+                                                       size_t mki_index,
+                                                       size_t *length)
+{
+    return get_protect_trailer_length(session, false, mki_index, length);
+}
+
+/*
+ * SRTP debug interface
+ */
+srtp_err_status_t srtp_set_debug_module(const char *mod_name, bool v)
+{
+    return srtp_crypto_kernel_set_debug_module(mod_name, v);
+}
+
+srtp_err_status_t srtp_list_debug_modules(void)
+{
+    return srtp_crypto_kernel_list_debug_modules();
+}
+
+/*
+ * srtp_log_handler is a global variable holding a pointer to the
+ * log handler function; this function is called for any log
+ * output.
+ */
+
+static srtp_log_handler_func_t *srtp_log_handler = NULL;
+static void *srtp_log_handler_data = NULL;
+
+static void srtp_err_handler(srtp_err_reporting_level_t level, const char *msg)
+{
+    if (srtp_log_handler) {
+        srtp_log_level_t log_level = srtp_log_level_error;
+        switch (level) {
+        case srtp_err_level_error:
+            log_level = srtp_log_level_error;
+            break;
+        case srtp_err_level_warning:
+            log_level = srtp_log_level_warning;
+            break;
+        case srtp_err_level_info:
+            log_level = srtp_log_level_info;
+            break;
+        case srtp_err_level_debug:
+            log_level = srtp_log_level_debug;
+            break;
         }
-    } else if (rtcp != srtcp) {
-        /* if no encryption and not-inplace then need to copy rest of packet */
-        memcpy(srtcp + enc_start, rtcp + enc_start, enc_octet_len);
-    }
 
-    /* initialize auth func context */
-    status = srtp_auth_start(session_keys->rtcp_auth);
-    if (status) {
-        return status;
+        srtp_log_handler(log_level, msg, srtp_log_handler_data);
     }
+}
 
+srtp_err_status_t srtp_install_log_handler(srtp_log_handler_func_t func,
+                                           void *data)
+{
     /*
-     * run auth func over packet (including trailer), and write the
-     * result at auth_tag
+     * note that we accept NULL arguments intentionally - calling this
+     * function with a NULL arguments removes a log handler that's
+     * been previously installed
      */
-    status = srtp_auth_compute(session_keys->rtcp_auth, auth_start,
-                               rtcp_len + sizeof(srtcp_trailer_t), auth_tag);
-    debug_print(mod_srtp, "srtcp auth tag:    %s",
-                srtp_octet_string_hex_string(auth_tag, tag_len));
-    if (status) {
-        return srtp_err_status_auth_fail;
+
+    if (srtp_log_handler) {
+        srtp_install_err_report_handler(NULL);
+    }
+    srtp_log_handler = func;
+    srtp_log_handler_data = data;
+    if (srtp_log_handler) {
+        srtp_install_err_report_handler(srtp_err_handler);
     }
+    return srtp_err_status_ok;
+}
 
-    *srtcp_len = enc_start + enc_octet_len;
+srtp_err_status_t srtp_stream_set_roc(srtp_t session,
+                                      uint32_t ssrc,
+                                      uint32_t roc)
+{
+    srtp_stream_t stream;
 
-    /* increase the packet length by the length of the auth tag and seq_num*/
-    *srtcp_len += (tag_len + sizeof(srtcp_trailer_t));
+    stream = srtp_get_stream(session, htonl(ssrc));
+    if (stream == NULL) {
+        return srtp_err_status_bad_param;
+    }
 
-    /* increase the packet by the mki_size */
-    *srtcp_len += stream->mki_size;
+    stream->pending_roc = roc;
 
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_unprotect_rtcp(srtp_t ctx,
-                                      const uint8_t *srtcp,
-                                      size_t srtcp_len,
-                                      uint8_t *rtcp,
-                                      size_t *rtcp_len)
+srtp_err_status_t srtp_stream_get_roc(srtp_t session,
+                                      uint32_t ssrc,
+                                      uint32_t *roc)
 {
-    const srtcp_hdr_t *hdr = (const srtcp_hdr_t *)srtcp;
-    size_t enc_start;               /* pointer to start of encrypted portion  */
-    const uint8_t *auth_start;      /* pointer to start of auth. portion      */
-    const uint8_t *trailer_p;       /* pointer to start of trailer            */
-    uint32_t trailer;               /* trailer value                          */
-    size_t enc_octet_len = 0;       /* number of octets in encrypted portion  */
-    const uint8_t *auth_tag = NULL; /* location of auth_tag within packet     */
-    uint8_t tmp_tag[SRTP_MAX_TAG_LEN];
-    srtp_err_status_t status;
-    size_t auth_len;
-    size_t tag_len;
-    srtp_stream_ctx_t *stream;
-    size_t prefix_len;
-    uint32_t seq_num;
-    bool e_bit_in_packet;          /* E-bit was found in the packet */
-    bool sec_serv_confidentiality; /* whether confidentiality was requested */
-    srtp_session_keys_t *session_keys = NULL;
+    srtp_stream_t stream;
 
-    /*
-     * check that the length value is sane; we'll check again once we
-     * know the tag length, but we at least want to know that it is
-     * a positive value
-     */
-    if (srtcp_len < octets_in_rtcp_header + sizeof(srtcp_trailer_t)) {
+    stream = srtp_get_stream(session, htonl(ssrc));
+    if (stream == NULL) {
         return srtp_err_status_bad_param;
     }
 
-    /*
-     * look up ssrc in srtp_stream list, and process the packet with
-     * the appropriate stream.  if we haven't seen this stream before,
-     * there's only one key for this srtp_session, and the cipher
-     * supports key-sharing, then we assume that a new stream using
-     * that key has just started up
-     */
-    stream = srtp_get_stream(ctx, hdr->ssrc);
-    if (stream == NULL) {
-        if (ctx->stream_template != NULL) {
-            stream = ctx->stream_template;
+    *roc = srtp_rdbx_get_roc(&stream->rtp_rdbx);
 
-            debug_print(mod_srtp,
-                        "srtcp using provisional stream (SSRC: 0x%08x)",
-                        (unsigned int)ntohl(hdr->ssrc));
-        } else {
-            /* no template stream, so we return an error */
-            return srtp_err_status_no_ctx;
-        }
+    return srtp_err_status_ok;
+}
+
+/*
+ * the bulk stream functions sort the requested SSRCs and look each stream
+ * of the index up among them, which takes one pass over the index
+ * whatever its implementation
+ */
+typedef struct srtp_ssrc_request_t {
+    uint32_t ssrc; /* network order, as streams keep it */
+    size_t pos;    /* position of the SSRC in the request */
+    bool found;
+} srtp_ssrc_request_t;
+
+typedef void(srtp_ssrc_request_func_t)(srtp_stream_t stream,
+                                       size_t pos,
+                                       void *data);
+
+struct srtp_ssrc_requests_data {
+    srtp_ssrc_request_t *requests;
+    size_t count;
+    srtp_ssrc_request_func_t *func;
+    void *data;
+};
+
+static int srtp_ssrc_request_compare(const void *a, const void *b)
+{
+    uint32_t ssrc_a = ((const srtp_ssrc_request_t *)a)->ssrc;
+    uint32_t ssrc_b = ((const srtp_ssrc_request_t *)b)->ssrc;
+
+    return ssrc_a < ssrc_b ? -1 : ssrc_a > ssrc_b;
+}
+
+static bool srtp_ssrc_requests_cb(srtp_stream_t stream, void *raw_data)
+{
+    struct srtp_ssrc_requests_data *data =
+        (struct srtp_ssrc_requests_data *)raw_data;
+    srtp_ssrc_request_t *end = data->requests + data->count;
+    srtp_ssrc_request_t key;
+    srtp_ssrc_request_t *request;
+
+    key.ssrc = stream->ssrc;
+    request = (srtp_ssrc_request_t *)bsearch(&key, data->requests,
+                                             data->count, sizeof(key),
+                                             srtp_ssrc_request_compare);
+    if (request == NULL) {
+        return true;
     }
 
-    /*
-     * Determine if MKI is being used and what session keys should be used
-     */
-    status = srtp_get_session_keys_for_rtcp_packet(stream, srtcp, srtcp_len,
-                                                   &session_keys);
-    if (status) {
-        return status;
+    /* an SSRC may be requested more than once */
+    while (request > data->requests && request[-1].ssrc == stream->ssrc) {
+        request--;
+    }
+    for (; request < end && request->ssrc == stream->ssrc; request++) {
+        request->found = true;
+        data->func(stream, request->pos, data->data);
     }
 
-    /* get tag length from stream context */
-    tag_len = srtp_auth_get_tag_length(session_keys->rtcp_auth);
+    return true;
+}
 
-    /* check the packet length - it must contain at least a full RTCP
-       header, an auth tag (if applicable), and the SRTCP encrypted flag
-       and 31-bit index value */
-    if (srtcp_len < octets_in_rtcp_header + sizeof(srtcp_trailer_t) +
-                        stream->mki_size + tag_len) {
+/*
+ * srtp_for_each_ssrc(session, ssrcs, stride, count, func, data) calls
+ * func(stream, pos, data) for each of the count SSRCs (host order) that
+ * are stride octets apart from ssrcs and have a stream in the session.
+ * returns srtp_err_status_no_ctx if one of them has none.
+ */
+static srtp_err_status_t srtp_for_each_ssrc(srtp_t session,
+                                            const void *ssrcs,
+                                            size_t stride,
+                                            size_t count,
+                                            srtp_ssrc_request_func_t *func,
+                                            void *data)
+{
+    struct srtp_ssrc_requests_data requests_data;
+    srtp_err_status_t status = srtp_err_status_ok;
+
+    if (session == NULL || (ssrcs == NULL && count > 0)) {
         return srtp_err_status_bad_param;
     }
+    if (count == 0) {
+        return srtp_err_status_ok;
+    }
 
-    /*
-     * Check if this is an AEAD stream (GCM mode).  If so, then dispatch
-     * the request to our AEAD handler.
-     */
-    if (session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_128 ||
-        session_keys->rtp_cipher->algorithm == SRTP_AES_GCM_256) {
-        return srtp_unprotect_rtcp_aead(ctx, stream, srtcp, srtcp_len, rtcp,
-                                        rtcp_len, session_keys);
+    requests_data.requests = (srtp_ssrc_request_t *)srtp_crypto_alloc(
+        sizeof(srtp_ssrc_request_t) * count);
+    if (requests_data.requests == NULL) {
+        return srtp_err_status_alloc_fail;
     }
+    for (size_t i = 0; i < count; i++) {
+        uint32_t ssrc;
 
-    sec_serv_confidentiality = stream->rtcp_services == sec_serv_conf ||
-                               stream->rtcp_services == sec_serv_conf_and_auth;
+        memcpy(&ssrc, (const uint8_t *)ssrcs + i * stride, sizeof(ssrc));
+        requests_data.requests[i].ssrc = htonl(ssrc);
+        requests_data.requests[i].pos = i;
+        requests_data.requests[i].found = false;
+    }
+    qsort(requests_data.requests, count, sizeof(srtp_ssrc_request_t),
+          srtp_ssrc_request_compare);
+    requests_data.count = count;
+    requests_data.func = func;
+    requests_data.data = data;
 
-    /*
-     * set encryption start, encryption length, and trailer
-     */
-    enc_start = octets_in_rtcp_header;
-    enc_octet_len = srtcp_len - (octets_in_rtcp_header + tag_len +
-                                 stream->mki_size + sizeof(srtcp_trailer_t));
-    /*
-     *index & E (encryption) bit follow normal data. hdr->len is the number of
-     * words (32-bit) in the normal packet minus 1
-     */
-    /* This should point trailer to the word past the end of the normal data. */
-    /* This would need to be modified for optional mikey data */
-    trailer_p = srtcp + srtcp_len -
-                (tag_len + stream->mki_size + sizeof(srtcp_trailer_t));
-    memcpy(&trailer, trailer_p, sizeof(trailer));
+    session->stream_index->for_each(session->stream_list,
+                                    srtp_ssrc_requests_cb, &requests_data);
 
-    e_bit_in_packet = (*trailer_p & SRTCP_E_BYTE_BIT) == SRTCP_E_BYTE_BIT;
-    if (e_bit_in_packet != sec_serv_confidentiality) {
-        return srtp_err_status_cant_check;
+    for (size_t i = 0; i < count; i++) {
+        if (!requests_data.requests[i].found) {
+            status = srtp_err_status_no_ctx;
+        }
     }
+    srtp_crypto_free(requests_data.requests);
 
-    /*
-     * set the auth_start and auth_tag pointers to the proper locations
-     * (note that srtcp *always* uses authentication, unlike srtp)
-     */
-    auth_start = srtcp;
+    return status;
+}
 
-    /*
-     * The location of the auth tag in the packet needs to know MKI
-     * could be present.  The data needed to calculate the Auth tag
-     * must not include the MKI
-     */
-    auth_len = srtcp_len - tag_len - stream->mki_size;
-    auth_tag = srtcp + auth_len + stream->mki_size;
+static void srtp_set_roc_func(srtp_stream_t stream, size_t pos, void *data)
+{
+    stream->pending_roc = (*(const uint32_t **)data)[pos];
+}
 
-    /*
-     * check the sequence number for replays
-     */
-    /* this is easier than dealing with bitfield access */
-    seq_num = ntohl(trailer) & SRTCP_INDEX_MASK;
-    debug_print(mod_srtp, "srtcp index: %x", (unsigned int)seq_num);
-    status = srtp_rdb_check(&stream->rtcp_rdb, seq_num);
-    if (status) {
-        return status;
+srtp_err_status_t srtp_set_stream_rocs(srtp_t session,
+                                       const uint32_t *ssrcs,
+                                       const uint32_t *rocs,
+                                       size_t count)
+{
+    srtp_err_status_t status;
+
+    if (rocs == NULL && count > 0) {
+        return srtp_err_status_bad_param;
     }
 
-    /*
-     * if we're using aes counter mode, set nonce and seq
-     */
-    if (session_keys->rtcp_cipher->type->id == SRTP_AES_ICM_128 ||
-        session_keys->rtcp_cipher->type->id == SRTP_AES_ICM_192 ||
-        session_keys->rtcp_cipher->type->id == SRTP_AES_ICM_256) {
-        v128_t iv;
+    status = srtp_for_each_ssrc(session, ssrcs, sizeof(uint32_t), count,
+                                srtp_set_roc_func, &rocs);
+    if (status == srtp_err_status_no_ctx) {
+        return srtp_err_status_bad_param;
+    }
 
-        iv.v32[0] = 0;
-        iv.v32[1] = hdr->ssrc; /* still in network order! */
-        iv.v32[2] = htonl(seq_num >> 16);
-        iv.v32[3] = htonl(seq_num << 16);
-        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
-                                    srtp_direction_decrypt);
+    return status;
+}
 
-    } else {
-        v128_t iv;
+static void srtp_get_roc_func(srtp_stream_t stream, size_t pos, void *data)
+{
+    ((uint32_t *)data)[pos] = srtp_rdbx_get_roc(&stream->rtp_rdbx);
+}
 
-        /* otherwise, just set the index to seq_num */
-        iv.v32[0] = 0;
-        iv.v32[1] = 0;
-        iv.v32[2] = 0;
-        iv.v32[3] = htonl(seq_num);
-        status = srtp_cipher_set_iv(session_keys->rtcp_cipher, (uint8_t *)&iv,
-                                    srtp_direction_decrypt);
-    }
-    if (status) {
-        return srtp_err_status_cipher_fail;
-    }
+srtp_err_status_t srtp_get_stream_rocs(srtp_t session,
+                                       const uint32_t *ssrcs,
+                                       uint32_t *rocs,
+                                       size_t count)
+{
+    srtp_err_status_t status;
 
-    /*
-     * if we're authenticating using a universal hash, put the keystream
-     * prefix into the authentication tag
-     */
-    prefix_len = srtp_auth_get_prefix_length(session_keys->rtcp_auth);
-    if (prefix_len) {
-        status =
-            srtp_cipher_output(session_keys->rtcp_cipher, tmp_tag, &prefix_len);
-        debug_print(mod_srtp, "keystream prefix: %s",
-                    srtp_octet_string_hex_string(tmp_tag, prefix_len));
-        if (status) {
-            return srtp_err_status_cipher_fail;
-        }
+    if (rocs == NULL && count > 0) {
+        return srtp_err_status_bad_param;
     }
 
-    /* initialize auth func context */
-    status = srtp_auth_start(session_keys->rtcp_auth);
-    if (status) {
-        return status;
+    status = srtp_for_each_ssrc(session, ssrcs, sizeof(uint32_t), count,
+                                srtp_get_roc_func, rocs);
+    if (status == srtp_err_status_no_ctx) {
+        return srtp_err_status_bad_param;
     }
 
-    /* run auth func over packet, put result into tmp_tag */
-    status = srtp_auth_compute(session_keys->rtcp_auth, auth_start, auth_len,
-                               tmp_tag);
-    debug_print(mod_srtp, "srtcp computed tag:       %s",
-                srtp_octet_string_hex_string(tmp_tag, tag_len));
-    if (status) {
-        return srtp_err_status_auth_fail;
-    }
+    return status;
+}
+
+/*
+ * bit i of the replay window of srtp_stream_sync_t is the bit of the
+ * packet with index - i, which the rdbx bitmask keeps at length - 1 - i
+ */
+#define SRTP_SYNC_REPLAY_BITS 128
 
-    /* compare the tag just computed with the one in the packet */
-    debug_print(mod_srtp, "srtcp tag from packet:    %s",
-                srtp_octet_string_hex_string(auth_tag, tag_len));
-    if (!srtp_octet_string_equal(tmp_tag, auth_tag, tag_len)) {
-        return srtp_err_status_auth_fail;
+static void srtp_get_sync_func(srtp_stream_t stream, size_t pos, void *data)
+{
+    srtp_stream_sync_t *sync = &((srtp_stream_sync_t *)data)[pos];
+    const bitvector_t *bitmask = &stream->rtp_rdbx.bitmask;
+    size_t len = bitvector_get_length(bitmask);
+
+    sync->index = stream->rtp_rdbx.index;
+    sync->replay[0] = 0;
+    sync->replay[1] = 0;
+    for (size_t i = 0; i < SRTP_SYNC_REPLAY_BITS && i < len; i++) {
+        if (bitvector_get_bit(bitmask, len - 1 - i)) {
+            sync->replay[i / 64] |= (uint64_t)1 << (i % 64);
+        }
     }
 
-    /* check output length */
-    if (*rtcp_len <
-        srtcp_len - sizeof(srtcp_trailer_t) - stream->mki_size - tag_len) {
-        return srtp_err_status_buffer_small;
+    sync->rtcp_index = stream->rtcp_rdb.window_start;
+    memcpy(sync->rtcp_replay, &stream->rtcp_rdb.bitmask,
+           sizeof(sync->rtcp_replay));
+
+    sync->status = srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_get_stream_sync(srtp_t session,
+                                       srtp_stream_sync_t *sync,
+                                       size_t count)
+{
+    if (sync == NULL) {
+        return count > 0 ? srtp_err_status_bad_param : srtp_err_status_ok;
     }
 
-    /* if not inplace need to copy rtcp header */
-    if (srtcp != rtcp) {
-        memcpy(rtcp, srtcp, enc_start);
+    for (size_t i = 0; i < count; i++) {
+        sync[i].status = srtp_err_status_no_ctx;
     }
 
-    /* if we're decrypting, exor keystream into the message */
-    if (sec_serv_confidentiality) {
-        status = srtp_cipher_decrypt(session_keys->rtcp_cipher,
-                                     srtcp + enc_start, enc_octet_len,
-                                     rtcp + enc_start, &enc_octet_len);
-        if (status) {
-            return srtp_err_status_cipher_fail;
+    return srtp_for_each_ssrc(session, &sync->ssrc, sizeof(*sync), count,
+                              srtp_get_sync_func, sync);
+}
+
+static void srtp_set_sync_func(srtp_stream_t stream, size_t pos, void *data)
+{
+    srtp_stream_sync_t *sync = &((srtp_stream_sync_t *)data)[pos];
+    bitvector_t *bitmask = &stream->rtp_rdbx.bitmask;
+    size_t len = bitvector_get_length(bitmask);
+
+    /* srtp_rdbx_set_roc_seq() clears the replay window */
+    sync->status = srtp_rdbx_set_roc_seq(&stream->rtp_rdbx,
+                                         (uint32_t)(sync->index >> 16),
+                                         (uint16_t)sync->index);
+    if (sync->status) {
+        return;
+    }
+    for (size_t i = 0; i < len; i++) {
+        if (i >= SRTP_SYNC_REPLAY_BITS ||
+            (sync->replay[i / 64] >> (i % 64) & 1) != 0) {
+            bitvector_set_bit(bitmask, len - 1 - i);
         }
-    } else if (srtcp != rtcp) {
-        /* if no encryption and not-inplace then need to copy rest of packet */
-        memcpy(rtcp + enc_start, srtcp + enc_start, enc_octet_len);
     }
+    stream->pending_roc = 0;
 
-    *rtcp_len = srtcp_len;
+    stream->rtcp_rdb.window_start = sync->rtcp_index;
+    memcpy(&stream->rtcp_rdb.bitmask, sync->rtcp_replay,
+           sizeof(sync->rtcp_replay));
+}
 
-    /* decrease the packet length by the length of the auth tag and seq_num */
-    *rtcp_len -= (tag_len + sizeof(srtcp_trailer_t));
+srtp_err_status_t srtp_set_stream_sync(srtp_t session,
+                                       srtp_stream_sync_t *sync,
+                                       size_t count)
+{
+    srtp_err_status_t status;
 
-    /* decrease the packet length by the length of the mki_size */
-    *rtcp_len -= stream->mki_size;
+    if (sync == NULL) {
+        return count > 0 ? srtp_err_status_bad_param : srtp_err_status_ok;
+    }
 
-    /*
-     * verify that stream is for received traffic - this check will
-     * detect SSRC collisions, since a stream that appears in both
-     * srtp_protect() and srtp_unprotect() will fail this test in one of
-     * those functions.
-     *
-     * we do this check *after* the authentication check, so that the
-     * latter check will catch any attempts to fool us into thinking
-     * that we've got a collision
-     */
-    if (stream->direction != dir_srtp_receiver) {
-        if (stream->direction == dir_unknown) {
-            stream->direction = dir_srtp_receiver;
-        } else {
-            srtp_handle_event(ctx, stream, event_ssrc_collision);
-        }
+    for (size_t i = 0; i < count; i++) {
+        sync[i].status = srtp_err_status_no_ctx;
     }
 
-    /*
-     * if the stream is a 'provisional' one, in which the template context
-     * is used, then we need to allocate a new stream at this point, since
-     * the authentication passed
-     */
-    if (stream == ctx->stream_template) {
-        srtp_stream_ctx_t *new_stream;
+    status = srtp_for_each_ssrc(session, &sync->ssrc, sizeof(*sync), count,
+                                srtp_set_sync_func, sync);
+    if (status != srtp_err_status_ok && status != srtp_err_status_no_ctx) {
+        return status;
+    }
 
-        /*
-         * allocate and initialize a new stream
-         *
-         * note that we indicate failure if we can't allocate the new
-         * stream, and some implementations will want to not return
-         * failure here
-         */
-        status =
-            srtp_stream_clone(ctx->stream_template, hdr->ssrc, &new_stream);
-        if (status) {
-            return status;
+    for (size_t i = 0; i < count; i++) {
+        if (sync[i].status) {
+            return sync[i].status;
         }
+    }
 
-        /* add new stream to the list */
-        status = srtp_insert_or_dealloc_stream(ctx->stream_list, new_stream,
-                                               ctx->stream_template);
-        if (status) {
-            return status;
-        }
+    return srtp_err_status_ok;
+}
 
-        /* set stream (the pointer used in this function) */
-        stream = new_stream;
+srtp_err_status_t srtp_stream_get_tx_cache_stats(srtp_t session,
+                                                 uint32_t ssrc,
+                                                 uint64_t *hits,
+                                                 uint64_t *misses)
+{
+    srtp_stream_t stream;
+
+    stream = srtp_get_stream(session, htonl(ssrc));
+    if (stream == NULL || stream->tx_cache == NULL) {
+        return srtp_err_status_bad_param;
     }
 
-    /* we've passed the authentication check, so add seq_num to the rdb */
-    srtp_rdb_add_index(&stream->rtcp_rdb, seq_num);
+    *hits = stream->tx_cache->hits;
+    *misses = stream->tx_cache->misses;
 
     return srtp_err_status_ok;
 }
 
-/*
- * user data within srtp_t context
- */
-
-void srtp_set_user_data(srtp_t ctx, void *data)
+srtp_err_status_t srtp_index_store_open(srtp_t session,
+                                        const char *path,
+                                        size_t max_streams,
+                                        uint32_t margin)
 {
-    ctx->user_data = data;
-}
+    if (session == NULL || session->index_store != NULL) {
+        return srtp_err_status_bad_param;
+    }
 
-void *srtp_get_user_data(srtp_t ctx)
-{
-    return ctx->user_data;
+    return srtp_index_store_alloc(&session->index_store, path, max_streams,
+                                  margin);
 }
 
-srtp_err_status_t srtp_crypto_policy_set_from_profile_for_rtp(
-    srtp_crypto_policy_t *policy,
-    srtp_profile_t profile)
+srtp_err_status_t srtp_index_store_sync(srtp_t session)
 {
-    /* set SRTP policy from the SRTP profile in the key set */
-    switch (profile) {
-    case srtp_profile_aes128_cm_sha1_80:
-        srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(policy);
-        break;
-    case srtp_profile_aes128_cm_sha1_32:
-        srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32(policy);
-        break;
-    case srtp_profile_null_sha1_80:
-        srtp_crypto_policy_set_null_cipher_hmac_sha1_80(policy);
-        break;
-#ifdef GCM
-    case srtp_profile_aead_aes_128_gcm:
-        srtp_crypto_policy_set_aes_gcm_128_16_auth(policy);
-        break;
-    case srtp_profile_aead_aes_256_gcm:
-        srtp_crypto_policy_set_aes_gcm_256_16_auth(policy);
-        break;
-#endif
-    /* the following profiles are not (yet) supported */
-    case srtp_profile_null_sha1_32:
-    default:
+    if (session == NULL || session->index_store == NULL) {
         return srtp_err_status_bad_param;
     }
 
-    return srtp_err_status_ok;
+    return srtp_index_store_flush(session->index_store);
 }
 
-srtp_err_status_t srtp_crypto_policy_set_from_profile_for_rtcp(
-    srtp_crypto_policy_t *policy,
-    srtp_profile_t profile)
+srtp_err_status_t srtp_index_store_get_resume(srtp_t session,
+                                              uint32_t ssrc,
+                                              uint64_t *rtp_index,
+                                              uint32_t *rtcp_index)
 {
-    /* set SRTP policy from the SRTP profile in the key set */
-    switch (profile) {
-    case srtp_profile_aes128_cm_sha1_80:
-        srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(policy);
-        break;
-    case srtp_profile_aes128_cm_sha1_32:
-        /* We do not honor the 32-bit auth tag request since
-         * this is not compliant with RFC 3711 */
-        srtp_crypto_policy_set_aes_cm_128_hmac_sha1_80(policy);
-        break;
-    case srtp_profile_null_sha1_80:
-        srtp_crypto_policy_set_null_cipher_hmac_sha1_80(policy);
-        break;
-#ifdef GCM
-    case srtp_profile_aead_aes_128_gcm:
-        srtp_crypto_policy_set_aes_gcm_128_16_auth(policy);
-        break;
-    case srtp_profile_aead_aes_256_gcm:
-        srtp_crypto_policy_set_aes_gcm_256_16_auth(policy);
-        break;
-#endif
-    /* the following profiles are not (yet) supported */
-    case srtp_profile_null_sha1_32:
-    default:
+    if (session == NULL || session->index_store == NULL ||
+        rtp_index == NULL || rtcp_index == NULL) {
         return srtp_err_status_bad_param;
     }
 
+    if (!srtp_index_store_lookup(session->index_store, htonl(ssrc),
+                                 rtp_index, rtcp_index)) {
+        return srtp_err_status_no_ctx;
+    }
+
     return srtp_err_status_ok;
 }
 
-void srtp_append_salt_to_key(uint8_t *key,
-                             size_t bytes_in_key,
-                             uint8_t *salt,
-                             size_t bytes_in_salt)
+struct shared_state_claim_data {
+    srtp_err_status_t status;
+    srtp_t session;
+};
+
+static bool shared_state_claim_cb(srtp_stream_t stream, void *raw_data)
 {
-    memcpy(key + bytes_in_key, salt, bytes_in_salt);
+    struct shared_state_claim_data *data =
+        (struct shared_state_claim_data *)raw_data;
+
+    data->status = srtp_stream_claim_shared(data->session, stream);
+    return data->status == srtp_err_status_ok;
 }
 
-size_t srtp_profile_get_master_key_length(srtp_profile_t profile)
+static bool shared_state_unclaim_cb(srtp_stream_t stream, void *raw_data)
 {
-    switch (profile) {
-    case srtp_profile_aes128_cm_sha1_80:
-        return SRTP_AES_128_KEY_LEN;
-        break;
-    case srtp_profile_aes128_cm_sha1_32:
-        return SRTP_AES_128_KEY_LEN;
-        break;
-    case srtp_profile_null_sha1_80:
-        return SRTP_AES_128_KEY_LEN;
-        break;
-    case srtp_profile_aead_aes_128_gcm:
-        return SRTP_AES_128_KEY_LEN;
-        break;
-    case srtp_profile_aead_aes_256_gcm:
-        return SRTP_AES_256_KEY_LEN;
-        break;
-    /* the following profiles are not (yet) supported */
-    case srtp_profile_null_sha1_32:
-    default:
-        return 0; /* indicate error by returning a zero */
+    srtp_t session = (srtp_t)raw_data;
+
+    if (stream->shared_slot != NULL) {
+        srtp_shared_state_unclaim(session->shared_state, stream->shared_slot);
+        stream->shared_slot = NULL;
     }
+    return true;
 }
 
-size_t srtp_profile_get_master_salt_length(srtp_profile_t profile)
+srtp_err_status_t srtp_shared_state_open(srtp_t session,
+                                         const char *path,
+                                         size_t max_streams,
+                                         size_t window_size)
 {
-    switch (profile) {
-    case srtp_profile_aes128_cm_sha1_80:
-        return SRTP_SALT_LEN;
-        break;
-    case srtp_profile_aes128_cm_sha1_32:
-        return SRTP_SALT_LEN;
-        break;
-    case srtp_profile_null_sha1_80:
-        return SRTP_SALT_LEN;
-        break;
-    case srtp_profile_aead_aes_128_gcm:
-        return SRTP_AEAD_SALT_LEN;
-        break;
-    case srtp_profile_aead_aes_256_gcm:
-        return SRTP_AEAD_SALT_LEN;
-        break;
-    /* the following profiles are not (yet) supported */
-    case srtp_profile_null_sha1_32:
-    default:
-        return 0; /* indicate error by returning a zero */
+    srtp_err_status_t status;
+
+    if (session == NULL || session->shared_state != NULL || session->use_ekt) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = srtp_shared_state_alloc(&session->shared_state, path,
+                                     max_streams, window_size);
+    if (status) {
+        return status;
+    }
+
+    /* the streams the session already has claim their slots */
+    struct shared_state_claim_data data = { srtp_err_status_ok, session };
+    session->stream_index->for_each(session->stream_list,
+                                    shared_state_claim_cb, &data);
+    if (data.status) {
+        session->stream_index->for_each(session->stream_list,
+                                        shared_state_unclaim_cb, session);
+        srtp_shared_state_dealloc(session->shared_state);
+        session->shared_state = NULL;
+    }
+
+    return data.status;
+}
+
+srtp_err_status_t srtp_get_header_extensions(const uint8_t *rtp,
+                                             size_t rtp_len,
+                                             srtp_hdr_xtn_element_t *elements,
+                                             size_t *count)
+{
+    const srtp_hdr_t *hdr = (const srtp_hdr_t *)rtp;
+    const srtp_hdr_xtnd_t *xtn_hdr;
+    const uint8_t *pos;
+    const uint8_t *end;
+    const uint8_t *data;
+    srtp_err_status_t status;
+    size_t capacity;
+    bool two_byte;
+    uint8_t id;
+    size_t len;
+
+    if (rtp == NULL || count == NULL || (elements == NULL && *count > 0)) {
+        return srtp_err_status_bad_param;
+    }
+
+    status = srtp_validate_rtp_header(rtp, rtp_len);
+    if (status) {
+        return status;
+    }
+
+    capacity = *count;
+    *count = 0;
+
+    if (hdr->x != 1) {
+        return srtp_err_status_ok;
+    }
+
+    xtn_hdr = (const srtp_hdr_xtnd_t *)(rtp + srtp_get_rtp_hdr_len(hdr));
+    status = srtp_get_xtn_block(xtn_hdr, &pos, &end, &two_byte);
+    if (status) {
+        return status;
+    }
+
+    while (true) {
+        status = srtp_next_xtn_element(&pos, end, two_byte, &id, &len, &data);
+        if (status) {
+            return status;
+        }
+        if (data == NULL) {
+            break;
+        }
+
+        /* id 0 is reserved, it only shows up as leading padding */
+        if (id == 0) {
+            continue;
+        }
+
+        if (*count == capacity) {
+            return srtp_err_status_buffer_small;
+        }
+
+        elements[*count].id = id;
+        elements[*count].length = (uint8_t)len;
+        elements[*count].offset = (uint32_t)(data - rtp);
+        (*count)++;
     }
+
+    return srtp_err_status_ok;
 }
 
-srtp_err_status_t stream_get_protect_trailer_length(srtp_stream_ctx_t *stream,
-                                                    bool is_rtp,
-                                                    size_t mki_index,
-                                                    size_t *length)
+srtp_err_status_t srtp_set_cost_sampling(srtp_t session, uint32_t interval)
 {
-    srtp_session_keys_t *session_key;
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
+    }
 
-    *length = 0;
+    session->cost_interval = interval;
+    session->cost_countdown = interval;
 
-    if (stream->use_mki) {
-        if (mki_index >= stream->num_master_keys) {
-            return srtp_err_status_bad_mki;
-        }
-        session_key = &stream->session_keys[mki_index];
+    return srtp_err_status_ok;
+}
 
-        *length += stream->mki_size;
+srtp_err_status_t srtp_get_session_cost(srtp_t session,
+                                        srtp_stream_cost_t *cost)
+{
+    if (session == NULL || cost == NULL) {
+        return srtp_err_status_bad_param;
+    }
 
-    } else {
-        session_key = &stream->session_keys[0];
+    cost->ssrc = 0;
+    cost->samples = session->cost_samples;
+    cost->sampled_ns = session->cost_ns;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_set_session_quota(srtp_t session,
+                                         size_t max_streams,
+                                         size_t max_bytes)
+{
+    if (session == NULL) {
+        return srtp_err_status_bad_param;
     }
-    if (is_rtp) {
-        *length += srtp_auth_get_tag_length(session_key->rtp_auth);
-    } else {
-        *length += srtp_auth_get_tag_length(session_key->rtcp_auth);
-        *length += sizeof(srtcp_trailer_t);
+
+    session->quota_max_streams = max_streams;
+    session->quota_max_bytes = max_bytes;
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_get_session_quota_usage(
+    srtp_t session,
+    srtp_session_quota_usage_t *usage)
+{
+    if (session == NULL || usage == NULL) {
+        return srtp_err_status_bad_param;
     }
 
+    usage->streams = session->quota_streams;
+    usage->bytes = session->quota_bytes;
+    usage->rejections = session->quota_rejections;
+
     return srtp_err_status_ok;
 }
 
-struct get_protect_trailer_length_data {
-    bool found_stream; /* whether at least one matching stream was found */
-    size_t length;     /* maximum trailer length found so far */
-    bool is_rtp;
-    size_t mki_index;
+struct get_top_stream_costs_data {
+    srtp_stream_cost_t *costs;
+    size_t capacity;
+    size_t count;
 };
 
-static bool get_protect_trailer_length_cb(srtp_stream_t stream, void *raw_data)
+static bool get_top_stream_costs_cb(srtp_stream_t stream, void *raw_data)
 {
-    struct get_protect_trailer_length_data *data =
-        (struct get_protect_trailer_length_data *)raw_data;
-    size_t temp_length;
+    struct get_top_stream_costs_data *data =
+        (struct get_top_stream_costs_data *)raw_data;
+    size_t i;
 
-    if (stream_get_protect_trailer_length(stream, data->is_rtp, data->mki_index,
-                                          &temp_length) == srtp_err_status_ok) {
-        data->found_stream = true;
-        if (temp_length > data->length) {
-            data->length = temp_length;
-        }
+    if (stream->cost_samples == 0) {
+        return true;
+    }
+
+    /* keep the costs sorted, the cheapest one drops out when full */
+    if (data->count < data->capacity) {
+        i = data->count++;
+    } else if (stream->cost_ns > data->costs[data->capacity - 1].sampled_ns) {
+        i = data->capacity - 1;
+    } else {
+        return true;
     }
 
+    while (i > 0 && data->costs[i - 1].sampled_ns < stream->cost_ns) {
+        data->costs[i] = data->costs[i - 1];
+        i--;
+    }
+
+    data->costs[i].ssrc = ntohl(stream->ssrc);
+    data->costs[i].samples = stream->cost_samples;
+    data->costs[i].sampled_ns = stream->cost_ns;
+
     return true;
 }
 
-srtp_err_status_t get_protect_trailer_length(srtp_t session,
-                                             bool is_rtp,
-                                             size_t mki_index,
-                                             size_t *length)
+srtp_err_status_t srtp_get_top_stream_costs(srtp_t session,
+                                            srtp_stream_cost_t *costs,
+                                            size_t *count)
 {
-    srtp_stream_ctx_t *stream;
-    struct get_protect_trailer_length_data data = { false, 0, is_rtp,
-                                                    mki_index };
+    struct get_top_stream_costs_data data;
 
-    if (session == NULL) {
+    if (session == NULL || count == NULL || (costs == NULL && *count > 0)) {
         return srtp_err_status_bad_param;
     }
 
-    stream = session->stream_template;
+    data.costs = costs;
+    data.capacity = *count;
+    data.count = 0;
 
-    if (stream != NULL) {
-        data.found_stream = true;
-        stream_get_protect_trailer_length(stream, is_rtp, mki_index,
-                                          &data.length);
+    if (data.capacity > 0) {
+        session->stream_index->for_each(session->stream_list,
+                                        get_top_stream_costs_cb, &data);
     }
 
-    srtp_stream_list_for_each(session->stream_list,
-                              get_protect_trailer_length_cb, &data);
+    *count = data.count;
 
-    if (!data.found_stream) {
-        return srtp_err_status_bad_param;
-    }
-
-    *length = data.length;
     return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_get_protect_trailer_length(srtp_t session,
-                                                  size_t mki_index,
-                                                  size_t *length)
-{
-    return get_protect_trailer_length(session, true, mki_index, length);
-}
+#ifndef SRTP_NO_STREAM_LIST
 
-srtp_err_status_t srtp_get_protect_rtcp_trailer_length(srtp_t session,
-                                                       size_t mki_index,
-                                                       size_t *length)
-{
-    return get_protect_trailer_length(session, false, mki_index, length);
-}
+#define INITIAL_STREAM_INDEX_SIZE 2
 
 /*
- * SRTP debug interface
+ * once a list holds more than STREAM_INDEX_HASH_THRESHOLD streams a hash
+ * table of the entries is kept, smaller lists are searched linearly
  */
-srtp_err_status_t srtp_set_debug_module(const char *mod_name, bool v)
+#define STREAM_INDEX_HASH_THRESHOLD 16
+
+typedef struct list_entry {
+    uint32_t ssrc;
+    srtp_stream_t stream;
+} list_entry;
+
+typedef struct srtp_stream_list_ctx_t_ {
+    list_entry *entries;
+    size_t capacity;
+    size_t size;
+    /*
+     * open addressing hash table with linear probing, each bucket holds
+     * the position of an entry plus one or 0 if it is empty
+     */
+    uint32_t *buckets;
+    size_t bucket_mask;
+    bool fixed; /* the capacity may not grow */
+} srtp_stream_list_ctx_t_;
+
+static size_t stream_list_bucket(srtp_stream_list_t list, uint32_t ssrc)
 {
-    return srtp_crypto_kernel_set_debug_module(mod_name, v);
+    /* SSRCs are random but may be chosen badly, so mix them anyway */
+    return (size_t)(ssrc * 2654435761u) & list->bucket_mask;
 }
 
-srtp_err_status_t srtp_list_debug_modules(void)
+static void stream_list_hash_entry(srtp_stream_list_t list, size_t pos)
 {
-    return srtp_crypto_kernel_list_debug_modules();
+    size_t b = stream_list_bucket(list, list->entries[pos].ssrc);
+
+    while (list->buckets[b] != 0) {
+        b = (b + 1) & list->bucket_mask;
+    }
+    list->buckets[b] = (uint32_t)(pos + 1);
 }
 
 /*
- * srtp_log_handler is a global variable holding a pointer to the
- * log handler function; this function is called for any log
- * output.
+ * (re)build the hash table for the capacity of the list, it is kept at
+ * most half full.  if the table can not be allocated the list falls back
+ * to linear search until it grows again.
  */
-
-static srtp_log_handler_func_t *srtp_log_handler = NULL;
-static void *srtp_log_handler_data = NULL;
-
-static void srtp_err_handler(srtp_err_reporting_level_t level, const char *msg)
+static void stream_list_rehash(srtp_stream_list_t list)
 {
-    if (srtp_log_handler) {
-        srtp_log_level_t log_level = srtp_log_level_error;
-        switch (level) {
-        case srtp_err_level_error:
-            log_level = srtp_log_level_error;
-            break;
-        case srtp_err_level_warning:
-            log_level = srtp_log_level_warning;
-            break;
-        case srtp_err_level_info:
-            log_level = srtp_log_level_info;
-            break;
-        case srtp_err_level_debug:
-            log_level = srtp_log_level_debug;
-            break;
-        }
+    size_t num_buckets = 1;
+    uint32_t *buckets = NULL;
 
-        srtp_log_handler(log_level, msg, srtp_log_handler_data);
+    while (num_buckets < list->capacity * 2) {
+        num_buckets *= 2;
     }
-}
 
-srtp_err_status_t srtp_install_log_handler(srtp_log_handler_func_t func,
-                                           void *data)
-{
-    /*
-     * note that we accept NULL arguments intentionally - calling this
-     * function with a NULL arguments removes a log handler that's
-     * been previously installed
-     */
+    if (list->capacity < UINT32_MAX &&
+        num_buckets <= SIZE_MAX / sizeof(uint32_t)) {
+        buckets = srtp_crypto_alloc(sizeof(uint32_t) * num_buckets);
+    }
 
-    if (srtp_log_handler) {
-        srtp_install_err_report_handler(NULL);
+    if (list->buckets != NULL) {
+        srtp_crypto_free(list->buckets);
     }
-    srtp_log_handler = func;
-    srtp_log_handler_data = data;
-    if (srtp_log_handler) {
-        srtp_install_err_report_handler(srtp_err_handler);
+    list->buckets = buckets;
+    list->bucket_mask = num_buckets - 1;
+
+    if (buckets == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < list->size; i++) {
+        stream_list_hash_entry(list, i);
     }
-    return srtp_err_status_ok;
 }
 
-srtp_err_status_t srtp_stream_set_roc(srtp_t session,
+/*
+ * returns the bucket of the entry with the given ssrc, the list must have
+ * a hash table
+ */
+static size_t stream_list_find_bucket(srtp_stream_list_t list,
                                       uint32_t ssrc,
-                                      uint32_t roc)
+                                      bool *found)
 {
-    srtp_stream_t stream;
+    size_t b = stream_list_bucket(list, ssrc);
 
-    stream = srtp_get_stream(session, htonl(ssrc));
-    if (stream == NULL) {
-        return srtp_err_status_bad_param;
+    while (list->buckets[b] != 0) {
+        if (list->entries[list->buckets[b] - 1].ssrc == ssrc) {
+            *found = true;
+            return b;
+        }
+        b = (b + 1) & list->bucket_mask;
     }
 
-    stream->pending_roc = roc;
-
-    return srtp_err_status_ok;
+    *found = false;
+    return b;
 }
 
-srtp_err_status_t srtp_stream_get_roc(srtp_t session,
-                                      uint32_t ssrc,
-                                      uint32_t *roc)
+/*
+ * empty bucket b by moving later entries of its probe sequence back, so
+ * that lookups do not need tombstones
+ */
+static void stream_list_unhash_bucket(srtp_stream_list_t list, size_t b)
 {
-    srtp_stream_t stream;
-
-    stream = srtp_get_stream(session, htonl(ssrc));
-    if (stream == NULL) {
-        return srtp_err_status_bad_param;
-    }
+    size_t next = b;
 
-    *roc = srtp_rdbx_get_roc(&stream->rtp_rdbx);
-
-    return srtp_err_status_ok;
-}
+    list->buckets[b] = 0;
+    while (true) {
+        size_t home;
 
-#ifndef SRTP_NO_STREAM_LIST
+        next = (next + 1) & list->bucket_mask;
+        if (list->buckets[next] == 0) {
+            return;
+        }
 
-#define INITIAL_STREAM_INDEX_SIZE 2
+        home = stream_list_bucket(
+            list, list->entries[list->buckets[next] - 1].ssrc);
 
-typedef struct list_entry {
-    uint32_t ssrc;
-    srtp_stream_t stream;
-} list_entry;
+        /* leave the entry if its home lies cyclically in (b, next] */
+        if (b <= next ? (b < home && home <= next)
+                      : (b < home || home <= next)) {
+            continue;
+        }
 
-typedef struct srtp_stream_list_ctx_t_ {
-    list_entry *entries;
-    size_t capacity;
-    size_t size;
-} srtp_stream_list_ctx_t_;
+        list->buckets[b] = list->buckets[next];
+        list->buckets[next] = 0;
+        b = next;
+    }
+}
 
 srtp_err_status_t srtp_stream_list_alloc(srtp_stream_list_t *list_ptr)
 {
@@ -4897,6 +8027,54 @@ srtp_err_status_t srtp_stream_list_alloc(srtp_stream_list_t *list_ptr)
 
     list->capacity = INITIAL_STREAM_INDEX_SIZE;
     list->size = 0;
+    list->buckets = NULL;
+    list->bucket_mask = 0;
+    list->fixed = false;
+
+    *list_ptr = list;
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_stream_list_alloc_fixed(list_ptr, capacity) allocates a list for
+ * capacity streams that does not grow, so that inserting never allocates
+ */
+static srtp_err_status_t srtp_stream_list_alloc_fixed(
+    srtp_stream_list_t *list_ptr,
+    size_t capacity)
+{
+    srtp_stream_list_t list;
+
+    if (capacity > SIZE_MAX / sizeof(list_entry)) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    list = srtp_crypto_alloc(sizeof(srtp_stream_list_ctx_t_));
+    if (list == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    list->entries = srtp_crypto_alloc(sizeof(list_entry) * capacity);
+    if (list->entries == NULL) {
+        srtp_crypto_free(list);
+        return srtp_err_status_alloc_fail;
+    }
+
+    list->capacity = capacity;
+    list->size = 0;
+    list->buckets = NULL;
+    list->bucket_mask = 0;
+    list->fixed = true;
+
+    if (capacity > STREAM_INDEX_HASH_THRESHOLD) {
+        stream_list_rehash(list);
+        if (list->buckets == NULL) {
+            srtp_crypto_free(list->entries);
+            srtp_crypto_free(list);
+            return srtp_err_status_alloc_fail;
+        }
+    }
 
     *list_ptr = list;
 
@@ -4910,6 +8088,9 @@ srtp_err_status_t srtp_stream_list_dealloc(srtp_stream_list_t list)
         return srtp_err_status_fail;
     }
 
+    if (list->buckets != NULL) {
+        srtp_crypto_free(list->buckets);
+    }
     srtp_crypto_free(list->entries);
     srtp_crypto_free(list);
 
@@ -4930,6 +8111,10 @@ srtp_err_status_t srtp_stream_list_insert(srtp_stream_list_t list,
     if (list->size == list->capacity) {
         size_t new_capacity = list->capacity * 2;
 
+        if (list->fixed) {
+            return srtp_err_status_alloc_fail;
+        }
+
         // Check for capacity overflow.
         if (new_capacity < list->capacity ||
             new_capacity > SIZE_MAX / sizeof(list_entry)) {
@@ -4953,6 +8138,11 @@ srtp_err_status_t srtp_stream_list_insert(srtp_stream_list_t list,
 
         // Update list capacity.
         list->capacity = new_capacity;
+
+        // Grow the hash table with the list, or start one.
+        if (list->capacity > STREAM_INDEX_HASH_THRESHOLD) {
+            stream_list_rehash(list);
+        }
     }
 
     // fill the first available entry
@@ -4963,29 +8153,53 @@ srtp_err_status_t srtp_stream_list_insert(srtp_stream_list_t list,
     // update size value
     list->size++;
 
+    if (list->buckets != NULL) {
+        stream_list_hash_entry(list, next_index);
+    }
+
     return srtp_err_status_ok;
 }
 
 /*
- * removing an entry from the list performs a memory move of the following
- * entries one position back in order to keep all the entries in the buffer
- * contiguous.
+ * removing an entry from the list moves the last entry into its place in
+ * order to keep all the entries in the buffer contiguous.
  */
 void srtp_stream_list_remove(srtp_stream_list_t list,
                              srtp_stream_t stream_to_remove)
 {
-    size_t end = list->size;
-
-    for (size_t i = 0; i < end; i++) {
-        if (list->entries[i].ssrc == stream_to_remove->ssrc) {
-            size_t entries_to_move = list->size - i - 1;
-            memmove(&list->entries[i], &list->entries[i + 1],
-                    sizeof(list_entry) * entries_to_move);
-            list->size--;
-
-            break;
+    size_t last = list->size - 1;
+    size_t pos = list->size;
+
+    if (list->buckets != NULL) {
+        bool found;
+        size_t b =
+            stream_list_find_bucket(list, stream_to_remove->ssrc, &found);
+        if (!found) {
+            return;
+        }
+        pos = list->buckets[b] - 1;
+        stream_list_unhash_bucket(list, b);
+
+        /* the last entry moves to pos */
+        if (pos != last) {
+            b = stream_list_find_bucket(list, list->entries[last].ssrc,
+                                        &found);
+            list->buckets[b] = (uint32_t)(pos + 1);
+        }
+    } else {
+        for (size_t i = 0; i < list->size; i++) {
+            if (list->entries[i].ssrc == stream_to_remove->ssrc) {
+                pos = i;
+                break;
+            }
+        }
+        if (pos == list->size) {
+            return;
         }
     }
+
+    list->entries[pos] = list->entries[last];
+    list->size--;
 }
 
 srtp_stream_t srtp_stream_list_get(srtp_stream_list_t list, uint32_t ssrc)
@@ -4994,6 +8208,12 @@ srtp_stream_t srtp_stream_list_get(srtp_stream_list_t list, uint32_t ssrc)
 
     list_entry *entries = list->entries;
 
+    if (list->buckets != NULL) {
+        bool found;
+        size_t b = stream_list_find_bucket(list, ssrc, &found);
+        return found ? entries[list->buckets[b] - 1].stream : NULL;
+    }
+
     for (size_t i = 0; i < end; i++) {
         if (entries[i].ssrc == ssrc) {
             return entries[i].stream;
@@ -5015,7 +8235,8 @@ void srtp_stream_list_for_each(srtp_stream_list_t list,
      * the second statement of the expression needs to be recalculated on each
      * iteration as the available number of entries may change within the given
      * callback.
-     * Ie: in case the callback calls srtp_stream_list_remove().
+     * Ie: in case the callback calls srtp_stream_list_remove(), which moves
+     * the last entry into the current one.
      */
     for (size_t i = 0; i < list->size;) {
         if (!callback(entries[i].stream, data)) {
@@ -0,0 +1,407 @@
+/*
+ * trace.c
+ *
+ * recording of API calls for offline replay
+ */
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+// Leave this as the top level import. Ensures the existence of defines
+#include "config.h"
+
+#include "trace_priv.h"
+
+#include <string.h>
+#include <time.h>
+
+#ifdef SRTP_TRACE_ATOMICS
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sched.h>
+#endif
+#endif
+
+/* the longest record is a policy with 255 encrypted header extensions */
+#define SRTP_TRACE_MAX_RECORD_LEN                                              \
+    (SRTP_TRACE_HEADER_LEN + SRTP_TRACE_POLICY_MIN_LEN + 255)
+
+FILE *srtp_trace_file = NULL;
+
+static uint64_t srtp_trace_epoch;
+
+static uint64_t srtp_trace_last_id;
+
+#ifdef SRTP_TRACE_ATOMICS
+static bool srtp_trace_busy;
+
+/* the number of threads that are writing a record */
+static unsigned int srtp_trace_writers;
+
+static void srtp_trace_yield(void)
+{
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+#endif
+
+/*
+ * the lock of the trace is only held while the trace starts and stops.
+ * records are written under the lock of the stream that fwrite() takes,
+ * so a thread that waits for another one's write sleeps in stdio rather
+ * than spinning here.  without the atomic builtins of GCC and clang, the
+ * trace is not thread safe.
+ */
+static void srtp_trace_lock(void)
+{
+#ifdef SRTP_TRACE_ATOMICS
+    while (__atomic_test_and_set(&srtp_trace_busy, __ATOMIC_ACQUIRE)) {
+        srtp_trace_yield();
+    }
+#endif
+}
+
+static void srtp_trace_unlock(void)
+{
+#ifdef SRTP_TRACE_ATOMICS
+    __atomic_clear(&srtp_trace_busy, __ATOMIC_RELEASE);
+#endif
+}
+
+static void srtp_trace_set_file(FILE *file)
+{
+#ifdef SRTP_TRACE_ATOMICS
+    __atomic_store_n(&srtp_trace_file, file, __ATOMIC_SEQ_CST);
+#else
+    srtp_trace_file = file;
+#endif
+}
+
+/*
+ * srtp_trace_wait_writers() returns once no thread writes to a file that
+ * was replaced by srtp_trace_set_file(NULL), so that it can be closed.
+ * a writer counts itself before it loads the file, so one that is not
+ * counted yet will load NULL.
+ */
+static void srtp_trace_wait_writers(void)
+{
+#ifdef SRTP_TRACE_ATOMICS
+    while (__atomic_load_n(&srtp_trace_writers, __ATOMIC_SEQ_CST) != 0) {
+        srtp_trace_yield();
+    }
+#endif
+}
+
+uint64_t srtp_trace_next_id(void)
+{
+#ifdef SRTP_TRACE_ATOMICS
+    return __atomic_add_fetch(&srtp_trace_last_id, 1, __ATOMIC_RELAXED);
+#else
+    return ++srtp_trace_last_id;
+#endif
+}
+
+static uint64_t srtp_trace_clock(void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+    return (uint64_t)clock() * (1000000000u / CLOCKS_PER_SEC);
+#endif
+}
+
+uint64_t srtp_trace_now(void)
+{
+#ifdef SRTP_TRACE_ATOMICS
+    return srtp_trace_clock() -
+           __atomic_load_n(&srtp_trace_epoch, __ATOMIC_RELAXED);
+#else
+    return srtp_trace_clock() - srtp_trace_epoch;
+#endif
+}
+
+static uint8_t *srtp_trace_put8(uint8_t *p, uint8_t v)
+{
+    *p = v;
+    return p + 1;
+}
+
+static uint8_t *srtp_trace_put16(uint8_t *p, uint16_t v)
+{
+    v = htons(v);
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+static uint8_t *srtp_trace_put32(uint8_t *p, uint32_t v)
+{
+    v = htonl(v);
+    memcpy(p, &v, sizeof(v));
+    return p + sizeof(v);
+}
+
+static uint8_t *srtp_trace_put64(uint8_t *p, uint64_t v)
+{
+    p = srtp_trace_put32(p, (uint32_t)(v >> 32));
+    return srtp_trace_put32(p, (uint32_t)v);
+}
+
+/*
+ * srtp_trace_write() completes the header at the start of record and
+ * writes the record, end points past its body
+ */
+static void srtp_trace_write(uint8_t *record,
+                             const uint8_t *end,
+                             srtp_trace_op_t op,
+                             const srtp_ctx_t *session,
+                             uint64_t start,
+                             srtp_err_status_t status)
+{
+    uint64_t now = srtp_trace_now();
+    size_t len = (size_t)(end - record);
+    uint8_t *p = record;
+    FILE *file;
+
+    p = srtp_trace_put8(p, (uint8_t)op);
+    p = srtp_trace_put8(p, (uint8_t)status);
+    p = srtp_trace_put16(p, (uint16_t)(len - SRTP_TRACE_HEADER_LEN));
+    p = srtp_trace_put64(p, session->trace_id);
+    p = srtp_trace_put64(p, start);
+    srtp_trace_put32(p, now - start > UINT32_MAX ? UINT32_MAX
+                                                 : (uint32_t)(now - start));
+
+#ifdef SRTP_TRACE_ATOMICS
+    __atomic_add_fetch(&srtp_trace_writers, 1, __ATOMIC_SEQ_CST);
+    file = __atomic_load_n(&srtp_trace_file, __ATOMIC_SEQ_CST);
+#else
+    file = srtp_trace_file;
+#endif
+
+    /* fwrite() locks the stream, so records do not interleave */
+    if (file != NULL) {
+        fwrite(record, 1, len, file);
+    }
+
+#ifdef SRTP_TRACE_ATOMICS
+    __atomic_sub_fetch(&srtp_trace_writers, 1, __ATOMIC_RELEASE);
+#endif
+}
+
+void srtp_trace_call(srtp_trace_op_t op,
+                     const srtp_ctx_t *session,
+                     uint64_t start,
+                     srtp_err_status_t status)
+{
+    uint8_t record[SRTP_TRACE_HEADER_LEN];
+
+    srtp_trace_write(record, record + sizeof(record), op, session, start,
+                     status);
+}
+
+static uint8_t *srtp_trace_put_crypto_policy(uint8_t *p,
+                                             const srtp_crypto_policy_t *cp)
+{
+    p = srtp_trace_put32(p, cp->cipher_type);
+    p = srtp_trace_put16(p, (uint16_t)cp->cipher_key_len);
+    p = srtp_trace_put32(p, cp->auth_type);
+    p = srtp_trace_put16(p, (uint16_t)cp->auth_key_len);
+    p = srtp_trace_put16(p, (uint16_t)cp->auth_tag_len);
+    return srtp_trace_put8(p, (uint8_t)cp->sec_serv);
+}
+
+void srtp_trace_policy(srtp_trace_op_t op,
+                       const srtp_ctx_t *session,
+                       uint64_t start,
+                       const srtp_policy_t *policy,
+                       srtp_err_status_t status)
+{
+    uint8_t record[SRTP_TRACE_MAX_RECORD_LEN];
+    uint8_t *p = record + SRTP_TRACE_HEADER_LEN;
+    size_t count = policy->enc_xtn_hdr_count;
+
+    if (count > 255) {
+        count = 255;
+    }
+
+    p = srtp_trace_put8(p, (uint8_t)policy->ssrc.type);
+    p = srtp_trace_put32(p, policy->ssrc.value);
+    p = srtp_trace_put_crypto_policy(p, &policy->rtp);
+    p = srtp_trace_put_crypto_policy(p, &policy->rtcp);
+    p = srtp_trace_put8(p, (uint8_t)policy->num_master_keys);
+    p = srtp_trace_put8(p, (uint8_t)policy->use_mki);
+    p = srtp_trace_put8(p, (uint8_t)policy->mki_size);
+    p = srtp_trace_put32(p, (uint32_t)policy->window_size);
+    p = srtp_trace_put8(p, (uint8_t)policy->allow_repeat_tx);
+    p = srtp_trace_put32(p, (uint32_t)policy->tx_cache_size);
+    p = srtp_trace_put32(p, (uint32_t)policy->tx_cache_max_packet_len);
+    p = srtp_trace_put8(p, (uint8_t)count);
+    if (count > 0) {
+        memcpy(p, policy->enc_xtn_hdr, count);
+        p += count;
+    }
+
+    srtp_trace_write(record, p, op, session, start, status);
+}
+
+void srtp_trace_stream_remove(const srtp_ctx_t *session,
+                              uint64_t start,
+                              uint32_t ssrc,
+                              srtp_err_status_t status)
+{
+    uint8_t record[SRTP_TRACE_HEADER_LEN + 4];
+
+    srtp_trace_put32(record + SRTP_TRACE_HEADER_LEN, ssrc);
+    srtp_trace_write(record, record + sizeof(record), SRTP_TRACE_STREAM_REMOVE,
+                     session, start, status);
+}
+
+void srtp_trace_packet(srtp_trace_op_t op,
+                       const srtp_ctx_t *session,
+                       uint64_t start,
+                       const uint8_t *pkt,
+                       size_t in_len,
+                       size_t out_len,
+                       size_t mki_index,
+                       srtp_err_status_t status)
+{
+    uint8_t record[SRTP_TRACE_HEADER_LEN + SRTP_TRACE_PACKET_LEN];
+    uint8_t *p = record + SRTP_TRACE_HEADER_LEN;
+    uint32_t ssrc = 0;
+    uint16_t seq = 0;
+    uint8_t cc = 0;
+    uint8_t x = 0;
+    uint16_t xtn_len = 0;
+
+    if (op == SRTP_TRACE_PROTECT || op == SRTP_TRACE_UNPROTECT) {
+        if (in_len >= sizeof(srtp_hdr_t)) {
+            const srtp_hdr_t *hdr = (const srtp_hdr_t *)pkt;
+            size_t hdr_len = sizeof(srtp_hdr_t) + 4 * hdr->cc;
+
+            ssrc = ntohl(hdr->ssrc);
+            seq = ntohs(hdr->seq);
+            cc = hdr->cc;
+            x = hdr->x;
+            if (x && in_len >= hdr_len + sizeof(srtp_hdr_xtnd_t)) {
+                const srtp_hdr_xtnd_t *xtn =
+                    (const srtp_hdr_xtnd_t *)(pkt + hdr_len);
+                xtn_len = (uint16_t)(4 * (ntohs(xtn->length) + 1));
+            }
+        }
+    } else if (in_len >= sizeof(srtcp_hdr_t)) {
+        ssrc = ntohl(((const srtcp_hdr_t *)pkt)->ssrc);
+    }
+
+    if (status) {
+        out_len = 0;
+    }
+
+    p = srtp_trace_put32(p, ssrc);
+    p = srtp_trace_put16(p, seq);
+    p = srtp_trace_put8(p, cc);
+    p = srtp_trace_put8(p, x);
+    p = srtp_trace_put16(p, xtn_len);
+    p = srtp_trace_put32(p, (uint32_t)in_len);
+    p = srtp_trace_put32(p, (uint32_t)out_len);
+    p = srtp_trace_put32(p, (uint32_t)mki_index);
+
+    srtp_trace_write(record, p, op, session, start, status);
+}
+
+srtp_err_status_t srtp_trace_start(const char *path)
+{
+    uint8_t header[SRTP_TRACE_MAGIC_LEN + 4];
+    FILE *file;
+
+    if (path == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    srtp_trace_lock();
+
+    if (srtp_trace_file != NULL) {
+        srtp_trace_unlock();
+        return srtp_err_status_bad_param;
+    }
+
+    file = fopen(path, "wb");
+    if (file == NULL) {
+        srtp_trace_unlock();
+        return srtp_err_status_write_fail;
+    }
+
+    memcpy(header, SRTP_TRACE_MAGIC, SRTP_TRACE_MAGIC_LEN);
+    srtp_trace_put32(header + SRTP_TRACE_MAGIC_LEN, SRTP_TRACE_VERSION);
+    fwrite(header, 1, sizeof(header), file);
+
+#ifdef SRTP_TRACE_ATOMICS
+    __atomic_store_n(&srtp_trace_epoch, srtp_trace_clock(), __ATOMIC_RELAXED);
+#else
+    srtp_trace_epoch = srtp_trace_clock();
+#endif
+    srtp_trace_set_file(file);
+
+    srtp_trace_unlock();
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_trace_stop(void)
+{
+    FILE *file;
+    int err;
+
+    /* records that are being written are completed first */
+    srtp_trace_lock();
+    file = srtp_trace_file;
+    srtp_trace_set_file(NULL);
+    srtp_trace_wait_writers();
+    srtp_trace_unlock();
+
+    if (file == NULL) {
+        return srtp_err_status_bad_param;
+    }
+
+    err = ferror(file);
+    err |= fclose(file);
+
+    return err ? srtp_err_status_write_fail : srtp_err_status_ok;
+}
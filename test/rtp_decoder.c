@@ -186,6 +186,7 @@ int main(int argc, char *argv[])
     rtp_decoder_mode_t mode = mode_rtp;
     srtp_ssrc_t ssrc = { ssrc_any_inbound, 0 };
     uint32_t roc = 0;
+    uint32_t roc_search = 0;
     srtp_err_status_t status;
     int len;
     int expected_len;
@@ -211,7 +212,7 @@ int main(int argc, char *argv[])
 
     /* check args */
     while (1) {
-        c = getopt_s(argc, argv, "b:k:i:gt:ae:ld:f:c:m:p:o:s:r:");
+        c = getopt_s(argc, argv, "b:k:i:gt:ae:ld:f:c:m:p:o:s:r:R:");
         if (c == -1) {
             break;
         }
@@ -317,6 +318,9 @@ int main(int argc, char *argv[])
         case 'r':
             roc = atoi(optarg_s);
             break;
+        case 'R':
+            roc_search = atoi(optarg_s);
+            break;
         default:
             usage(argv[0]);
         }
@@ -597,8 +601,9 @@ int main(int argc, char *argv[])
 
     policy.ssrc = ssrc;
 
-    if (roc != 0 && policy.ssrc.type != ssrc_specific) {
-        fprintf(stderr, "error: setting ROC (-r) requires -s <ssrc>\n");
+    if (roc != 0 && policy.ssrc.type != ssrc_specific && roc_search == 0) {
+        fprintf(stderr,
+                "error: setting ROC (-r) requires -s <ssrc> or -R <range>\n");
         exit(1);
     }
 
@@ -625,7 +630,8 @@ int main(int argc, char *argv[])
         exit(1);
     }
     fprintf(stderr, "Starting decoder\n");
-    if (rtp_decoder_init(dec, policy, mode, rtp_packet_offset, roc)) {
+    if (rtp_decoder_init(dec, policy, mode, rtp_packet_offset, roc,
+                         roc_search)) {
         fprintf(stderr, "error: init failed\n");
         exit(1);
     }
@@ -658,7 +664,8 @@ void usage(char *string)
     fprintf(
         stderr,
         "usage: %s [-d <debug>]* [[-k][-b] <key>] [-a][-t][-e] [-c "
-        "<srtp-crypto-suite>] [-m <mode>] [-s <ssrc> [-r <roc>]]\n"
+        "<srtp-crypto-suite>] [-m <mode>] [-s <ssrc> [-r <roc>]] "
+        "[-R <range>]\n"
         "or     %s -l\n"
         "where  -a use message authentication\n"
         "       -e <key size> use encryption (use 128 or 256 for key size)\n"
@@ -678,7 +685,9 @@ void usage(char *string)
         "       -s <ssrc> restrict decrypting to the given SSRC (in host byte "
         "order)\n"
         "       -r <roc> initial rollover counter, requires -s <ssrc> "
-        "(defaults to 0)\n",
+        "(defaults to 0)\n"
+        "       -R <range> search the rollover counter of the first packet\n"
+        "          of each SSRC up to <range> away from <roc>\n",
         string, string);
     exit(1);
 }
@@ -695,6 +704,7 @@ void rtp_decoder_dealloc(rtp_decoder_t rtp_ctx)
 
 srtp_err_status_t rtp_decoder_deinit(rtp_decoder_t decoder)
 {
+    free(decoder->ssrcs);
     if (decoder->srtp_ctx) {
         return srtp_dealloc(decoder->srtp_ctx);
     }
@@ -705,7 +715,8 @@ srtp_err_status_t rtp_decoder_init(rtp_decoder_t dcdr,
                                    srtp_policy_t policy,
                                    rtp_decoder_mode_t mode,
                                    size_t rtp_packet_offset,
-                                   uint32_t roc)
+                                   uint32_t roc,
+                                   uint32_t roc_search)
 {
     dcdr->rtp_offset = rtp_packet_offset;
     dcdr->srtp_ctx = NULL;
@@ -717,6 +728,10 @@ srtp_err_status_t rtp_decoder_init(rtp_decoder_t dcdr,
     dcdr->rtcp_cnt = 0;
     dcdr->mode = mode;
     dcdr->policy = policy;
+    dcdr->roc = roc;
+    dcdr->roc_search = roc_search;
+    dcdr->ssrcs = NULL;
+    dcdr->num_ssrcs = 0;
 
     srtp_err_status_t result = srtp_create(&dcdr->srtp_ctx, &dcdr->policy);
     if (result != srtp_err_status_ok) {
@@ -750,6 +765,43 @@ void hexdump(const void *ptr, size_t size)
     }
 }
 
+/*
+ * rtp_decoder_find_roc() searches the ROC of the first authenticated
+ * packet of an SSRC, a packet of an SSRC whose ROC was found before is
+ * left to srtp_unprotect()
+ */
+static srtp_err_status_t rtp_decoder_find_roc(rtp_decoder_t dcdr,
+                                              const uint8_t *srtp,
+                                              size_t srtp_len)
+{
+    uint32_t ssrc = ntohl(((const srtp_hdr_t *)srtp)->ssrc);
+    uint32_t *ssrcs;
+    uint32_t roc;
+    srtp_err_status_t status;
+
+    for (size_t i = 0; i < dcdr->num_ssrcs; i++) {
+        if (dcdr->ssrcs[i] == ssrc) {
+            return srtp_err_status_ok;
+        }
+    }
+
+    status = srtp_stream_find_roc(dcdr->srtp_ctx, srtp, srtp_len, dcdr->roc,
+                                  dcdr->roc_search, &roc);
+    if (status) {
+        return status;
+    }
+    fprintf(stderr, "found ROC %u for SSRC 0x%08x\n", roc, ssrc);
+
+    ssrcs = realloc(dcdr->ssrcs, (dcdr->num_ssrcs + 1) * sizeof(uint32_t));
+    if (ssrcs == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    dcdr->ssrcs = ssrcs;
+    dcdr->ssrcs[dcdr->num_ssrcs++] = ssrc;
+
+    return srtp_err_status_ok;
+}
+
 void rtp_decoder_handle_pkt(u_char *arg,
                             const struct pcap_pkthdr *hdr,
                             const u_char *bytes)
@@ -800,6 +852,13 @@ void rtp_decoder_handle_pkt(u_char *arg,
             return;
         }
 
+        /* lock in the ROC before the first packet of the SSRC */
+        if (dcdr->roc_search &&
+            rtp_decoder_find_roc(dcdr, (uint8_t *)&message, octets_recvd)) {
+            dcdr->error_cnt++;
+            return;
+        }
+
         status =
             srtp_unprotect(dcdr->srtp_ctx, (uint8_t *)&message, octets_recvd,
                            (uint8_t *)&message, &octets_recvd);
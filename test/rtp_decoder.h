@@ -68,6 +68,10 @@ typedef struct rtp_decoder_ctx_t {
     size_t error_cnt;
     size_t rtp_cnt;
     size_t rtcp_cnt;
+    uint32_t roc;
+    uint32_t roc_search;
+    uint32_t *ssrcs;
+    size_t num_ssrcs;
 } rtp_decoder_ctx_t;
 
 typedef struct rtp_decoder_ctx_t *rtp_decoder_t;
@@ -103,7 +107,8 @@ srtp_err_status_t rtp_decoder_init(rtp_decoder_t dcdr,
                                    srtp_policy_t policy,
                                    rtp_decoder_mode_t mode,
                                    size_t rtp_packet_offset,
-                                   uint32_t roc);
+                                   uint32_t roc,
+                                   uint32_t roc_search);
 
 srtp_err_status_t rtp_decoder_deinit(rtp_decoder_t decoder);
 
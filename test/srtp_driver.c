@@ -50,6 +50,8 @@
 
 #include "srtp_priv.h"
 #include "stream_list_priv.h"
+#include "trace_priv.h"
+#include "recording_priv.h"
 #include "util.h"
 
 #ifdef HAVE_NETINET_IN_H
@@ -58,6 +60,14 @@
 #include <winsock2.h>
 #endif
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h> /* for sysconf()        */
+#endif
+
+#ifdef OPENSSL
+#include <openssl/crypto.h> /* for CRYPTO_set_mem_functions() */
+#endif
+
 #define PRINT_REFERENCE_PACKET 1
 
 srtp_err_status_t srtp_validate(void);
@@ -108,6 +118,97 @@ srtp_err_status_t srtp_test_roc_mismatch(void);
 
 srtp_err_status_t srtp_test_set_sender_roc(void);
 
+srtp_err_status_t srtp_test_tx_cache(void);
+
+srtp_err_status_t srtp_test_unprotect_split(void);
+
+srtp_err_status_t srtp_test_ekt_field(void);
+
+srtp_err_status_t srtp_test_ekt(void);
+
+srtp_err_status_t srtp_test_index_store(void);
+
+srtp_err_status_t srtp_test_shared_state(void);
+
+srtp_err_status_t srtp_test_trace(void);
+
+srtp_err_status_t srtp_test_cost_sampling(void);
+
+srtp_err_status_t srtp_test_get_header_extensions(void);
+
+srtp_err_status_t srtp_test_stream_index(void);
+
+srtp_err_status_t srtp_test_create_fixed(void);
+
+srtp_err_status_t srtp_test_stream_sync(void);
+
+srtp_err_status_t srtp_test_repair_streams(void);
+
+srtp_err_status_t srtp_test_recording(void);
+
+srtp_err_status_t srtp_test_find_roc(void);
+
+srtp_err_status_t srtp_test_session_quota(void);
+
+/*
+ * the capacity planner estimates how many streams and sessions of a
+ * workload a host can carry.  a workload is a mix of codecs, each a share
+ * of the streams; every received packet is unprotected once and protected
+ * again for each of fanout receivers, and a ratio of the packets is RTCP.
+ * the planner measures protect and unprotect of each codec's packets on
+ * one core and scales the result by the number of cores and the
+ * efficiency with which libsrtp scales across them, which srtp_thread_bench
+ * measures.  the workload file has one setting per line:
+ *
+ *   codec <name> <profile> <payload octets> <packets/s> <share> [<xtn>]
+ *   rtcp <RTCP packets per RTP packet> <RTCP packet octets>
+ *   fanout <receivers per stream>
+ *   streams_per_session <streams>
+ *   cores <cores>
+ *   efficiency <0..1>
+ *
+ * where profile is the name of an SRTP protection profile of RFC 5764 or
+ * RFC 7714, xtn the length of the RTP header extension and lines starting
+ * with '#' are comments.
+ */
+
+#define MAX_WORKLOAD_CODECS 16
+#define MAX_WORKLOAD_LINE 256
+#define CAPACITY_TRIALS 20000
+
+typedef struct {
+    char name[32];
+    srtp_profile_t profile;
+    size_t payload_len;
+    double packet_rate;
+    double share;
+    size_t xtn_len;
+} workload_codec_t;
+
+typedef struct {
+    workload_codec_t codecs[MAX_WORKLOAD_CODECS];
+    size_t num_codecs;
+    double rtcp_ratio;
+    size_t rtcp_len;
+    double fanout;
+    double streams_per_session;
+    double cores;
+    double efficiency;
+} workload_t;
+
+void workload_default(workload_t *w);
+
+bool workload_read(const char *path, workload_t *w);
+
+srtp_err_status_t srtp_packet_cost(srtp_profile_t profile,
+                                   size_t payload_len,
+                                   size_t xtn_len,
+                                   bool rtcp,
+                                   double *protect_ns,
+                                   double *unprotect_ns);
+
+void srtp_do_capacity_plan(const workload_t *w);
+
 double srtp_bits_per_second(size_t msg_len_octets, const srtp_policy_t *policy);
 
 double srtp_rejections_per_second(size_t msg_len_octets,
@@ -117,6 +218,8 @@ void srtp_do_timing(const srtp_policy_t *policy);
 
 void srtp_do_rejection_timing(const srtp_policy_t *policy);
 
+void srtp_do_repair_timing(void);
+
 srtp_err_status_t srtp_test(const srtp_policy_t *policy,
                             bool test_extension_headers,
                             bool use_mki,
@@ -142,8 +245,6 @@ srtp_err_status_t srtp_print_policy(const srtp_policy_t *policy);
 char *srtp_packet_to_string(uint8_t *packet, size_t packet_len);
 char *srtp_rtcp_packet_to_string(uint8_t *packet, size_t pkt_octet_len);
 
-double mips_estimate(size_t num_trials, size_t *ignore);
-
 srtp_err_status_t srtp_stream_list_test(void);
 
 const uint8_t rtp_test_packet_extension_header[12] = {
@@ -318,11 +419,12 @@ srtp_err_status_t call_srtp_unprotect_rtcp(srtp_ctx_t *ctx,
 
 void usage(char *prog_name)
 {
-    printf("usage: %s [ -t ][ -c ][ -v ][ -s ][ -o ][-d <debug_module> ]* [ -l "
-           "][ -n ]\n"
+    printf("usage: %s [ -t ][ -c ][ -w <workload> ][ -v ][ -s ][ -o ]"
+           "[-d <debug_module> ]* [ -l ][ -n ]\n"
            "  -t         run timing test\n"
            "  -r         run rejection timing test\n"
-           "  -c         run codec timing test\n"
+           "  -c         run capacity planner for voice codecs\n"
+           "  -w <file>  run capacity planner for workload in <file>\n"
            "  -v         run validation tests\n"
            "  -s         run stream list tests only\n"
            "  -o         output logging to stdout\n"
@@ -378,6 +480,38 @@ srtp_debug_module_t mod_driver = {
     "driver" /* printable name for module   */
 };
 
+#ifdef OPENSSL
+static size_t ossl_allocs = 0;
+
+static void *ossl_count_malloc(size_t size, const char *file, int line)
+{
+    (void)file;
+    (void)line;
+    ossl_allocs++;
+    return malloc(size);
+}
+
+static void *ossl_count_realloc(void *ptr,
+                                size_t size,
+                                const char *file,
+                                int line)
+{
+    (void)file;
+    (void)line;
+    if (ptr == NULL) {
+        ossl_allocs++;
+    }
+    return realloc(ptr, size);
+}
+
+static void ossl_count_free(void *ptr, const char *file, int line)
+{
+    (void)file;
+    (void)line;
+    free(ptr);
+}
+#endif
+
 int main(int argc, char *argv[])
 {
     int q;
@@ -388,6 +522,7 @@ int main(int argc, char *argv[])
     bool do_stream_list = false;
     bool do_list_mods = false;
     bool do_log_stdout = false;
+    workload_t workload;
     srtp_err_status_t status;
     const size_t hdr_size = 12;
 
@@ -402,6 +537,15 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+#ifdef OPENSSL
+    /* count the allocations of OpenSSL, see srtp_test_create_fixed() */
+    if (!CRYPTO_set_mem_functions(ossl_count_malloc, ossl_count_realloc,
+                                  ossl_count_free)) {
+        printf("error: could not set the OpenSSL memory functions\n");
+        exit(1);
+    }
+#endif
+
     /* initialize srtp library */
     status = srtp_init();
     if (status) {
@@ -418,9 +562,11 @@ int main(int argc, char *argv[])
         exit(1);
     }
 
+    workload_default(&workload);
+
     /* process input arguments */
     while (1) {
-        q = getopt_s(argc, argv, "trcvsold:n");
+        q = getopt_s(argc, argv, "trcw:vsold:n");
         if (q == -1) {
             break;
         }
@@ -434,6 +580,12 @@ int main(int argc, char *argv[])
         case 'c':
             do_codec_timing = true;
             break;
+        case 'w':
+            if (!workload_read(optarg_s, &workload)) {
+                exit(1);
+            }
+            do_codec_timing = true;
+            break;
         case 'v':
             do_validation = true;
             do_stream_list = true;
@@ -858,6 +1010,134 @@ int main(int argc, char *argv[])
             printf("failed\n");
             exit(1);
         }
+
+        printf("testing srtp_test_tx_cache()...");
+        if (srtp_test_tx_cache() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_test_unprotect_split()...");
+        if (srtp_test_unprotect_split() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_test_ekt_field()...");
+        if (srtp_test_ekt_field() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_test_ekt()...");
+        if (srtp_test_ekt() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_test_index_store()...");
+        if (srtp_test_index_store() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_test_shared_state()...");
+        if (srtp_test_shared_state() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_test_trace()...");
+        if (srtp_test_trace() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_test_cost_sampling()...");
+        if (srtp_test_cost_sampling() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_get_header_extensions()...");
+        if (srtp_test_get_header_extensions() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_create_with_stream_index()...");
+        if (srtp_test_stream_index() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_create_fixed()...");
+        if (srtp_test_create_fixed() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_get_stream_sync()/srtp_set_stream_sync()...");
+        if (srtp_test_stream_sync() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_stream_add_repair()...");
+        if (srtp_test_repair_streams() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_recording_decrypt()...");
+        if (srtp_test_recording() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_stream_find_roc()...");
+        if (srtp_test_find_roc() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
+
+        printf("testing srtp_set_session_quota()...");
+        if (srtp_test_session_quota() == srtp_err_status_ok) {
+            printf("passed\n");
+        } else {
+            printf("failed\n");
+            exit(1);
+        }
     }
 
     if (do_stream_list) {
@@ -879,6 +1159,8 @@ int main(int argc, char *argv[])
             srtp_do_timing(*policy);
             policy++;
         }
+
+        srtp_do_repair_timing();
     }
 
     if (do_rejection_test) {
@@ -893,48 +1175,7 @@ int main(int argc, char *argv[])
     }
 
     if (do_codec_timing) {
-        srtp_policy_t policy;
-        size_t ignore;
-        double mips_value = mips_estimate(1000000000, &ignore);
-
-        memset(&policy, 0, sizeof(policy));
-        srtp_crypto_policy_set_rtp_default(&policy.rtp);
-        srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
-        policy.ssrc.type = ssrc_specific;
-        policy.ssrc.value = 0xdecafbad;
-        policy.key = test_key;
-        policy.window_size = 128;
-        policy.allow_repeat_tx = false;
-        policy.next = NULL;
-
-        printf("mips estimate: %e\n", mips_value);
-
-        printf("testing srtp processing time for voice codecs:\n");
-        printf("codec\t\tlength (octets)\t\tsrtp instructions/second\n");
-        printf("G.711\t\t%d\t\t\t%e\n", 80,
-               (double)mips_value * (80 * 8) /
-                   srtp_bits_per_second(80, &policy) / .01);
-        printf("G.711\t\t%d\t\t\t%e\n", 160,
-               (double)mips_value * (160 * 8) /
-                   srtp_bits_per_second(160, &policy) / .02);
-        printf("G.726-32\t%d\t\t\t%e\n", 40,
-               (double)mips_value * (40 * 8) /
-                   srtp_bits_per_second(40, &policy) / .01);
-        printf("G.726-32\t%d\t\t\t%e\n", 80,
-               (double)mips_value * (80 * 8) /
-                   srtp_bits_per_second(80, &policy) / .02);
-        printf("G.729\t\t%d\t\t\t%e\n", 10,
-               (double)mips_value * (10 * 8) /
-                   srtp_bits_per_second(10, &policy) / .01);
-        printf("G.729\t\t%d\t\t\t%e\n", 20,
-               (double)mips_value * (20 * 8) /
-                   srtp_bits_per_second(20, &policy) / .02);
-        printf("Wideband\t%d\t\t\t%e\n", 320,
-               (double)mips_value * (320 * 8) /
-                   srtp_bits_per_second(320, &policy) / .01);
-        printf("Wideband\t%d\t\t\t%e\n", 640,
-               (double)mips_value * (640 * 8) /
-                   srtp_bits_per_second(640, &policy) / .02);
+        srtp_do_capacity_plan(&workload);
     }
 
     status = srtp_shutdown();
@@ -1219,77 +1460,443 @@ double srtp_rejections_per_second(size_t msg_len_octets,
     return (double)num_trials * CLOCKS_PER_SEC / timer;
 }
 
-srtp_err_status_t srtp_test(const srtp_policy_t *policy,
-                            bool test_extension_headers,
-                            bool use_mki,
-                            size_t mki_index)
+static const struct {
+    const char *name;
+    srtp_profile_t profile;
+} workload_profiles[] = {
+    { "AES_CM_128_HMAC_SHA1_80", srtp_profile_aes128_cm_sha1_80 },
+    { "AES_CM_128_HMAC_SHA1_32", srtp_profile_aes128_cm_sha1_32 },
+    { "NULL_HMAC_SHA1_80", srtp_profile_null_sha1_80 },
+    { "NULL_HMAC_SHA1_32", srtp_profile_null_sha1_32 },
+    { "AEAD_AES_128_GCM", srtp_profile_aead_aes_128_gcm },
+    { "AEAD_AES_256_GCM", srtp_profile_aead_aes_256_gcm },
+};
+
+static const char *workload_profile_name(srtp_profile_t profile)
 {
-    size_t i;
-    srtp_t srtp_sender;
-    srtp_t srtp_rcvr;
-    srtp_err_status_t status = srtp_err_status_ok;
-    uint8_t *hdr, *hdr2;
-    uint8_t hdr_enc[64];
-    size_t msg_len_octets, msg_len_enc, msg_len;
-    size_t len, len2;
-    size_t tag_length;
-    size_t buffer_len;
-    uint32_t ssrc;
-    srtp_policy_t send_policy;
-    srtp_policy_t rcvr_policy;
-    uint8_t header = 1;
+    for (size_t i = 0;
+         i < sizeof(workload_profiles) / sizeof(workload_profiles[0]); i++) {
+        if (workload_profiles[i].profile == profile) {
+            return workload_profiles[i].name;
+        }
+    }
+    return "unknown";
+}
 
-    memcpy(&send_policy, policy, sizeof(srtp_policy_t));
+static void workload_add_codec(workload_t *w,
+                               const char *name,
+                               size_t payload_len,
+                               double packet_rate)
+{
+    workload_codec_t *codec = &w->codecs[w->num_codecs++];
+
+    snprintf(codec->name, sizeof(codec->name), "%s", name);
+    codec->profile = srtp_profile_aes128_cm_sha1_80;
+    codec->payload_len = payload_len;
+    codec->packet_rate = packet_rate;
+    codec->share = 1;
+    codec->xtn_len = 0;
+}
 
-    send_policy.use_mki = use_mki;
-    if (!use_mki) {
-        send_policy.mki_size = 0;
+/*
+ * workload_default() is used without a workload file: an even mix of the
+ * voice codecs that the codec timing test used to report on
+ */
+void workload_default(workload_t *w)
+{
+    memset(w, 0, sizeof(*w));
+    workload_add_codec(w, "G.711", 160, 50);
+    workload_add_codec(w, "G.726-32", 80, 50);
+    workload_add_codec(w, "G.729", 20, 50);
+    workload_add_codec(w, "Wideband", 640, 50);
+    w->rtcp_ratio = 0.004;
+    w->rtcp_len = 80;
+    w->fanout = 1;
+    w->streams_per_session = 2;
+    w->cores = 1;
+    w->efficiency = 1;
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    if (sysconf(_SC_NPROCESSORS_ONLN) > 0) {
+        w->cores = (double)sysconf(_SC_NPROCESSORS_ONLN);
     }
+#endif
+}
 
-    if (test_extension_headers) {
-        send_policy.enc_xtn_hdr = &header;
-        send_policy.enc_xtn_hdr_count = 1;
+/*
+ * workload_read() reads a workload file on top of the default one, the
+ * codecs of the file replace the default codecs
+ */
+bool workload_read(const char *path, workload_t *w)
+{
+    FILE *f = fopen(path, "r");
+    char line[MAX_WORKLOAD_LINE];
+    size_t line_number = 0;
+    bool ok = true;
+
+    if (f == NULL) {
+        printf("error: can not open workload %s\n", path);
+        return false;
     }
 
-    CHECK_OK(srtp_create(&srtp_sender, &send_policy));
+    workload_default(w);
+    w->num_codecs = 0;
+
+    while (ok && fgets(line, sizeof(line), f) != NULL) {
+        char key[32];
+        char name[32];
+        char profile[32];
+        unsigned long payload_len;
+        unsigned long xtn_len = 0;
+        double rate;
+        double share;
+        double value;
+        unsigned long len;
+        int n;
+
+        line_number++;
+        n = sscanf(line, "%31s", key);
+        if (n != 1 || key[0] == '#') {
+            continue;
+        }
 
-    /* print out policy */
-    CHECK_OK(srtp_session_print_policy(srtp_sender));
+        if (strcmp(key, "codec") == 0) {
+            workload_codec_t *codec = &w->codecs[w->num_codecs];
+            size_t i;
+
+            n = sscanf(line, "%*s %31s %31s %lu %lf %lf %lu", name, profile,
+                       &payload_len, &rate, &share, &xtn_len);
+            ok = n >= 5 && w->num_codecs < MAX_WORKLOAD_CODECS &&
+                 payload_len > 0 && payload_len <= MAX_MSG_LEN &&
+                 xtn_len <= 1020 && rate > 0 && share > 0;
+            for (i = 0; ok && i < sizeof(workload_profiles) /
+                                      sizeof(workload_profiles[0]);
+                 i++) {
+                if (strcmp(profile, workload_profiles[i].name) == 0) {
+                    break;
+                }
+            }
+            if (ok && i == sizeof(workload_profiles) /
+                               sizeof(workload_profiles[0])) {
+                ok = false;
+            }
+            if (ok) {
+                snprintf(codec->name, sizeof(codec->name), "%s", name);
+                codec->profile = workload_profiles[i].profile;
+                codec->payload_len = payload_len;
+                codec->packet_rate = rate;
+                codec->share = share;
+                codec->xtn_len = (xtn_len + 3) / 4 * 4;
+                w->num_codecs++;
+            }
+        } else if (strcmp(key, "rtcp") == 0) {
+            n = sscanf(line, "%*s %lf %lu", &value, &len);
+            ok = n == 2 && value >= 0 && len >= 8 && len <= MAX_MSG_LEN;
+            w->rtcp_ratio = value;
+            w->rtcp_len = (len + 3) / 4 * 4;
+        } else {
+            n = sscanf(line, "%*s %lf", &value);
+            ok = n == 1 && value > 0;
+            if (strcmp(key, "fanout") == 0) {
+                w->fanout = value;
+            } else if (strcmp(key, "streams_per_session") == 0) {
+                w->streams_per_session = value;
+            } else if (strcmp(key, "cores") == 0) {
+                w->cores = value;
+            } else if (strcmp(key, "efficiency") == 0) {
+                ok = ok && value <= 1;
+                w->efficiency = value;
+            } else {
+                ok = false;
+            }
+        }
+    }
+    fclose(f);
 
-    /*
-     * initialize data buffer, using the ssrc in the policy unless that
-     * value is a wildcard, in which case we'll just use an arbitrary
-     * one
-     */
-    if (policy->ssrc.type != ssrc_specific) {
-        ssrc = 0xdecafbad;
-    } else {
-        ssrc = policy->ssrc.value;
+    if (!ok) {
+        printf("error: %s:%zu: invalid workload setting\n", path,
+               line_number);
+        return false;
     }
-    msg_len_octets = 28;
-    hdr = create_rtp_test_packet(msg_len_octets, ssrc, 1, 1,
-                                 test_extension_headers, &len, &buffer_len);
-    hdr2 = create_rtp_test_packet(msg_len_octets, ssrc, 1, 1,
-                                  test_extension_headers, &len2, NULL);
+    if (w->num_codecs == 0) {
+        printf("error: %s: no codecs in workload\n", path);
+        return false;
+    }
+    return true;
+}
 
-    /* save original msg len */
-    msg_len = len;
+/*
+ * srtp_packet_cost() measures the time in nanoseconds that protecting and
+ * unprotecting an RTP packet with the given payload and header extension
+ * length, or an RTCP packet of the given length, takes with a profile
+ */
+srtp_err_status_t srtp_packet_cost(srtp_profile_t profile,
+                                   size_t payload_len,
+                                   size_t xtn_len,
+                                   bool rtcp,
+                                   double *protect_ns,
+                                   double *unprotect_ns)
+{
+    uint8_t packet[12 + 1024 + MAX_MSG_LEN + SRTP_MAX_TRAILER_LEN];
+    uint8_t buffer[sizeof(packet)];
+    srtp_hdr_t *hdr = (srtp_hdr_t *)packet;
+    srtp_policy_t policy;
+    srtp_t sender = NULL;
+    srtp_t receiver = NULL;
+    size_t packet_len;
+    clock_t protect_time = 0;
+    clock_t pair_time = 0;
+    srtp_err_status_t status;
 
-    if (hdr == NULL) {
-        free(hdr2);
-        return srtp_err_status_alloc_fail;
+    memset(&policy, 0, sizeof(policy));
+    status = srtp_crypto_policy_set_from_profile_for_rtp(&policy.rtp, profile);
+    if (status) {
+        return status;
     }
-    if (hdr2 == NULL) {
-        free(hdr);
-        return srtp_err_status_alloc_fail;
+    status =
+        srtp_crypto_policy_set_from_profile_for_rtcp(&policy.rtcp, profile);
+    if (status) {
+        return status;
     }
+    policy.key = test_key;
+    policy.window_size = 128;
 
-    debug_print(mod_driver, "before protection:\n%s",
-                srtp_packet_to_string(hdr, len));
+    memset(packet, 0xab, sizeof(packet));
+    if (rtcp) {
+        srtcp_hdr_t *rtcp_hdr = (srtcp_hdr_t *)packet;
+
+        rtcp_hdr->version = 2;
+        rtcp_hdr->p = 0;
+        rtcp_hdr->rc = 0;
+        rtcp_hdr->pt = 200;
+        rtcp_hdr->len = htons((uint16_t)(payload_len / 4 - 1));
+        rtcp_hdr->ssrc = htonl(0xdecafbad);
+        packet_len = payload_len;
+    } else {
+        memset(hdr, 0, 12);
+        hdr->version = 2;
+        hdr->pt = 96;
+        hdr->ssrc = htonl(0xdecafbad);
+        packet_len = 12;
+        if (xtn_len > 0) {
+            hdr->x = 1;
+            packet[12] = 0xbe;
+            packet[13] = 0xde;
+            packet[14] = (uint8_t)(xtn_len / 4 >> 8);
+            packet[15] = (uint8_t)(xtn_len / 4);
+            packet_len += 4 + xtn_len;
+        }
+        packet_len += payload_len;
+    }
 
-#if PRINT_REFERENCE_PACKET
-    debug_print(mod_driver, "reference packet before protection:\n%s",
-                octet_string_hex_string(hdr, len));
+    /*
+     * time protecting alone, then protecting and unprotecting with a fresh
+     * pair of sessions; the difference is the time of unprotecting
+     */
+    for (int pass = 0; pass < 2 && !status; pass++) {
+        clock_t timer;
+
+        policy.ssrc.type = ssrc_any_outbound;
+        status = srtp_create(&sender, &policy);
+        if (status) {
+            break;
+        }
+        policy.ssrc.type = ssrc_any_inbound;
+        status = srtp_create(&receiver, &policy);
+        if (status) {
+            break;
+        }
+
+        timer = clock();
+        for (size_t i = 0; i < CAPACITY_TRIALS && !status; i++) {
+            size_t len = sizeof(buffer);
+
+            if (rtcp) {
+                status = srtp_protect_rtcp(sender, packet, packet_len, buffer,
+                                           &len, 0);
+            } else {
+                hdr->seq = htons((uint16_t)i);
+                status = srtp_protect(sender, packet, packet_len, buffer,
+                                      &len, 0);
+            }
+            if (status || pass == 0) {
+                continue;
+            }
+            if (rtcp) {
+                status = srtp_unprotect_rtcp(receiver, buffer, len, buffer,
+                                             &len);
+            } else {
+                status = srtp_unprotect(receiver, buffer, len, buffer, &len);
+            }
+        }
+        timer = clock() - timer;
+
+        if (pass == 0) {
+            protect_time = timer;
+        } else {
+            pair_time = timer;
+        }
+
+        srtp_dealloc(sender);
+        srtp_dealloc(receiver);
+        sender = NULL;
+        receiver = NULL;
+    }
+
+    if (sender != NULL) {
+        srtp_dealloc(sender);
+    }
+    if (status) {
+        return status;
+    }
+
+    *protect_ns = (double)protect_time * 1e9 / CLOCKS_PER_SEC / CAPACITY_TRIALS;
+    *unprotect_ns =
+        (double)(pair_time - protect_time) * 1e9 / CLOCKS_PER_SEC /
+        CAPACITY_TRIALS;
+    if (*unprotect_ns < 0) {
+        *unprotect_ns = 0;
+    }
+
+    return srtp_err_status_ok;
+}
+
+void srtp_do_capacity_plan(const workload_t *w)
+{
+    double total_share = 0;
+    double stream_ns = 0;
+    double streams_per_core;
+    double machine;
+
+    printf("capacity plan: fan-out %.1f, %.4f RTCP packets of %zu octets "
+           "per RTP packet\n",
+           w->fanout, w->rtcp_ratio, w->rtcp_len);
+    printf("%-12s %-24s %7s %7s %6s %9s %9s %9s %9s %9s\n", "codec",
+           "profile", "payload", "pkt/s", "share", "prot ns", "unprot ns",
+           "rtcp p ns", "rtcp u ns", "us/s");
+
+    for (size_t i = 0; i < w->num_codecs; i++) {
+        const workload_codec_t *codec = &w->codecs[i];
+        double protect_ns;
+        double unprotect_ns;
+        double rtcp_protect_ns;
+        double rtcp_unprotect_ns;
+        double ns_per_second;
+        srtp_err_status_t status;
+
+        status = srtp_packet_cost(codec->profile, codec->payload_len,
+                                  codec->xtn_len, false, &protect_ns,
+                                  &unprotect_ns);
+        if (!status) {
+            status = srtp_packet_cost(codec->profile, w->rtcp_len, 0, true,
+                                      &rtcp_protect_ns, &rtcp_unprotect_ns);
+        }
+        if (status) {
+            printf("error: measuring %s with %s failed with error code %d\n",
+                   codec->name, workload_profile_name(codec->profile),
+                   status);
+            exit(1);
+        }
+
+        /* the CPU time one received stream of the codec takes per second */
+        ns_per_second =
+            codec->packet_rate *
+            (unprotect_ns + w->fanout * protect_ns +
+             w->rtcp_ratio * (rtcp_unprotect_ns + w->fanout * rtcp_protect_ns));
+
+        printf("%-12s %-24s %7zu %7.0f %6.2f %9.0f %9.0f %9.0f %9.0f %9.1f\n",
+               codec->name, workload_profile_name(codec->profile),
+               codec->payload_len, codec->packet_rate, codec->share,
+               protect_ns, unprotect_ns, rtcp_protect_ns, rtcp_unprotect_ns,
+               ns_per_second / 1e3);
+
+        total_share += codec->share;
+        stream_ns += codec->share * ns_per_second;
+    }
+
+    stream_ns /= total_share;
+    streams_per_core = 1e9 / stream_ns;
+    machine = streams_per_core * w->cores * w->efficiency;
+
+    printf("per stream:  %.1f us of CPU per second\n", stream_ns / 1e3);
+    printf("per core:    %.0f streams, %.0f sessions\n", streams_per_core,
+           streams_per_core / w->streams_per_session);
+    printf("per machine: %.0f streams, %.0f sessions (%.0f cores at %.0f%% "
+           "efficiency)\n",
+           machine, machine / w->streams_per_session, w->cores,
+           w->efficiency * 100);
+}
+
+srtp_err_status_t srtp_test(const srtp_policy_t *policy,
+                            bool test_extension_headers,
+                            bool use_mki,
+                            size_t mki_index)
+{
+    size_t i;
+    srtp_t srtp_sender;
+    srtp_t srtp_rcvr;
+    srtp_err_status_t status = srtp_err_status_ok;
+    uint8_t *hdr, *hdr2;
+    uint8_t hdr_enc[64];
+    size_t msg_len_octets, msg_len_enc, msg_len;
+    size_t len, len2;
+    size_t tag_length;
+    size_t buffer_len;
+    uint32_t ssrc;
+    srtp_policy_t send_policy;
+    srtp_policy_t rcvr_policy;
+    uint8_t header = 1;
+
+    memcpy(&send_policy, policy, sizeof(srtp_policy_t));
+
+    send_policy.use_mki = use_mki;
+    if (!use_mki) {
+        send_policy.mki_size = 0;
+    }
+
+    if (test_extension_headers) {
+        send_policy.enc_xtn_hdr = &header;
+        send_policy.enc_xtn_hdr_count = 1;
+    }
+
+    CHECK_OK(srtp_create(&srtp_sender, &send_policy));
+
+    /* print out policy */
+    CHECK_OK(srtp_session_print_policy(srtp_sender));
+
+    /*
+     * initialize data buffer, using the ssrc in the policy unless that
+     * value is a wildcard, in which case we'll just use an arbitrary
+     * one
+     */
+    if (policy->ssrc.type != ssrc_specific) {
+        ssrc = 0xdecafbad;
+    } else {
+        ssrc = policy->ssrc.value;
+    }
+    msg_len_octets = 28;
+    hdr = create_rtp_test_packet(msg_len_octets, ssrc, 1, 1,
+                                 test_extension_headers, &len, &buffer_len);
+    hdr2 = create_rtp_test_packet(msg_len_octets, ssrc, 1, 1,
+                                  test_extension_headers, &len2, NULL);
+
+    /* save original msg len */
+    msg_len = len;
+
+    if (hdr == NULL) {
+        free(hdr2);
+        return srtp_err_status_alloc_fail;
+    }
+    if (hdr2 == NULL) {
+        free(hdr);
+        return srtp_err_status_alloc_fail;
+    }
+
+    debug_print(mod_driver, "before protection:\n%s",
+                srtp_packet_to_string(hdr, len));
+
+#if PRINT_REFERENCE_PACKET
+    debug_print(mod_driver, "reference packet before protection:\n%s",
+                octet_string_hex_string(hdr, len));
 #endif
     CHECK_OK(call_srtp_protect(srtp_sender, hdr, &len, mki_index));
 
@@ -2080,8 +2687,8 @@ srtp_err_status_t srtp_session_print_policy(srtp_t srtp)
 
     /* loop over streams in session, printing the policy of each */
     data.is_template = 0;
-    srtp_stream_list_for_each(srtp->stream_list, srtp_session_print_stream,
-                              &data);
+    srtp->stream_index->for_each(srtp->stream_list, srtp_session_print_stream,
+                                 &data);
 
     return data.status;
 }
@@ -2181,37 +2788,6 @@ char *srtp_rtcp_packet_to_string(uint8_t *packet, size_t pkt_octet_len)
     return packet_string;
 }
 
-/*
- * mips_estimate() is a simple function to estimate the number of
- * instructions per second that the host can perform.  note that this
- * function can be grossly wrong; you may want to have a manual sanity
- * check of its output!
- *
- * the 'ignore' pointer is there to convince the compiler to not just
- * optimize away the function
- */
-
-double mips_estimate(size_t num_trials, size_t *ignore)
-{
-    clock_t t;
-    volatile size_t sum;
-
-    sum = 0;
-    t = clock();
-    for (size_t i = 0; i < num_trials; i++) {
-        sum += i;
-    }
-    t = clock() - t;
-    if (t < 1) {
-        t = 1;
-    }
-
-    /*   printf("%d\n", sum); */
-    *ignore = sum;
-
-    return (double)num_trials * CLOCKS_PER_SEC / t;
-}
-
 /*
  * srtp_validate() verifies the correctness of libsrtp by comparing
  * some computed packets against some pre-computed reference values.
@@ -4770,133 +5346,2330 @@ srtp_err_status_t srtp_test_roc_mismatch(void)
 }
 
 /*
- * srtp policy definitions - these definitions are used above
+ * srtp_test_tx_cache() verifies that a retransmission of an unchanged
+ * packet is answered from the retransmission cache, even though repeated
+ * transmissions are not allowed, that changed or evicted packets are
+ * not, and that failed protects leave the cache unchanged
  */
+srtp_err_status_t srtp_test_tx_cache(void)
+{
+    srtp_policy_t policy;
+    srtp_t session;
+    uint8_t *pkt;
+    size_t pkt_len;
+    uint8_t *next;
+    size_t next_len;
+    uint8_t first[128];
+    size_t first_len;
+    uint8_t out[128];
+    size_t out_len;
+    uint64_t hits;
+    uint64_t misses;
+    uint16_t seq;
 
-// clang-format off
-uint8_t test_key[46] = {
-    0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0,
-    0xd6, 0x4f, 0xa3, 0x2c, 0x06, 0xde, 0x41, 0x39,
-    0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb,
-    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6, 0xc1, 0x73,
-    0xc3, 0x17, 0xf2, 0xda, 0xbe, 0x35, 0x77, 0x93,
-    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
-};
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.ssrc.type = ssrc_specific;
+    policy.ssrc.value = 0xcafebabe;
+    policy.window_size = 128;
+    policy.tx_cache_size = 4;
+
+    CHECK_OK(srtp_create(&session, &policy));
+
+    pkt = create_rtp_test_packet(64, policy.ssrc.value, 1, 0, false, &pkt_len,
+                                 NULL);
+
+    /* first transmission is protected as usual */
+    first_len = sizeof(first);
+    CHECK_OK(srtp_protect(session, pkt, pkt_len, first, &first_len, 0));
+
+    /* retransmission of the same packet is served from the cache */
+    out_len = sizeof(out);
+    CHECK_OK(srtp_protect(session, pkt, pkt_len, out, &out_len, 0));
+    CHECK(out_len == first_len);
+    CHECK_BUFFER_EQUAL(out, first, first_len);
+
+    CHECK_OK(srtp_stream_get_tx_cache_stats(session, policy.ssrc.value, &hits,
+                                            &misses));
+    CHECK(hits == 1);
+    CHECK(misses == 0);
+
+    /* a changed packet with the same sequence number is not */
+    pkt[pkt_len - 1] ^= 0xff;
+    out_len = sizeof(out);
+    CHECK_RETURN(srtp_protect(session, pkt, pkt_len, out, &out_len, 0),
+                 srtp_err_status_replay_fail);
+    pkt[pkt_len - 1] ^= 0xff;
+
+    /* and neither it nor a failed protect of a new packet evicts the entry */
+    next = create_rtp_test_packet(64, policy.ssrc.value, 5, 0, false,
+                                  &next_len, NULL);
+    out_len = pkt_len;
+    CHECK_RETURN(srtp_protect(session, next, next_len, out, &out_len, 0),
+                 srtp_err_status_buffer_small);
+    free(next);
 
-uint8_t test_key_2[46] = {
-    0xf0, 0xf0, 0x49, 0x14, 0xb5, 0x13, 0xf2, 0x76,
-    0x3a, 0x1b, 0x1f, 0xa1, 0x30, 0xf1, 0x0e, 0x29,
-    0x98, 0xf6, 0xf6, 0xe4, 0x3e, 0x43, 0x09, 0xd1,
-    0xe6, 0x22, 0xa0, 0xe3, 0x32, 0xb9, 0xf1, 0xb6,
-    0xc3, 0x17, 0xf2, 0xda, 0xbe, 0x35, 0x77, 0x93,
-    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
-};
+    out_len = sizeof(out);
+    CHECK_OK(srtp_protect(session, pkt, pkt_len, out, &out_len, 0));
+    CHECK(out_len == first_len);
+    CHECK_BUFFER_EQUAL(out, first, first_len);
 
-uint8_t test_key_gcm[28] = {
-    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
-    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
-    0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
-    0xa8, 0xa9, 0xaa, 0xab
-};
+    /* wrap the cache so the first packet is evicted */
+    for (seq = 2; seq <= 5; seq++) {
+        next = create_rtp_test_packet(64, policy.ssrc.value, seq, 0, false,
+                                      &next_len, NULL);
+        out_len = sizeof(out);
+        CHECK_OK(srtp_protect(session, next, next_len, out, &out_len, 0));
+        free(next);
+    }
 
-uint8_t test_mki_id[TEST_MKI_ID_SIZE] = {
-    0xe1, 0xf9, 0x7a, 0x0d
-};
+    out_len = sizeof(out);
+    CHECK_RETURN(srtp_protect(session, pkt, pkt_len, out, &out_len, 0),
+                 srtp_err_status_replay_fail);
 
-uint8_t test_mki_id_2[TEST_MKI_ID_SIZE] = {
-    0xf3, 0xa1, 0x46, 0x71
-};
-// clang-format on
+    CHECK_OK(srtp_stream_get_tx_cache_stats(session, policy.ssrc.value, &hits,
+                                            &misses));
+    CHECK(hits == 2);
+    CHECK(misses == 2);
 
-const srtp_policy_t default_policy = {
-    { ssrc_any_outbound, 0 }, /* SSRC */
-    {
-        /* SRTP policy */
-        SRTP_AES_ICM_128,               /* cipher type                 */
-        SRTP_AES_ICM_128_KEY_LEN_WSALT, /* cipher key length in octets */
-        SRTP_HMAC_SHA1,                 /* authentication func type    */
-        16,                             /* auth key length in octets   */
-        10,                             /* auth tag length in octets   */
-        sec_serv_conf_and_auth          /* security services flag      */
-    },
-    {
-        /* SRTCP policy */
-        SRTP_AES_ICM_128,               /* cipher type                 */
-        SRTP_AES_ICM_128_KEY_LEN_WSALT, /* cipher key length in octets */
-        SRTP_HMAC_SHA1,                 /* authentication func type    */
-        16,                             /* auth key length in octets   */
-        10,                             /* auth tag length in octets   */
-        sec_serv_conf_and_auth          /* security services flag      */
-    },
-    NULL,
-    (srtp_master_key_t **)test_keys,
-    2,                /* indicates the number of Master keys          */
-    true,             /* no mki */
-    TEST_MKI_ID_SIZE, /* mki size */
-    128,              /* replay window size                           */
-    0,                /* retransmission not allowed                   */
-    NULL,             /* no encrypted extension headers               */
-    0,                /* list of encrypted extension headers is empty */
-    NULL
-};
+    CHECK_RETURN(srtp_stream_get_tx_cache_stats(session, 0xdeadbeef, &hits,
+                                                &misses),
+                 srtp_err_status_bad_param);
 
-const srtp_policy_t aes_only_policy = {
-    { ssrc_any_outbound, 0 }, /* SSRC                        */
-    {
-        SRTP_AES_ICM_128,               /* cipher type                 */
-        SRTP_AES_ICM_128_KEY_LEN_WSALT, /* cipher key length in octets */
-        SRTP_NULL_AUTH,                 /* authentication func type    */
-        0,                              /* auth key length in octets   */
-        0,                              /* auth tag length in octets   */
-        sec_serv_conf                   /* security services flag      */
-    },
-    {
-        SRTP_AES_ICM_128,               /* cipher type                 */
-        SRTP_AES_ICM_128_KEY_LEN_WSALT, /* cipher key length in octets */
-        SRTP_NULL_AUTH,                 /* authentication func type    */
-        0,                              /* auth key length in octets   */
-        0,                              /* auth tag length in octets   */
-        sec_serv_conf                   /* security services flag      */
-    },
-    NULL,
-    (srtp_master_key_t **)test_keys,
-    2,                /* indicates the number of Master keys          */
-    true,             /* no mki */
-    TEST_MKI_ID_SIZE, /* mki size */
-    128,              /* replay window size                           */
-    0,                /* retransmission not allowed                   */
-    NULL,             /* no encrypted extension headers               */
-    0,                /* list of encrypted extension headers is empty */
-    NULL
-};
+    free(pkt);
+    CHECK_OK(srtp_dealloc(session));
 
-const srtp_policy_t hmac_only_policy = {
-    { ssrc_any_outbound, 0 }, /* SSRC */
-    {
-        SRTP_NULL_CIPHER,               /* cipher type                 */
-        SRTP_AES_ICM_128_KEY_LEN_WSALT, /* cipher key length in octets */
-        SRTP_HMAC_SHA1,                 /* authentication func type    */
-        20,                             /* auth key length in octets   */
-        4,                              /* auth tag length in octets   */
-        sec_serv_auth                   /* security services flag      */
-    },
-    {
-        SRTP_NULL_CIPHER,               /* cipher type                 */
-        SRTP_AES_ICM_128_KEY_LEN_WSALT, /* cipher key length in octets */
-        SRTP_HMAC_SHA1,                 /* authentication func type    */
-        20,                             /* auth key length in octets   */
-        4,                              /* auth tag length in octets   */
-        sec_serv_auth                   /* security services flag      */
-    },
-    NULL,
-    (srtp_master_key_t **)test_keys,
-    2,                /* Number of Master keys associated with the policy */
-    true,             /* no mki */
-    TEST_MKI_ID_SIZE, /* mki size */
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_unprotect_split() checks that srtp_unprotect_verify(),
+ * srtp_unprotect_decrypt() and srtp_unprotect_commit() together behave
+ * like srtp_unprotect(), that the replay database is only updated on
+ * commit, that srtp_unprotect_decrypt_prefix() stops after the
+ * requested part of the payload, also when called again in place, and
+ * that a token only decrypts the packet it was verified for
+ */
+srtp_err_status_t srtp_test_unprotect_split(void)
+{
+    srtp_policy_t policy;
+    srtp_t sender_session;
+    srtp_t receiver_session;
+    srtp_unprotect_token_t token;
+    srtp_unprotect_token_t dropped_token;
+    uint8_t *pkts[3];
+    size_t pkt_len_octets[3];
+    uint8_t *plain;
+    size_t plain_len;
+    uint8_t rtp[128];
+    size_t rtp_len;
+    uint8_t forged[128];
+    uint16_t i;
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.ssrc.type = ssrc_any_outbound;
+    policy.window_size = 128;
+    CHECK_OK(srtp_create(&sender_session, &policy));
+
+    /* the receiver streams are created from the template on commit */
+    policy.ssrc.type = ssrc_any_inbound;
+    CHECK_OK(srtp_create(&receiver_session, &policy));
+
+    plain = create_rtp_test_packet(64, 0xcafebabe, 1, 0, false, &plain_len,
+                                   NULL);
+    for (i = 0; i < 3; i++) {
+        pkts[i] = create_rtp_test_packet(64, 0xcafebabe, i + 1, 0, false,
+                                         &pkt_len_octets[i], NULL);
+        CHECK_OK(call_srtp_protect(sender_session, pkts[i], &pkt_len_octets[i],
+                                   0));
+    }
+
+    /* verify, decrypt and commit the first packet */
+    CHECK_OK(srtp_unprotect_verify(receiver_session, pkts[0],
+                                   pkt_len_octets[0], &token));
+    CHECK(token.index == 1);
+    rtp_len = sizeof(rtp);
+    CHECK_OK(srtp_unprotect_decrypt(receiver_session, &token, pkts[0],
+                                    pkt_len_octets[0], rtp, &rtp_len));
+    CHECK(rtp_len == plain_len);
+    CHECK_BUFFER_EQUAL(rtp, plain, plain_len);
+
+    /* the token does not decrypt a packet other than the verified one */
+    memcpy(forged, pkts[0], pkt_len_octets[0]);
+    forged[20] ^= 0xff;
+    rtp_len = sizeof(rtp);
+    CHECK_RETURN(srtp_unprotect_decrypt(receiver_session, &token, forged,
+                                        pkt_len_octets[0], rtp, &rtp_len),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_unprotect_decrypt_prefix(receiver_session, &token,
+                                               forged, pkt_len_octets[0], 4,
+                                               rtp, &rtp_len),
+                 srtp_err_status_bad_param);
+    pkts[0][pkt_len_octets[0] - 1] ^= 0xff;
+    CHECK_RETURN(srtp_unprotect_decrypt(receiver_session, &token, pkts[0],
+                                        pkt_len_octets[0], rtp, &rtp_len),
+                 srtp_err_status_bad_param);
+    pkts[0][pkt_len_octets[0] - 1] ^= 0xff;
+
+    /* decryption alone does not update the replay database */
+    CHECK_OK(srtp_unprotect_verify(receiver_session, pkts[0],
+                                   pkt_len_octets[0], &dropped_token));
+    CHECK_OK(srtp_unprotect_commit(receiver_session, &token));
+    CHECK_RETURN(srtp_unprotect_commit(receiver_session, &dropped_token),
+                 srtp_err_status_replay_fail);
+    CHECK_RETURN(srtp_unprotect_verify(receiver_session, pkts[0],
+                                       pkt_len_octets[0], &token),
+                 srtp_err_status_replay_fail);
+
+    /* only the start of the payload of the second packet is decrypted */
+    CHECK_OK(srtp_unprotect_verify(receiver_session, pkts[1],
+                                   pkt_len_octets[1], &token));
+    rtp_len = sizeof(rtp);
+    CHECK_OK(srtp_unprotect_decrypt_prefix(receiver_session, &token, pkts[1],
+                                           pkt_len_octets[1], 4, rtp,
+                                           &rtp_len));
+    CHECK(rtp_len == 12 + 4);
+    /* compare everything but the sequence number */
+    CHECK_BUFFER_EQUAL(rtp, plain, 2);
+    CHECK_BUFFER_EQUAL(rtp + 4, plain + 4, rtp_len - 4);
+
+    /* a prefix longer than the payload yields the whole packet */
+    rtp_len = sizeof(rtp);
+    CHECK_OK(srtp_unprotect_decrypt_prefix(receiver_session, &token, pkts[1],
+                                           pkt_len_octets[1], 1000, rtp,
+                                           &rtp_len));
+    CHECK(rtp_len == plain_len);
+
+    /*
+     * in place, every call only decrypts the part of the payload that is
+     * still encrypted, and the partly decrypted packet can not be
+     * decrypted into another buffer any more
+     */
+    CHECK_OK(srtp_unprotect_verify(receiver_session, pkts[1],
+                                   pkt_len_octets[1], &token));
+    rtp_len = pkt_len_octets[1];
+    CHECK_OK(srtp_unprotect_decrypt_prefix(receiver_session, &token, pkts[1],
+                                           pkt_len_octets[1], 5, pkts[1],
+                                           &rtp_len));
+    CHECK(rtp_len == 12 + 5);
+    CHECK_BUFFER_EQUAL(pkts[1] + 12, plain + 12, 5);
+    rtp_len = pkt_len_octets[1];
+    CHECK_OK(srtp_unprotect_decrypt_prefix(receiver_session, &token, pkts[1],
+                                           pkt_len_octets[1], 3, pkts[1],
+                                           &rtp_len));
+    CHECK(rtp_len == 12 + 3);
+    CHECK_BUFFER_EQUAL(pkts[1] + 12, plain + 12, 5);
+    rtp_len = pkt_len_octets[1];
+    CHECK_OK(srtp_unprotect_decrypt_prefix(receiver_session, &token, pkts[1],
+                                           pkt_len_octets[1], 21, pkts[1],
+                                           &rtp_len));
+    CHECK(rtp_len == 12 + 21);
+    CHECK_BUFFER_EQUAL(pkts[1] + 12, plain + 12, 21);
+    rtp_len = sizeof(rtp);
+    CHECK_RETURN(srtp_unprotect_decrypt(receiver_session, &token, pkts[1],
+                                        pkt_len_octets[1], rtp, &rtp_len),
+                 srtp_err_status_bad_param);
+    rtp_len = pkt_len_octets[1];
+    CHECK_OK(srtp_unprotect_decrypt(receiver_session, &token, pkts[1],
+                                    pkt_len_octets[1], pkts[1], &rtp_len));
+    CHECK(rtp_len == plain_len);
+    CHECK_BUFFER_EQUAL(pkts[1] + 12, plain + 12, plain_len - 12);
+
+    /* the token of a packet decrypted in place is still committed */
+    CHECK_OK(srtp_unprotect_commit(receiver_session, &token));
+
+    /* a modified packet fails verification */
+    pkts[2][pkt_len_octets[2] - 1] ^= 0xff;
+    CHECK_RETURN(srtp_unprotect_verify(receiver_session, pkts[2],
+                                       pkt_len_octets[2], &token),
+                 srtp_err_status_auth_fail);
+    pkts[2][pkt_len_octets[2] - 1] ^= 0xff;
+
+    /* and the split api interoperates with srtp_unprotect */
+    CHECK_OK(call_srtp_unprotect(receiver_session, pkts[2],
+                                 &pkt_len_octets[2]));
+
+    for (i = 0; i < 3; i++) {
+        free(pkts[i]);
+    }
+    free(plain);
+    CHECK_OK(srtp_dealloc(sender_session));
+    CHECK_OK(srtp_dealloc(receiver_session));
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_ekt_field() checks the EKTFields that srtp_protect() appends
+ * against FullEKTFields computed with an independent AES Key Wrap with
+ * Padding implementation, and that the SRTP packet itself is unchanged
+ */
+srtp_err_status_t srtp_test_ekt_field(void)
+{
+    // clang-format off
+    /* EKTKey for AESKW-128 (first 16 octets) and AESKW-256 */
+    static const uint8_t ekt_key[32] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+        0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+    };
+
+    /*
+     * FullEKTFields with SPI 0x1234 carrying the master key of test_key,
+     * SSRC 0xcafebabe and ROC 5
+     */
+    static const uint8_t full_field_aeskw_128[47] = {
+        0x1e, 0xe9, 0x36, 0xd4, 0x05, 0x32, 0x99, 0xb0,
+        0x3a, 0x08, 0x1c, 0x30, 0x06, 0xb1, 0xc6, 0x53,
+        0xb7, 0x92, 0xb6, 0x08, 0xb3, 0x5d, 0xfe, 0xe2,
+        0x3b, 0xae, 0x71, 0x7a, 0xb1, 0x82, 0x16, 0x35,
+        0x50, 0xbd, 0x12, 0x12, 0xd8, 0x49, 0x9b, 0x7f,
+        0x12, 0x34, 0x00, 0x00, 0x00, 0x2f, 0x02
+    };
+    static const uint8_t full_field_aeskw_256[47] = {
+        0x97, 0xd3, 0x59, 0x74, 0x42, 0x91, 0x83, 0x6e,
+        0x83, 0x79, 0xab, 0x69, 0x0f, 0x97, 0xcf, 0x63,
+        0xed, 0xda, 0xb9, 0xe8, 0xdb, 0x88, 0x52, 0x63,
+        0xa4, 0x78, 0x3c, 0x54, 0xa2, 0x23, 0x0a, 0x95,
+        0xb9, 0x43, 0xee, 0x8e, 0x0f, 0xe4, 0x23, 0xe9,
+        0x12, 0x34, 0x00, 0x00, 0x00, 0x2f, 0x02
+    };
+    // clang-format on
+
+    const srtp_ekt_cipher_t ciphers[2] = { srtp_ekt_cipher_aeskw_128,
+                                           srtp_ekt_cipher_aeskw_256 };
+    const uint8_t *full_fields[2] = { full_field_aeskw_128,
+                                      full_field_aeskw_256 };
+    srtp_ekt_policy_t ekt_policy;
+    srtp_policy_t policy;
+    srtp_t session;
+    srtp_t plain_session;
+    uint8_t *pkt;
+    size_t pkt_len;
+    uint8_t out[128];
+    size_t out_len;
+    uint8_t plain_out[128];
+    size_t plain_out_len;
+
+    for (size_t i = 0; i < 2; i++) {
+        memset(&policy, 0, sizeof(policy));
+        srtp_crypto_policy_set_rtp_default(&policy.rtp);
+        srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+        policy.key = test_key;
+        policy.ssrc.type = ssrc_specific;
+        policy.ssrc.value = 0xcafebabe;
+        policy.window_size = 128;
+
+        CHECK_OK(srtp_create(&plain_session, &policy));
+        CHECK_OK(srtp_stream_set_roc(plain_session, policy.ssrc.value, 5));
+
+        memset(&ekt_policy, 0, sizeof(ekt_policy));
+        ekt_policy.cipher = ciphers[i];
+        ekt_policy.key = ekt_key;
+        ekt_policy.spi = 0x1234;
+        ekt_policy.full_field_interval = 4;
+        policy.ekt = &ekt_policy;
+
+        CHECK_OK(srtp_create(&session, &policy));
+        CHECK_OK(srtp_stream_set_roc(session, policy.ssrc.value, 5));
+
+        for (uint16_t seq = 1; seq <= 6; seq++) {
+            pkt = create_rtp_test_packet(28, policy.ssrc.value, seq, 0, false,
+                                         &pkt_len, NULL);
+
+            plain_out_len = sizeof(plain_out);
+            CHECK_OK(srtp_protect(plain_session, pkt, pkt_len, plain_out,
+                                  &plain_out_len, 0));
+
+            /* the buffer must have room for the EKTField */
+            out_len = plain_out_len;
+            CHECK_RETURN(srtp_protect(session, pkt, pkt_len, out, &out_len, 0),
+                         srtp_err_status_buffer_small);
+
+            out_len = sizeof(out);
+            CHECK_OK(srtp_protect(session, pkt, pkt_len, out, &out_len, 0));
+            CHECK_BUFFER_EQUAL(out, plain_out, plain_out_len);
+
+            /* every fourth packet carries a FullEKTField */
+            if (seq % 4 == 1) {
+                CHECK(out_len == plain_out_len + sizeof(full_field_aeskw_128));
+                CHECK_BUFFER_EQUAL(out + plain_out_len, full_fields[i],
+                                   sizeof(full_field_aeskw_128));
+            } else {
+                CHECK(out_len == plain_out_len + 1);
+                CHECK(out[plain_out_len] == 0x00);
+            }
+
+            free(pkt);
+        }
+
+        CHECK_OK(srtp_dealloc(session));
+        CHECK_OK(srtp_dealloc(plain_session));
+    }
+
+    /* EKT carries a single master key */
+    policy.key = NULL;
+    policy.keys = (srtp_master_key_t **)test_keys;
+    policy.num_master_keys = 2;
+    policy.use_mki = true;
+    policy.mki_size = TEST_MKI_ID_SIZE;
+    CHECK_RETURN(srtp_create(&session, &policy), srtp_err_status_bad_param);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_ekt() checks that a receiver with an inbound EKT template
+ * creates streams for the master keys, SSRCs and ROCs it receives in
+ * FullEKTFields, and that it does not for packets whose EKTField is
+ * short, corrupted or names another SSRC
+ */
+srtp_err_status_t srtp_test_ekt(void)
+{
+    static const uint8_t ekt_key[16] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05,
+                                         0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b,
+                                         0x0c, 0x0d, 0x0e, 0x0f };
+    srtp_ekt_policy_t ekt_policy;
+    srtp_policy_t sender_policy;
+    srtp_policy_t roc_policy;
+    srtp_policy_t receiver_policy;
+    uint8_t receiver_key[46];
+    srtp_t sender_session;
+    srtp_t receiver_session;
+    srtp_unprotect_token_t token;
+    srtp_session_quota_usage_t usage;
+    uint8_t *pkt;
+    size_t pkt_len;
+    uint8_t srtp[128];
+    size_t srtp_len;
+    uint8_t rtp[128];
+    size_t rtp_len;
+    uint32_t roc;
+
+    memset(&ekt_policy, 0, sizeof(ekt_policy));
+    ekt_policy.cipher = srtp_ekt_cipher_aeskw_128;
+    ekt_policy.key = ekt_key;
+    ekt_policy.spi = 0x0001;
+    ekt_policy.full_field_interval = 3;
+
+    /* the sender shares its master key with every receiver over EKT */
+    memset(&sender_policy, 0, sizeof(sender_policy));
+    srtp_crypto_policy_set_rtp_default(&sender_policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&sender_policy.rtcp);
+    sender_policy.key = test_key;
+    sender_policy.ssrc.type = ssrc_any_outbound;
+    sender_policy.window_size = 128;
+    sender_policy.ekt = &ekt_policy;
+
+    roc_policy = sender_policy;
+    roc_policy.ssrc.type = ssrc_specific;
+    roc_policy.ssrc.value = 0xdecafbad;
+    sender_policy.next = &roc_policy;
+
+    CHECK_OK(srtp_create(&sender_session, &sender_policy));
+    CHECK_OK(srtp_stream_set_roc(sender_session, roc_policy.ssrc.value, 7));
+
+    /* the receiver only knows the master salt */
+    memcpy(receiver_key, test_key_2, SRTP_AES_128_KEY_LEN);
+    memcpy(receiver_key + SRTP_AES_128_KEY_LEN,
+           test_key + SRTP_AES_128_KEY_LEN,
+           sizeof(receiver_key) - SRTP_AES_128_KEY_LEN);
+
+    memset(&receiver_policy, 0, sizeof(receiver_policy));
+    srtp_crypto_policy_set_rtp_default(&receiver_policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&receiver_policy.rtcp);
+    receiver_policy.key = receiver_key;
+    receiver_policy.ssrc.type = ssrc_any_inbound;
+    receiver_policy.window_size = 128;
+    receiver_policy.ekt = &ekt_policy;
+
+    CHECK_OK(srtp_create(&receiver_session, &receiver_policy));
+    CHECK_OK(srtp_set_session_quota(receiver_session, 3, 0));
+
+    /* packets of a stream that starts with a FullEKTField */
+    for (uint16_t seq = 1; seq <= 6; seq++) {
+        pkt = create_rtp_test_packet(32, 0xcafebabe, seq, 0, false, &pkt_len,
+                                     NULL);
+        srtp_len = sizeof(srtp);
+        CHECK_OK(
+            srtp_protect(sender_session, pkt, pkt_len, srtp, &srtp_len, 0));
+
+        rtp_len = sizeof(rtp);
+        CHECK_OK(
+            srtp_unprotect(receiver_session, srtp, srtp_len, rtp, &rtp_len));
+        CHECK(rtp_len == pkt_len);
+        CHECK_BUFFER_EQUAL(rtp, pkt, pkt_len);
+
+        /* the split API does not handle the EKTField */
+        CHECK_RETURN(
+            srtp_unprotect_verify(receiver_session, srtp, srtp_len, &token),
+            srtp_err_status_cant_check);
+
+        free(pkt);
+    }
+
+    /* the ROC of the sender is taken from the FullEKTField */
+    pkt = create_rtp_test_packet(32, roc_policy.ssrc.value, 1, 0, false,
+                                 &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect(sender_session, pkt, pkt_len, srtp, &srtp_len, 0));
+    rtp_len = sizeof(rtp);
+    CHECK_OK(srtp_unprotect(receiver_session, srtp, srtp_len, rtp, &rtp_len));
+    CHECK_BUFFER_EQUAL(rtp, pkt, pkt_len);
+    CHECK_OK(srtp_stream_get_roc(receiver_session, roc_policy.ssrc.value, &roc));
+    CHECK(roc == 7);
+    free(pkt);
+
+    /*
+     * a stream whose FullEKTField was lost can not be decrypted with the
+     * key of the template until the next FullEKTField arrives
+     */
+    pkt =
+        create_rtp_test_packet(32, 0x11111111, 1, 0, false, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect(sender_session, pkt, pkt_len, srtp, &srtp_len, 0));
+    free(pkt);
+
+    pkt =
+        create_rtp_test_packet(32, 0x11111111, 2, 0, false, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect(sender_session, pkt, pkt_len, srtp, &srtp_len, 0));
+    CHECK(srtp[srtp_len - 1] == 0x00);
+    rtp_len = sizeof(rtp);
+    CHECK_RETURN(
+        srtp_unprotect(receiver_session, srtp, srtp_len, rtp, &rtp_len),
+        srtp_err_status_auth_fail);
+    CHECK_RETURN(srtp_stream_get_roc(receiver_session, 0x11111111, &roc),
+                 srtp_err_status_bad_param);
+    free(pkt);
+
+    /* a corrupted FullEKTField does not create a stream */
+    pkt =
+        create_rtp_test_packet(32, 0x22222222, 1, 0, false, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect(sender_session, pkt, pkt_len, srtp, &srtp_len, 0));
+    CHECK(srtp[srtp_len - 1] == 0x02);
+    srtp[srtp_len - 10] ^= 0x01;
+    rtp_len = sizeof(rtp);
+    CHECK_RETURN(
+        srtp_unprotect(receiver_session, srtp, srtp_len, rtp, &rtp_len),
+        srtp_err_status_auth_fail);
+    CHECK_RETURN(srtp_stream_get_roc(receiver_session, 0x22222222, &roc),
+                 srtp_err_status_bad_param);
+
+    /* neither does a FullEKTField that names another SSRC */
+    srtp[srtp_len - 10] ^= 0x01;
+    srtp[8] = 0x33;
+    rtp_len = sizeof(rtp);
+    CHECK_RETURN(
+        srtp_unprotect(receiver_session, srtp, srtp_len, rtp, &rtp_len),
+        srtp_err_status_auth_fail);
+    CHECK_RETURN(srtp_stream_get_roc(receiver_session, 0x33222222, &roc),
+                 srtp_err_status_bad_param);
+
+    /* the unmodified packet does */
+    srtp[8] = 0x22;
+    rtp_len = sizeof(rtp);
+    CHECK_OK(srtp_unprotect(receiver_session, srtp, srtp_len, rtp, &rtp_len));
+    CHECK_BUFFER_EQUAL(rtp, pkt, pkt_len);
+    CHECK_OK(srtp_stream_get_roc(receiver_session, 0x22222222, &roc));
+    free(pkt);
+
+    /* the streams added from FullEKTFields are charged to the quota */
+    CHECK_OK(srtp_get_session_quota_usage(receiver_session, &usage));
+    CHECK(usage.streams == 3);
+    CHECK(usage.bytes > 3 * sizeof(srtp_stream_ctx_t));
+
+    pkt =
+        create_rtp_test_packet(32, 0x44444444, 1, 0, false, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect(sender_session, pkt, pkt_len, srtp, &srtp_len, 0));
+    rtp_len = sizeof(rtp);
+    CHECK_RETURN(
+        srtp_unprotect(receiver_session, srtp, srtp_len, rtp, &rtp_len),
+        srtp_err_status_quota_fail);
+    CHECK_OK(srtp_stream_remove(receiver_session, 0x22222222));
+    rtp_len = sizeof(rtp);
+    CHECK_OK(srtp_unprotect(receiver_session, srtp, srtp_len, rtp, &rtp_len));
+    CHECK_BUFFER_EQUAL(rtp, pkt, pkt_len);
+    free(pkt);
+
+    CHECK_OK(srtp_get_session_quota_usage(receiver_session, &usage));
+    CHECK(usage.streams == 3);
+    CHECK(usage.rejections == 1);
+
+    CHECK_OK(srtp_dealloc(sender_session));
+    CHECK_OK(srtp_dealloc(receiver_session));
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_index_store() checks that sending streams of a session that
+ * is created again with the same index store continue beyond the RTP
+ * and SRTCP indices used before, and that removed streams free their
+ * slots
+ */
+srtp_err_status_t srtp_test_index_store(void)
+{
+    static const char path[] = "srtp_driver_index_store.tmp";
+    srtp_policy_t policy;
+    srtp_t session;
+    srtp_err_status_t status;
+    uint8_t *pkt;
+    size_t pkt_len;
+    uint8_t srtp[128];
+    size_t srtp_len;
+    uint32_t trailer;
+    uint32_t roc;
+    uint64_t rtp_index;
+    uint32_t rtcp_index;
+
+    remove(path);
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.ssrc.type = ssrc_any_outbound;
+    policy.window_size = 128;
+
+    CHECK_OK(srtp_create(&session, &policy));
+
+    status = srtp_index_store_open(session, path, 2, 100);
+    if (status == srtp_err_status_no_such_op) {
+        /* no memory mapped files on this platform */
+        CHECK_OK(srtp_dealloc(session));
+        return srtp_err_status_ok;
+    }
+    CHECK_OK(status);
+    CHECK_RETURN(srtp_index_store_open(session, path, 2, 100),
+                 srtp_err_status_bad_param);
+
+    for (uint16_t seq = 1; seq <= 10; seq++) {
+        pkt = create_rtp_test_packet(32, 0xcafebabe, seq, 0, false, &pkt_len,
+                                     NULL);
+        srtp_len = sizeof(srtp);
+        CHECK_OK(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0));
+        free(pkt);
+    }
+    CHECK_OK(srtp_stream_get_roc(session, 0xcafebabe, &roc));
+    CHECK(roc == 0);
+
+    pkt = create_rtcp_test_packet(28, 0xcafebabe, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect_rtcp(session, pkt, pkt_len, srtp, &srtp_len, 0));
+    free(pkt);
+
+    /* the second slot is taken by another stream, a third one fails */
+    pkt = create_rtp_test_packet(32, 0x11111111, 1, 0, false, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0));
+    free(pkt);
+
+    pkt = create_rtp_test_packet(32, 0x22222222, 1, 0, false, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_RETURN(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0),
+                 srtp_err_status_alloc_fail);
+    srtp_len = sizeof(srtp);
+    CHECK_RETURN(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0),
+                 srtp_err_status_alloc_fail);
+
+    /* removing a stream frees its slot for the waiting one */
+    CHECK_OK(srtp_stream_remove(session, 0x11111111));
+    CHECK_RETURN(srtp_index_store_get_resume(session, 0x11111111,
+                                             &rtp_index, &rtcp_index),
+                 srtp_err_status_no_ctx);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0));
+    free(pkt);
+
+    /* updating the template hands the slots to the new streams */
+    CHECK_OK(srtp_index_store_get_resume(session, 0xcafebabe, &rtp_index,
+                                         &rtcp_index));
+    CHECK_OK(srtp_update(session, &policy));
+    CHECK_OK(srtp_index_store_get_resume(session, 0xcafebabe, &rtp_index,
+                                         &rtcp_index));
+    CHECK(rtp_index == 1 + 100);
+
+    CHECK_OK(srtp_index_store_sync(session));
+    CHECK_OK(srtp_dealloc(session));
+
+    /* the store has to have the same number of slots */
+    CHECK_OK(srtp_create(&session, &policy));
+    CHECK_RETURN(srtp_index_store_open(session, path, 3, 100),
+                 srtp_err_status_parse_err);
+    CHECK_OK(srtp_dealloc(session));
+
+    /* a restarted sender resumes past the persisted limits */
+    CHECK_OK(srtp_create(&session, &policy));
+    CHECK_OK(srtp_index_store_open(session, path, 2, 100));
+    CHECK_OK(srtp_index_store_get_resume(session, 0xcafebabe, &rtp_index,
+                                         &rtcp_index));
+    CHECK(rtp_index == 1 + 100);
+    CHECK(rtcp_index > 100);
+
+    /* continuing the sequence numbers from the limit keeps the ROC */
+    pkt = create_rtp_test_packet(32, 0xcafebabe, (uint16_t)rtp_index, 0,
+                                 false, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0));
+    free(pkt);
+    CHECK_OK(srtp_stream_get_roc(session, 0xcafebabe, &roc));
+    CHECK(roc == 0);
+
+    /* an earlier sequence number moves the stream to the next ROC */
+    pkt = create_rtp_test_packet(32, 0x22222222, 1, 0, false, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0));
+    free(pkt);
+    CHECK_OK(srtp_stream_get_roc(session, 0x22222222, &roc));
+    CHECK(roc == 1);
+
+    pkt = create_rtcp_test_packet(28, 0xcafebabe, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect_rtcp(session, pkt, pkt_len, srtp, &srtp_len, 0));
+    free(pkt);
+    /* the trailer precedes the 10 octet tag of the default policy */
+    memcpy(&trailer, srtp + srtp_len - 10 - sizeof(trailer), sizeof(trailer));
+    CHECK((ntohl(trailer) & SRTCP_INDEX_MASK) > 100);
+
+    CHECK_OK(srtp_dealloc(session));
+
+    remove(path);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_shared_state() checks that two receiving sessions with the
+ * same shared state accept each packet only once between them, as two
+ * worker processes would, and that only authenticated streams take slots
+ */
+srtp_err_status_t srtp_test_shared_state(void)
+{
+    static const char path[] = "srtp_driver_shared_state.tmp";
+    srtp_policy_t policy;
+    srtp_t sender;
+    srtp_t worker[2];
+    srtp_err_status_t status;
+    uint8_t *pkt;
+    size_t pkt_len;
+    uint8_t srtp[10][128];
+    size_t srtp_len[10];
+    uint8_t srtcp[128];
+    size_t srtcp_len;
+    uint8_t other[128];
+    size_t other_len;
+    uint8_t rtp[128];
+    size_t rtp_len;
+    uint32_t ssrc = 0x2545f491;
+
+    remove(path);
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.ssrc.type = ssrc_any_outbound;
+    policy.window_size = 128;
+
+    CHECK_OK(srtp_create(&sender, &policy));
+    for (uint16_t i = 0; i < 10; i++) {
+        pkt = create_rtp_test_packet(32, 0xcafebabe, i + 1, 0, false,
+                                     &pkt_len, NULL);
+        srtp_len[i] = sizeof(srtp[i]);
+        CHECK_OK(srtp_protect(sender, pkt, pkt_len, srtp[i], &srtp_len[i], 0));
+        free(pkt);
+    }
+    pkt = create_rtcp_test_packet(28, 0xcafebabe, &pkt_len, NULL);
+    srtcp_len = sizeof(srtcp);
+    CHECK_OK(srtp_protect_rtcp(sender, pkt, pkt_len, srtcp, &srtcp_len, 0));
+    free(pkt);
+    pkt = create_rtp_test_packet(32, 0x11111111, 1, 0, false, &pkt_len, NULL);
+    other_len = sizeof(other);
+    CHECK_OK(srtp_protect(sender, pkt, pkt_len, other, &other_len, 0));
+    free(pkt);
+    CHECK_OK(srtp_dealloc(sender));
+
+    policy.ssrc.type = ssrc_any_inbound;
+    for (size_t i = 0; i < 2; i++) {
+        CHECK_OK(srtp_create(&worker[i], &policy));
+        status = srtp_shared_state_open(worker[i], path, 1, 128);
+        if (status == srtp_err_status_no_such_op) {
+            /* no shared state on this platform */
+            CHECK_OK(srtp_dealloc(worker[i]));
+            return srtp_err_status_ok;
+        }
+        CHECK_OK(status);
+    }
+    CHECK_RETURN(srtp_shared_state_open(worker[0], path, 1, 128),
+                 srtp_err_status_bad_param);
+
+    /* the workers take turns, each packet is accepted once */
+    for (size_t i = 0; i < 10; i++) {
+        rtp_len = sizeof(rtp);
+        CHECK_OK(srtp_unprotect(worker[i % 2], srtp[i], srtp_len[i], rtp,
+                                &rtp_len));
+        rtp_len = sizeof(rtp);
+        CHECK_RETURN(srtp_unprotect(worker[(i + 1) % 2], srtp[i], srtp_len[i],
+                                    rtp, &rtp_len),
+                     srtp_err_status_replay_fail);
+    }
+
+    rtp_len = sizeof(rtp);
+    CHECK_OK(srtp_unprotect_rtcp(worker[1], srtcp, srtcp_len, rtp, &rtp_len));
+    rtp_len = sizeof(rtp);
+    CHECK_RETURN(
+        srtp_unprotect_rtcp(worker[0], srtcp, srtcp_len, rtp, &rtp_len),
+        srtp_err_status_replay_fail);
+
+    /* the only slot is taken, which only matters to authentic packets */
+    pkt = create_rtp_test_packet(32, 0x11111111, 1, 0, false, &pkt_len, NULL);
+    rtp_len = pkt_len;
+    CHECK_RETURN(srtp_unprotect(worker[0], pkt, pkt_len, rtp, &rtp_len),
+                 srtp_err_status_auth_fail);
+    free(pkt);
+    rtp_len = sizeof(rtp);
+    CHECK_RETURN(srtp_unprotect(worker[0], other, other_len, rtp, &rtp_len),
+                 srtp_err_status_alloc_fail);
+
+    /* the slot is freed once no worker has a stream for its SSRC */
+    CHECK_OK(srtp_stream_remove(worker[0], 0xcafebabe));
+    rtp_len = sizeof(rtp);
+    CHECK_RETURN(srtp_unprotect(worker[0], other, other_len, rtp, &rtp_len),
+                 srtp_err_status_alloc_fail);
+    CHECK_OK(srtp_dealloc(worker[1]));
+
+    /* a flood of forged packets of random SSRCs claims no slot */
+    for (size_t i = 0; i < 1000; i++) {
+        ssrc ^= ssrc << 13;
+        ssrc ^= ssrc >> 17;
+        ssrc ^= ssrc << 5;
+        pkt = create_rtp_test_packet(32, ssrc, 1, 0, false, &pkt_len, NULL);
+        rtp_len = pkt_len;
+        CHECK_RETURN(srtp_unprotect(worker[0], pkt, pkt_len, rtp, &rtp_len),
+                     srtp_err_status_auth_fail);
+        free(pkt);
+    }
+    rtp_len = sizeof(rtp);
+    CHECK_OK(srtp_unprotect(worker[0], other, other_len, rtp, &rtp_len));
+    CHECK_OK(srtp_dealloc(worker[0]));
+
+    /* the file has to match */
+    CHECK_OK(srtp_create(&worker[0], &policy));
+    CHECK_RETURN(srtp_shared_state_open(worker[0], path, 1, 256),
+                 srtp_err_status_parse_err);
+    CHECK_OK(srtp_dealloc(worker[0]));
+
+    remove(path);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_trace() checks the records that srtp_trace_start() writes for
+ * the calls made on a session
+ */
+srtp_err_status_t srtp_test_trace(void)
+{
+    static const char path[] = "srtp_driver_trace.tmp";
+    srtp_policy_t policy;
+    srtp_t session;
+    FILE *trace;
+    uint8_t *pkt;
+    size_t pkt_len;
+    uint8_t srtp[128];
+    size_t srtp_len;
+    uint8_t header[SRTP_TRACE_HEADER_LEN];
+    uint8_t body[SRTP_TRACE_POLICY_MIN_LEN];
+    uint8_t magic[SRTP_TRACE_MAGIC_LEN + 4];
+    uint32_t value;
+    uint16_t seq;
+    size_t body_len;
+    size_t count[SRTP_TRACE_UNPROTECT_RTCP + 1] = { 0 };
+    uint64_t id = 0;
+    uint64_t record_id;
+
+    CHECK_OK(srtp_trace_start(path));
+    CHECK_RETURN(srtp_trace_start(path), srtp_err_status_bad_param);
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.ssrc.type = ssrc_specific;
+    policy.ssrc.value = 0xcafebabe;
+    policy.window_size = 128;
+
+    CHECK_OK(srtp_create(&session, &policy));
+
+    for (uint16_t i = 1; i <= 3; i++) {
+        pkt = create_rtp_test_packet(32, 0xcafebabe, i, 0, false, &pkt_len,
+                                     NULL);
+        srtp_len = sizeof(srtp);
+        CHECK_OK(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0));
+        free(pkt);
+    }
+
+    pkt = create_rtcp_test_packet(28, 0xcafebabe, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect_rtcp(session, pkt, pkt_len, srtp, &srtp_len, 0));
+    free(pkt);
+
+    CHECK_OK(srtp_stream_remove(session, 0xcafebabe));
+    CHECK_OK(srtp_dealloc(session));
+
+    CHECK_OK(srtp_trace_stop());
+    CHECK_RETURN(srtp_trace_stop(), srtp_err_status_bad_param);
+
+    trace = fopen(path, "rb");
+    CHECK(trace != NULL);
+    CHECK(fread(magic, 1, sizeof(magic), trace) == sizeof(magic));
+    CHECK(memcmp(magic, SRTP_TRACE_MAGIC, SRTP_TRACE_MAGIC_LEN) == 0);
+
+    seq = 1;
+    while (fread(header, 1, sizeof(header), trace) == sizeof(header)) {
+        CHECK(header[0] >= SRTP_TRACE_CREATE &&
+              header[0] <= SRTP_TRACE_UNPROTECT_RTCP);
+        CHECK(header[1] == srtp_err_status_ok);
+        body_len = ((size_t)header[2] << 8) | header[3];
+        CHECK(body_len <= sizeof(body));
+        CHECK(fread(body, 1, body_len, trace) == body_len);
+        count[header[0]]++;
+
+        /* all records carry the id of the session, not its address */
+        record_id = 0;
+        for (size_t i = 4; i < 12; i++) {
+            record_id = record_id << 8 | header[i];
+        }
+        if (id == 0) {
+            id = record_id;
+        }
+        CHECK(record_id == id);
+        CHECK(record_id != (uint64_t)(uintptr_t)session);
+
+        /* the SSRC leads the body of stream and packet records */
+        if (body_len > 0 && header[0] != SRTP_TRACE_STREAM_ADD) {
+            memcpy(&value, body, sizeof(value));
+            CHECK(ntohl(value) == 0xcafebabe);
+        }
+
+        if (header[0] == SRTP_TRACE_PROTECT) {
+            CHECK(body_len == SRTP_TRACE_PACKET_LEN);
+            CHECK((((uint16_t)body[4] << 8) | body[5]) == seq);
+            seq++;
+        }
+    }
+    fclose(trace);
+
+    CHECK(count[SRTP_TRACE_CREATE] == 1);
+    CHECK(count[SRTP_TRACE_STREAM_ADD] == 1);
+    CHECK(count[SRTP_TRACE_PROTECT] == 3);
+    CHECK(count[SRTP_TRACE_PROTECT_RTCP] == 1);
+    CHECK(count[SRTP_TRACE_STREAM_REMOVE] == 1);
+    CHECK(count[SRTP_TRACE_DEALLOC] == 1);
+
+    remove(path);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_cost_sampling() checks that the sampled calls are counted for
+ * the session and the stream of each packet
+ */
+srtp_err_status_t srtp_test_cost_sampling(void)
+{
+    srtp_policy_t policy;
+    srtp_t session;
+    uint8_t *pkt;
+    size_t pkt_len;
+    uint8_t srtp[1500];
+    size_t srtp_len;
+    srtp_stream_cost_t cost;
+    srtp_stream_cost_t costs[3];
+    size_t count;
+    uint32_t top_ssrc;
+    uint16_t seq;
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.ssrc.type = ssrc_any_outbound;
+    policy.window_size = 128;
+
+    CHECK_OK(srtp_create(&session, &policy));
+
+    CHECK_RETURN(srtp_set_cost_sampling(NULL, 1), srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_get_session_cost(session, NULL),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_get_top_stream_costs(session, NULL, NULL),
+                 srtp_err_status_bad_param);
+
+    /* nothing is sampled by default */
+    pkt = create_rtp_test_packet(16, 0x11111111, 1, 0, false, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0));
+    free(pkt);
+    CHECK_OK(srtp_get_session_cost(session, &cost));
+    CHECK(cost.samples == 0);
+
+    CHECK_OK(srtp_set_cost_sampling(session, 1));
+    for (seq = 2; seq <= 21; seq++) {
+        pkt = create_rtp_test_packet(16, 0x11111111, seq, 0, false, &pkt_len,
+                                     NULL);
+        srtp_len = sizeof(srtp);
+        CHECK_OK(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0));
+        free(pkt);
+
+        pkt = create_rtp_test_packet(1200, 0x22222222, seq, 0, false,
+                                     &pkt_len, NULL);
+        srtp_len = sizeof(srtp);
+        CHECK_OK(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0));
+        free(pkt);
+    }
+
+    pkt = create_rtcp_test_packet(28, 0x22222222, &pkt_len, NULL);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect_rtcp(session, pkt, pkt_len, srtp, &srtp_len, 0));
+    free(pkt);
+
+    CHECK_OK(srtp_get_session_cost(session, &cost));
+    CHECK(cost.ssrc == 0);
+    CHECK(cost.samples == 41);
+
+    count = 3;
+    CHECK_OK(srtp_get_top_stream_costs(session, costs, &count));
+    CHECK(count == 2);
+    CHECK(costs[0].sampled_ns >= costs[1].sampled_ns);
+    CHECK(costs[0].ssrc == 0x11111111 || costs[0].ssrc == 0x22222222);
+    CHECK(costs[1].ssrc == 0x11111111 || costs[1].ssrc == 0x22222222);
+    CHECK(costs[0].ssrc != costs[1].ssrc);
+    CHECK(costs[0].samples + costs[1].samples == 41);
+    CHECK(costs[costs[0].ssrc == 0x22222222 ? 0 : 1].samples == 21);
+    top_ssrc = costs[0].ssrc;
+
+    count = 1;
+    CHECK_OK(srtp_get_top_stream_costs(session, costs, &count));
+    CHECK(count == 1);
+    CHECK(costs[0].ssrc == top_ssrc);
+
+    /* one in four calls is timed */
+    CHECK_OK(srtp_set_cost_sampling(session, 4));
+    for (seq = 22; seq <= 29; seq++) {
+        pkt = create_rtp_test_packet(16, 0x11111111, seq, 0, false, &pkt_len,
+                                     NULL);
+        srtp_len = sizeof(srtp);
+        CHECK_OK(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0));
+        free(pkt);
+    }
+
+    CHECK_OK(srtp_get_session_cost(session, &cost));
+    CHECK(cost.samples == 43);
+
+    CHECK_OK(srtp_dealloc(session));
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_get_header_extensions() checks the element index of one-byte
+ * and two-byte header extensions, including long runs of padding
+ */
+srtp_err_status_t srtp_test_get_header_extensions(void)
+{
+    // clang-format off
+    uint8_t one_byte[] = {
+        0x90, 0x60, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+        0xca, 0xfe, 0xba, 0xbe, 0xbe, 0xde, 0x00, 0x08,
+        /* id 1, 3 octets, then padding */
+        0x12, 0xaa, 0xbb, 0xcc, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        /* id 3, 1 octet, id 2, 2 octets, padding */
+        0x30, 0x11, 0x21, 0x22, 0x33, 0x00, 0x00, 0x00,
+        0xab, 0xab
+    };
+    uint8_t two_byte[] = {
+        0x90, 0x60, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+        0xca, 0xfe, 0xba, 0xbe, 0x10, 0x00, 0x00, 0x02,
+        /* id 200, 0 octets, padding, id 7, 2 octets */
+        0xc8, 0x00, 0x00, 0x07, 0x02, 0xaa, 0xbb, 0x00
+    };
+    // clang-format on
+    uint8_t one_byte_stop[sizeof(one_byte)];
+    srtp_hdr_xtn_element_t elements[4];
+    size_t count;
+
+    count = 4;
+    CHECK_OK(srtp_get_header_extensions(one_byte, sizeof(one_byte), elements,
+                                        &count));
+    CHECK(count == 3);
+    CHECK(elements[0].id == 1 && elements[0].length == 3);
+    CHECK(elements[0].offset == 17);
+    CHECK(elements[1].id == 3 && elements[1].length == 1);
+    CHECK(elements[1].offset == 41);
+    CHECK(elements[2].id == 2 && elements[2].length == 2);
+    CHECK(elements[2].offset == 43);
+
+    count = 2;
+    CHECK_RETURN(srtp_get_header_extensions(one_byte, sizeof(one_byte),
+                                            elements, &count),
+                 srtp_err_status_buffer_small);
+    CHECK(count == 2);
+
+    /* an element with id 15 ends the block */
+    memcpy(one_byte_stop, one_byte, sizeof(one_byte));
+    one_byte_stop[40] = 0xf0;
+    count = 4;
+    CHECK_OK(srtp_get_header_extensions(one_byte_stop, sizeof(one_byte_stop),
+                                        elements, &count));
+    CHECK(count == 1);
+
+    /* an element running past the block */
+    one_byte_stop[40] = 0x3f;
+    count = 4;
+    CHECK_RETURN(srtp_get_header_extensions(one_byte_stop,
+                                            sizeof(one_byte_stop), elements,
+                                            &count),
+                 srtp_err_status_parse_err);
+
+    count = 4;
+    CHECK_OK(srtp_get_header_extensions(two_byte, sizeof(two_byte), elements,
+                                        &count));
+    CHECK(count == 2);
+    CHECK(elements[0].id == 200 && elements[0].length == 0);
+    CHECK(elements[0].offset == 18);
+    CHECK(elements[1].id == 7 && elements[1].length == 2);
+    CHECK(elements[1].offset == 21);
+
+    /* the header extension does not fit into the packet */
+    count = 4;
+    CHECK_RETURN(srtp_get_header_extensions(two_byte, sizeof(two_byte) - 1,
+                                            elements, &count),
+                 srtp_err_status_bad_param);
+
+    /* no header extension */
+    two_byte[0] = 0x80;
+    count = 4;
+    CHECK_OK(srtp_get_header_extensions(two_byte, sizeof(two_byte), elements,
+                                        &count));
+    CHECK(count == 0);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * a stream index with room for a few streams that counts its calls, used
+ * by srtp_test_stream_index()
+ */
+#define TEST_STREAM_INDEX_SIZE 4
+
+struct test_stream_index {
+    uint32_t ssrc[TEST_STREAM_INDEX_SIZE];
+    srtp_stream_t stream[TEST_STREAM_INDEX_SIZE];
+    size_t inserts;
+    size_t removes;
+};
+
+static size_t test_stream_index_live;
+
+static srtp_err_status_t test_stream_index_alloc(void **index)
+{
+    *index = calloc(1, sizeof(struct test_stream_index));
+    if (*index == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    test_stream_index_live++;
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t test_stream_index_dealloc(void *index)
+{
+    struct test_stream_index *t = (struct test_stream_index *)index;
+
+    for (size_t i = 0; i < TEST_STREAM_INDEX_SIZE; i++) {
+        if (t->stream[i] != NULL) {
+            return srtp_err_status_fail;
+        }
+    }
+    free(t);
+    test_stream_index_live--;
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t test_stream_index_insert(void *index,
+                                                  uint32_t ssrc,
+                                                  srtp_stream_t stream)
+{
+    struct test_stream_index *t = (struct test_stream_index *)index;
+
+    for (size_t i = 0; i < TEST_STREAM_INDEX_SIZE; i++) {
+        if (t->stream[i] == NULL) {
+            t->ssrc[i] = ssrc;
+            t->stream[i] = stream;
+            t->inserts++;
+            return srtp_err_status_ok;
+        }
+    }
+    return srtp_err_status_alloc_fail;
+}
+
+static srtp_stream_t test_stream_index_get(void *index, uint32_t ssrc)
+{
+    struct test_stream_index *t = (struct test_stream_index *)index;
+
+    for (size_t i = 0; i < TEST_STREAM_INDEX_SIZE; i++) {
+        if (t->stream[i] != NULL && t->ssrc[i] == ssrc) {
+            return t->stream[i];
+        }
+    }
+    return NULL;
+}
+
+static void test_stream_index_remove(void *index, uint32_t ssrc)
+{
+    struct test_stream_index *t = (struct test_stream_index *)index;
+
+    for (size_t i = 0; i < TEST_STREAM_INDEX_SIZE; i++) {
+        if (t->stream[i] != NULL && t->ssrc[i] == ssrc) {
+            t->stream[i] = NULL;
+            t->removes++;
+        }
+    }
+}
+
+static void test_stream_index_for_each(void *index,
+                                       bool (*callback)(srtp_stream_t, void *),
+                                       void *data)
+{
+    struct test_stream_index *t = (struct test_stream_index *)index;
+
+    for (size_t i = 0; i < TEST_STREAM_INDEX_SIZE; i++) {
+        if (t->stream[i] != NULL && !callback(t->stream[i], data)) {
+            break;
+        }
+    }
+}
+
+/*
+ * srtp_test_stream_index() checks that a session uses the stream index it
+ * was created with
+ */
+srtp_err_status_t srtp_test_stream_index(void)
+{
+    srtp_stream_index_t index = {
+        test_stream_index_alloc,  test_stream_index_dealloc,
+        test_stream_index_insert, test_stream_index_get,
+        test_stream_index_remove, test_stream_index_for_each,
+    };
+    struct test_stream_index *t;
+    srtp_policy_t policy;
+    srtp_t session;
+    uint8_t *pkt;
+    size_t pkt_len;
+    uint8_t srtp[128];
+    size_t srtp_len;
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.ssrc.type = ssrc_any_outbound;
+    policy.window_size = 128;
+
+    index.get = NULL;
+    CHECK_RETURN(srtp_create_with_stream_index(&session, &policy, &index),
+                 srtp_err_status_bad_param);
+    index.get = test_stream_index_get;
+
+    CHECK_OK(srtp_create_with_stream_index(&session, &policy, &index));
+    CHECK(test_stream_index_live == 1);
+    t = (struct test_stream_index *)session->stream_list;
+
+    /* streams cloned from the template go into the index */
+    for (uint32_t ssrc = 1; ssrc <= TEST_STREAM_INDEX_SIZE + 1; ssrc++) {
+        pkt = create_rtp_test_packet(16, ssrc, 1, 0, false, &pkt_len, NULL);
+        srtp_len = sizeof(srtp);
+        if (ssrc <= TEST_STREAM_INDEX_SIZE) {
+            CHECK_OK(srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0));
+        } else {
+            CHECK_RETURN(
+                srtp_protect(session, pkt, pkt_len, srtp, &srtp_len, 0),
+                srtp_err_status_alloc_fail);
+        }
+        free(pkt);
+    }
+    CHECK(t->inserts == TEST_STREAM_INDEX_SIZE);
+    CHECK(srtp_get_stream(session, htonl(2)) == t->stream[1]);
+
+    CHECK_OK(srtp_stream_remove(session, 2));
+    CHECK(t->removes == 1);
+    CHECK(srtp_get_stream(session, htonl(2)) == NULL);
+
+    /* the updated streams go into a new index */
+    CHECK_OK(srtp_update(session, &policy));
+    CHECK(test_stream_index_live == 1);
+    t = (struct test_stream_index *)session->stream_list;
+    CHECK(t->inserts == TEST_STREAM_INDEX_SIZE - 1);
+
+    CHECK_OK(srtp_dealloc(session));
+    CHECK(test_stream_index_live == 0);
+
+    return srtp_err_status_ok;
+}
+
+static void count_alloc_log_handler(srtp_log_level_t level,
+                                    const char *msg,
+                                    void *data)
+{
+    (void)level;
+    if (strncmp(msg, "alloc: ", 7) == 0) {
+        (*(size_t *)data)++;
+    }
+}
+
+/*
+ * fixed_session_send() protects an RTP packet with the given SSRC and
+ * sequence number in sender and unprotects it in receiver
+ */
+static srtp_err_status_t fixed_session_send(srtp_t sender,
+                                            srtp_t receiver,
+                                            uint8_t *rtp,
+                                            size_t rtp_len,
+                                            uint32_t ssrc,
+                                            uint16_t seq)
+{
+    srtp_hdr_t *hdr = (srtp_hdr_t *)rtp;
+    uint8_t srtp[128];
+    size_t srtp_len = sizeof(srtp);
+    uint8_t out[128];
+    size_t out_len = sizeof(out);
+    srtp_err_status_t status;
+
+    hdr->ssrc = htonl(ssrc);
+    hdr->seq = htons(seq);
+
+    status = srtp_protect(sender, rtp, rtp_len, srtp, &srtp_len, 0);
+    if (status) {
+        return status;
+    }
+
+    status = srtp_unprotect(receiver, srtp, srtp_len, out, &out_len);
+    if (status) {
+        return status;
+    }
+
+    if (out_len != rtp_len || memcmp(out, rtp, rtp_len) != 0) {
+        return srtp_err_status_fail;
+    }
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_create_fixed() checks that fixed capacity sessions do not
+ * allocate while processing packets, also when streams are recycled;
+ * OpenSSL builds also count the allocations made by OpenSSL itself
+ */
+srtp_err_status_t srtp_test_create_fixed(void)
+{
+    srtp_policy_t policy;
+    srtp_t sender;
+    srtp_t receiver;
+    srtp_stream_t stream;
+    const srtp_tx_cache_t *cache;
+    uint8_t *rtp;
+    size_t rtp_len;
+    uint8_t srtp[128];
+    size_t srtp_len;
+    uint8_t old_hdr[12];
+    size_t allocs = 0;
+#ifdef OPENSSL
+    size_t ossl_allocs_before;
+#endif
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.ssrc.type = ssrc_any_outbound;
+    policy.window_size = 128;
+
+    /* not available with a replaced stream list */
+    if (srtp_create_fixed(&sender, &policy, 4) == srtp_err_status_no_such_op) {
+        return srtp_err_status_ok;
+    }
+    CHECK_OK(srtp_dealloc(sender));
+
+    CHECK_RETURN(srtp_create_fixed(&sender, &policy, 0),
+                 srtp_err_status_bad_param);
+
+    CHECK_OK(srtp_create_fixed(&sender, &policy, 4));
+    policy.ssrc.type = ssrc_any_inbound;
+    CHECK_OK(srtp_create_fixed(&receiver, &policy, 4));
+
+    rtp = create_rtp_test_packet(32, 1, 1, 0, false, &rtp_len, NULL);
+
+    CHECK_OK(srtp_set_debug_module("alloc", true));
+    CHECK_OK(srtp_install_log_handler(count_alloc_log_handler, &allocs));
+#ifdef OPENSSL
+    ossl_allocs_before = ossl_allocs;
+#endif
+
+    for (uint32_t i = 0; i < 4000; i++) {
+        CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 1 + i % 4,
+                                    (uint16_t)(1 + i / 4)));
+    }
+
+    /* the sessions are full */
+    CHECK_RETURN(fixed_session_send(sender, receiver, rtp, rtp_len, 5, 1),
+                 srtp_err_status_alloc_fail);
+
+    /* a removed stream is recycled for a new SSRC */
+    CHECK_OK(srtp_stream_remove(sender, 1));
+    CHECK_OK(srtp_stream_remove(receiver, 1));
+    for (uint16_t seq = 1; seq <= 100; seq++) {
+        CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 5, seq));
+    }
+
+    CHECK_OK(srtp_install_log_handler(NULL, NULL));
+    CHECK_OK(srtp_set_debug_module("alloc", false));
+    CHECK(allocs == 0);
+#ifdef OPENSSL
+    CHECK(ossl_allocs == ossl_allocs_before);
+#endif
+
+    /* updating the template refills the pool with new clones */
+    policy.ssrc.type = ssrc_any_outbound;
+    CHECK_OK(srtp_update(sender, &policy));
+    policy.ssrc.type = ssrc_any_inbound;
+    CHECK_OK(srtp_update(receiver, &policy));
+    CHECK_OK(srtp_stream_remove(sender, 2));
+    CHECK_OK(srtp_stream_remove(receiver, 2));
+    CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 6, 1));
+    CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 5, 101));
+
+    CHECK_OK(srtp_dealloc(sender));
+    CHECK_OK(srtp_dealloc(receiver));
+
+    /* a recycled clone keeps no packet of its previous SSRC */
+    policy.ssrc.type = ssrc_any_outbound;
+    policy.tx_cache_size = 2;
+    CHECK_OK(srtp_create_fixed(&sender, &policy, 1));
+    ((srtp_hdr_t *)rtp)->ssrc = htonl(7);
+    ((srtp_hdr_t *)rtp)->seq = htons(1);
+    memcpy(old_hdr, rtp, sizeof(old_hdr));
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect(sender, rtp, rtp_len, srtp, &srtp_len, 0));
+    stream = srtp_get_stream(sender, htonl(7));
+    CHECK(stream != NULL && stream->tx_cache != NULL);
+    CHECK_OK(srtp_stream_remove(sender, 7));
+
+    /* the packet goes to the other entry of the cache */
+    ((srtp_hdr_t *)rtp)->ssrc = htonl(8);
+    ((srtp_hdr_t *)rtp)->seq = htons(2);
+    srtp_len = sizeof(srtp);
+    CHECK_OK(srtp_protect(sender, rtp, rtp_len, srtp, &srtp_len, 0));
+    CHECK(srtp_get_stream(sender, htonl(8)) == stream);
+    CHECK(stream->session_keys[0].limit ==
+          sender->stream_template->session_keys[0].limit);
+    cache = stream->tx_cache;
+    for (size_t i = 0; i + sizeof(old_hdr) <= 5 * cache->slot_len; i++) {
+        CHECK(memcmp(cache->buffer + i, old_hdr, sizeof(old_hdr)) != 0);
+    }
+
+    free(rtp);
+    CHECK_OK(srtp_dealloc(sender));
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_stream_sync() moves the state of the streams of one receiver
+ * to another one, which must then reject replayed packets and accept new
+ * ones, also after a rollover
+ */
+srtp_err_status_t srtp_test_stream_sync(void)
+{
+    srtp_policy_t policy;
+    srtp_t sender;
+    srtp_t receiver;
+    srtp_t standby;
+    srtp_hdr_t *hdr;
+    uint8_t *rtp;
+    size_t rtp_len;
+    uint8_t replayed[128];
+    size_t replayed_len = sizeof(replayed);
+    uint8_t out[128];
+    size_t out_len = sizeof(out);
+    const uint32_t ssrcs[4] = { 1, 2, 3, 4 };
+    uint32_t rocs[4];
+    srtp_stream_sync_t sync[4];
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.window_size = 128;
+
+    policy.ssrc.type = ssrc_any_outbound;
+    CHECK_OK(srtp_create(&sender, &policy));
+    policy.ssrc.type = ssrc_any_inbound;
+    CHECK_OK(srtp_create(&receiver, &policy));
+
+    rtp = create_rtp_test_packet(32, 1, 1, 0, false, &rtp_len, NULL);
+
+    for (uint16_t seq = 1; seq < 10; seq++) {
+        CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 1, seq));
+    }
+    for (uint16_t seq = 1; seq <= 5; seq++) {
+        CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 2, seq));
+    }
+    /* the third stream rolls over */
+    for (uint16_t seq = 65530; seq != 3; seq++) {
+        CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 3, seq));
+    }
+
+    /* keep a packet to replay it later */
+    hdr = (srtp_hdr_t *)rtp;
+    hdr->ssrc = htonl(1);
+    hdr->seq = htons(10);
+    CHECK_OK(srtp_protect(sender, rtp, rtp_len, replayed, &replayed_len, 0));
+    CHECK_OK(srtp_unprotect(receiver, replayed, replayed_len, out, &out_len));
+
+    memset(sync, 0, sizeof(sync));
+    for (size_t i = 0; i < 4; i++) {
+        sync[i].ssrc = ssrcs[3 - i];
+    }
+    CHECK_RETURN(srtp_get_stream_sync(receiver, sync, 4),
+                 srtp_err_status_no_ctx);
+    CHECK(sync[0].status == srtp_err_status_no_ctx);
+    CHECK(sync[1].status == srtp_err_status_ok);
+    CHECK(sync[1].index == ((uint64_t)1 << 16 | 2));
+    CHECK(sync[1].replay[0] == 0x1ff);
+    CHECK(sync[3].status == srtp_err_status_ok);
+    CHECK(sync[3].index == 10);
+    CHECK(sync[3].replay[0] == 0x3ff);
+    CHECK(sync[3].replay[1] == 0);
+
+    CHECK_OK(srtp_get_stream_rocs(receiver, ssrcs, rocs, 3));
+    CHECK(rocs[0] == 0 && rocs[1] == 0 && rocs[2] == 1);
+    CHECK_RETURN(srtp_get_stream_rocs(receiver, ssrcs, rocs, 4),
+                 srtp_err_status_bad_param);
+
+    /* a standby receiver takes over the streams */
+    CHECK_OK(srtp_create(&standby, NULL));
+    policy.ssrc.type = ssrc_specific;
+    for (size_t i = 0; i < 3; i++) {
+        policy.ssrc.value = ssrcs[i];
+        CHECK_OK(srtp_stream_add(standby, &policy));
+    }
+    CHECK_OK(srtp_set_stream_sync(standby, &sync[1], 3));
+
+    CHECK_RETURN(srtp_unprotect(standby, replayed, replayed_len, out, &out_len),
+                 srtp_err_status_replay_fail);
+    CHECK_OK(fixed_session_send(sender, standby, rtp, rtp_len, 1, 11));
+    CHECK_OK(fixed_session_send(sender, standby, rtp, rtp_len, 2, 6));
+    CHECK_OK(fixed_session_send(sender, standby, rtp, rtp_len, 3, 3));
+
+    CHECK_RETURN(srtp_set_stream_sync(standby, &sync[0], 2),
+                 srtp_err_status_no_ctx);
+    CHECK(sync[0].status == srtp_err_status_no_ctx);
+    CHECK(sync[1].status == srtp_err_status_ok);
+
+    /* the rollover counter does not go backwards */
+    sync[1].index = 2;
+    CHECK_RETURN(srtp_set_stream_sync(standby, &sync[1], 1),
+                 srtp_err_status_replay_old);
+    CHECK(sync[1].status == srtp_err_status_replay_old);
+
+    /* a pending rollover counter applies to the next packet */
+    rocs[0] = 0;
+    CHECK_OK(srtp_set_stream_rocs(standby, ssrcs, rocs, 1));
+    CHECK_RETURN(srtp_set_stream_rocs(standby, &ssrcs[3], rocs, 1),
+                 srtp_err_status_bad_param);
+    CHECK_OK(fixed_session_send(sender, standby, rtp, rtp_len, 1, 12));
+
+    free(rtp);
+    CHECK_OK(srtp_dealloc(sender));
+    CHECK_OK(srtp_dealloc(receiver));
+    CHECK_OK(srtp_dealloc(standby));
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_repair_streams() checks that repair streams are protected
+ * with the keys of their media stream, follow it through updates and are
+ * removed with it
+ */
+srtp_err_status_t srtp_test_repair_streams(void)
+{
+    srtp_policy_t policy;
+    srtp_t sender;
+    srtp_t receiver;
+    srtp_hdr_t *hdr;
+    uint8_t *rtp;
+    size_t rtp_len;
+    uint8_t srtp[128];
+    size_t srtp_len = sizeof(srtp);
+    uint8_t out[128];
+    size_t out_len = sizeof(out);
+    uint32_t roc;
+    size_t allocs = 0;
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.window_size = 1024;
+    policy.ssrc.type = ssrc_specific;
+    policy.ssrc.value = 1;
+
+    CHECK_OK(srtp_create(&sender, &policy));
+    CHECK_OK(srtp_create(&receiver, &policy));
+
+    CHECK_RETURN(srtp_stream_add_repair(sender, 3, 2), srtp_err_status_no_ctx);
+    CHECK_RETURN(srtp_stream_add_repair(sender, 1, 1),
+                 srtp_err_status_bad_param);
+
+    /* a repair stream only allocates its context and replay window */
+    CHECK_OK(srtp_set_debug_module("alloc", true));
+    CHECK_OK(srtp_install_log_handler(count_alloc_log_handler, &allocs));
+    CHECK_OK(srtp_stream_add_repair(sender, 1, 2));
+    CHECK_OK(srtp_install_log_handler(NULL, NULL));
+    CHECK_OK(srtp_set_debug_module("alloc", false));
+    CHECK(allocs == 2);
+
+    CHECK_OK(srtp_stream_add_repair(receiver, 1, 2));
+    CHECK_RETURN(srtp_stream_add_repair(receiver, 1, 2),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(srtp_stream_add_repair(receiver, 2, 3),
+                 srtp_err_status_bad_param);
+
+    rtp = create_rtp_test_packet(32, 1, 1, 0, false, &rtp_len, NULL);
+
+    for (uint16_t seq = 1; seq <= 5; seq++) {
+        CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 1, seq));
+        CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 2, seq));
+    }
+
+    /* the repair stream follows its media stream to the new key */
+    policy.key = test_key_2;
+    CHECK_OK(srtp_stream_update(sender, &policy));
+    CHECK_OK(srtp_stream_update(receiver, &policy));
+    CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 2, 6));
+    CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 1, 6));
+
+    /* and is removed with it */
+    CHECK_OK(srtp_stream_remove(receiver, 1));
+    CHECK_RETURN(srtp_stream_get_roc(receiver, 2, &roc),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_stream_remove(sender, 2));
+    CHECK_RETURN(srtp_stream_get_roc(sender, 2, &roc),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_stream_get_roc(sender, 1, &roc));
+
+    CHECK_OK(srtp_dealloc(sender));
+    CHECK_OK(srtp_dealloc(receiver));
+
+    /* repair streams of streams cloned from a template */
+    policy.key = test_key;
+    policy.ssrc.type = ssrc_any_outbound;
+    CHECK_OK(srtp_create(&sender, &policy));
+    policy.ssrc.type = ssrc_any_inbound;
+    CHECK_OK(srtp_create(&receiver, &policy));
+
+    CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 1, 1));
+    CHECK_OK(srtp_stream_add_repair(sender, 1, 2));
+    CHECK_OK(srtp_stream_add_repair(receiver, 1, 2));
+    CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 2, 1));
+
+    policy.key = test_key_2;
+    policy.ssrc.type = ssrc_any_outbound;
+    CHECK_OK(srtp_update(sender, &policy));
+    policy.ssrc.type = ssrc_any_inbound;
+    CHECK_OK(srtp_update(receiver, &policy));
+    CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 2, 2));
+    CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 1, 2));
+
+    /* a replayed repair packet is rejected */
+    hdr = (srtp_hdr_t *)rtp;
+    hdr->ssrc = htonl(2);
+    hdr->seq = htons(3);
+    CHECK_OK(srtp_protect(sender, rtp, rtp_len, srtp, &srtp_len, 0));
+    CHECK_OK(srtp_unprotect(receiver, srtp, srtp_len, out, &out_len));
+    out_len = sizeof(out);
+    CHECK_RETURN(srtp_unprotect(receiver, srtp, srtp_len, out, &out_len),
+                 srtp_err_status_replay_fail);
+
+    CHECK_OK(srtp_stream_remove(receiver, 2));
+    CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, 1, 3));
+
+    free(rtp);
+    CHECK_OK(srtp_dealloc(sender));
+    CHECK_OK(srtp_dealloc(receiver));
+
+    return srtp_err_status_ok;
+}
+
+#define REPAIR_TIMING_STREAMS 200
+#define REPAIR_TIMING_TRIALS 100000
+#define REPAIR_TIMING_LOSS 20 /* one media packet in 20 is repaired */
+
+/*
+ * srtp_repair_timing(bind, &allocs) sends video with RTX over
+ * REPAIR_TIMING_STREAMS media streams and as many repair streams, the
+ * latter bound with srtp_stream_add_repair() if bind is set and cloned
+ * from the template otherwise.  allocs is set to the allocations the
+ * receiver made for the repair streams.  returns packets per second.
+ */
+static double srtp_repair_timing(bool bind, size_t *allocs)
+{
+    srtp_policy_t policy;
+    srtp_t sender;
+    srtp_t receiver;
+    uint8_t *rtp;
+    size_t rtp_len;
+    uint16_t repair_seq[REPAIR_TIMING_STREAMS];
+    size_t packets = 0;
+    clock_t timer;
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.window_size = 1024;
+    policy.ssrc.type = ssrc_any_outbound;
+    CHECK_OK(srtp_create(&sender, &policy));
+    policy.ssrc.type = ssrc_any_inbound;
+    CHECK_OK(srtp_create(&receiver, &policy));
+
+    rtp = create_rtp_test_packet(80, 1, 1, 0, false, &rtp_len, NULL);
+
+    *allocs = 0;
+    for (uint32_t i = 0; i < REPAIR_TIMING_STREAMS; i++) {
+        uint32_t media = 1 + i;
+        uint32_t repair = 1 + REPAIR_TIMING_STREAMS + i;
+
+        CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, media, 1));
+
+        CHECK_OK(srtp_set_debug_module("alloc", true));
+        CHECK_OK(srtp_install_log_handler(count_alloc_log_handler, allocs));
+        if (bind) {
+            CHECK_OK(srtp_stream_add_repair(sender, media, repair));
+            CHECK_OK(srtp_stream_add_repair(receiver, media, repair));
+        }
+        CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len, repair, 1));
+        CHECK_OK(srtp_install_log_handler(NULL, NULL));
+        CHECK_OK(srtp_set_debug_module("alloc", false));
+        repair_seq[i] = 2;
+    }
+    /* both sessions were counted */
+    *allocs /= 2;
+
+    timer = clock();
+    for (size_t t = 0; t < REPAIR_TIMING_TRIALS; t++) {
+        size_t i = t % REPAIR_TIMING_STREAMS;
+        uint16_t seq = (uint16_t)(2 + t / REPAIR_TIMING_STREAMS);
+
+        CHECK_OK(fixed_session_send(sender, receiver, rtp, rtp_len,
+                                    (uint32_t)(1 + i), seq));
+        packets++;
+        if (t % REPAIR_TIMING_LOSS == 0) {
+            CHECK_OK(fixed_session_send(
+                sender, receiver, rtp, rtp_len,
+                (uint32_t)(1 + REPAIR_TIMING_STREAMS + i), repair_seq[i]++));
+            packets++;
+        }
+    }
+    timer = clock() - timer;
+
+    free(rtp);
+    CHECK_OK(srtp_dealloc(sender));
+    CHECK_OK(srtp_dealloc(receiver));
+
+    return (double)packets * CLOCKS_PER_SEC / (double)timer;
+}
+
+void srtp_do_repair_timing(void)
+{
+    size_t allocs;
+    double rate;
+
+    printf("# testing video with RTX, %d media and repair streams:\r\n",
+           REPAIR_TIMING_STREAMS);
+    printf("# repair streams\tallocations per stream\tpackets per second"
+           "\r\n");
+
+    rate = srtp_repair_timing(false, &allocs);
+    printf("cloned\t\t\t%f\t\t%f\r\n",
+           (double)allocs / REPAIR_TIMING_STREAMS, rate);
+    rate = srtp_repair_timing(true, &allocs);
+    printf("bound\t\t\t%f\t\t%f\r\n",
+           (double)allocs / REPAIR_TIMING_STREAMS, rate);
+
+    printf("\r\n\r\n");
+}
+
+/*
+ * the packets of the recording test, numbered in the order they are
+ * appended
+ */
+#define RECORDING_TEST_PACKETS 40
+
+typedef struct {
+    uint8_t data[RECORDING_TEST_PACKETS][64];
+    size_t len[RECORDING_TEST_PACKETS];
+    size_t delivered;
+    uint64_t first_time_us;
+    size_t failures;
+} recording_test_t;
+
+static void recording_test_packet(void *user_data,
+                                  const srtp_recording_packet_t *packet)
+{
+    recording_test_t *test = (recording_test_t *)user_data;
+
+    if (test->delivered == 0) {
+        test->first_time_us = packet->time_us;
+    }
+    test->delivered++;
+
+    if (packet->status != srtp_err_status_ok ||
+        packet->number >= RECORDING_TEST_PACKETS ||
+        packet->len != test->len[packet->number] ||
+        memcmp(packet->data, test->data[packet->number], packet->len) != 0) {
+        test->failures++;
+    }
+}
+
+/*
+ * srtp_test_recording() records two streams, one of which rolls over and
+ * one that starts at a ROC other than 0, and checks that every segment of
+ * the recording is unprotected independently of the others, also when
+ * the recording was cut short before it was closed
+ */
+srtp_err_status_t srtp_test_recording(void)
+{
+    static const char path[] = "srtp_driver_recording.tmp";
+    static const char cut_path[] = "srtp_driver_recording_cut.tmp";
+    static recording_test_t test;
+    srtp_recording_reader_t *reader;
+    srtp_recording_t *recording;
+    srtp_policy_t policy;
+    srtp_t sender;
+    uint8_t *pkt;
+    size_t pkt_len;
+    uint8_t srtp[128];
+    size_t srtp_len;
+    size_t num_packets = 0;
+    size_t segments;
+    size_t segment;
+    uint64_t time_us;
+    uint64_t first_packet;
+    uint8_t *file_data;
+    long file_len;
+    FILE *file;
+
+    memset(&test, 0, sizeof(test));
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.ssrc.type = ssrc_any_outbound;
+    policy.window_size = 128;
+    CHECK_OK(srtp_create(&sender, &policy));
+
+    policy.ssrc.type = ssrc_specific;
+    policy.ssrc.value = 0x11111111;
+    CHECK_OK(srtp_stream_add(sender, &policy));
+    CHECK_OK(srtp_stream_set_roc(sender, 0x11111111, 5));
+
+    CHECK_RETURN(srtp_recording_create(&recording, path, 0),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_recording_create(&recording, path, 4));
+    CHECK_OK(srtp_recording_set_roc(recording, 0x11111111, 5));
+
+    for (uint16_t i = 0; i < 16; i++) {
+        time_us = 1000 * (uint64_t)i;
+
+        /* 0xcafebabe rolls over after its sixth packet */
+        pkt = create_rtp_test_packet(32, 0xcafebabe, (uint16_t)(65530 + i),
+                                     0, false, &pkt_len, NULL);
+        memcpy(test.data[num_packets], pkt, pkt_len);
+        test.len[num_packets++] = pkt_len;
+        srtp_len = sizeof(srtp);
+        CHECK_OK(srtp_protect(sender, pkt, pkt_len, srtp, &srtp_len, 0));
+        CHECK_OK(srtp_recording_append(recording, srtp, srtp_len, false,
+                                       time_us, 0));
+        free(pkt);
+
+        if (i >= 3) {
+            pkt = create_rtp_test_packet(32, 0x11111111, (uint16_t)(100 + i),
+                                         0, false, &pkt_len, NULL);
+            memcpy(test.data[num_packets], pkt, pkt_len);
+            test.len[num_packets++] = pkt_len;
+            srtp_len = sizeof(srtp);
+            CHECK_OK(srtp_protect(sender, pkt, pkt_len, srtp, &srtp_len, 0));
+            CHECK_OK(srtp_recording_append(recording, srtp, srtp_len, false,
+                                           time_us + 500, 0));
+            free(pkt);
+        }
+
+        if (i % 5 == 4) {
+            pkt = create_rtcp_test_packet(28, 0xcafebabe, &pkt_len, NULL);
+            memcpy(test.data[num_packets], pkt, pkt_len);
+            test.len[num_packets++] = pkt_len;
+            srtp_len = sizeof(srtp);
+            CHECK_OK(
+                srtp_protect_rtcp(sender, pkt, pkt_len, srtp, &srtp_len, 0));
+            CHECK_OK(srtp_recording_append(recording, srtp, srtp_len, true,
+                                           time_us + 500, 0));
+            free(pkt);
+        }
+    }
+    CHECK(num_packets <= RECORDING_TEST_PACKETS);
+
+    /* too late for the ROC of a stream and for an earlier packet */
+    CHECK_RETURN(srtp_recording_set_roc(recording, 0x11111111, 6),
+                 srtp_err_status_bad_param);
+    CHECK_RETURN(
+        srtp_recording_append(recording, srtp, srtp_len, true, 0, 0),
+        srtp_err_status_bad_param);
+
+    CHECK_OK(srtp_recording_close(recording));
+    CHECK_OK(srtp_dealloc(sender));
+
+    policy.ssrc.type = ssrc_any_inbound;
+
+    /* the segments are independent, decrypt them backwards */
+    CHECK_OK(srtp_recording_open(&reader, path));
+    segments = srtp_recording_get_segment_count(reader);
+    CHECK(segments == (num_packets + 3) / 4);
+    CHECK_OK(srtp_recording_get_segment(reader, 0, &time_us, &first_packet));
+    CHECK(time_us == 0 && first_packet == 0);
+    CHECK_RETURN(srtp_recording_get_segment(reader, segments, NULL, NULL),
+                 srtp_err_status_bad_param);
+    for (size_t i = segments; i > 0; i--) {
+        CHECK_OK(srtp_recording_decrypt(reader, &policy, i - 1, 0,
+                                        UINT64_MAX, recording_test_packet,
+                                        &test));
+    }
+    CHECK(test.delivered == num_packets);
+    CHECK(test.failures == 0);
+
+    /* a range starts in the last segment that begins before it */
+    CHECK_OK(srtp_recording_seek(reader, 0, &segment));
+    CHECK(segment == 0);
+    CHECK_OK(srtp_recording_seek(reader, UINT64_MAX, &segment));
+    CHECK(segment == segments - 1);
+    CHECK_OK(srtp_recording_seek(reader, 9000, &segment));
+    CHECK_OK(srtp_recording_get_segment(reader, segment, &time_us, NULL));
+    CHECK(time_us < 9000);
+    test.delivered = 0;
+    CHECK_OK(srtp_recording_decrypt(reader, &policy, segment, 9000, 10000,
+                                    recording_test_packet, &test));
+    if (segment + 1 < segments) {
+        CHECK_OK(srtp_recording_decrypt(reader, &policy, segment + 1, 9000,
+                                        10000, recording_test_packet, &test));
+    }
+    /* 0xcafebabe and 0x11111111 at 9000 and 9500, and the SRTCP packet */
+    CHECK(test.delivered == 3);
+    CHECK(test.first_time_us == 9000);
+    CHECK(test.failures == 0);
+    srtp_recording_reader_close(reader);
+
+    /*
+     * without the index and with the last packet cut short, as after a
+     * crash, the index is rebuilt from the other packets
+     */
+    file = fopen(path, "rb");
+    CHECK(file != NULL);
+    CHECK(fseek(file, 0, SEEK_END) == 0);
+    file_len = ftell(file);
+    CHECK(file_len > 0);
+    file_data = (uint8_t *)malloc((size_t)file_len);
+    CHECK(file_data != NULL);
+    rewind(file);
+    CHECK(fread(file_data, (size_t)file_len, 1, file) == 1);
+    fclose(file);
+    file_len -= SRTP_RECORDING_TRAILER_LEN +
+                (long)segments * SRTP_RECORDING_INDEX_ENTRY_LEN + 7;
+    file = fopen(cut_path, "wb");
+    CHECK(file != NULL);
+    CHECK(fwrite(file_data, (size_t)file_len, 1, file) == 1);
+    fclose(file);
+    free(file_data);
+
+    CHECK_OK(srtp_recording_open(&reader, cut_path));
+    CHECK(srtp_recording_get_segment_count(reader) == segments);
+    test.delivered = 0;
+    for (size_t i = 0; i < segments; i++) {
+        CHECK_OK(srtp_recording_decrypt(reader, &policy, i, 0, UINT64_MAX,
+                                        recording_test_packet, &test));
+    }
+    CHECK(test.delivered == num_packets - 1);
+    CHECK(test.failures == 0);
+    srtp_recording_reader_close(reader);
+
+    remove(path);
+    remove(cut_path);
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * test_find_roc(gcm) checks that srtp_stream_find_roc() finds the ROC of
+ * streams that a receiver joins mid-call, with or without an AEAD cipher
+ */
+static srtp_err_status_t test_find_roc(bool gcm)
+{
+    srtp_policy_t policy;
+    srtp_t sender;
+    srtp_t receiver;
+    uint8_t *pkt;
+    size_t pkt_len;
+    uint8_t srtp[2][128];
+    size_t srtp_len[2];
+    uint8_t rtp[128];
+    size_t rtp_len;
+    uint32_t roc;
+
+    memset(&policy, 0, sizeof(policy));
+#ifdef GCM
+    if (gcm) {
+        srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy.rtp);
+        srtp_crypto_policy_set_aes_gcm_128_16_auth(&policy.rtcp);
+        policy.key = test_key_gcm;
+    } else
+#endif
+    {
+        (void)gcm;
+        srtp_crypto_policy_set_rtp_default(&policy.rtp);
+        srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+        policy.key = test_key;
+    }
+    policy.window_size = 128;
+
+    /* 0xcafebabe is at ROC 7, 0x11111111 at ROC 0 */
+    policy.ssrc.type = ssrc_specific;
+    policy.ssrc.value = 0xcafebabe;
+    CHECK_OK(srtp_create(&sender, &policy));
+    CHECK_OK(srtp_stream_set_roc(sender, 0xcafebabe, 7));
+    policy.ssrc.value = 0x11111111;
+    CHECK_OK(srtp_stream_add(sender, &policy));
+
+    pkt = create_rtp_test_packet(32, 0xcafebabe, 1000, 0, false, &pkt_len,
+                                 NULL);
+    srtp_len[0] = sizeof(srtp[0]);
+    CHECK_OK(srtp_protect(sender, pkt, pkt_len, srtp[0], &srtp_len[0], 0));
+    free(pkt);
+    pkt = create_rtp_test_packet(32, 0x11111111, 1000, 0, false, &pkt_len,
+                                 NULL);
+    srtp_len[1] = sizeof(srtp[1]);
+    CHECK_OK(srtp_protect(sender, pkt, pkt_len, srtp[1], &srtp_len[1], 0));
+    free(pkt);
+    CHECK_OK(srtp_dealloc(sender));
+
+    policy.ssrc.type = ssrc_any_inbound;
+    CHECK_OK(srtp_create(&receiver, &policy));
+
+    rtp_len = sizeof(rtp);
+    CHECK_RETURN(
+        srtp_unprotect(receiver, srtp[0], srtp_len[0], rtp, &rtp_len),
+        srtp_err_status_auth_fail);
+
+    /* out of reach of the estimate, nothing is set */
+    CHECK_RETURN(
+        srtp_stream_find_roc(receiver, srtp[0], srtp_len[0], 4, 2, &roc),
+        srtp_err_status_auth_fail);
+    CHECK(srtp_get_stream(receiver, htonl(0xcafebabe)) == NULL);
+
+    CHECK_OK(srtp_stream_find_roc(receiver, srtp[0], srtp_len[0], 4, 3, &roc));
+    CHECK(roc == 7);
+    rtp_len = sizeof(rtp);
+    CHECK_OK(srtp_unprotect(receiver, srtp[0], srtp_len[0], rtp, &rtp_len));
+    CHECK_OK(srtp_stream_get_roc(receiver, 0xcafebabe, &roc));
+    CHECK(roc == 7);
+
+    /* the search does not go below ROC 0 */
+    CHECK_OK(srtp_stream_find_roc(receiver, srtp[1], srtp_len[1], 2, 5, &roc));
+    CHECK(roc == 0);
+    rtp_len = sizeof(rtp);
+    CHECK_OK(srtp_unprotect(receiver, srtp[1], srtp_len[1], rtp, &rtp_len));
+
+    /* a corrupted packet verifies with no ROC */
+    srtp[0][srtp_len[0] - 1] ^= 0x01;
+    CHECK_RETURN(
+        srtp_stream_find_roc(receiver, srtp[0], srtp_len[0], 7, 4, &roc),
+        srtp_err_status_auth_fail);
+
+    CHECK_OK(srtp_dealloc(receiver));
+
+    return srtp_err_status_ok;
+}
+
+srtp_err_status_t srtp_test_find_roc(void)
+{
+    srtp_err_status_t status;
+
+    status = test_find_roc(false);
+    if (status) {
+        return status;
+    }
+
+#ifdef GCM
+    status = test_find_roc(true);
+    if (status) {
+        return status;
+    }
+#endif
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp_test_session_quota() checks that the quota of a session bounds the
+ * streams its template adds for new SSRCs, by count and by memory, and
+ * that removed streams give their share back
+ */
+srtp_err_status_t srtp_test_session_quota(void)
+{
+    srtp_policy_t policy;
+    srtp_session_quota_usage_t usage;
+    srtp_t sender;
+    srtp_t receiver;
+    uint8_t *pkt;
+    size_t pkt_len;
+    uint8_t srtp[4][128];
+    size_t srtp_len[4];
+    uint8_t rtp[128];
+    size_t rtp_len;
+    size_t stream_bytes;
+
+    memset(&policy, 0, sizeof(policy));
+    srtp_crypto_policy_set_rtp_default(&policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy.rtcp);
+    policy.key = test_key;
+    policy.ssrc.type = ssrc_any_outbound;
+    policy.window_size = 128;
+
+    CHECK_OK(srtp_create(&sender, &policy));
+    for (uint32_t i = 0; i < 4; i++) {
+        pkt = create_rtp_test_packet(32, 0x1000 + i, 1, 0, false, &pkt_len,
+                                     NULL);
+        srtp_len[i] = sizeof(srtp[i]);
+        CHECK_OK(srtp_protect(sender, pkt, pkt_len, srtp[i], &srtp_len[i], 0));
+        free(pkt);
+    }
+    CHECK_OK(srtp_dealloc(sender));
+
+    policy.ssrc.type = ssrc_any_inbound;
+    CHECK_OK(srtp_create(&receiver, &policy));
+    CHECK_RETURN(srtp_set_session_quota(NULL, 2, 0),
+                 srtp_err_status_bad_param);
+    CHECK_OK(srtp_set_session_quota(receiver, 2, 0));
+
+    for (size_t i = 0; i < 2; i++) {
+        rtp_len = sizeof(rtp);
+        CHECK_OK(srtp_unprotect(receiver, srtp[i], srtp_len[i], rtp, &rtp_len));
+    }
+    rtp_len = sizeof(rtp);
+    CHECK_RETURN(
+        srtp_unprotect(receiver, srtp[2], srtp_len[2], rtp, &rtp_len),
+        srtp_err_status_quota_fail);
+    CHECK(srtp_get_stream(receiver, htonl(0x1002)) == NULL);
+
+    CHECK_OK(srtp_get_session_quota_usage(receiver, &usage));
+    CHECK(usage.streams == 2);
+    CHECK(usage.bytes > 2 * sizeof(srtp_stream_ctx_t));
+    CHECK(usage.rejections == 1);
+    stream_bytes = usage.bytes / 2;
+
+    /* a removed stream makes room for another */
+    CHECK_OK(srtp_stream_remove(receiver, 0x1000));
+    rtp_len = sizeof(rtp);
+    CHECK_OK(srtp_unprotect(receiver, srtp[2], srtp_len[2], rtp, &rtp_len));
+
+    /* updating the template keeps the streams and their charge */
+    CHECK_OK(srtp_update(receiver, &policy));
+    CHECK_OK(srtp_get_session_quota_usage(receiver, &usage));
+    CHECK(usage.streams == 2);
+    CHECK(usage.bytes == 2 * stream_bytes);
+
+    /* the memory quota holds exactly the streams there are */
+    CHECK_OK(srtp_set_session_quota(receiver, 0, 2 * stream_bytes));
+    rtp_len = sizeof(rtp);
+    CHECK_RETURN(
+        srtp_unprotect(receiver, srtp[3], srtp_len[3], rtp, &rtp_len),
+        srtp_err_status_quota_fail);
+    CHECK_OK(srtp_set_session_quota(receiver, 0, 3 * stream_bytes));
+    rtp_len = sizeof(rtp);
+    CHECK_OK(srtp_unprotect(receiver, srtp[3], srtp_len[3], rtp, &rtp_len));
+
+    /* streams added by the application are not charged */
+    policy.ssrc.type = ssrc_specific;
+    policy.ssrc.value = 0x2000;
+    CHECK_OK(srtp_stream_add(receiver, &policy));
+
+    CHECK_OK(srtp_get_session_quota_usage(receiver, &usage));
+    CHECK(usage.streams == 3);
+    CHECK(usage.bytes == 3 * stream_bytes);
+    CHECK(usage.rejections == 2);
+
+    CHECK_OK(srtp_dealloc(receiver));
+
+    return srtp_err_status_ok;
+}
+
+/*
+ * srtp policy definitions - these definitions are used above
+ */
+
+// clang-format off
+uint8_t test_key[46] = {
+    0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0,
+    0xd6, 0x4f, 0xa3, 0x2c, 0x06, 0xde, 0x41, 0x39,
+    0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb,
+    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6, 0xc1, 0x73,
+    0xc3, 0x17, 0xf2, 0xda, 0xbe, 0x35, 0x77, 0x93,
+    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
+};
+
+uint8_t test_key_2[46] = {
+    0xf0, 0xf0, 0x49, 0x14, 0xb5, 0x13, 0xf2, 0x76,
+    0x3a, 0x1b, 0x1f, 0xa1, 0x30, 0xf1, 0x0e, 0x29,
+    0x98, 0xf6, 0xf6, 0xe4, 0x3e, 0x43, 0x09, 0xd1,
+    0xe6, 0x22, 0xa0, 0xe3, 0x32, 0xb9, 0xf1, 0xb6,
+    0xc3, 0x17, 0xf2, 0xda, 0xbe, 0x35, 0x77, 0x93,
+    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
+};
+
+uint8_t test_key_gcm[28] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+    0xa0, 0xa1, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xab
+};
+
+uint8_t test_mki_id[TEST_MKI_ID_SIZE] = {
+    0xe1, 0xf9, 0x7a, 0x0d
+};
+
+uint8_t test_mki_id_2[TEST_MKI_ID_SIZE] = {
+    0xf3, 0xa1, 0x46, 0x71
+};
+// clang-format on
+
+const srtp_policy_t default_policy = {
+    { ssrc_any_outbound, 0 }, /* SSRC */
+    {
+        /* SRTP policy */
+        SRTP_AES_ICM_128,               /* cipher type                 */
+        SRTP_AES_ICM_128_KEY_LEN_WSALT, /* cipher key length in octets */
+        SRTP_HMAC_SHA1,                 /* authentication func type    */
+        16,                             /* auth key length in octets   */
+        10,                             /* auth tag length in octets   */
+        sec_serv_conf_and_auth          /* security services flag      */
+    },
+    {
+        /* SRTCP policy */
+        SRTP_AES_ICM_128,               /* cipher type                 */
+        SRTP_AES_ICM_128_KEY_LEN_WSALT, /* cipher key length in octets */
+        SRTP_HMAC_SHA1,                 /* authentication func type    */
+        16,                             /* auth key length in octets   */
+        10,                             /* auth tag length in octets   */
+        sec_serv_conf_and_auth          /* security services flag      */
+    },
+    NULL,
+    (srtp_master_key_t **)test_keys,
+    2,                /* indicates the number of Master keys          */
+    true,             /* no mki */
+    TEST_MKI_ID_SIZE, /* mki size */
+    128,              /* replay window size                           */
+    0,                /* retransmission not allowed                   */
+    NULL,             /* no encrypted extension headers               */
+    0,                /* list of encrypted extension headers is empty */
+    0,                /* no retransmission cache                      */
+    0,                /* default retransmission cache packet length   */
+    NULL,             /* no encrypted key transport                   */
+    NULL
+};
+
+const srtp_policy_t aes_only_policy = {
+    { ssrc_any_outbound, 0 }, /* SSRC                        */
+    {
+        SRTP_AES_ICM_128,               /* cipher type                 */
+        SRTP_AES_ICM_128_KEY_LEN_WSALT, /* cipher key length in octets */
+        SRTP_NULL_AUTH,                 /* authentication func type    */
+        0,                              /* auth key length in octets   */
+        0,                              /* auth tag length in octets   */
+        sec_serv_conf                   /* security services flag      */
+    },
+    {
+        SRTP_AES_ICM_128,               /* cipher type                 */
+        SRTP_AES_ICM_128_KEY_LEN_WSALT, /* cipher key length in octets */
+        SRTP_NULL_AUTH,                 /* authentication func type    */
+        0,                              /* auth key length in octets   */
+        0,                              /* auth tag length in octets   */
+        sec_serv_conf                   /* security services flag      */
+    },
+    NULL,
+    (srtp_master_key_t **)test_keys,
+    2,                /* indicates the number of Master keys          */
+    true,             /* no mki */
+    TEST_MKI_ID_SIZE, /* mki size */
+    128,              /* replay window size                           */
+    0,                /* retransmission not allowed                   */
+    NULL,             /* no encrypted extension headers               */
+    0,                /* list of encrypted extension headers is empty */
+    0,                /* no retransmission cache                      */
+    0,                /* default retransmission cache packet length   */
+    NULL,             /* no encrypted key transport                   */
+    NULL
+};
+
+const srtp_policy_t hmac_only_policy = {
+    { ssrc_any_outbound, 0 }, /* SSRC */
+    {
+        SRTP_NULL_CIPHER,               /* cipher type                 */
+        SRTP_AES_ICM_128_KEY_LEN_WSALT, /* cipher key length in octets */
+        SRTP_HMAC_SHA1,                 /* authentication func type    */
+        20,                             /* auth key length in octets   */
+        4,                              /* auth tag length in octets   */
+        sec_serv_auth                   /* security services flag      */
+    },
+    {
+        SRTP_NULL_CIPHER,               /* cipher type                 */
+        SRTP_AES_ICM_128_KEY_LEN_WSALT, /* cipher key length in octets */
+        SRTP_HMAC_SHA1,                 /* authentication func type    */
+        20,                             /* auth key length in octets   */
+        4,                              /* auth tag length in octets   */
+        sec_serv_auth                   /* security services flag      */
+    },
+    NULL,
+    (srtp_master_key_t **)test_keys,
+    2,                /* Number of Master keys associated with the policy */
+    true,             /* no mki */
+    TEST_MKI_ID_SIZE, /* mki size */
     128,              /* replay window size                               */
     0,                /* retransmission not allowed                       */
     NULL,             /* no encrypted extension headers                   */
     0,                /* list of encrypted extension headers is empty     */
+    0,                /* no retransmission cache                          */
+    0,                /* default retransmission cache packet length       */
+    NULL,             /* no encrypted key transport                       */
     NULL
 };
 
@@ -4930,6 +7703,9 @@ const srtp_policy_t aes128_gcm_8_policy = {
     0,                /* retransmission not allowed                   */
     NULL,             /* no encrypted extension headers               */
     0,                /* list of encrypted extension headers is empty */
+    0,                /* no retransmission cache                      */
+    0,                /* default retransmission cache packet length   */
+    NULL,             /* no encrypted key transport                   */
     NULL
 };
 
@@ -4962,6 +7738,9 @@ const srtp_policy_t aes128_gcm_8_cauth_policy = {
     0,                /* retransmission not allowed                   */
     NULL,             /* no encrypted extension headers               */
     0,                /* list of encrypted extension headers is empty */
+    0,                /* no retransmission cache                      */
+    0,                /* default retransmission cache packet length   */
+    NULL,             /* no encrypted key transport                   */
     NULL
 };
 
@@ -4994,6 +7773,9 @@ const srtp_policy_t aes256_gcm_8_policy = {
     0,                /* retransmission not allowed                   */
     NULL,             /* no encrypted extension headers               */
     0,                /* list of encrypted extension headers is empty */
+    0,                /* no retransmission cache                      */
+    0,                /* default retransmission cache packet length   */
+    NULL,             /* no encrypted key transport                   */
     NULL
 };
 
@@ -5026,6 +7808,9 @@ const srtp_policy_t aes256_gcm_8_cauth_policy = {
     0,                /* retransmission not allowed                   */
     NULL,             /* no encrypted extension headers               */
     0,                /* list of encrypted extension headers is empty */
+    0,                /* no retransmission cache                      */
+    0,                /* default retransmission cache packet length   */
+    NULL,             /* no encrypted key transport                   */
     NULL
 };
 #endif
@@ -5057,6 +7842,9 @@ const srtp_policy_t null_policy = {
     0,                /* retransmission not allowed                   */
     NULL,             /* no encrypted extension headers               */
     0,                /* list of encrypted extension headers is empty */
+    0,                /* no retransmission cache                      */
+    0,                /* default retransmission cache packet length   */
+    NULL,             /* no encrypted key transport                   */
     NULL
 };
 
@@ -5125,6 +7913,9 @@ const srtp_policy_t aes_256_hmac_policy = {
     false,            /* retransmission not allowed                   */
     NULL,             /* no encrypted extension headers               */
     0,                /* list of encrypted extension headers is empty */
+    0,                /* no retransmission cache                      */
+    0,                /* default retransmission cache packet length   */
+    NULL,             /* no encrypted key transport                   */
     NULL
 };
 
@@ -5158,6 +7949,9 @@ const srtp_policy_t aes_256_hmac_32_policy = {
     false,            /* retransmission not allowed                   */
     NULL,             /* no encrypted extension headers               */
     0,                /* list of encrypted extension headers is empty */
+    0,                /* no retransmission cache                      */
+    0,                /* default retransmission cache packet length   */
+    NULL,             /* no encrypted key transport                   */
     NULL
 };
 
@@ -5188,6 +7982,9 @@ const srtp_policy_t hmac_only_with_no_master_key = {
     false, /* retransmission not allowed                   */
     NULL,  /* no encrypted extension headers               */
     0,     /* list of encrypted extension headers is empty */
+    0,     /* no retransmission cache                      */
+    0,     /* default retransmission cache packet length   */
+    NULL,  /* no encrypted key transport                   */
     NULL
 };
 
@@ -5255,6 +8052,9 @@ const srtp_policy_t wildcard_policy = {
     0,     /* retransmission not allowed                   */
     NULL,  /* no encrypted extension headers               */
     0,     /* list of encrypted extension headers is empty */
+    0,     /* no retransmission cache                      */
+    0,     /* default retransmission cache packet length   */
+    NULL,  /* no encrypted key transport                   */
     NULL
 };
 
@@ -5406,6 +8206,49 @@ srtp_err_status_t srtp_stream_list_test(void)
         return srtp_err_status_fail;
     }
 
+    /* a list large enough to be hashed */
+    if (srtp_stream_list_alloc(&list)) {
+        return srtp_err_status_fail;
+    }
+
+    for (uint32_t i = 1; i <= 1000; i++) {
+        if (srtp_stream_list_insert(list,
+                                    stream_list_test_create_stream(i * 7))) {
+            return srtp_err_status_fail;
+        }
+    }
+
+    /* remove every third stream */
+    for (uint32_t i = 3; i <= 1000; i += 3) {
+        stream = srtp_stream_list_get(list, i * 7);
+        if (stream == NULL) {
+            return srtp_err_status_fail;
+        }
+        srtp_stream_list_remove(list, stream);
+        stream_list_test_free_stream(stream);
+    }
+
+    for (uint32_t i = 1; i <= 1000; i++) {
+        stream = srtp_stream_list_get(list, i * 7);
+        if ((stream == NULL) != (i % 3 == 0)) {
+            return srtp_err_status_fail;
+        }
+        if (stream != NULL && stream->ssrc != i * 7) {
+            return srtp_err_status_fail;
+        }
+    }
+
+    count = 0;
+    srtp_stream_list_for_each(list, stream_list_test_count_cb, &count);
+    if (count != 667) {
+        return srtp_err_status_fail;
+    }
+
+    srtp_stream_list_for_each(list, stream_list_test_remove_all_cb, &list);
+    if (srtp_stream_list_dealloc(list)) {
+        return srtp_err_status_fail;
+    }
+
     return srtp_err_status_ok;
 }
 
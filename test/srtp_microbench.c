@@ -0,0 +1,879 @@
+/*
+ * srtp_microbench.c
+ *
+ * microbenchmarks of the primitives that libsrtp is built from
+ *
+ * Every benchmark is timed in the same way: the number of operations per
+ * run is doubled until a run takes at least the minimum run time (which
+ * also warms up caches and branch predictors), then a number of runs is
+ * timed with a monotonic clock.  The mean time per operation is reported
+ * with a 95% confidence interval over the runs, together with cycles per
+ * byte (or per operation) when the CPU frequency is known.  Each cipher
+ * and auth type that is compiled in is benchmarked under its own
+ * description, so that the JSON output (-j) of different builds can be
+ * compared directly.  See the usage() function for more details.
+ *
+ */
+
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "getopt_s.h" /* for local getopt()  */
+
+#include <stdio.h>  /* for printf, fprintf  */
+#include <stdlib.h> /* for malloc()         */
+#include <string.h> /* for memset()         */
+#include <time.h>   /* for clock_gettime()  */
+
+#include "srtp_priv.h"
+#include "aes.h"
+#include "rdb.h"
+#include "rdbx.h"
+
+#if !defined(OPENSSL) && !defined(WOLFSSL) && !defined(MBEDTLS) &&             \
+    !defined(NSS)
+#define BENCH_NATIVE_CRYPTO
+#include "sha1.h"
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h> /* for htonl()          */
+#endif
+
+#define BENCH_MAX_LEN 1500
+#define BENCH_MAX_RUNS 100
+#define BENCH_XTN_HDR_LEN 12
+
+typedef struct bench_t bench_t;
+
+/*
+ * a benchmark: setup() prepares the state (returning an error if the
+ * primitive is not compiled in), run() performs the operation a number of
+ * times and teardown() frees the state
+ */
+struct bench_t {
+    const char *name;
+    size_t bytes; /* octets processed per operation, 0 if none */
+    srtp_err_status_t (*setup)(bench_t *b);
+    void (*run)(bench_t *b, size_t iterations);
+    void (*teardown)(bench_t *b);
+    int id;         /* cipher or auth type, stream count, ... */
+    size_t key_len; /* key length, including salt */
+    const char *variant;
+    union {
+        srtp_cipher_t *cipher;
+        srtp_auth_t *auth;
+        srtp_aes_expanded_key_t *aes_key;
+        srtp_rdbx_t *rdbx;
+        srtp_rdb_t *rdb;
+        srtp_t session;
+    } u;
+    srtp_policy_t policy;
+    uint8_t *buf;
+    size_t len;
+    uint32_t counter;
+    srtp_err_status_t status;
+};
+
+typedef struct {
+    size_t iterations;
+    size_t runs;
+    double mean_ns;
+    double ci95_ns;
+    double min_ns;
+} bench_result_t;
+
+static uint8_t bench_key[SRTP_MAX_KEY_LEN] = {
+    0xe1, 0xf9, 0x7a, 0x0d, 0x3e, 0x01, 0x8b, 0xe0, 0xd6, 0x4f, 0xa3, 0x2c,
+    0x06, 0xde, 0x41, 0x39, 0x0e, 0xc6, 0x75, 0xad, 0x49, 0x8a, 0xfe, 0xeb,
+    0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6, 0xc1, 0x73, 0xc3, 0x17, 0xf2, 0xda,
+    0xbe, 0x35, 0x77, 0x93, 0xb6, 0x96, 0x0b, 0x3a, 0xab, 0xe6
+};
+
+static uint8_t bench_xtn_hdr_ids[] = { 1, 2 };
+
+/* the library that the sessions use for their crypto */
+static const char *crypto_library(void)
+{
+#if defined(OPENSSL)
+    return "openssl";
+#elif defined(WOLFSSL)
+    return "wolfssl";
+#elif defined(MBEDTLS)
+    return "mbedtls";
+#elif defined(NSS)
+    return "nss";
+#else
+    return "native";
+#endif
+}
+
+static uint8_t *bench_alloc_buffer(bench_t *b, size_t len)
+{
+    b->buf = (uint8_t *)malloc(len);
+    if (b->buf != NULL) {
+        memset(b->buf, 0xa5, len);
+    }
+    return b->buf;
+}
+
+static void bench_free_buffer(bench_t *b)
+{
+    free(b->buf);
+    b->buf = NULL;
+}
+
+/*
+ * AES block encryption (crypto/cipher/aes.c, used by the native AES-ICM
+ * cipher and the native KDF)
+ */
+static srtp_err_status_t aes_block_setup(bench_t *b)
+{
+    b->u.aes_key =
+        (srtp_aes_expanded_key_t *)malloc(sizeof(srtp_aes_expanded_key_t));
+    if (b->u.aes_key == NULL || bench_alloc_buffer(b, 16) == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    b->variant = "native";
+    return srtp_aes_expand_encryption_key(bench_key, b->key_len, b->u.aes_key);
+}
+
+static void aes_block_run(bench_t *b, size_t iterations)
+{
+    for (size_t i = 0; i < iterations; i++) {
+        srtp_aes_encrypt((v128_t *)b->buf, b->u.aes_key);
+    }
+}
+
+static void aes_block_teardown(bench_t *b)
+{
+    free(b->u.aes_key);
+    bench_free_buffer(b);
+}
+
+/*
+ * a cipher type from the crypto kernel, encrypting b->bytes octets with a
+ * fresh IV per operation as srtp_protect() does
+ */
+static srtp_err_status_t cipher_setup(bench_t *b)
+{
+    srtp_err_status_t status;
+    size_t tag_len = (b->id == SRTP_AES_GCM_128 || b->id == SRTP_AES_GCM_256)
+                         ? SRTP_MAX_TAG_LEN
+                         : 0;
+
+    status = srtp_crypto_kernel_alloc_cipher((srtp_cipher_type_id_t)b->id,
+                                             &b->u.cipher, b->key_len, tag_len);
+    if (status) {
+        return status;
+    }
+    status = srtp_cipher_init(b->u.cipher, bench_key);
+    if (status) {
+        srtp_cipher_dealloc(b->u.cipher);
+        return status;
+    }
+    if (bench_alloc_buffer(b, BENCH_MAX_LEN + SRTP_MAX_TAG_LEN) == NULL) {
+        srtp_cipher_dealloc(b->u.cipher);
+        return srtp_err_status_alloc_fail;
+    }
+    b->variant = b->u.cipher->type->description;
+    return srtp_err_status_ok;
+}
+
+static void cipher_run(bench_t *b, size_t iterations)
+{
+    v128_t iv;
+    size_t out_len;
+
+    v128_set_to_zero(&iv);
+    for (size_t i = 0; i < iterations; i++) {
+        iv.v32[3] = b->counter++;
+        srtp_cipher_set_iv(b->u.cipher, (uint8_t *)&iv,
+                           srtp_direction_encrypt);
+        if (b->u.cipher->type->set_aad) {
+            srtp_cipher_set_aad(b->u.cipher, b->buf, 12);
+        }
+        out_len = BENCH_MAX_LEN + SRTP_MAX_TAG_LEN;
+        srtp_cipher_encrypt(b->u.cipher, b->buf, b->bytes, b->buf, &out_len);
+    }
+}
+
+/*
+ * GCM with all of the data as AAD, which leaves GHASH (plus one block of
+ * AES for the tag) as the cost; the backends do not expose GHASH itself
+ */
+static void ghash_run(bench_t *b, size_t iterations)
+{
+    v128_t iv;
+    size_t out_len;
+
+    v128_set_to_zero(&iv);
+    for (size_t i = 0; i < iterations; i++) {
+        iv.v32[3] = b->counter++;
+        srtp_cipher_set_iv(b->u.cipher, (uint8_t *)&iv,
+                           srtp_direction_encrypt);
+        srtp_cipher_set_aad(b->u.cipher, b->buf, b->bytes);
+        out_len = SRTP_MAX_TAG_LEN;
+        srtp_cipher_encrypt(b->u.cipher, b->buf, 0, b->buf + BENCH_MAX_LEN,
+                            &out_len);
+    }
+}
+
+static void cipher_teardown(bench_t *b)
+{
+    srtp_cipher_dealloc(b->u.cipher);
+    bench_free_buffer(b);
+}
+
+#define ghash_setup cipher_setup
+#define ghash_teardown cipher_teardown
+
+/* an auth type from the crypto kernel, tagging b->bytes octets */
+static srtp_err_status_t auth_setup(bench_t *b)
+{
+    srtp_err_status_t status;
+
+    status = srtp_crypto_kernel_alloc_auth((srtp_auth_type_id_t)b->id,
+                                           &b->u.auth, b->key_len, 10);
+    if (status) {
+        return status;
+    }
+    status = srtp_auth_init(b->u.auth, bench_key);
+    if (status) {
+        srtp_auth_dealloc(b->u.auth);
+        return status;
+    }
+    if (bench_alloc_buffer(b, BENCH_MAX_LEN + SRTP_MAX_TAG_LEN) == NULL) {
+        srtp_auth_dealloc(b->u.auth);
+        return srtp_err_status_alloc_fail;
+    }
+    b->variant = b->u.auth->type->description;
+    return srtp_err_status_ok;
+}
+
+static void auth_run(bench_t *b, size_t iterations)
+{
+    for (size_t i = 0; i < iterations; i++) {
+        srtp_auth_start(b->u.auth);
+        srtp_auth_compute(b->u.auth, b->buf, b->bytes, b->buf + BENCH_MAX_LEN);
+    }
+}
+
+static void auth_teardown(bench_t *b)
+{
+    srtp_auth_dealloc(b->u.auth);
+    bench_free_buffer(b);
+}
+
+#ifdef BENCH_NATIVE_CRYPTO
+/* the native SHA-1 under HMAC-SHA1, over b->bytes octets */
+static srtp_err_status_t sha1_setup(bench_t *b)
+{
+    if (bench_alloc_buffer(b, BENCH_MAX_LEN) == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    b->variant = "native";
+    return srtp_err_status_ok;
+}
+
+#define sha1_teardown bench_free_buffer
+
+static void sha1_run(bench_t *b, size_t iterations)
+{
+    srtp_sha1_ctx_t ctx;
+    uint32_t hash[5];
+
+    for (size_t i = 0; i < iterations; i++) {
+        srtp_sha1_init(&ctx);
+        srtp_sha1_update(&ctx, b->buf, b->bytes);
+        srtp_sha1_final(&ctx, hash);
+        b->buf[0] ^= (uint8_t)hash[0];
+    }
+}
+#endif
+
+/* replay databases: check and add one new index per operation */
+static srtp_err_status_t rdbx_setup(bench_t *b)
+{
+    b->u.rdbx = (srtp_rdbx_t *)malloc(sizeof(srtp_rdbx_t));
+    if (b->u.rdbx == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    b->variant = "native";
+    return srtp_rdbx_init(b->u.rdbx, (size_t)b->id);
+}
+
+static void rdbx_run(bench_t *b, size_t iterations)
+{
+    srtp_xtd_seq_num_t est;
+    ssize_t delta;
+
+    for (size_t i = 0; i < iterations; i++) {
+        delta = srtp_rdbx_estimate_index(b->u.rdbx, &est,
+                                         (srtp_sequence_number_t)b->counter++);
+        if (srtp_rdbx_check(b->u.rdbx, delta) == srtp_err_status_ok) {
+            srtp_rdbx_add_index(b->u.rdbx, delta);
+        }
+    }
+}
+
+static void rdbx_teardown(bench_t *b)
+{
+    srtp_rdbx_dealloc(b->u.rdbx);
+    free(b->u.rdbx);
+}
+
+static srtp_err_status_t rdb_setup(bench_t *b)
+{
+    b->u.rdb = (srtp_rdb_t *)malloc(sizeof(srtp_rdb_t));
+    if (b->u.rdb == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+    b->variant = "native";
+    return srtp_rdb_init(b->u.rdb);
+}
+
+static void rdb_run(bench_t *b, size_t iterations)
+{
+    for (size_t i = 0; i < iterations; i++) {
+        uint32_t index = b->counter++ & 0x7fffffff;
+        if (srtp_rdb_check(b->u.rdb, index) == srtp_err_status_ok) {
+            srtp_rdb_add_index(b->u.rdb, index);
+        }
+    }
+}
+
+static void rdb_teardown(bench_t *b)
+{
+    free(b->u.rdb);
+}
+
+/* sessions for the stream lookup, key derivation and protect benchmarks */
+static srtp_err_status_t session_setup(bench_t *b, size_t num_streams)
+{
+    srtp_err_status_t status;
+
+    memset(&b->policy, 0, sizeof(b->policy));
+    srtp_crypto_policy_set_rtp_default(&b->policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&b->policy.rtcp);
+    b->policy.ssrc.type = ssrc_specific;
+    b->policy.key = bench_key;
+    b->policy.window_size = 128;
+
+    status = srtp_create(&b->u.session, NULL);
+    if (status) {
+        return status;
+    }
+    for (size_t i = 0; i < num_streams; i++) {
+        b->policy.ssrc.value = 0x10000000 + (uint32_t)i;
+        status = srtp_stream_add(b->u.session, &b->policy);
+        if (status) {
+            srtp_dealloc(b->u.session);
+            return status;
+        }
+    }
+    b->variant = crypto_library();
+    return srtp_err_status_ok;
+}
+
+static srtp_err_status_t lookup_setup(bench_t *b)
+{
+    return session_setup(b, (size_t)b->id);
+}
+
+static void lookup_run(bench_t *b, size_t iterations)
+{
+    uint32_t num_streams = (uint32_t)b->id;
+
+    for (size_t i = 0; i < iterations; i++) {
+        /* walk the streams with a stride, so that lookups do not repeat */
+        uint32_t ssrc = 0x10000000 + (b->counter * 2654435761u) % num_streams;
+        b->counter++;
+        if (srtp_get_stream(b->u.session, htonl(ssrc)) == NULL) {
+            abort();
+        }
+    }
+}
+
+static void session_teardown(bench_t *b)
+{
+    srtp_dealloc(b->u.session);
+    bench_free_buffer(b);
+}
+
+#define lookup_teardown session_teardown
+#define kdf_teardown session_teardown
+#define protect_teardown session_teardown
+
+/*
+ * the KDF has no entry point of its own; adding a stream runs it for the
+ * six session keys and removing the stream frees them again
+ */
+static srtp_err_status_t kdf_setup(bench_t *b)
+{
+    srtp_err_status_t status = session_setup(b, 0);
+
+    b->policy.ssrc.value = 0x20000000;
+    return status;
+}
+
+static void kdf_run(bench_t *b, size_t iterations)
+{
+    for (size_t i = 0; i < iterations; i++) {
+        srtp_stream_add(b->u.session, &b->policy);
+        srtp_stream_remove(b->u.session, 0x20000000);
+    }
+}
+
+static void protect_run(bench_t *b, size_t iterations);
+
+/*
+ * srtp_protect() of a packet of b->bytes octets with a header extension,
+ * which is encrypted if b->id is set
+ */
+static srtp_err_status_t protect_setup(bench_t *b)
+{
+    srtp_err_status_t status;
+    uint8_t *hdr;
+
+    memset(&b->policy, 0, sizeof(b->policy));
+    srtp_crypto_policy_set_rtp_default(&b->policy.rtp);
+    srtp_crypto_policy_set_rtcp_default(&b->policy.rtcp);
+    b->policy.ssrc.type = ssrc_specific;
+    b->policy.ssrc.value = 0xcafebabe;
+    b->policy.key = bench_key;
+    b->policy.window_size = 128;
+    if (b->id) {
+        b->policy.enc_xtn_hdr = bench_xtn_hdr_ids;
+        b->policy.enc_xtn_hdr_count = sizeof(bench_xtn_hdr_ids);
+    }
+
+    status = srtp_create(&b->u.session, &b->policy);
+    if (status) {
+        return status;
+    }
+    if (bench_alloc_buffer(b, 2 * (BENCH_MAX_LEN + SRTP_MAX_TRAILER_LEN)) ==
+        NULL) {
+        srtp_dealloc(b->u.session);
+        return srtp_err_status_alloc_fail;
+    }
+
+    /* RTP header with a one-byte header extension holding ids 1 and 2 */
+    hdr = b->buf;
+    memset(hdr, 0, 12 + BENCH_XTN_HDR_LEN);
+    hdr[0] = 0x90; /* version 2, X bit */
+    hdr[1] = 96;
+    hdr[8] = 0xca;
+    hdr[9] = 0xfe;
+    hdr[10] = 0xba;
+    hdr[11] = 0xbe;
+    hdr[12] = 0xbe; /* 0xbede profile, 2 words of elements */
+    hdr[13] = 0xde;
+    hdr[15] = 2;
+    hdr[16] = 0x13; /* id 1, 4 octets */
+    hdr[21] = 0x21; /* id 2, 2 octets */
+
+    /* make sure that the packet is accepted before timing it */
+    b->counter = 0;
+    protect_run(b, 1);
+    b->variant = crypto_library();
+    return b->status;
+}
+
+static void protect_run(bench_t *b, size_t iterations)
+{
+    uint8_t *out = b->buf + BENCH_MAX_LEN + SRTP_MAX_TRAILER_LEN;
+    size_t out_len;
+
+    for (size_t i = 0; i < iterations; i++) {
+        b->buf[2] = (uint8_t)(b->counter >> 8);
+        b->buf[3] = (uint8_t)b->counter;
+        b->counter++;
+        out_len = BENCH_MAX_LEN + SRTP_MAX_TRAILER_LEN;
+        b->status =
+            srtp_protect(b->u.session, b->buf, b->bytes, out, &out_len, 0);
+    }
+}
+
+#define BENCH(bench_name, bench_bytes, kind, bench_id, bench_key_len)          \
+    {                                                                          \
+        .name = bench_name, .bytes = bench_bytes, .setup = kind##_setup,       \
+        .run = kind##_run, .teardown = kind##_teardown, .id = bench_id,        \
+        .key_len = bench_key_len                                               \
+    }
+
+static bench_t benches[] = {
+    BENCH("aes_block/128", 16, aes_block, 0, 16),
+    BENCH("aes_block/256", 16, aes_block, 0, 32),
+    BENCH("cipher/null/1200", 1200, cipher, SRTP_NULL_CIPHER, 0),
+    BENCH("cipher/aes_icm_128/160", 160, cipher, SRTP_AES_ICM_128,
+          SRTP_AES_ICM_128_KEY_LEN_WSALT),
+    BENCH("cipher/aes_icm_128/1200", 1200, cipher, SRTP_AES_ICM_128,
+          SRTP_AES_ICM_128_KEY_LEN_WSALT),
+    BENCH("cipher/aes_icm_192/1200", 1200, cipher, SRTP_AES_ICM_192,
+          SRTP_AES_ICM_192_KEY_LEN_WSALT),
+    BENCH("cipher/aes_icm_256/160", 160, cipher, SRTP_AES_ICM_256,
+          SRTP_AES_ICM_256_KEY_LEN_WSALT),
+    BENCH("cipher/aes_icm_256/1200", 1200, cipher, SRTP_AES_ICM_256,
+          SRTP_AES_ICM_256_KEY_LEN_WSALT),
+    BENCH("cipher/aes_gcm_128/160", 160, cipher, SRTP_AES_GCM_128,
+          SRTP_AES_GCM_128_KEY_LEN_WSALT),
+    BENCH("cipher/aes_gcm_128/1200", 1200, cipher, SRTP_AES_GCM_128,
+          SRTP_AES_GCM_128_KEY_LEN_WSALT),
+    BENCH("cipher/aes_gcm_256/1200", 1200, cipher, SRTP_AES_GCM_256,
+          SRTP_AES_GCM_256_KEY_LEN_WSALT),
+    BENCH("ghash/aes_gcm_128/1200", 1200, ghash, SRTP_AES_GCM_128,
+          SRTP_AES_GCM_128_KEY_LEN_WSALT),
+    BENCH("auth/null/1200", 1200, auth, SRTP_NULL_AUTH, 0),
+    BENCH("auth/hmac_sha1/160", 160, auth, SRTP_HMAC_SHA1, 20),
+    BENCH("auth/hmac_sha1/1200", 1200, auth, SRTP_HMAC_SHA1, 20),
+#ifdef BENCH_NATIVE_CRYPTO
+    BENCH("sha1/1200", 1200, sha1, 0, 0),
+#endif
+    BENCH("rdbx/128", 0, rdbx, 128, 0),
+    BENCH("rdbx/1024", 0, rdbx, 1024, 0),
+    BENCH("rdb", 0, rdb, 0, 0),
+    BENCH("stream_lookup/1", 0, lookup, 1, 0),
+    BENCH("stream_lookup/16", 0, lookup, 16, 0),
+    BENCH("stream_lookup/256", 0, lookup, 256, 0),
+    BENCH("stream_lookup/4096", 0, lookup, 4096, 0),
+    BENCH("kdf/stream_add_remove", 0, kdf, 0, 0),
+    BENCH("protect/xtn_hdr_clear/184", 12 + BENCH_XTN_HDR_LEN + 160, protect,
+          0, 0),
+    BENCH("protect/xtn_hdr_encrypted/184", 12 + BENCH_XTN_HDR_LEN + 160,
+          protect, 1, 0),
+};
+
+#define NUM_BENCHES (sizeof(benches) / sizeof(benches[0]))
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec;
+}
+
+static double bench_sqrt(double x)
+{
+    double r = x > 1 ? x : 1;
+
+    if (x <= 0) {
+        return 0;
+    }
+    for (int i = 0; i < 64; i++) {
+        r = (r + x / r) / 2;
+    }
+    return r;
+}
+
+/* two-sided 95% quantiles of Student's t distribution */
+static double student_t95(size_t df)
+{
+    static const double t[] = { 12.706, 4.303, 3.182, 2.776, 2.571, 2.447,
+                                2.365,  2.306, 2.262, 2.228, 2.201, 2.179,
+                                2.160,  2.145, 2.131, 2.120, 2.110, 2.101,
+                                2.093,  2.086, 2.080, 2.074, 2.069, 2.064,
+                                2.060,  2.056, 2.052, 2.048, 2.045, 2.042 };
+
+    if (df == 0) {
+        return 0;
+    }
+    if (df <= sizeof(t) / sizeof(t[0])) {
+        return t[df - 1];
+    }
+    return 1.960;
+}
+
+static void bench_measure(bench_t *b,
+                          size_t runs,
+                          double min_run_ns,
+                          bench_result_t *r)
+{
+    double samples[BENCH_MAX_RUNS];
+    double start, elapsed, sum = 0, var = 0;
+    size_t iterations = 1;
+
+    /* calibrate (and warm up) */
+    for (;;) {
+        start = now_ns();
+        b->run(b, iterations);
+        elapsed = now_ns() - start;
+        if (elapsed >= min_run_ns || iterations >= ((size_t)1 << 40)) {
+            break;
+        }
+        iterations *= 2;
+    }
+
+    r->min_ns = 0;
+    for (size_t i = 0; i < runs; i++) {
+        start = now_ns();
+        b->run(b, iterations);
+        samples[i] = (now_ns() - start) / (double)iterations;
+        sum += samples[i];
+        if (i == 0 || samples[i] < r->min_ns) {
+            r->min_ns = samples[i];
+        }
+    }
+    r->iterations = iterations;
+    r->runs = runs;
+    r->mean_ns = sum / (double)runs;
+    for (size_t i = 0; i < runs; i++) {
+        var += (samples[i] - r->mean_ns) * (samples[i] - r->mean_ns);
+    }
+    if (runs > 1) {
+        var /= (double)(runs - 1);
+    }
+    r->ci95_ns = student_t95(runs - 1) * bench_sqrt(var / (double)runs);
+}
+
+/* reads a single line sysfs value, returns false if it is not there */
+static bool read_sysfs(const char *path, char *buf, size_t len)
+{
+    FILE *f = fopen(path, "r");
+    bool ok;
+
+    if (f == NULL) {
+        return false;
+    }
+    ok = fgets(buf, (int)len, f) != NULL;
+    fclose(f);
+    if (ok) {
+        buf[strcspn(buf, "\n")] = '\0';
+    }
+    return ok;
+}
+
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') {
+            putchar('\\');
+        }
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+static void usage(char *prog_name)
+{
+    printf("usage: %s [ -j ] [ -l ] [ -b name ] [ -r runs ] [ -t ms ] "
+           "[ -f ghz ]\n"
+           "  -j       print the results as JSON\n"
+           "  -l       list the benchmarks that are compiled in\n"
+           "  -b name  only run benchmarks whose name starts with name\n"
+           "  -r runs  number of timed runs per benchmark (default 10, "
+           "max %d)\n"
+           "  -t ms    minimum duration of a run (default 20)\n"
+           "  -f ghz   CPU frequency for cycles, default from sysfs\n"
+           "For stable numbers pin the process to one core (taskset -c 2), "
+           "set the\n"
+           "performance governor (cpupower frequency-set -g performance) "
+           "and disable\n"
+           "turbo, then pass the fixed frequency with -f.\n",
+           prog_name, BENCH_MAX_RUNS);
+    exit(255);
+}
+
+int main(int argc, char *argv[])
+{
+    bench_result_t r;
+    srtp_err_status_t status;
+    char governor[64] = "";
+    char freq[64];
+    const char *filter = NULL;
+    double ghz = 0;
+    double min_run_ms = 20;
+    size_t runs = 10;
+    bool json = false;
+    bool list = false;
+    bool first = true;
+    int q;
+
+    while (1) {
+        q = getopt_s(argc, argv, "jlb:r:t:f:");
+        if (q == -1) {
+            break;
+        }
+        switch (q) {
+        case 'j':
+            json = true;
+            break;
+        case 'l':
+            list = true;
+            break;
+        case 'b':
+            filter = optarg_s;
+            break;
+        case 'r':
+            runs = (size_t)atoi(optarg_s);
+            if (runs < 2 || runs > BENCH_MAX_RUNS) {
+                usage(argv[0]);
+            }
+            break;
+        case 't':
+            min_run_ms = atof(optarg_s);
+            if (min_run_ms <= 0) {
+                usage(argv[0]);
+            }
+            break;
+        case 'f':
+            ghz = atof(optarg_s);
+            if (ghz <= 0) {
+                usage(argv[0]);
+            }
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (srtp_init() != srtp_err_status_ok) {
+        fprintf(stderr, "error: srtp init failed\n");
+        exit(1);
+    }
+
+    if (ghz == 0 &&
+        read_sysfs("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq",
+                   freq, sizeof(freq))) {
+        ghz = atof(freq) / 1e6;
+    }
+    read_sysfs("/sys/devices/system/cpu/cpu0/cpufreq/scaling_governor",
+               governor, sizeof(governor));
+    if (!list && strcmp(governor, "performance") != 0) {
+        fprintf(stderr, "hint: CPU frequency scaling is %s%s; pin the "
+                        "frequency and the core for stable results "
+                        "(see -h)\n",
+                governor[0] ? "governed by " : "unknown",
+                governor);
+    }
+
+    if (json) {
+        printf("{\n  \"version\": ");
+        print_json_string(srtp_get_version_string());
+        printf(",\n  \"crypto\": \"%s\",\n", crypto_library());
+        if (ghz > 0) {
+            printf("  \"cpu_ghz\": %.3f,\n", ghz);
+        } else {
+            printf("  \"cpu_ghz\": null,\n");
+        }
+        printf("  \"governor\": ");
+        print_json_string(governor);
+        printf(",\n  \"runs\": %zu,\n  \"min_run_ms\": %.1f,\n", runs,
+               min_run_ms);
+        printf("  \"results\": [");
+    } else if (!list) {
+        printf("%-30s %-38s %10s %8s %8s\n", "benchmark", "variant",
+               "ns/op", "+-95%", "cyc/B");
+    }
+
+    for (size_t i = 0; i < NUM_BENCHES; i++) {
+        bench_t *b = &benches[i];
+        double cycles;
+
+        if (filter && strncmp(b->name, filter, strlen(filter)) != 0) {
+            continue;
+        }
+        status = b->setup(b);
+        if (status == srtp_err_status_fail) {
+            /* the crypto kernel does not have this type compiled in */
+            continue;
+        }
+        if (status != srtp_err_status_ok) {
+            fprintf(stderr, "error: setup of %s failed with error code %d\n",
+                    b->name, status);
+            exit(1);
+        }
+        if (list) {
+            printf("%-30s %s\n", b->name, b->variant);
+            b->teardown(b);
+            continue;
+        }
+
+        b->counter = 0;
+        bench_measure(b, runs, min_run_ms * 1e6, &r);
+        b->teardown(b);
+
+        /* cycles per byte, or per operation for non-data benchmarks */
+        cycles = r.mean_ns * ghz / (double)(b->bytes ? b->bytes : 1);
+
+        if (json) {
+            printf("%s\n    { \"name\": ", first ? "" : ",");
+            print_json_string(b->name);
+            printf(", \"variant\": ");
+            print_json_string(b->variant);
+            printf(", \"bytes\": %zu, \"iterations\": %zu,\n"
+                   "      \"ns_per_op\": %.3f, \"ns_per_op_ci95\": %.3f, "
+                   "\"ns_per_op_min\": %.3f,\n",
+                   b->bytes, r.iterations, r.mean_ns, r.ci95_ns, r.min_ns);
+            if (ghz <= 0) {
+                printf("      \"%s\": null", b->bytes ? "cycles_per_byte"
+                                                       : "cycles_per_op");
+            } else {
+                printf("      \"%s\": %.3f",
+                       b->bytes ? "cycles_per_byte" : "cycles_per_op",
+                       cycles);
+            }
+            if (b->bytes) {
+                printf(", \"mb_per_s\": %.1f",
+                       (double)b->bytes * 1e3 / r.mean_ns);
+            }
+            printf(" }");
+        } else {
+            printf("%-30s %-38.38s %10.1f %8.2f ", b->name, b->variant,
+                   r.mean_ns, r.ci95_ns);
+            if (ghz > 0) {
+                printf("%8.2f%s\n", cycles, b->bytes ? "" : "/op");
+            } else {
+                printf("%8s\n", "-");
+            }
+        }
+        first = false;
+    }
+
+    if (json) {
+        printf("\n  ]\n}\n");
+    }
+
+    srtp_shutdown();
+
+    return 0;
+}
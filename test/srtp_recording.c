@@ -0,0 +1,406 @@
+/*
+ * srtp_recording.c
+ *
+ * unprotects a recording made with srtp_recording_append()
+ *
+ * This app seeks to a time range of a recording and unprotects the
+ * segments that cover it on several threads, printing the packets in the
+ * order they were recorded.  See the usage() function for more details.
+ *
+ */
+
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "getopt_s.h" /* for local getopt()  */
+
+#include <pthread.h> /* for pthread_create() */
+#include <stdarg.h>  /* for va_list          */
+#include <stdio.h>   /* for printf, fprintf  */
+#include <stdlib.h>  /* for malloc()         */
+#include <string.h>  /* for memset()         */
+#include <strings.h> /* for strcasecmp()     */
+
+#include "srtp_priv.h"
+#include "util.h"
+
+#define MAX_THREADS 64
+
+typedef struct {
+    const char *name;
+    srtp_profile_t profile;
+} recording_profile_t;
+
+static const recording_profile_t profiles[] = {
+    { "AES_CM_128_HMAC_SHA1_80", srtp_profile_aes128_cm_sha1_80 },
+    { "AES_CM_128_HMAC_SHA1_32", srtp_profile_aes128_cm_sha1_32 },
+    { "NULL_HMAC_SHA1_80", srtp_profile_null_sha1_80 },
+    { "NULL_HMAC_SHA1_32", srtp_profile_null_sha1_32 },
+    { "AEAD_AES_128_GCM", srtp_profile_aead_aes_128_gcm },
+    { "AEAD_AES_256_GCM", srtp_profile_aead_aes_256_gcm },
+    { NULL, srtp_profile_reserved },
+};
+
+/*
+ * the output of a segment, printed once the segments before it are
+ */
+typedef struct {
+    char *text;
+    size_t len;
+    size_t max;
+    uint64_t packets;
+    uint64_t failures;
+    srtp_err_status_t status;
+    bool done;
+} segment_output_t;
+
+typedef struct {
+    size_t thread;
+} worker_t;
+
+static srtp_recording_reader_t *reader;
+static srtp_policy_t policy;
+static uint64_t start_us = 0;
+static uint64_t end_us = UINT64_MAX;
+static size_t first_segment;
+static size_t num_segments;
+static size_t num_threads = 1;
+static bool info_only = false;
+static segment_output_t *outputs;
+static pthread_mutex_t outputs_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t outputs_cond = PTHREAD_COND_INITIALIZER;
+
+void usage(char *prog_name);
+
+static void output_printf(segment_output_t *output, const char *format, ...)
+{
+    va_list args;
+    int len;
+
+    va_start(args, format);
+    len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+    if (len < 0) {
+        return;
+    }
+
+    if (output->len + (size_t)len + 1 > output->max) {
+        size_t max = output->max ? output->max : 4096;
+        char *text;
+
+        while (output->len + (size_t)len + 1 > max) {
+            max *= 2;
+        }
+        text = (char *)realloc(output->text, max);
+        if (text == NULL) {
+            return;
+        }
+        output->text = text;
+        output->max = max;
+    }
+
+    va_start(args, format);
+    vsnprintf(output->text + output->len, output->max - output->len, format,
+              args);
+    va_end(args);
+    output->len += (size_t)len;
+}
+
+static void print_packet(void *user_data, const srtp_recording_packet_t *p)
+{
+    segment_output_t *output = (segment_output_t *)user_data;
+    uint32_t ssrc = 0;
+    uint16_t seq = 0;
+
+    if (p->is_rtcp && p->len >= sizeof(srtcp_hdr_t)) {
+        ssrc = ntohl(((const srtcp_hdr_t *)p->data)->ssrc);
+    } else if (!p->is_rtcp && p->len >= sizeof(srtp_hdr_t)) {
+        ssrc = ntohl(((const srtp_hdr_t *)p->data)->ssrc);
+        seq = ntohs(((const srtp_hdr_t *)p->data)->seq);
+    }
+
+    output->packets++;
+    if (p->status) {
+        output->failures++;
+    }
+
+    output_printf(output,
+                  "%" PRIu64 "\t%" PRIu64 ".%06" PRIu64 "\t%s\t0x%08x\t%u\t%zu"
+                  "\t%s\n",
+                  p->number, p->time_us / 1000000, p->time_us % 1000000,
+                  p->is_rtcp ? "rtcp" : "rtp", (unsigned int)ssrc,
+                  (unsigned int)seq, p->len, err_status_string(p->status));
+}
+
+/*
+ * worker thread t unprotects the segments first_segment + i with
+ * i % num_threads == t, every one on its own session
+ */
+static void *worker(void *arg)
+{
+    const worker_t *w = (const worker_t *)arg;
+
+    for (size_t i = w->thread; i < num_segments; i += num_threads) {
+        segment_output_t *output = &outputs[i];
+        srtp_err_status_t status;
+
+        status = srtp_recording_decrypt(reader, &policy, first_segment + i,
+                                        start_us, end_us, print_packet,
+                                        output);
+
+        pthread_mutex_lock(&outputs_mutex);
+        output->status = status;
+        output->done = true;
+        pthread_cond_broadcast(&outputs_cond);
+        pthread_mutex_unlock(&outputs_mutex);
+    }
+
+    return NULL;
+}
+
+static void print_info(void)
+{
+    size_t count = srtp_recording_get_segment_count(reader);
+    uint64_t time_us;
+    uint64_t first_packet;
+
+    printf("%zu segments\n", count);
+    printf("segment\tfirst packet\ttime\n");
+    for (size_t i = 0; i < count; i++) {
+        srtp_recording_get_segment(reader, i, &time_us, &first_packet);
+        printf("%zu\t%" PRIu64 "\t%" PRIu64 ".%06" PRIu64 "\n", i,
+               first_packet, time_us / 1000000, time_us % 1000000);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    const recording_profile_t *profile = &profiles[0];
+    const char *path = NULL;
+    const char *input_key = NULL;
+    uint8_t key[SRTP_MAX_KEY_LEN];
+    size_t key_len;
+    pthread_t threads[MAX_THREADS];
+    worker_t workers[MAX_THREADS];
+    size_t last_segment;
+    uint64_t packets = 0;
+    uint64_t failures = 0;
+    srtp_err_status_t status;
+    int exit_code = 0;
+    int c;
+
+    while (1) {
+        c = getopt_s(argc, argv, "k:c:f:b:e:j:i");
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case 'k':
+            input_key = optarg_s;
+            break;
+        case 'c':
+            for (profile = &profiles[0]; profile->name != NULL; profile++) {
+                if (strcasecmp(profile->name, optarg_s) == 0) {
+                    break;
+                }
+            }
+            if (profile->name == NULL) {
+                fprintf(stderr, "error: unknown crypto suite %s\n", optarg_s);
+                exit(1);
+            }
+            break;
+        case 'f':
+            path = optarg_s;
+            break;
+        case 'b':
+            start_us = strtoull(optarg_s, NULL, 0) * 1000;
+            break;
+        case 'e':
+            end_us = strtoull(optarg_s, NULL, 0) * 1000;
+            break;
+        case 'j':
+            num_threads = (size_t)atoi(optarg_s);
+            if (num_threads < 1 || num_threads > MAX_THREADS) {
+                fprintf(stderr, "error: threads must be 1 to %d\n",
+                        MAX_THREADS);
+                exit(1);
+            }
+            break;
+        case 'i':
+            info_only = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (path == NULL || (input_key == NULL && !info_only) ||
+        start_us >= end_us) {
+        usage(argv[0]);
+    }
+
+    status = srtp_init();
+    if (status) {
+        fprintf(stderr,
+                "error: srtp initialization failed with error code %d\n",
+                status);
+        exit(1);
+    }
+
+    status = srtp_recording_open(&reader, path);
+    if (status) {
+        fprintf(stderr, "error: can not read recording %s (%s)\n", path,
+                err_status_string(status));
+        exit(1);
+    }
+
+    if (info_only) {
+        print_info();
+        srtp_recording_reader_close(reader);
+        srtp_shutdown();
+        return 0;
+    }
+
+    key_len = srtp_profile_get_master_key_length(profile->profile) +
+              srtp_profile_get_master_salt_length(profile->profile);
+    if (strlen(input_key) != 2 * key_len ||
+        hex_string_to_octet_string(key, input_key, 2 * key_len) !=
+            2 * key_len) {
+        fprintf(stderr,
+                "error: the key and salt of %s are %zu hexadecimal digits\n",
+                profile->name, 2 * key_len);
+        exit(1);
+    }
+
+    memset(&policy, 0, sizeof(policy));
+    if (srtp_crypto_policy_set_from_profile_for_rtp(&policy.rtp,
+                                                    profile->profile) ||
+        srtp_crypto_policy_set_from_profile_for_rtcp(&policy.rtcp,
+                                                     profile->profile)) {
+        fprintf(stderr, "error: %s is not supported by this build\n",
+                profile->name);
+        exit(1);
+    }
+    policy.ssrc.type = ssrc_any_inbound;
+    policy.key = key;
+    policy.window_size = 1024;
+
+    if (srtp_recording_get_segment_count(reader) == 0) {
+        srtp_recording_reader_close(reader);
+        srtp_shutdown();
+        return 0;
+    }
+    srtp_recording_seek(reader, start_us, &first_segment);
+    srtp_recording_seek(reader, end_us, &last_segment);
+    num_segments = last_segment - first_segment + 1;
+    if (num_threads > num_segments) {
+        num_threads = num_segments;
+    }
+
+    outputs = (segment_output_t *)calloc(num_segments, sizeof(*outputs));
+    if (outputs == NULL) {
+        fprintf(stderr, "error: out of memory\n");
+        exit(1);
+    }
+
+    for (size_t t = 0; t < num_threads; t++) {
+        workers[t].thread = t;
+        if (pthread_create(&threads[t], NULL, worker, &workers[t]) != 0) {
+            fprintf(stderr, "error: can not create thread %zu\n", t);
+            exit(1);
+        }
+    }
+
+    /* print the segments in order, as soon as each one is done */
+    printf("packet\ttime\ttype\tssrc\tseq\tlength\tstatus\n");
+    for (size_t i = 0; i < num_segments; i++) {
+        pthread_mutex_lock(&outputs_mutex);
+        while (!outputs[i].done) {
+            pthread_cond_wait(&outputs_cond, &outputs_mutex);
+        }
+        pthread_mutex_unlock(&outputs_mutex);
+
+        if (outputs[i].len) {
+            fwrite(outputs[i].text, 1, outputs[i].len, stdout);
+        }
+        free(outputs[i].text);
+        packets += outputs[i].packets;
+        failures += outputs[i].failures;
+        if (outputs[i].status) {
+            fprintf(stderr, "error: segment %zu failed (%s)\n",
+                    first_segment + i, err_status_string(outputs[i].status));
+            exit_code = 1;
+        }
+    }
+
+    for (size_t t = 0; t < num_threads; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(outputs);
+    srtp_recording_reader_close(reader);
+
+    fprintf(stderr, "%" PRIu64 " packets, %" PRIu64 " failed to unprotect\n",
+            packets, failures);
+
+    status = srtp_shutdown();
+    if (status) {
+        fprintf(stderr, "error: srtp shutdown failed with error code %d\n",
+                status);
+        exit(1);
+    }
+
+    return exit_code;
+}
+
+void usage(char *string)
+{
+    printf("usage: %s -f recording [-k key] [-c suite] [-b ms] [-e ms] "
+           "[-j threads] [-i]\n"
+           "where  -f is the recording to read\n"
+           "       -k is the master key and salt in hexadecimal\n"
+           "       -c is the crypto suite, AES_CM_128_HMAC_SHA1_80 by "
+           "default\n"
+           "       -b is the start of the time range in milliseconds\n"
+           "       -e is the end of the time range in milliseconds\n"
+           "       -j is the number of threads unprotecting segments\n"
+           "       -i prints the segments of the recording only\n",
+           string);
+    exit(1);
+}
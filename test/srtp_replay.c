@@ -0,0 +1,624 @@
+/*
+ * srtp_replay.c
+ *
+ * replays a trace recorded with srtp_trace_start()
+ *
+ * This app re-drives libsrtp with the calls of a trace, using synthetic
+ * keys and payloads of the recorded sizes, and compares the time the
+ * calls take with the recorded durations.  See the usage() function for
+ * more details.
+ *
+ */
+
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "getopt_s.h" /* for local getopt()  */
+
+#include <stdio.h>  /* for printf, fprintf */
+#include <stdlib.h> /* for malloc()        */
+#include <string.h> /* for memset()        */
+#include <time.h>   /* for clock_gettime() */
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h> /* for usleep()        */
+#endif
+
+#include "srtp_priv.h"
+#include "trace_priv.h"
+
+#define MAX_PACKET_LEN 65536
+#define MAX_MASTER_KEYS 16
+
+/*
+ * a replayed session, shadow is a session with the same policies that
+ * creates the packets passed to srtp_unprotect() and srtp_unprotect_rtcp()
+ */
+typedef struct {
+    uint64_t handle;
+    srtp_t session;
+    srtp_t shadow;
+} replay_session_t;
+
+typedef struct {
+    const char *name;
+    uint64_t count;
+    uint64_t recorded_ns;
+    uint64_t replayed_ns;
+    uint64_t mismatches;
+} replay_stats_t;
+
+static replay_stats_t stats[] = {
+    { "", 0, 0, 0, 0 },
+    { "srtp_create", 0, 0, 0, 0 },
+    { "srtp_dealloc", 0, 0, 0, 0 },
+    { "srtp_stream_add", 0, 0, 0, 0 },
+    { "srtp_stream_update", 0, 0, 0, 0 },
+    { "srtp_stream_remove", 0, 0, 0, 0 },
+    { "srtp_protect", 0, 0, 0, 0 },
+    { "srtp_unprotect", 0, 0, 0, 0 },
+    { "srtp_protect_rtcp", 0, 0, 0, 0 },
+    { "srtp_unprotect_rtcp", 0, 0, 0, 0 },
+};
+
+#define NUM_OPS (sizeof(stats) / sizeof(stats[0]))
+
+static replay_session_t *sessions = NULL;
+static size_t num_sessions = 0;
+static uint8_t master_key[SRTP_MAX_KEY_LEN];
+static uint8_t packet[MAX_PACKET_LEN + SRTP_MAX_TRAILER_LEN];
+static uint8_t output[MAX_PACKET_LEN + SRTP_MAX_TRAILER_LEN];
+
+void usage(char *prog_name);
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static uint16_t get16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static uint32_t get32(const uint8_t *p)
+{
+    return ((uint32_t)get16(p) << 16) | get16(p + 2);
+}
+
+static uint64_t get64(const uint8_t *p)
+{
+    return ((uint64_t)get32(p) << 32) | get32(p + 4);
+}
+
+static replay_session_t *find_session(uint64_t handle)
+{
+    for (size_t i = 0; i < num_sessions; i++) {
+        if (sessions[i].handle == handle) {
+            return &sessions[i];
+        }
+    }
+    return NULL;
+}
+
+static const uint8_t *get_crypto_policy(const uint8_t *p,
+                                        srtp_crypto_policy_t *cp)
+{
+    cp->cipher_type = get32(p);
+    cp->cipher_key_len = get16(p + 4);
+    cp->auth_type = get32(p + 6);
+    cp->auth_key_len = get16(p + 10);
+    cp->auth_tag_len = get16(p + 12);
+    cp->sec_serv = (srtp_sec_serv_t)p[14];
+    return p + 15;
+}
+
+/*
+ * get_policy() sets policy from a policy record body, using the synthetic
+ * master key and MKIs built from the key index
+ */
+static int get_policy(const uint8_t *body,
+                      size_t body_len,
+                      srtp_policy_t *policy,
+                      srtp_master_key_t *keys,
+                      srtp_master_key_t **key_ptrs,
+                      uint8_t *mki_ids,
+                      uint8_t *xtn_ids)
+{
+    const uint8_t *p = body;
+    size_t count;
+
+    if (body_len < SRTP_TRACE_POLICY_MIN_LEN) {
+        return 1;
+    }
+
+    memset(policy, 0, sizeof(*policy));
+    policy->ssrc.type = (srtp_ssrc_type_t)p[0];
+    policy->ssrc.value = get32(p + 1);
+    p = get_crypto_policy(p + 5, &policy->rtp);
+    p = get_crypto_policy(p, &policy->rtcp);
+    policy->num_master_keys = p[0];
+    policy->use_mki = p[1] != 0;
+    policy->mki_size = p[2];
+    policy->window_size = get32(p + 3);
+    policy->allow_repeat_tx = p[7] != 0;
+    policy->tx_cache_size = get32(p + 8);
+    policy->tx_cache_max_packet_len = get32(p + 12);
+    count = p[16];
+    p += 17;
+
+    if (body_len < SRTP_TRACE_POLICY_MIN_LEN + count ||
+        policy->num_master_keys > MAX_MASTER_KEYS ||
+        policy->mki_size > SRTP_MAX_MKI_LEN) {
+        return 1;
+    }
+
+    if (count > 0) {
+        memcpy(xtn_ids, p, count);
+        policy->enc_xtn_hdr = xtn_ids;
+        policy->enc_xtn_hdr_count = count;
+    }
+
+    if (policy->num_master_keys > 0) {
+        for (size_t i = 0; i < policy->num_master_keys; i++) {
+            memset(mki_ids + i * SRTP_MAX_MKI_LEN, (int)i, SRTP_MAX_MKI_LEN);
+            keys[i].key = master_key;
+            keys[i].mki_id = mki_ids + i * SRTP_MAX_MKI_LEN;
+            key_ptrs[i] = &keys[i];
+        }
+        policy->keys = key_ptrs;
+    } else {
+        policy->key = master_key;
+    }
+
+    return 0;
+}
+
+/*
+ * build_rtp() writes an RTP packet of len octets with the recorded header
+ * to packet and returns 0, or 1 if the header does not fit
+ */
+static int build_rtp(const uint8_t *body, size_t len)
+{
+    srtp_hdr_t *hdr = (srtp_hdr_t *)packet;
+    uint8_t cc = body[6];
+    uint8_t x = body[7];
+    size_t xtn_len = get16(body + 8);
+    size_t hdr_len = sizeof(srtp_hdr_t) + 4 * (size_t)cc;
+
+    if (!x) {
+        xtn_len = 0;
+    } else if (xtn_len < 4) {
+        xtn_len = 4;
+    }
+    if (cc > 15 || len < hdr_len + xtn_len || len > MAX_PACKET_LEN) {
+        return 1;
+    }
+
+    memset(packet, 0xab, len);
+    hdr->version = 2;
+    hdr->p = 0;
+    hdr->x = x;
+    hdr->cc = cc;
+    hdr->m = 0;
+    hdr->pt = 0x1;
+    hdr->seq = htons(get16(body + 4));
+    hdr->ts = 0;
+    hdr->ssrc = htonl(get32(body));
+    if (x) {
+        srtp_hdr_xtnd_t *xtn = (srtp_hdr_xtnd_t *)(packet + hdr_len);
+        xtn->profile_specific = htons(0xbede);
+        xtn->length = htons((uint16_t)(xtn_len / 4 - 1));
+        memset(packet + hdr_len + 4, 0, xtn_len - 4);
+    }
+
+    return 0;
+}
+
+/*
+ * build_rtcp() writes an RTCP sender report of len octets to packet
+ */
+static int build_rtcp(const uint8_t *body, size_t len)
+{
+    srtcp_hdr_t *hdr = (srtcp_hdr_t *)packet;
+
+    if (len < sizeof(srtcp_hdr_t) || len > MAX_PACKET_LEN) {
+        return 1;
+    }
+
+    memset(packet, 0xab, len);
+    hdr->version = 2;
+    hdr->p = 0;
+    hdr->rc = 0;
+    hdr->pt = 0xc8;
+    hdr->len = htons((uint16_t)(len / 4 - 1));
+    hdr->ssrc = htonl(get32(body));
+
+    return 0;
+}
+
+/*
+ * replay_packet() repeats a protect or unprotect call and returns its
+ * status in *status and its duration in ns, or 0 with *status set to
+ * srtp_err_status_fail if the call could not be rebuilt
+ */
+static uint64_t replay_packet(srtp_trace_op_t op,
+                              const replay_session_t *rs,
+                              srtp_err_status_t recorded,
+                              const uint8_t *body,
+                              size_t body_len,
+                              srtp_err_status_t *status)
+{
+    bool rtcp = op == SRTP_TRACE_PROTECT_RTCP || op == SRTP_TRACE_UNPROTECT_RTCP;
+    size_t in_len;
+    size_t out_len;
+    size_t mki_index;
+    size_t trailer_len;
+    size_t len;
+    uint64_t start;
+
+    *status = srtp_err_status_fail;
+    if (body_len < SRTP_TRACE_PACKET_LEN) {
+        return 0;
+    }
+    in_len = get32(body + 10);
+    out_len = get32(body + 14);
+    mki_index = get32(body + 18);
+
+    if (op == SRTP_TRACE_PROTECT || op == SRTP_TRACE_PROTECT_RTCP) {
+        if ((rtcp ? build_rtcp(body, in_len) : build_rtp(body, in_len))) {
+            return 0;
+        }
+        len = sizeof(output);
+        start = now_ns();
+        if (rtcp) {
+            *status = srtp_protect_rtcp(rs->session, packet, in_len, output,
+                                        &len, mki_index);
+        } else {
+            *status = srtp_protect(rs->session, packet, in_len, output, &len,
+                                   mki_index);
+        }
+        return now_ns() - start;
+    }
+
+    /* rebuild the protected packet with the shadow session */
+    if (recorded == srtp_err_status_ok) {
+        len = out_len;
+    } else {
+        if (rtcp) {
+            srtp_get_protect_rtcp_trailer_length(rs->shadow, 0, &trailer_len);
+        } else {
+            srtp_get_protect_trailer_length(rs->shadow, 0, &trailer_len);
+        }
+        if (in_len < trailer_len) {
+            return 0;
+        }
+        len = in_len - trailer_len;
+    }
+    if ((rtcp ? build_rtcp(body, len) : build_rtp(body, len))) {
+        return 0;
+    }
+    in_len = sizeof(output);
+    if (rtcp) {
+        *status =
+            srtp_protect_rtcp(rs->shadow, packet, len, output, &in_len, 0);
+    } else {
+        *status = srtp_protect(rs->shadow, packet, len, output, &in_len, 0);
+    }
+    if (*status) {
+        return 0;
+    }
+
+    /* calls that failed authentication fail again */
+    if (recorded == srtp_err_status_auth_fail) {
+        output[in_len - 1] ^= 0x01;
+    }
+
+    len = sizeof(packet);
+    start = now_ns();
+    if (rtcp) {
+        *status = srtp_unprotect_rtcp(rs->session, output, in_len, packet, &len);
+    } else {
+        *status = srtp_unprotect(rs->session, output, in_len, packet, &len);
+    }
+    return now_ns() - start;
+}
+
+/*
+ * replay_policy() adds or updates a stream of the session and the shadow
+ * session, the shadow session sends what the session receives
+ */
+static uint64_t replay_policy(srtp_trace_op_t op,
+                              replay_session_t *rs,
+                              const uint8_t *body,
+                              size_t body_len,
+                              srtp_err_status_t *status)
+{
+    srtp_policy_t policy;
+    srtp_master_key_t keys[MAX_MASTER_KEYS];
+    srtp_master_key_t *key_ptrs[MAX_MASTER_KEYS];
+    uint8_t mki_ids[MAX_MASTER_KEYS * SRTP_MAX_MKI_LEN];
+    uint8_t xtn_ids[255];
+    uint64_t start;
+    uint64_t duration;
+
+    *status = srtp_err_status_fail;
+    if (get_policy(body, body_len, &policy, keys, key_ptrs, mki_ids,
+                   xtn_ids)) {
+        return 0;
+    }
+
+    start = now_ns();
+    if (op == SRTP_TRACE_STREAM_ADD) {
+        *status = srtp_stream_add(rs->session, &policy);
+    } else {
+        *status = srtp_stream_update(rs->session, &policy);
+    }
+    duration = now_ns() - start;
+
+    if (policy.ssrc.type == ssrc_any_inbound) {
+        policy.ssrc.type = ssrc_any_outbound;
+    } else if (policy.ssrc.type == ssrc_any_outbound) {
+        policy.ssrc.type = ssrc_any_inbound;
+    }
+    policy.allow_repeat_tx = true;
+    policy.tx_cache_size = 0;
+    if (op == SRTP_TRACE_STREAM_ADD) {
+        srtp_stream_add(rs->shadow, &policy);
+    } else {
+        srtp_stream_update(rs->shadow, &policy);
+    }
+
+    return duration;
+}
+
+static uint64_t replay_record(srtp_trace_op_t op,
+                              uint64_t handle,
+                              srtp_err_status_t recorded,
+                              const uint8_t *body,
+                              size_t body_len,
+                              srtp_err_status_t *status)
+{
+    replay_session_t *rs;
+    replay_session_t *grown;
+    uint64_t start;
+    uint64_t duration;
+
+    *status = srtp_err_status_fail;
+
+    if (op == SRTP_TRACE_CREATE) {
+        grown = (replay_session_t *)realloc(
+            sessions, (num_sessions + 1) * sizeof(replay_session_t));
+        if (grown == NULL) {
+            return 0;
+        }
+        sessions = grown;
+        rs = &sessions[num_sessions];
+        rs->handle = handle;
+        start = now_ns();
+        *status = srtp_create(&rs->session, NULL);
+        duration = now_ns() - start;
+        if (*status == srtp_err_status_ok) {
+            if (srtp_create(&rs->shadow, NULL) == srtp_err_status_ok) {
+                num_sessions++;
+            } else {
+                srtp_dealloc(rs->session);
+            }
+        }
+        return duration;
+    }
+
+    rs = find_session(handle);
+    if (rs == NULL) {
+        return 0;
+    }
+
+    switch (op) {
+    case SRTP_TRACE_DEALLOC:
+        srtp_dealloc(rs->shadow);
+        start = now_ns();
+        *status = srtp_dealloc(rs->session);
+        duration = now_ns() - start;
+        *rs = sessions[--num_sessions];
+        return duration;
+    case SRTP_TRACE_STREAM_ADD:
+    case SRTP_TRACE_STREAM_UPDATE:
+        return replay_policy(op, rs, body, body_len, status);
+    case SRTP_TRACE_STREAM_REMOVE:
+        if (body_len < 4) {
+            return 0;
+        }
+        srtp_stream_remove(rs->shadow, get32(body));
+        start = now_ns();
+        *status = srtp_stream_remove(rs->session, get32(body));
+        return now_ns() - start;
+    case SRTP_TRACE_PROTECT:
+    case SRTP_TRACE_UNPROTECT:
+    case SRTP_TRACE_PROTECT_RTCP:
+    case SRTP_TRACE_UNPROTECT_RTCP:
+        return replay_packet(op, rs, recorded, body, body_len, status);
+    default:
+        return 0;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    FILE *trace;
+    uint8_t header[SRTP_TRACE_HEADER_LEN];
+    uint8_t body[UINT16_MAX];
+    uint8_t magic[SRTP_TRACE_MAGIC_LEN + 4];
+    bool realtime = false;
+    bool verbose = false;
+    uint64_t replay_start;
+    uint64_t records = 0;
+    srtp_err_status_t status;
+    int c;
+
+    while (1) {
+        c = getopt_s(argc, argv, "tv");
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case 't':
+            realtime = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (optind_s != argc - 1) {
+        usage(argv[0]);
+    }
+
+    trace = fopen(argv[optind_s], "rb");
+    if (trace == NULL) {
+        fprintf(stderr, "error: can not open %s\n", argv[optind_s]);
+        exit(1);
+    }
+
+    if (fread(magic, 1, sizeof(magic), trace) != sizeof(magic) ||
+        memcmp(magic, SRTP_TRACE_MAGIC, SRTP_TRACE_MAGIC_LEN) != 0 ||
+        get32(magic + SRTP_TRACE_MAGIC_LEN) != SRTP_TRACE_VERSION) {
+        fprintf(stderr, "error: %s is not a trace\n", argv[optind_s]);
+        exit(1);
+    }
+
+    status = srtp_init();
+    if (status) {
+        printf("error: srtp initialization failed with error code %d\n",
+               status);
+        exit(1);
+    }
+
+    for (size_t i = 0; i < sizeof(master_key); i++) {
+        master_key[i] = (uint8_t)i;
+    }
+
+    replay_start = now_ns();
+    while (fread(header, 1, sizeof(header), trace) == sizeof(header)) {
+        srtp_trace_op_t op = (srtp_trace_op_t)header[0];
+        srtp_err_status_t recorded = (srtp_err_status_t)header[1];
+        size_t body_len = get16(header + 2);
+        uint64_t handle = get64(header + 4);
+        uint64_t start = get64(header + 12);
+        uint32_t duration = get32(header + 20);
+        uint64_t replayed;
+
+        if (fread(body, 1, body_len, trace) != body_len) {
+            fprintf(stderr, "error: truncated record %" PRIu64 "\n", records);
+            break;
+        }
+        records++;
+
+        if ((size_t)op >= NUM_OPS || op == 0) {
+            continue;
+        }
+
+        /* wait for the recorded start of the call */
+        if (realtime) {
+            uint64_t elapsed = now_ns() - replay_start;
+            if (elapsed < start) {
+                usleep((unsigned int)((start - elapsed) / 1000));
+            }
+        }
+
+        replayed = replay_record(op, handle, recorded, body, body_len, &status);
+
+        stats[op].count++;
+        stats[op].recorded_ns += duration;
+        stats[op].replayed_ns += replayed;
+        if (status != recorded) {
+            stats[op].mismatches++;
+        }
+
+        if (verbose) {
+            printf("%-20s recorded %u ns status %d, replayed %" PRIu64
+                   " ns status %d\n",
+                   stats[op].name, (unsigned int)duration, recorded, replayed,
+                   status);
+        }
+    }
+    fclose(trace);
+
+    while (num_sessions > 0) {
+        srtp_dealloc(sessions[num_sessions - 1].session);
+        srtp_dealloc(sessions[num_sessions - 1].shadow);
+        num_sessions--;
+    }
+    free(sessions);
+
+    printf("%-20s %10s %14s %14s %10s\n", "call", "count", "recorded ns",
+           "replayed ns", "mismatch");
+    for (size_t i = 1; i < NUM_OPS; i++) {
+        if (stats[i].count == 0) {
+            continue;
+        }
+        printf("%-20s %10" PRIu64 " %14" PRIu64 " %14" PRIu64 " %10" PRIu64
+               "\n",
+               stats[i].name, stats[i].count, stats[i].recorded_ns,
+               stats[i].replayed_ns, stats[i].mismatches);
+    }
+
+    status = srtp_shutdown();
+    if (status) {
+        printf("error: srtp shutdown failed with error code %d\n", status);
+        exit(1);
+    }
+
+    return 0;
+}
+
+void usage(char *string)
+{
+    printf("usage: %s [-t] [-v] trace\n"
+           "where  -t replays the calls at their recorded times\n"
+           "       -v prints every call\n",
+           string);
+    exit(1);
+}
@@ -0,0 +1,817 @@
+/*
+ * srtp_soak.c
+ *
+ * soak benchmark for libsrtp at production scale
+ *
+ * This app keeps a large number of streams spread over many sessions
+ * busy for a long time: streams join and leave, sessions are rekeyed with
+ * srtp_update() and roll over between their MKIs, sequence numbers wrap
+ * and the traffic is dropped, duplicated, reordered and corrupted.  It
+ * periodically reports throughput, latency percentiles, resident memory
+ * and the number of live libsrtp allocations, and flags leaks, memory
+ * growth and throughput decay.  See the usage() function for more
+ * details.
+ *
+ */
+
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "getopt_s.h" /* for local getopt()  */
+
+#include <stdio.h>  /* for printf, fprintf */
+#include <stdlib.h> /* for malloc()        */
+#include <string.h> /* for memset()        */
+#include <time.h>   /* for clock_gettime() */
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h> /* for sysconf()       */
+#endif
+#include <sys/resource.h> /* for getrusage() */
+
+#include "srtp_priv.h"
+
+#define SOAK_KEY_LEN SRTP_AES_ICM_128_KEY_LEN_WSALT
+#define SOAK_NUM_KEYS 2
+#define SOAK_MKI_LEN 4
+#define SOAK_WINDOW_SIZE 128
+#define SOAK_MAX_PAYLOAD 1200
+#define SOAK_MAX_PACKET_LEN (12 + SOAK_MAX_PAYLOAD + SRTP_MAX_TRAILER_LEN)
+#define SOAK_RTCP_LEN 28
+#define SOAK_LATENCY_BUCKETS 64
+
+/* impairments, in packets per thousand */
+#define SOAK_DROP 20
+#define SOAK_CORRUPT 5
+#define SOAK_DUPLICATE 10
+#define SOAK_REORDER 20
+
+/* events per second of the whole run */
+#define SOAK_CHURN_RATE 1000
+#define SOAK_REKEY_RATE 10
+#define SOAK_MKI_RATE 10
+
+/* thresholds for flagging a run */
+#define SOAK_DECAY_PERCENT 20
+#define SOAK_GROWTH_PERCENT 10
+
+typedef struct {
+    uint32_t ssrc;
+    uint16_t seq;
+    uint32_t ts;
+    bool established;
+} soak_stream_t;
+
+/*
+ * a soak session is a sender and a receiver session with the same keys,
+ * held is a packet of the session that is delivered late to reorder it
+ */
+typedef struct {
+    srtp_t sender;
+    srtp_t receiver;
+    uint8_t keys[SOAK_NUM_KEYS][SOAK_KEY_LEN];
+    uint8_t mki_ids[SOAK_NUM_KEYS][SOAK_MKI_LEN];
+    srtp_master_key_t master_keys[SOAK_NUM_KEYS];
+    srtp_master_key_t *master_key_ptrs[SOAK_NUM_KEYS];
+    size_t mki_index;
+    soak_stream_t *streams;
+    size_t num_streams;
+    uint8_t *held;
+    size_t held_len;
+} soak_session_t;
+
+/* counters of one reporting interval, or of the whole run */
+typedef struct {
+    uint64_t packets;
+    uint64_t bytes;
+    uint64_t calls;
+    uint64_t latency[SOAK_LATENCY_BUCKETS];
+    uint64_t dropped;
+    uint64_t corrupted;
+    uint64_t duplicated;
+    uint64_t reordered;
+    uint64_t rtcp;
+    uint64_t joins;
+    uint64_t rekeys;
+    uint64_t mki_rollovers;
+    uint64_t roc_wraps;
+    uint64_t errors;
+} soak_stats_t;
+
+static soak_session_t *sessions = NULL;
+static size_t num_sessions = 0;
+static uint32_t next_ssrc = 1;
+static uint64_t random_state = 0x853c49e6748fea9bULL;
+static int64_t live_allocs = 0;
+static soak_stats_t interval;
+static soak_stats_t total;
+
+void usage(char *prog_name);
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+/* xorshift64*, reproducible for a given seed */
+static uint64_t soak_random(void)
+{
+    random_state ^= random_state >> 12;
+    random_state ^= random_state << 25;
+    random_state ^= random_state >> 27;
+    return random_state * 2685821657736338717ULL;
+}
+
+static size_t soak_random_below(size_t n)
+{
+    return (size_t)(soak_random() % n);
+}
+
+static void soak_random_fill(uint8_t *buf, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)soak_random();
+    }
+}
+
+/*
+ * the alloc debug module reports every srtp_crypto_alloc() and
+ * srtp_crypto_free(), which keeps count of the live allocations
+ */
+static void soak_log_handler(srtp_log_level_t level,
+                             const char *msg,
+                             void *data)
+{
+    (void)level;
+    (void)data;
+    if (strncmp(msg, "alloc: ", 7) != 0) {
+        return;
+    }
+    if (strstr(msg, " allocated") != NULL) {
+        live_allocs++;
+    } else if (strstr(msg, " freed") != NULL) {
+        live_allocs--;
+    }
+}
+
+/* resident set size in octets, the peak where the current one is unknown */
+static uint64_t soak_rss(void)
+{
+#if defined(__linux__) && defined(HAVE_UNISTD_H)
+    FILE *statm = fopen("/proc/self/statm", "r");
+    unsigned long size;
+    unsigned long resident;
+
+    if (statm != NULL) {
+        int n = fscanf(statm, "%lu %lu", &size, &resident);
+        fclose(statm);
+        if (n == 2) {
+            return (uint64_t)resident * (uint64_t)sysconf(_SC_PAGESIZE);
+        }
+    }
+#endif
+    struct rusage usage;
+
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    return (uint64_t)usage.ru_maxrss;
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+static void soak_record_latency(uint64_t ns)
+{
+    size_t bucket = 0;
+
+    while (ns > 1 && bucket < SOAK_LATENCY_BUCKETS - 1) {
+        ns >>= 1;
+        bucket++;
+    }
+    interval.latency[bucket]++;
+    interval.calls++;
+}
+
+/*
+ * the latency below which the given per mille of the calls fall, as the
+ * upper bound of the power of two bucket that holds it
+ */
+static uint64_t soak_percentile(const soak_stats_t *stats, uint64_t per_mille)
+{
+    uint64_t target = (stats->calls * per_mille + 999) / 1000;
+    uint64_t count = 0;
+
+    for (size_t i = 0; i < SOAK_LATENCY_BUCKETS; i++) {
+        count += stats->latency[i];
+        if (count >= target && count > 0) {
+            return (uint64_t)1 << i;
+        }
+    }
+    return 0;
+}
+
+static void soak_policy(soak_session_t *sess,
+                        srtp_policy_t *policy,
+                        srtp_ssrc_type_t type)
+{
+    memset(policy, 0, sizeof(*policy));
+    srtp_crypto_policy_set_rtp_default(&policy->rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy->rtcp);
+    for (size_t i = 0; i < SOAK_NUM_KEYS; i++) {
+        sess->master_keys[i].key = sess->keys[i];
+        sess->master_keys[i].mki_id = sess->mki_ids[i];
+        sess->master_key_ptrs[i] = &sess->master_keys[i];
+    }
+    policy->keys = sess->master_key_ptrs;
+    policy->num_master_keys = SOAK_NUM_KEYS;
+    policy->use_mki = true;
+    policy->mki_size = SOAK_MKI_LEN;
+    policy->ssrc.type = type;
+    policy->window_size = SOAK_WINDOW_SIZE;
+}
+
+/* a new stream, a tenth of them start just before their ROC wraps */
+static void soak_stream_join(soak_stream_t *stream)
+{
+    stream->ssrc = next_ssrc++;
+    if (soak_random_below(10) == 0) {
+        stream->seq = (uint16_t)(0xffff - soak_random_below(64));
+    } else {
+        stream->seq = (uint16_t)soak_random();
+    }
+    stream->ts = (uint32_t)soak_random();
+    stream->established = false;
+}
+
+static srtp_err_status_t soak_session_init(soak_session_t *sess,
+                                           size_t num_streams)
+{
+    srtp_policy_t policy;
+    srtp_err_status_t status;
+
+    memset(sess, 0, sizeof(*sess));
+    for (size_t i = 0; i < SOAK_NUM_KEYS; i++) {
+        soak_random_fill(sess->keys[i], SOAK_KEY_LEN);
+        soak_random_fill(sess->mki_ids[i], SOAK_MKI_LEN);
+        sess->mki_ids[i][0] = (uint8_t)i;
+    }
+
+    soak_policy(sess, &policy, ssrc_any_outbound);
+    status = srtp_create(&sess->sender, &policy);
+    if (status) {
+        return status;
+    }
+
+    soak_policy(sess, &policy, ssrc_any_inbound);
+    status = srtp_create(&sess->receiver, &policy);
+    if (status) {
+        return status;
+    }
+
+    sess->held = malloc(SOAK_MAX_PACKET_LEN);
+    sess->streams = malloc(num_streams * sizeof(soak_stream_t));
+    if (sess->held == NULL || sess->streams == NULL) {
+        return srtp_err_status_alloc_fail;
+    }
+
+    sess->num_streams = num_streams;
+    for (size_t i = 0; i < num_streams; i++) {
+        soak_stream_join(&sess->streams[i]);
+    }
+
+    return srtp_err_status_ok;
+}
+
+static void soak_session_free(soak_session_t *sess)
+{
+    if (sess->sender != NULL) {
+        srtp_dealloc(sess->sender);
+    }
+    if (sess->receiver != NULL) {
+        srtp_dealloc(sess->receiver);
+    }
+    free(sess->held);
+    free(sess->streams);
+}
+
+static void soak_unprotect(soak_session_t *sess,
+                           uint8_t *srtp,
+                           size_t srtp_len,
+                           srtp_err_status_t expected)
+{
+    uint8_t out[SOAK_MAX_PACKET_LEN];
+    size_t out_len = sizeof(out);
+    srtp_err_status_t status;
+    uint64_t start = now_ns();
+
+    status = srtp_unprotect(sess->receiver, srtp, srtp_len, out, &out_len);
+    soak_record_latency(now_ns() - start);
+
+    if (status != expected) {
+        if (total.errors + interval.errors < 10) {
+            fprintf(stderr, "error: srtp_unprotect returned %d, expected %d\n",
+                    status, expected);
+        }
+        interval.errors++;
+    }
+}
+
+/* deliver the held packet of a session, if any */
+static void soak_flush(soak_session_t *sess)
+{
+    if (sess->held_len > 0) {
+        soak_unprotect(sess, sess->held, sess->held_len, srtp_err_status_ok);
+        sess->held_len = 0;
+    }
+}
+
+static void soak_send_rtcp(soak_session_t *sess, soak_stream_t *stream)
+{
+    uint8_t rtcp[SOAK_RTCP_LEN + SRTP_MAX_SRTCP_TRAILER_LEN];
+    size_t rtcp_len = sizeof(rtcp);
+    uint8_t out[sizeof(rtcp)];
+    size_t out_len = sizeof(out);
+    srtcp_hdr_t *hdr = (srtcp_hdr_t *)rtcp;
+    srtp_err_status_t status;
+
+    soak_random_fill(rtcp, SOAK_RTCP_LEN);
+    hdr->version = 2;
+    hdr->p = 0;
+    hdr->rc = 0;
+    hdr->pt = 200;
+    hdr->len = htons(SOAK_RTCP_LEN / 4 - 1);
+    hdr->ssrc = htonl(stream->ssrc);
+
+    status = srtp_protect_rtcp(sess->sender, rtcp, SOAK_RTCP_LEN, rtcp,
+                               &rtcp_len, sess->mki_index);
+    if (!status) {
+        status = srtp_unprotect_rtcp(sess->receiver, rtcp, rtcp_len, out,
+                                     &out_len);
+    }
+    if (status) {
+        interval.errors++;
+    }
+    interval.rtcp++;
+}
+
+/*
+ * protect the next packet of a stream and deliver it to the receiver,
+ * impaired
+ */
+static void soak_send(soak_session_t *sess, soak_stream_t *stream)
+{
+    uint8_t rtp[SOAK_MAX_PACKET_LEN];
+    uint8_t srtp[SOAK_MAX_PACKET_LEN];
+    size_t payload_len = 20 + soak_random_below(SOAK_MAX_PAYLOAD - 20);
+    size_t rtp_len = 12 + payload_len;
+    size_t srtp_len = sizeof(srtp);
+    srtp_hdr_t *hdr = (srtp_hdr_t *)rtp;
+    srtp_err_status_t status;
+    uint64_t start;
+    size_t impairment;
+
+    memset(hdr, 0, 12);
+    hdr->version = 2;
+    hdr->pt = 96;
+    hdr->seq = htons(stream->seq);
+    hdr->ts = htonl(stream->ts);
+    hdr->ssrc = htonl(stream->ssrc);
+    memset(rtp + 12, (int)stream->seq, payload_len);
+
+    start = now_ns();
+    status = srtp_protect(sess->sender, rtp, rtp_len, srtp, &srtp_len,
+                          sess->mki_index);
+    soak_record_latency(now_ns() - start);
+    if (status) {
+        interval.errors++;
+        return;
+    }
+
+    interval.packets++;
+    interval.bytes += rtp_len;
+
+    stream->seq++;
+    stream->ts += 960;
+    if (stream->seq == 0) {
+        interval.roc_wraps++;
+    }
+
+    if (soak_random_below(100) == 0) {
+        soak_send_rtcp(sess, stream);
+    }
+
+    /*
+     * the receiver learns the ROC of a stream from its first packet, which
+     * therefore always arrives intact and in order
+     */
+    if (!stream->established) {
+        soak_flush(sess);
+        soak_unprotect(sess, srtp, srtp_len, srtp_err_status_ok);
+        stream->established = true;
+        return;
+    }
+
+    impairment = soak_random_below(1000);
+    if (impairment < SOAK_DROP) {
+        interval.dropped++;
+        return;
+    }
+    impairment -= SOAK_DROP;
+
+    if (impairment < SOAK_CORRUPT) {
+        srtp[12 + soak_random_below(payload_len)] ^= 0x01;
+        soak_unprotect(sess, srtp, srtp_len, srtp_err_status_auth_fail);
+        interval.corrupted++;
+        return;
+    }
+    impairment -= SOAK_CORRUPT;
+
+    if (impairment < SOAK_REORDER && sess->held_len == 0) {
+        memcpy(sess->held, srtp, srtp_len);
+        sess->held_len = srtp_len;
+        interval.reordered++;
+        return;
+    }
+    impairment -= SOAK_REORDER;
+
+    soak_unprotect(sess, srtp, srtp_len, srtp_err_status_ok);
+    if (impairment < SOAK_DUPLICATE) {
+        soak_unprotect(sess, srtp, srtp_len, srtp_err_status_replay_fail);
+        interval.duplicated++;
+    }
+
+    soak_flush(sess);
+}
+
+/* a stream leaves its session and a new one joins in its place */
+static void soak_churn(soak_session_t *sess)
+{
+    soak_stream_t *stream = &sess->streams[soak_random_below(sess->num_streams)];
+    srtp_err_status_t status;
+
+    soak_flush(sess);
+
+    /* a stream that has not sent yet has no streams to remove */
+    status = srtp_stream_remove(sess->sender, stream->ssrc);
+    if (status && (stream->established || status != srtp_err_status_no_ctx)) {
+        interval.errors++;
+    }
+    status = srtp_stream_remove(sess->receiver, stream->ssrc);
+    if (status && (stream->established || status != srtp_err_status_no_ctx)) {
+        interval.errors++;
+    }
+
+    soak_stream_join(stream);
+    interval.joins++;
+}
+
+static void soak_rekey(soak_session_t *sess)
+{
+    srtp_policy_t policy;
+
+    soak_flush(sess);
+
+    for (size_t i = 0; i < SOAK_NUM_KEYS; i++) {
+        soak_random_fill(sess->keys[i], SOAK_KEY_LEN);
+    }
+
+    soak_policy(sess, &policy, ssrc_any_outbound);
+    if (srtp_update(sess->sender, &policy)) {
+        interval.errors++;
+    }
+    soak_policy(sess, &policy, ssrc_any_inbound);
+    if (srtp_update(sess->receiver, &policy)) {
+        interval.errors++;
+    }
+    interval.rekeys++;
+}
+
+static void soak_accumulate(soak_stats_t *to, const soak_stats_t *from)
+{
+    to->packets += from->packets;
+    to->bytes += from->bytes;
+    to->calls += from->calls;
+    for (size_t i = 0; i < SOAK_LATENCY_BUCKETS; i++) {
+        to->latency[i] += from->latency[i];
+    }
+    to->dropped += from->dropped;
+    to->corrupted += from->corrupted;
+    to->duplicated += from->duplicated;
+    to->reordered += from->reordered;
+    to->rtcp += from->rtcp;
+    to->joins += from->joins;
+    to->rekeys += from->rekeys;
+    to->mki_rollovers += from->mki_rollovers;
+    to->roc_wraps += from->roc_wraps;
+    to->errors += from->errors;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t num_streams = 100000;
+    unsigned long duration = 3600;
+    unsigned long report_interval = 60;
+    uint64_t seed = 0;
+    uint64_t run_start;
+    uint64_t run_end;
+    uint64_t last_report;
+    uint64_t last_events;
+    double churn_credit = 0;
+    double rekey_credit = 0;
+    double mki_credit = 0;
+    double first_pps = 0;
+    double last_pps = 0;
+    uint64_t first_rss = 0;
+    uint64_t last_rss = 0;
+    int64_t first_allocs = 0;
+    int64_t baseline_allocs;
+    size_t reports = 0;
+    bool flagged = false;
+    srtp_err_status_t status;
+    int c;
+
+    num_sessions = 1000;
+
+    while (1) {
+        c = getopt_s(argc, argv, "s:n:d:i:r:");
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case 's':
+            num_streams = strtoul(optarg_s, NULL, 0);
+            break;
+        case 'n':
+            num_sessions = strtoul(optarg_s, NULL, 0);
+            break;
+        case 'd':
+            duration = strtoul(optarg_s, NULL, 0);
+            break;
+        case 'i':
+            report_interval = strtoul(optarg_s, NULL, 0);
+            break;
+        case 'r':
+            seed = strtoull(optarg_s, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (num_sessions == 0 || num_streams < num_sessions ||
+        report_interval == 0) {
+        usage(argv[0]);
+    }
+
+    if (seed != 0) {
+        random_state = seed;
+    }
+
+    status = srtp_init();
+    if (status) {
+        printf("error: srtp initialization failed with error code %d\n",
+               status);
+        exit(1);
+    }
+
+    if (srtp_install_log_handler(soak_log_handler, NULL) ||
+        srtp_set_debug_module("alloc", true)) {
+        printf("error: can not count allocations\n");
+        exit(1);
+    }
+    baseline_allocs = live_allocs;
+
+    sessions = calloc(num_sessions, sizeof(soak_session_t));
+    if (sessions == NULL) {
+        printf("error: out of memory\n");
+        exit(1);
+    }
+
+    printf("soaking %zu streams in %zu sessions for %lu s\n", num_streams,
+           num_sessions, duration);
+
+    /* create the sessions and a first packet for every stream */
+    for (size_t i = 0; i < num_sessions; i++) {
+        size_t n = num_streams / num_sessions +
+                   (i < num_streams % num_sessions ? 1 : 0);
+
+        status = soak_session_init(&sessions[i], n);
+        if (status) {
+            printf("error: creating session %zu failed with error code %d\n",
+                   i, status);
+            exit(1);
+        }
+        for (size_t j = 0; j < n; j++) {
+            soak_send(&sessions[i], &sessions[i].streams[j]);
+        }
+    }
+    soak_accumulate(&total, &interval);
+    memset(&interval, 0, sizeof(interval));
+
+    printf("%8s %10s %8s %8s %8s %8s %8s %10s %8s %8s %8s %6s\n", "time",
+           "pkt/s", "Mbit/s", "p50 ns", "p99 ns", "p99.9 ns", "rss MB",
+           "allocs", "joins", "rekeys", "wraps", "errors");
+
+    run_start = now_ns();
+    run_end = run_start + (uint64_t)duration * 1000000000u;
+    last_report = run_start;
+    last_events = run_start;
+
+    while (true) {
+        uint64_t now;
+
+        for (size_t i = 0; i < 1000; i++) {
+            soak_session_t *sess = &sessions[soak_random_below(num_sessions)];
+            soak_send(sess,
+                      &sess->streams[soak_random_below(sess->num_streams)]);
+        }
+
+        now = now_ns();
+
+        /* spread joins and leaves, rekeys and MKI rollovers over time */
+        churn_credit += (double)(now - last_events) * SOAK_CHURN_RATE / 1e9;
+        rekey_credit += (double)(now - last_events) * SOAK_REKEY_RATE / 1e9;
+        mki_credit += (double)(now - last_events) * SOAK_MKI_RATE / 1e9;
+        last_events = now;
+        for (; churn_credit >= 1; churn_credit--) {
+            soak_churn(&sessions[soak_random_below(num_sessions)]);
+        }
+        for (; rekey_credit >= 1; rekey_credit--) {
+            soak_rekey(&sessions[soak_random_below(num_sessions)]);
+        }
+        for (; mki_credit >= 1; mki_credit--) {
+            soak_session_t *sess = &sessions[soak_random_below(num_sessions)];
+            sess->mki_index = (sess->mki_index + 1) % SOAK_NUM_KEYS;
+            interval.mki_rollovers++;
+        }
+
+        if (now - last_report >= (uint64_t)report_interval * 1000000000u ||
+            now >= run_end) {
+            double seconds = (double)(now - last_report) / 1e9;
+            double pps = (double)interval.packets / seconds;
+            uint64_t rss = soak_rss();
+
+            printf("%7.0fs %10.0f %8.1f %8" PRIu64 " %8" PRIu64 " %8" PRIu64
+                   " %8.1f %10" PRId64 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64
+                   " %6" PRIu64 "\n",
+                   (double)(now - run_start) / 1e9, pps,
+                   (double)interval.bytes * 8 / seconds / 1e6,
+                   soak_percentile(&interval, 500),
+                   soak_percentile(&interval, 990),
+                   soak_percentile(&interval, 999), (double)rss / 1e6,
+                   live_allocs - baseline_allocs, interval.joins,
+                   interval.rekeys, interval.roc_wraps, interval.errors);
+            fflush(stdout);
+
+            if (reports == 0) {
+                first_pps = pps;
+                first_rss = rss;
+                first_allocs = live_allocs;
+            }
+            last_pps = pps;
+            last_rss = rss;
+            reports++;
+
+            soak_accumulate(&total, &interval);
+            memset(&interval, 0, sizeof(interval));
+            last_report = now;
+
+            if (now >= run_end) {
+                break;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < num_sessions; i++) {
+        soak_flush(&sessions[i]);
+    }
+    soak_accumulate(&total, &interval);
+
+    printf("\n%" PRIu64 " packets, %" PRIu64 " dropped, %" PRIu64
+           " corrupted, %" PRIu64 " duplicated, %" PRIu64 " reordered, %" PRIu64
+           " rtcp\n",
+           total.packets, total.dropped, total.corrupted, total.duplicated,
+           total.reordered, total.rtcp);
+    printf("%" PRIu64 " joins, %" PRIu64 " rekeys, %" PRIu64
+           " mki rollovers, %" PRIu64 " roc wraps\n",
+           total.joins, total.rekeys, total.mki_rollovers, total.roc_wraps);
+    printf("latency p50 %" PRIu64 " ns, p99 %" PRIu64 " ns, p99.9 %" PRIu64
+           " ns\n",
+           soak_percentile(&total, 500), soak_percentile(&total, 990),
+           soak_percentile(&total, 999));
+
+    /* the number of streams is constant, so is their memory */
+    if (reports > 1) {
+        if (last_pps < first_pps * (100 - SOAK_DECAY_PERCENT) / 100) {
+            printf("WARNING: throughput decayed from %.0f to %.0f pkt/s\n",
+                   first_pps, last_pps);
+            flagged = true;
+        }
+        if (live_allocs >
+            first_allocs + first_allocs * SOAK_GROWTH_PERCENT / 100) {
+            printf("WARNING: live allocations grew from %" PRId64
+                   " to %" PRId64 "\n",
+                   first_allocs - baseline_allocs,
+                   live_allocs - baseline_allocs);
+            flagged = true;
+        } else if (last_rss > first_rss + first_rss * SOAK_GROWTH_PERCENT /
+                                              100) {
+            printf("WARNING: resident memory grew from %.1f to %.1f MB with "
+                   "stable allocations, the heap fragments\n",
+                   (double)first_rss / 1e6, (double)last_rss / 1e6);
+            flagged = true;
+        }
+    }
+
+    for (size_t i = 0; i < num_sessions; i++) {
+        soak_session_free(&sessions[i]);
+    }
+    free(sessions);
+
+    if (live_allocs != baseline_allocs) {
+        printf("LEAK: %" PRId64 " allocations were not freed\n",
+               live_allocs - baseline_allocs);
+    }
+
+    srtp_set_debug_module("alloc", false);
+    srtp_install_log_handler(NULL, NULL);
+
+    status = srtp_shutdown();
+    if (status) {
+        printf("error: srtp shutdown failed with error code %d\n", status);
+        exit(1);
+    }
+
+    if (total.errors > 0) {
+        printf("FAILED: %" PRIu64 " unexpected results\n", total.errors);
+        exit(1);
+    }
+    if (live_allocs != baseline_allocs) {
+        exit(1);
+    }
+    if (!flagged) {
+        printf("passed\n");
+    }
+
+    return 0;
+}
+
+void usage(char *string)
+{
+    printf("usage: %s [-s streams] [-n sessions] [-d seconds] [-i seconds] "
+           "[-r seed]\n"
+           "where  -s is the number of streams (default 100000)\n"
+           "       -n is the number of sessions they are spread over "
+           "(default 1000)\n"
+           "       -d is the duration of the run (default 3600)\n"
+           "       -i is the reporting interval (default 60)\n"
+           "       -r seeds the random choices of the run\n"
+           "Streams join and leave, sessions are rekeyed and roll over their\n"
+           "MKI, and packets are dropped, corrupted, duplicated and\n"
+           "reordered.  Unexpected results and leaked allocations fail the\n"
+           "run; throughput decay and memory growth are flagged.\n",
+           string);
+    exit(1);
+}
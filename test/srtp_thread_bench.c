@@ -0,0 +1,349 @@
+/*
+ * srtp_thread_bench.c
+ *
+ * multi-threaded protect/unprotect benchmark
+ *
+ * This app runs one sender and one receiver session per thread, each
+ * with a few streams, and measures how the aggregate packet rate scales
+ * with the number of threads.  The streams of the threads are created
+ * interleaved, so state of different threads that shares cache lines
+ * shows up as a loss of scaling.  See the usage() function for more
+ * details.
+ *
+ */
+
+/*
+ *
+ * Copyright (c) 2001-2017, Cisco Systems, Inc.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ *   Redistributions of source code must retain the above copyright
+ *   notice, this list of conditions and the following disclaimer.
+ *
+ *   Redistributions in binary form must reproduce the above
+ *   copyright notice, this list of conditions and the following
+ *   disclaimer in the documentation and/or other materials provided
+ *   with the distribution.
+ *
+ *   Neither the name of the Cisco Systems, Inc. nor the names of its
+ *   contributors may be used to endorse or promote products derived
+ *   from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT HOLDERS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+ * SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED
+ * OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "getopt_s.h" /* for local getopt()  */
+
+#include <pthread.h> /* for pthread_create() */
+#include <stdio.h>   /* for printf, fprintf  */
+#include <stdlib.h>  /* for malloc()         */
+#include <string.h>  /* for memset()         */
+#include <time.h>    /* for clock_gettime()  */
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h> /* for sysconf()        */
+#endif
+
+#include "srtp_priv.h"
+
+#define BENCH_MAX_PAYLOAD 1400
+#define BENCH_MAX_PACKET_LEN (12 + BENCH_MAX_PAYLOAD + SRTP_MAX_TRAILER_LEN)
+
+typedef struct {
+    uint32_t ssrc;
+    uint16_t seq;
+} bench_stream_t;
+
+/* the sessions and streams of a thread, only ever used by that thread */
+typedef struct {
+    pthread_t thread;
+    srtp_t sender;
+    srtp_t receiver;
+    bench_stream_t *streams;
+    size_t num_streams;
+    uint64_t packets;
+    uint64_t elapsed_ns;
+    srtp_err_status_t status;
+} bench_thread_t;
+
+static uint8_t bench_key[SRTP_AES_ICM_128_KEY_LEN_WSALT];
+static size_t payload_len = 100;
+static uint64_t packets_per_thread = 200000;
+
+/* the threads wait until all of them are running */
+static pthread_mutex_t start_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t start_cond = PTHREAD_COND_INITIALIZER;
+static bool started = false;
+
+void usage(char *prog_name);
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void bench_policy(srtp_policy_t *policy, uint32_t ssrc)
+{
+    memset(policy, 0, sizeof(*policy));
+    srtp_crypto_policy_set_rtp_default(&policy->rtp);
+    srtp_crypto_policy_set_rtcp_default(&policy->rtcp);
+    policy->key = bench_key;
+    policy->ssrc.type = ssrc_specific;
+    policy->ssrc.value = ssrc;
+    policy->window_size = 128;
+}
+
+static void *bench_run(void *arg)
+{
+    bench_thread_t *t = (bench_thread_t *)arg;
+    uint8_t packet[BENCH_MAX_PACKET_LEN];
+    srtp_hdr_t *hdr = (srtp_hdr_t *)packet;
+    uint64_t start;
+
+    pthread_mutex_lock(&start_mutex);
+    while (!started) {
+        pthread_cond_wait(&start_cond, &start_mutex);
+    }
+    pthread_mutex_unlock(&start_mutex);
+
+    start = now_ns();
+    for (uint64_t i = 0; i < packets_per_thread; i++) {
+        bench_stream_t *stream = &t->streams[i % t->num_streams];
+        size_t rtp_len = 12 + payload_len;
+        size_t len = sizeof(packet);
+
+        memset(hdr, 0, 12);
+        hdr->version = 2;
+        hdr->pt = 96;
+        hdr->seq = htons(stream->seq++);
+        hdr->ts = htonl((uint32_t)i);
+        hdr->ssrc = htonl(stream->ssrc);
+        memset(packet + 12, 0xab, payload_len);
+
+        t->status = srtp_protect(t->sender, packet, rtp_len, packet, &len, 0);
+        if (t->status) {
+            break;
+        }
+        t->status = srtp_unprotect(t->receiver, packet, len, packet, &len);
+        if (t->status) {
+            break;
+        }
+        t->packets++;
+    }
+    t->elapsed_ns = now_ns() - start;
+
+    return NULL;
+}
+
+/*
+ * runs num_threads threads and returns their aggregate packet rate, or a
+ * negative value on failure
+ */
+static double bench_threads(bench_thread_t *threads, size_t num_threads)
+{
+    uint64_t packets = 0;
+    uint64_t elapsed_ns = 0;
+
+    started = false;
+    for (size_t i = 0; i < num_threads; i++) {
+        threads[i].packets = 0;
+        threads[i].status = srtp_err_status_ok;
+        if (pthread_create(&threads[i].thread, NULL, bench_run,
+                           &threads[i]) != 0) {
+            fprintf(stderr, "error: can not create thread\n");
+            exit(1);
+        }
+    }
+
+    pthread_mutex_lock(&start_mutex);
+    started = true;
+    pthread_cond_broadcast(&start_cond);
+    pthread_mutex_unlock(&start_mutex);
+
+    for (size_t i = 0; i < num_threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        if (threads[i].status) {
+            fprintf(stderr, "error: thread %zu failed with error code %d\n",
+                    i, threads[i].status);
+            return -1;
+        }
+        packets += threads[i].packets;
+        if (threads[i].elapsed_ns > elapsed_ns) {
+            elapsed_ns = threads[i].elapsed_ns;
+        }
+    }
+
+    return (double)packets * 1e9 / (double)elapsed_ns;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t max_threads = 4;
+    size_t streams_per_thread = 4;
+    bench_thread_t *threads;
+    srtp_err_status_t status;
+    double single = 0;
+    int c;
+
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+    {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        if (cpus > 0) {
+            max_threads = (size_t)cpus;
+        }
+    }
+#endif
+
+    while (1) {
+        c = getopt_s(argc, argv, "t:s:n:l:");
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case 't':
+            max_threads = strtoul(optarg_s, NULL, 0);
+            break;
+        case 's':
+            streams_per_thread = strtoul(optarg_s, NULL, 0);
+            break;
+        case 'n':
+            packets_per_thread = strtoull(optarg_s, NULL, 0);
+            break;
+        case 'l':
+            payload_len = strtoul(optarg_s, NULL, 0);
+            break;
+        default:
+            usage(argv[0]);
+        }
+    }
+
+    if (max_threads == 0 || streams_per_thread == 0 ||
+        packets_per_thread == 0 || payload_len > BENCH_MAX_PAYLOAD) {
+        usage(argv[0]);
+    }
+
+    status = srtp_init();
+    if (status) {
+        printf("error: srtp initialization failed with error code %d\n",
+               status);
+        exit(1);
+    }
+
+    memset(bench_key, 0x5a, sizeof(bench_key));
+
+    threads = calloc(max_threads, sizeof(bench_thread_t));
+    if (threads == NULL) {
+        printf("error: out of memory\n");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < max_threads; i++) {
+        threads[i].streams = calloc(streams_per_thread, sizeof(bench_stream_t));
+        threads[i].num_streams = streams_per_thread;
+        if (threads[i].streams == NULL ||
+            srtp_create(&threads[i].sender, NULL) ||
+            srtp_create(&threads[i].receiver, NULL)) {
+            printf("error: can not create sessions\n");
+            exit(1);
+        }
+    }
+
+    /*
+     * add the streams round robin over the threads, so that consecutive
+     * allocations belong to different threads
+     */
+    for (size_t j = 0; j < streams_per_thread; j++) {
+        for (size_t i = 0; i < max_threads; i++) {
+            srtp_policy_t policy;
+            bench_stream_t *stream = &threads[i].streams[j];
+
+            stream->ssrc = (uint32_t)(i << 16 | j);
+            bench_policy(&policy, stream->ssrc);
+            if (srtp_stream_add(threads[i].sender, &policy) ||
+                srtp_stream_add(threads[i].receiver, &policy)) {
+                printf("error: can not add streams\n");
+                exit(1);
+            }
+        }
+    }
+
+    printf("%zu streams per thread, %zu octet payloads, %" PRIu64
+           " packets per thread\n",
+           streams_per_thread, payload_len, packets_per_thread);
+    printf("%8s %12s %12s %8s\n", "threads", "pkt/s", "pkt/s/thread",
+           "scaling");
+
+    for (size_t n = 1;; n *= 2) {
+        double rate;
+
+        if (n > max_threads) {
+            n = max_threads;
+        }
+        rate = bench_threads(threads, n);
+
+        if (rate < 0) {
+            exit(1);
+        }
+        if (n == 1) {
+            single = rate;
+        }
+        printf("%8zu %12.0f %12.0f %7.1f%%\n", n, rate, rate / (double)n,
+               100 * rate / ((double)n * single));
+        if (n == max_threads) {
+            break;
+        }
+    }
+
+    for (size_t i = 0; i < max_threads; i++) {
+        srtp_dealloc(threads[i].sender);
+        srtp_dealloc(threads[i].receiver);
+        free(threads[i].streams);
+    }
+    free(threads);
+
+    status = srtp_shutdown();
+    if (status) {
+        printf("error: srtp shutdown failed with error code %d\n", status);
+        exit(1);
+    }
+
+    return 0;
+}
+
+void usage(char *string)
+{
+    printf("usage: %s [-t threads] [-s streams] [-n packets] [-l length]\n"
+           "where  -t is the largest number of threads (default: all cpus)\n"
+           "       -s is the number of streams per thread (default 4)\n"
+           "       -n is the number of packets per thread (default 200000)\n"
+           "       -l is the payload length (default 100)\n"
+           "The benchmark runs 1, 2, 4, ... threads up to the largest\n"
+           "number; each protects and unprotects packets of its own\n"
+           "sessions.  Scaling is the aggregate rate relative to that many\n"
+           "single threads, losses point at shared cache lines.\n",
+           string);
+    exit(1);
+}
@@ -88,6 +88,7 @@ const char *err_status_string(srtp_err_status_t status)
         ERR_STATUS_STRING(pkt_idx_old);
         ERR_STATUS_STRING(pkt_idx_adv);
         ERR_STATUS_STRING(buffer_small);
+        ERR_STATUS_STRING(quota_fail);
     }
     return "unkown srtp_err_status";
 }
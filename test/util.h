@@ -79,6 +79,7 @@ void overrun_check_prepare(uint8_t *buffer, size_t offset, size_t buffer_len);
 
 #define MAX_PRINT_STRING_LEN 1024
 
+const char *err_status_string(srtp_err_status_t status);
 size_t hex_string_to_octet_string(uint8_t *raw, const char *hex, size_t len);
 const char *octet_string_hex_string(const uint8_t *str, size_t length);
 size_t base64_string_to_octet_string(uint8_t *raw,